@@ -1,16 +1,32 @@
 
 set(FREERTOS_PATH ${PROJECT_ROOT}/external/FreeRTOS/Source)
 
+if(CFG_TARGET_PLATFORM STREQUAL "host")
+    # POSIX simulator port shipped with FreeRTOS-Kernel (portable/ThirdParty/GCC/Posix)
+    set(FREERTOS_PORT_PATH ${FREERTOS_PATH}/portable/ThirdParty/GCC/Posix)
+    set(FREERTOS_PORT_SOURCES
+        ${FREERTOS_PORT_PATH}/port.c
+        ${FREERTOS_PORT_PATH}/utils/wait_for_event.c
+    )
+
+    if(NOT EXISTS ${FREERTOS_PORT_PATH}/port.c)
+        message(FATAL_ERROR "FreeRTOS POSIX port not found in ${FREERTOS_PORT_PATH}. "
+                            "Copy portable/ThirdParty/GCC/Posix from the FreeRTOS-Kernel release into the tree.")
+    endif()
+else()
+    set(FREERTOS_PORT_PATH ${FREERTOS_PATH}/portable/GCC/ARM_CM7/r0p1)
+    set(FREERTOS_PORT_SOURCES ${FREERTOS_PORT_PATH}/port.c)
+endif()
 
 set(FREERTOS_INCLUDES 
     ${FREERTOS_PATH}/CMSIS_RTOS_V2
     ${FREERTOS_PATH}/include
-    ${FREERTOS_PATH}/portable/GCC/ARM_CM7/r0p1
+    ${FREERTOS_PORT_PATH}
 )
 
 set(FREERTOS_SOURCES
     ${FREERTOS_PATH}/CMSIS_RTOS_V2/cmsis_os2.c
-    ${FREERTOS_PATH}/portable/GCC/ARM_CM7/r0p1/port.c
+    ${FREERTOS_PORT_SOURCES}
     ${FREERTOS_PATH}/portable/MemMang/heap_4.c
     ${FREERTOS_PATH}/croutine.c
     ${FREERTOS_PATH}/event_groups.c
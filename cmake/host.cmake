@@ -0,0 +1,18 @@
+# Host (x86-64 Linux) replacement for the STM32 SDK library. Instead of the HAL
+# sources it exposes the software stand-ins from source/host/inc, followed by the
+# board headers shared with the target build (i2c.h, usart.h, rtc.h, ...).
+set(HOST_INCLUDES
+    ${PROJECT_ROOT}/source/host/inc
+    ${PROJECT_ROOT}/source/board/inc
+)
+
+find_package(Threads REQUIRED)
+
+add_library(sdk INTERFACE)
+target_include_directories(sdk INTERFACE ${HOST_INCLUDES})
+target_link_libraries(sdk INTERFACE Threads::Threads m)
+
+if(CFG_HOST_SANITIZERS)
+    target_compile_options(sdk INTERFACE -fsanitize=${CFG_HOST_SANITIZERS} -fno-omit-frame-pointer)
+    target_link_options(sdk INTERFACE -fsanitize=${CFG_HOST_SANITIZERS})
+endif()
@@ -4,22 +4,28 @@ set(LWIP_PATH ${PROJECT_ROOT}/external/LwIP)
 
 set(LWIP_INCLUDES 
     ${LWIP_PATH}/src/include
-    ${LWIP_PATH}/src/include/netif/ppp
-    ${LWIP_PATH}/src/include/lwip/apps
-    ${LWIP_PATH}/src/include/lwip
-    ${LWIP_PATH}/src/include/lwip/apps
-    ${LWIP_PATH}/src/include/lwip/priv
-    ${LWIP_PATH}/src/include/lwip/prot
-    ${LWIP_PATH}/src/include/netif
-    ${LWIP_PATH}/src/include/compat/posix
-    ${LWIP_PATH}/src/include/compat/posix/arpa
-    ${LWIP_PATH}/src/include/compat/posix/net
-    ${LWIP_PATH}/src/include/compat/posix/sys
-    ${LWIP_PATH}/src/include/compat/stdc
     ${LWIP_PATH}/system
     ${LWIP_PATH}/system/arch
 )
 
+# The host compiles against the C library, there the headers of lwIP named like its
+# headers (errno.h, netdb.h, sys/socket.h, ...) must not be found before them
+if(NOT CFG_TARGET_PLATFORM STREQUAL "host")
+    list(APPEND LWIP_INCLUDES
+        ${LWIP_PATH}/src/include/netif/ppp
+        ${LWIP_PATH}/src/include/lwip/apps
+        ${LWIP_PATH}/src/include/lwip
+        ${LWIP_PATH}/src/include/lwip/priv
+        ${LWIP_PATH}/src/include/lwip/prot
+        ${LWIP_PATH}/src/include/netif
+        ${LWIP_PATH}/src/include/compat/posix
+        ${LWIP_PATH}/src/include/compat/posix/arpa
+        ${LWIP_PATH}/src/include/compat/posix/net
+        ${LWIP_PATH}/src/include/compat/posix/sys
+        ${LWIP_PATH}/src/include/compat/stdc
+    )
+endif()
+
 file(GLOB_RECURSE LWIP_SRC CONFIGURE_DEPENDS
     ${LWIP_PATH}/*.c
 )
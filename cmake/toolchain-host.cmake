@@ -0,0 +1,22 @@
+set(CMAKE_SYSTEM_NAME Linux)
+set(CMAKE_SYSTEM_PROCESSOR x86_64)
+
+set(COMPILE_FLAGS "-Wall -Wextra -Wpedantic -Wno-unused-parameter")
+
+# Options for DEBUG build
+# -O0   No optimization, keeps every frame visible to gdb/perf.
+# -g    Produce debugging information in the operating system’s native format.
+set(CMAKE_C_FLAGS_DEBUG "-O0 -g ${COMPILE_FLAGS}" CACHE INTERNAL "C Compiler options for debug build type")
+set(CMAKE_ASM_FLAGS_DEBUG "-g ${COMPILE_FLAGS}" CACHE INTERNAL "ASM Compiler options for debug build type")
+
+# Options for RELEASE build
+# -O2   Same optimization level as used for profiling the firmware logic.
+# -g    Keep symbols so perf can resolve the call stacks.
+set(CMAKE_C_FLAGS_RELEASE "-O2 -g ${COMPILE_FLAGS}" CACHE INTERNAL "C Compiler options for release build type")
+set(CMAKE_ASM_FLAGS_RELEASE "" CACHE INTERNAL "ASM Compiler options for release build type")
+
+#---------------------------------------------------------------------------------------
+# Set compilers
+#---------------------------------------------------------------------------------------
+set(CMAKE_C_COMPILER gcc CACHE INTERNAL "C Compiler")
+set(CMAKE_ASM_COMPILER gcc CACHE INTERNAL "ASM Compiler")
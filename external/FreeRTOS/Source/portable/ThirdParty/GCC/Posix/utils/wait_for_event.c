@@ -0,0 +1,136 @@
+/*
+ * FreeRTOS Kernel V10.2.1 - POSIX simulator port
+ *
+ * Same layout and design as portable/ThirdParty/GCC/Posix of the later
+ * FreeRTOS-Kernel releases, written against the V10.2 kernel of this tree.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * http://www.FreeRTOS.org
+ * http://aws.amazon.com/freertos
+ *
+ * 1 tab == 4 spaces!
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wait_for_event.h"
+
+struct event
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool event_triggered;
+};
+
+static void prvUnlockMutex( void *pvMutex );
+
+struct event *event_create( void )
+{
+	struct event *ev = malloc( sizeof( struct event ) );
+
+	if( ev != NULL )
+	{
+		ev->event_triggered = false;
+		pthread_mutex_init( &ev->mutex, NULL );
+		pthread_cond_init( &ev->cond, NULL );
+	}
+
+	return ev;
+}
+
+void event_delete( struct event *ev )
+{
+	pthread_mutex_destroy( &ev->mutex );
+	pthread_cond_destroy( &ev->cond );
+	free( ev );
+}
+
+bool event_wait( struct event *ev )
+{
+	pthread_mutex_lock( &ev->mutex );
+
+	/* A thread cancelled while waiting must not leave the mutex locked. */
+	pthread_cleanup_push( prvUnlockMutex, &ev->mutex );
+
+	while( ev->event_triggered == false )
+	{
+		pthread_cond_wait( &ev->cond, &ev->mutex );
+	}
+
+	ev->event_triggered = false;
+
+	pthread_cleanup_pop( 1 );
+
+	return true;
+}
+
+bool event_wait_timed( struct event *ev, time_t ms )
+{
+	struct timespec ts;
+	int ret = 0;
+
+	clock_gettime( CLOCK_REALTIME, &ts );
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += ( ( ms % 1000 ) * 1000000 );
+	if( ts.tv_nsec >= 1000000000 )
+	{
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock( &ev->mutex );
+	pthread_cleanup_push( prvUnlockMutex, &ev->mutex );
+
+	while( ( ev->event_triggered == false ) && ( ret == 0 ) )
+	{
+		ret = pthread_cond_timedwait( &ev->cond, &ev->mutex, &ts );
+
+		if( ( ret != 0 ) && ( ret != ETIMEDOUT ) )
+		{
+			ret = 0;
+		}
+	}
+
+	if( ev->event_triggered )
+	{
+		ret = 0;
+	}
+
+	ev->event_triggered = false;
+
+	pthread_cleanup_pop( 1 );
+
+	return ( ret == 0 );
+}
+
+void event_signal( struct event *ev )
+{
+	pthread_mutex_lock( &ev->mutex );
+	ev->event_triggered = true;
+	pthread_cond_signal( &ev->cond );
+	pthread_mutex_unlock( &ev->mutex );
+}
+
+static void prvUnlockMutex( void *pvMutex )
+{
+	pthread_mutex_unlock( ( pthread_mutex_t * ) pvMutex );
+}
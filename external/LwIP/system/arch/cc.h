@@ -38,7 +38,9 @@
 
 typedef int sys_prot_t;
 
+#ifndef LWIP_ERRNO_STDINCLUDE
 #define LWIP_PROVIDE_ERRNO
+#endif
 
 #if defined (__GNUC__) & !defined (__CC_ARM)
 
@@ -11,6 +11,8 @@
  * PRIVATE MACROS DEFINTIONS
  ***********************************************************************************/
 
+#define LOG_MODULE LOG_MODULE_DISPLAY
+
 /***********************************************************************************
  * PRIVATE TYPES DEFINTIONS
  ***********************************************************************************/
@@ -1,30 +1,76 @@
 #include "dns_resolver.h"
 
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "cmsis_os.h"
 #include "logger.h"
 #include "lwip/dns.h"
 #include "lwip/err.h"
 #include "lwip/ip_addr.h"
+#include "lwip/tcpip.h"
 
 /***********************************************************************************
  * PRIVATE MACROS DEFINTIONS
  ***********************************************************************************/
-#define DNS_QUERY_TIMEOUT ( 5000u )
+#define LOG_MODULE LOG_MODULE_DNS
+
+/* A query lwIP did not answer by then no longer holds its entry */
+#define DNS_QUERY_LIFETIME_MS ( 2u * DNS_RESOLVER_QUERY_TIMEOUT_MS )
+
+#define DNS_ENTRY_FLAG( INDEX ) ( 1u << ( INDEX ) )
+
+/* Entry and query the lwIP callback belongs to */
+#define DNS_CALLBACK_TAG( INDEX, GENERATION ) ( (void *)(uintptr_t)( (uintptr_t)( INDEX ) | ( (uintptr_t)( GENERATION ) << 8 ) ) )
+#define DNS_TAG_INDEX( TAG )                  ( (uint8_t)( (uintptr_t)( TAG ) & 0xFFu ) )
+#define DNS_TAG_GENERATION( TAG )             ( (uint32_t)( (uintptr_t)( TAG ) >> 8 ) )
+#define DNS_TAG_GENERATION_MASK               ( UINTPTR_MAX >> 8 )
+
+_Static_assert( DNS_RESOLVER_CACHE_ENTRIES <= 24u, "One event flag per entry" );
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef enum
+{
+    DNS_ENTRY_FREE,
+    DNS_ENTRY_RESOLVING,
+    DNS_ENTRY_RESOLVED,
+    DNS_ENTRY_FAILED,
+} tDnsResolver_entryState;
+
+/* One hostname, changed only with the lwIP core locked so the DNS callback of lwIP is serialized with the callers */
+typedef struct
+{
+    char hostname[DNS_RESOLVER_MAX_NAME_LENGTH];
+    ip_addr_t address;
+    tDnsResolver_entryState state;
+    uint32_t generation;   // Of the current query, answers to an older one are ignored
+    uint32_t startedTick;
+    uint32_t expiresTick;  // Resolved - valid until, failed - no new query before
+    uint32_t backoffMs;    // Of the last failure, 0 after a success
+    uint8_t waiters;
+} tDnsResolver_entry;
 
 /************************************************************************************
  * PRIVATE VARIABLES DECLERATION
  ***********************************************************************************/
 
 static bool m_dnsResolver_initalized;
-static osSemaphoreId_t m_dnsResolver_syncSempahore;
-static ip_addr_t resolved_addr;
+static osEventFlagsId_t m_dnsResolver_events;  // Flag per entry, set when its query ends
+static tDnsResolver_entry m_dnsResolver_entries[DNS_RESOLVER_CACHE_ENTRIES];
+static tDnsResolver_listener m_dnsResolver_listener;
 
 /************************************************************************************
  * PRIVATE FUNTCTION DECLERATION
  ***********************************************************************************/
-void dnsFoundCllback( const char *name, const ip_addr_t *ipaddr, void *callback_arg );
+static tDnsResolver_lookupResult startLookup( tDnsResolver_lookup *lookup, ip_addr_t *ipaddr );
+static void endLookup( tDnsResolver_lookup *lookup );
+static tDnsResolver_entry *findEntry( const char *hostname );
+static tDnsResolver_entry *takeEntry( void );
+static void finishQuery( tDnsResolver_entry *entry, const ip_addr_t *ipaddr );
+static void dnsFoundCllback( const char *name, const ip_addr_t *ipaddr, void *callback_arg );
 
 /************************************************************************************
  * PUBLIC FUNTCTION DEFINTIONS
@@ -33,9 +79,9 @@ void dnsResolver_init( void )
 {
     if( !m_dnsResolver_initalized )
     {
-        m_dnsResolver_syncSempahore = osSemaphoreNew( 1, 0, NULL );
+        m_dnsResolver_events = osEventFlagsNew( NULL );
 
-        if( NULL != m_dnsResolver_syncSempahore )
+        if( NULL != m_dnsResolver_events )
         {
             m_dnsResolver_initalized = true;
             LOG_INFO( "Dns resolver initialized" );
@@ -43,52 +89,278 @@ void dnsResolver_init( void )
     }
 }
 
+void dnsResolver_setListener( tDnsResolver_listener listener )
+{
+    m_dnsResolver_listener = listener;
+}
+
+/* Blocks for up to DNS_RESOLVER_QUERY_TIMEOUT_MS, answered from the cache without waiting when it can be */
 bool dnsResolver_resolveHostname( const char *hostname, ip_addr_t *out_ipaddr )
 {
-    bool success = false;
+    tDnsResolver_lookup lookup;
+    tDnsResolver_lookupResult result = dnsResolver_startLookup( &lookup, hostname, out_ipaddr );
 
-    // Start DNS query (non-blocking, uses callback)
-    err_t err = dns_gethostbyname( hostname, &resolved_addr, dnsFoundCllback, NULL );
+    while( DNS_LOOKUP_WAIT == result )
+    {
+        int32_t remaining = (int32_t)( lookup.deadline - osKernelGetTickCount() );
 
-    if( ERR_OK == err )
+        if( remaining > 0 )
+        {
+            // Not cleared, every lookup sharing the query wakes up
+            osEventFlagsWait( m_dnsResolver_events, DNS_ENTRY_FLAG( lookup.index ), osFlagsWaitAny | osFlagsNoClear, (uint32_t)remaining );
+        }
+
+        result = dnsResolver_checkLookup( &lookup, out_ipaddr );
+    }
+
+    return ( DNS_LOOKUP_DONE == result );
+}
+
+/* Does not block. DNS_LOOKUP_WAIT when a query has to be waited for, see dnsResolver_checkLookup() */
+tDnsResolver_lookupResult dnsResolver_startLookup( tDnsResolver_lookup *lookup, const char *hostname, ip_addr_t *ipaddr )
+{
+    tDnsResolver_lookupResult result = DNS_LOOKUP_FAILED;
+
+    lookup->hostname = hostname;
+    lookup->deadline = osKernelGetTickCount() + DNS_RESOLVER_QUERY_TIMEOUT_MS;
+    lookup->isWaiting = false;
+
+    if( ( !m_dnsResolver_initalized ) || ( NULL == hostname ) || ( NULL == ipaddr ) )
     {
-        // If the IP address is already cached, copy it immediately
-        LOG_INFO("IP address for %s: %s\n", hostname, ip4addr_ntoa((const ip4_addr_t *)&resolved_addr));
-        ip_addr_copy( *out_ipaddr, resolved_addr );
-        success = true;
+        LOG_ERROR( "Dns resolver not ready" );
     }
-    else if( ERR_INPROGRESS == err )
+    else if( strlen( hostname ) >= DNS_RESOLVER_MAX_NAME_LENGTH )
     {
-        // If the DNS query is in progress, wait for it to complete
-        LOG_INFO( "Resolving %s...", hostname );
-        if( osOK == osSemaphoreAcquire( m_dnsResolver_syncSempahore, DNS_QUERY_TIMEOUT ) )
+        LOG_ERROR( "Hostname %s too long", hostname );
+    }
+    else
+    {
+        LOCK_TCPIP_CORE();
+        result = startLookup( lookup, ipaddr );
+        UNLOCK_TCPIP_CORE();
+
+        if( DNS_LOOKUP_WAIT == result )
         {
-            // If the semaphore was successfully acquired, check the resolved IP
-            if( !ip_addr_isany( &resolved_addr ) )
+            LOG_INFO( "Resolving %s...", hostname );
+        }
+    }
+
+    return result;
+}
+
+/* Does not block. Ends once the query of the lookup ended or its deadline passed, a query started again meanwhile counts as failed */
+tDnsResolver_lookupResult dnsResolver_checkLookup( tDnsResolver_lookup *lookup, ip_addr_t *ipaddr )
+{
+    tDnsResolver_lookupResult result = DNS_LOOKUP_FAILED;
+
+    if( lookup->isWaiting )
+    {
+        tDnsResolver_entry *entry = &m_dnsResolver_entries[lookup->index];
+
+        LOCK_TCPIP_CORE();
+        if( ( lookup->generation != entry->generation ) || ( DNS_ENTRY_RESOLVING != entry->state ) )
+        {
+            if( ( lookup->generation == entry->generation ) && ( DNS_ENTRY_RESOLVED == entry->state ) )
             {
-                LOG_INFO("IP address for %s: %s\n", hostname, ip4addr_ntoa((const ip4_addr_t *)&resolved_addr));
-                ip_addr_copy( *out_ipaddr, resolved_addr );
-                success = true;
+                ip_addr_copy( *ipaddr, entry->address );
+                result = DNS_LOOKUP_DONE;
             }
+            endLookup( lookup );
+        }
+        else if( (int32_t)( osKernelGetTickCount() - lookup->deadline ) >= 0 )
+        {
+            // The answer may still come and is cached for the next lookup
+            LOG_WARNING( "DNS query for %s timed out", lookup->hostname );
+            endLookup( lookup );
         }
+        else
+        {
+            result = DNS_LOOKUP_WAIT;
+        }
+        UNLOCK_TCPIP_CORE();
     }
 
-    return success;
+    return result;
+}
+
+/* For a lookup that is no longer needed, its query goes on and the answer is cached */
+void dnsResolver_cancelLookup( tDnsResolver_lookup *lookup )
+{
+    if( lookup->isWaiting )
+    {
+        LOCK_TCPIP_CORE();
+        endLookup( lookup );
+        UNLOCK_TCPIP_CORE();
+    }
 }
 
 /************************************************************************************
  * PRIVATE FUNTCTION DEFINITIONS
  ***********************************************************************************/
-void dnsFoundCllback( const char *name, const ip_addr_t *ipaddr, void *callback_arg )
+/* Core locked. Answers from the entry of the name, joins its query in progress or starts a new one */
+static tDnsResolver_lookupResult startLookup( tDnsResolver_lookup *lookup, ip_addr_t *ipaddr )
+{
+    tDnsResolver_entry *entry = findEntry( lookup->hostname );
+    tDnsResolver_lookupResult result = DNS_LOOKUP_WAIT;
+    uint32_t now = osKernelGetTickCount();
+
+    if( NULL == entry )
+    {
+        entry = takeEntry();
+    }
+
+    if( NULL == entry )
+    {
+        LOG_WARNING( "No free DNS entry for %s", lookup->hostname );
+        result = DNS_LOOKUP_FAILED;
+    }
+    else if( ( DNS_ENTRY_RESOLVED == entry->state ) && ( (int32_t)( entry->expiresTick - now ) > 0 ) )
+    {
+        ip_addr_copy( *ipaddr, entry->address );
+        result = DNS_LOOKUP_DONE;
+    }
+    else if( ( DNS_ENTRY_FAILED == entry->state ) && ( (int32_t)( entry->expiresTick - now ) > 0 ) )
+    {
+        LOG_DEBUG( "%s failed recently, next query in %u ms", lookup->hostname, (unsigned int)( entry->expiresTick - now ) );
+        result = DNS_LOOKUP_FAILED;
+    }
+    else if( ( DNS_ENTRY_RESOLVING == entry->state ) && ( ( now - entry->startedTick ) < DNS_QUERY_LIFETIME_MS ) )
+    {
+        LOG_DEBUG( "Query for %s already in progress, shared", lookup->hostname );
+    }
+    else
+    {
+        ip_addr_t address;
+        uint8_t index = (uint8_t)( entry - m_dnsResolver_entries );
+        err_t err;
+
+        strcpy( entry->hostname, lookup->hostname );
+        entry->state = DNS_ENTRY_RESOLVING;
+        entry->generation = ( entry->generation + 1u ) & DNS_TAG_GENERATION_MASK;
+        entry->startedTick = now;
+        osEventFlagsClear( m_dnsResolver_events, DNS_ENTRY_FLAG( index ) );
+
+        err = dns_gethostbyname( entry->hostname, &address, dnsFoundCllback, DNS_CALLBACK_TAG( index, entry->generation ) );
+
+        if( ERR_OK == err )
+        {
+            // Still valid in the table of lwIP
+            finishQuery( entry, &address );
+            ip_addr_copy( *ipaddr, address );
+            result = DNS_LOOKUP_DONE;
+        }
+        else if( ERR_INPROGRESS != err )
+        {
+            LOG_ERROR( "DNS query for %s not started: %d", lookup->hostname, (int)err );
+            finishQuery( entry, NULL );
+            result = DNS_LOOKUP_FAILED;
+        }
+    }
+
+    if( DNS_LOOKUP_WAIT == result )
+    {
+        entry->waiters++;
+        lookup->index = (uint8_t)( entry - m_dnsResolver_entries );
+        lookup->generation = entry->generation;
+        lookup->isWaiting = true;
+    }
+
+    return result;
+}
+
+/* Core locked. The entry may be taken for another name once nobody waits for it */
+static void endLookup( tDnsResolver_lookup *lookup )
+{
+    m_dnsResolver_entries[lookup->index].waiters--;
+    lookup->isWaiting = false;
+}
+
+static tDnsResolver_entry *findEntry( const char *hostname )
 {
+    tDnsResolver_entry *entry = NULL;
+
+    for( uint8_t i = 0; ( NULL == entry ) && ( i < DNS_RESOLVER_CACHE_ENTRIES ); i++ )
+    {
+        if( ( DNS_ENTRY_FREE != m_dnsResolver_entries[i].state ) && ( 0 == strcmp( m_dnsResolver_entries[i].hostname, hostname ) ) )
+        {
+            entry = &m_dnsResolver_entries[i];
+        }
+    }
+
+    return entry;
+}
+
+/* A free entry, otherwise the one expiring first that nobody waits for */
+static tDnsResolver_entry *takeEntry( void )
+{
+    tDnsResolver_entry *entry = NULL;
+    uint32_t now = osKernelGetTickCount();
+
+    for( uint8_t i = 0; i < DNS_RESOLVER_CACHE_ENTRIES; i++ )
+    {
+        tDnsResolver_entry *candidate = &m_dnsResolver_entries[i];
+        bool busy = ( candidate->waiters > 0 ) ||
+                    ( ( DNS_ENTRY_RESOLVING == candidate->state ) && ( ( now - candidate->startedTick ) < DNS_QUERY_LIFETIME_MS ) );
+
+        if( DNS_ENTRY_FREE == candidate->state )
+        {
+            entry = candidate;
+            break;
+        }
+        else if( !busy && ( ( NULL == entry ) || ( (int32_t)( candidate->expiresTick - entry->expiresTick ) < 0 ) ) )
+        {
+            entry = candidate;
+        }
+    }
+
+    if( NULL != entry )
+    {
+        entry->state = DNS_ENTRY_FREE;
+        entry->backoffMs = 0;
+    }
+
+    return entry;
+}
+
+/* Core locked. Wakes every lookup waiting for the entry and tells the listener */
+static void finishQuery( tDnsResolver_entry *entry, const ip_addr_t *ipaddr )
+{
+    uint32_t now = osKernelGetTickCount();
+
     if( NULL != ipaddr )
     {
-        ip_addr_copy( resolved_addr, *ipaddr );
+        ip_addr_copy( entry->address, *ipaddr );
+        entry->state = DNS_ENTRY_RESOLVED;
+        entry->backoffMs = 0;
+        entry->expiresTick = now + DNS_RESOLVER_CACHE_TTL_MS;
+        LOG_INFO( "IP address for %s: %s", entry->hostname, ipaddr_ntoa( ipaddr ) );
     }
     else
     {
-        ip_addr_set_zero( &resolved_addr );
+        // Doubled with every failure in a row
+        entry->backoffMs = ( 0u == entry->backoffMs ) ? DNS_RESOLVER_NEGATIVE_TTL_MS : ( 2u * entry->backoffMs );
+        entry->backoffMs = ( entry->backoffMs < DNS_RESOLVER_MAX_BACKOFF_MS ) ? entry->backoffMs : DNS_RESOLVER_MAX_BACKOFF_MS;
+        entry->state = DNS_ENTRY_FAILED;
+        entry->expiresTick = now + entry->backoffMs;
+        LOG_WARNING( "Resolving %s failed, next query in %u ms", entry->hostname, (unsigned int)entry->backoffMs );
+    }
+
+    osEventFlagsSet( m_dnsResolver_events, DNS_ENTRY_FLAG( entry - m_dnsResolver_entries ) );
+
+    if( NULL != m_dnsResolver_listener )
+    {
+        m_dnsResolver_listener();
     }
+}
+
+/* Runs in the tcpip thread with the core locked */
+static void dnsFoundCllback( const char *name, const ip_addr_t *ipaddr, void *callback_arg )
+{
+    uint8_t index = DNS_TAG_INDEX( callback_arg );
 
-    osSemaphoreRelease( m_dnsResolver_syncSempahore );
-}
\ No newline at end of file
+    if( ( index < DNS_RESOLVER_CACHE_ENTRIES ) && ( DNS_ENTRY_RESOLVING == m_dnsResolver_entries[index].state ) &&
+        ( DNS_TAG_GENERATION( callback_arg ) == m_dnsResolver_entries[index].generation ) )
+    {
+        finishQuery( &m_dnsResolver_entries[index], ipaddr );
+    }
+}
@@ -2,10 +2,71 @@
 #define _DNS_RESOLVER_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "lwip/ip_addr.h"
 
+/*
+ * Hostname lookups for any task. dnsResolver_resolveHostname() blocks, a task that must
+ * not block starts a lookup, checks it whenever the listener reports that a query ended
+ * and cancels it when it gives up. Each lookup waits on its own cache entry, callers
+ * asking for a name that is already being resolved share the one query. Answers are kept
+ * for DNS_RESOLVER_CACHE_TTL_MS on top of the TTL aware table of lwIP, failures for a
+ * backoff that doubles with every failure in a row.
+ */
+
+#ifndef DNS_RESOLVER_CACHE_ENTRIES
+#define DNS_RESOLVER_CACHE_ENTRIES ( 6u )
+#endif
+
+/* Longer names are refused */
+#ifndef DNS_RESOLVER_MAX_NAME_LENGTH
+#define DNS_RESOLVER_MAX_NAME_LENGTH ( 64u )
+#endif
+
+/* lwIP does not hand the record TTL to the callback, an expired entry asks its table again */
+#ifndef DNS_RESOLVER_CACHE_TTL_MS
+#define DNS_RESOLVER_CACHE_TTL_MS ( 60000u )
+#endif
+
+/* A lookup not answered by then fails */
+#ifndef DNS_RESOLVER_QUERY_TIMEOUT_MS
+#define DNS_RESOLVER_QUERY_TIMEOUT_MS ( 5000u )
+#endif
+
+#ifndef DNS_RESOLVER_NEGATIVE_TTL_MS
+#define DNS_RESOLVER_NEGATIVE_TTL_MS ( 5000u )
+#endif
+
+#ifndef DNS_RESOLVER_MAX_BACKOFF_MS
+#define DNS_RESOLVER_MAX_BACKOFF_MS ( 120000u )
+#endif
+
+typedef enum
+{
+    DNS_LOOKUP_DONE,
+    DNS_LOOKUP_FAILED,
+    DNS_LOOKUP_WAIT,
+} tDnsResolver_lookupResult;
+
+/* One lookup, owned by the caller. The hostname is referenced until the lookup ends */
+typedef struct
+{
+    const char *hostname;
+    uint8_t index;        // Cache entry waited for
+    uint32_t generation;  // Of the query waited for
+    uint32_t deadline;
+    bool isWaiting;
+} tDnsResolver_lookup;
+
+/* Runs in the tcpip thread with the core locked whenever a query ends, it must not block */
+typedef void ( *tDnsResolver_listener )( void );
+
 void dnsResolver_init( void );
+void dnsResolver_setListener( tDnsResolver_listener listener );
 bool dnsResolver_resolveHostname( const char *hostname, ip_addr_t *ipaddr );
+tDnsResolver_lookupResult dnsResolver_startLookup( tDnsResolver_lookup *lookup, const char *hostname, ip_addr_t *ipaddr );
+tDnsResolver_lookupResult dnsResolver_checkLookup( tDnsResolver_lookup *lookup, ip_addr_t *ipaddr );
+void dnsResolver_cancelLookup( tDnsResolver_lookup *lookup );
 
 #endif /*  _DNS_RESOLVER_H_ */
@@ -0,0 +1,115 @@
+#include "httpBufferPool.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cmsis_os.h"
+#include "task.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define BUFFER_CLASS_STORAGE( SIZE, COUNT ) static char m_httpBufferPool_blocks##SIZE[COUNT][SIZE];
+#define BUFFER_CLASS_ENTRY( SIZE, COUNT )   { &m_httpBufferPool_blocks##SIZE[0][0], SIZE, COUNT, 0 },
+#define BUFFER_CLASS_CHECK( SIZE, COUNT )   _Static_assert( ( COUNT ) <= 32u, "One usage bit per block" );
+
+#define HTTP_BUFFER_POOL_CLASS_COUNT ( sizeof( m_httpBufferPool_classes ) / sizeof( m_httpBufferPool_classes[0] ) )
+
+HTTP_BUFFER_POOL_CLASSES( BUFFER_CLASS_CHECK )
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    char *blocks;
+    size_t size;
+    uint8_t count;
+    uint32_t used;  // Bit per block
+} tHttpBufferPool_class;
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+HTTP_BUFFER_POOL_CLASSES( BUFFER_CLASS_STORAGE )
+
+static tHttpBufferPool_class m_httpBufferPool_classes[] = {
+    HTTP_BUFFER_POOL_CLASSES( BUFFER_CLASS_ENTRY )
+};
+
+static tHttpBufferPool_listener m_httpBufferPool_listener;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+/* Smallest free block of at least size bytes, NULL when every fitting block is leased */
+char *httpBufferPool_lease( size_t size, size_t *leasedSize )
+{
+    char *buffer = NULL;
+
+    taskENTER_CRITICAL();
+    for( uint8_t i = 0; ( NULL == buffer ) && ( i < HTTP_BUFFER_POOL_CLASS_COUNT ); i++ )
+    {
+        tHttpBufferPool_class *sizeClass = &m_httpBufferPool_classes[i];
+
+        if( sizeClass->size < size )
+        {
+            continue;
+        }
+
+        for( uint8_t block = 0; block < sizeClass->count; block++ )
+        {
+            if( 0u == ( sizeClass->used & ( 1u << block ) ) )
+            {
+                sizeClass->used |= ( 1u << block );
+                buffer = sizeClass->blocks + ( block * sizeClass->size );
+                *leasedSize = sizeClass->size;
+                break;
+            }
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    return buffer;
+}
+
+void httpBufferPool_release( char *buffer )
+{
+    bool released = false;
+
+    taskENTER_CRITICAL();
+    for( uint8_t i = 0; !released && ( NULL != buffer ) && ( i < HTTP_BUFFER_POOL_CLASS_COUNT ); i++ )
+    {
+        tHttpBufferPool_class *sizeClass = &m_httpBufferPool_classes[i];
+
+        if( ( buffer >= sizeClass->blocks ) && ( buffer < ( sizeClass->blocks + ( sizeClass->count * sizeClass->size ) ) ) )
+        {
+            sizeClass->used &= ~( 1u << ( (size_t)( buffer - sizeClass->blocks ) / sizeClass->size ) );
+            released = true;
+        }
+    }
+    taskEXIT_CRITICAL();
+
+    if( released && ( NULL != m_httpBufferPool_listener ) )
+    {
+        m_httpBufferPool_listener();
+    }
+}
+
+/* True when some class has blocks of at least size bytes, a lease of that size then only waits for one to be given back */
+bool httpBufferPool_fits( size_t size )
+{
+    bool result = false;
+
+    for( uint8_t i = 0; !result && ( i < HTTP_BUFFER_POOL_CLASS_COUNT ); i++ )
+    {
+        result = ( m_httpBufferPool_classes[i].size >= size );
+    }
+
+    return result;
+}
+
+void httpBufferPool_setListener( tHttpBufferPool_listener listener )
+{
+    m_httpBufferPool_listener = listener;
+}
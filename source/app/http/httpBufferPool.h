@@ -0,0 +1,32 @@
+#ifndef _HTTP_BUFFER_POOL_H_
+#define _HTTP_BUFFER_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Fixed blocks for the request and response buffers of the HTTP clients, leased by
+ * the session task for one request and given back when it is finished. A lease gets
+ * the smallest free block that fits, so small requests do not hold large buffers and
+ * nothing of it comes from the FreeRTOS heap. The session task leases the blocks, a
+ * body kept for httpClient_wait() is given back from the task of the client.
+ */
+
+/* Block size and count of each class, smallest first */
+#ifndef HTTP_BUFFER_POOL_CLASSES
+#define HTTP_BUFFER_POOL_CLASSES( X ) \
+    X( 128u, 6u )                     \
+    X( 512u, 3u )                     \
+    X( 1024u, 2u )                    \
+    X( 2048u, 1u )
+#endif
+
+/* Called on the task giving a block back, after the pool is unlocked */
+typedef void ( *tHttpBufferPool_listener )( void );
+
+char *httpBufferPool_lease( size_t size, size_t *leasedSize );
+void httpBufferPool_release( char *buffer );
+bool httpBufferPool_fits( size_t size );
+void httpBufferPool_setListener( tHttpBufferPool_listener listener );
+
+#endif /* _HTTP_BUFFER_POOL_H_ */
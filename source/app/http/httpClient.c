@@ -1,19 +1,26 @@
 #include "httpClient.h"
 
 #include "cmsis_os.h"
+#include "httpBufferPool.h"
 #include "logger.h"
-#include "portable.h"
+#include "task.h"
 
 /************************************************************************************
  * PRIVATE MACROS
  ***********************************************************************************/
 
+#define LOG_MODULE LOG_MODULE_HTTP
+
 #define URL_PROTOCOL_END_MARKER        ( "://" )
 #define URL_PROTOCOL_END_MARKER_LEGNTH ( 3u )
 
 #define URL_HOSTNAME_END_MARKER        ( '/' )
 #define URL_HOSTNAME_END_MARKER_LEGNTH ( 1u )
 
+#define RESPONSE_BUFFER_FITS( SIZE, COUNT ) || ( HTTP_RESPONSE_BUFFER_SIZE <= ( SIZE ) )
+
+_Static_assert( false HTTP_BUFFER_POOL_CLASSES( RESPONSE_BUFFER_FITS ), "The largest response buffer fits no pool class" );
+
 /************************************************************************************
  * PRIVATE TYPES DECLARATION
  ***********************************************************************************/
@@ -22,26 +29,70 @@
  * PRIVATE FUNTCTION DECLERATION
  ***********************************************************************************/
 static bool parseUrl( const char *url, char *protocol, char *hostname, char *path );
+static char *takeResponseBuffer( tHttpClient_client *client );
 
 /************************************************************************************
  * PRIVATE VARIABLES DECLERATION
  ***********************************************************************************/
+static tHttpClient_client m_httpClient_pool[HTTP_CLIENT_POOL_SIZE];
 
 /************************************************************************************
  * PUBLIC FUNTCTION DEFINTIONS
  ***********************************************************************************/
+/* Takes a free slot of the client pool, NULL when all of them are in use */
 tHttpClient_client *httpClient_createNewHttpClient( tHttpClient_responeCallback responseCallback, tHttpClient_errorCallback errorCallback )
 {
-    tHttpClient_client *newClient = pvPortMalloc( sizeof( tHttpClient_client ) );
+    tHttpClient_client *newClient = NULL;
+
+    taskENTER_CRITICAL();
+    for( uint8_t i = 0; i < HTTP_CLIENT_POOL_SIZE; i++ )
+    {
+        if( !m_httpClient_pool[i].isInitalized )
+        {
+            newClient = &m_httpClient_pool[i];
+            newClient->isInitalized = true;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL();
 
-    if( NULL != newClient )
+    if( NULL == newClient )
+    {
+        LOG_WARNING( "No free HTTP client" );
+    }
+    else
     {
         newClient->requestType = NOT_SPECIFIED;
+        newClient->headerCount = 0;
+        newClient->contentType = NULL;
+        newClient->body = NULL;
+        newClient->bodyLength = 0;
+        newClient->bodyProvider = NULL;
+        newClient->bodyContext = NULL;
+        newClient->priority = HTTP_CLIENT_PRIORITY_NORMAL;
+        newClient->useCache = false;
+        newClient->cacheMaxAgeS = 0;
         newClient->port = 0;
         newClient->responseCallback = responseCallback;
         newClient->errorCallback = errorCallback;
-        newClient->isInitalized = true;
-        newClient->headerReceived = false;
+        newClient->headerCallback = NULL;
+        newClient->bodyCallback = NULL;
+        newClient->streamContext = NULL;
+        newClient->statusCode = 0;
+        newClient->requestState = HTTP_CLIENT_REQUEST_IDLE;
+        newClient->cancelRequested = false;
+        newClient->deleteRequested = false;
+        newClient->holdsResponseBuffer = false;
+        memset( &newClient->result, 0, sizeof( newClient->result ) );
+
+        if( NULL == newClient->completion )
+        {
+            // Kept by the pool slot for the next client
+            newClient->completion = osSemaphoreNew( 1, 0, NULL );
+        }
+        newClient->responseBuffer = NULL;
+        newClient->responseBufferSize = 0;
+        newClient->responseSize = HTTP_RESPONSE_DEFAULT_SIZE;
         newClient->bytesReceived = 0;
     }
 
@@ -56,22 +107,230 @@ void httpClient_configureRequest( tHttpClient_client *client, const char *url, u
         {
             client->requestType = type;
             client->port = port;
+            client->headerCount = 0;
+            client->contentType = NULL;
+            client->body = NULL;
+            client->bodyLength = 0;
+            client->bodyProvider = NULL;
+            client->bodyContext = NULL;
         }
     }
 }
 
+void httpClient_setPriority( tHttpClient_client *client, tHttpClient_priority priority )
+{
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        client->priority = priority;
+    }
+}
+
+/* Either callback may be NULL, without a body callback the body is collected in responseBuffer */
+void httpClient_setStreamCallbacks( tHttpClient_client *client, tHttpClient_headerCallback headerCallback,
+                                    tHttpClient_bodyCallback bodyCallback, void *context )
+{
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        client->headerCallback = headerCallback;
+        client->bodyCallback = bodyCallback;
+        client->streamContext = context;
+    }
+}
+
+/* Sizes the response buffer leased for each request, a body callback needs none. It holds size - 1 bytes of body */
+void httpClient_setResponseSize( tHttpClient_client *client, size_t size )
+{
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        client->responseSize = ( size < HTTP_RESPONSE_BUFFER_SIZE ) ? size : HTTP_RESPONSE_BUFFER_SIZE;
+    }
+}
+
+/* Only buffered GET responses are cached, with a body callback the cache is not used */
+void httpClient_enableCache( tHttpClient_client *client, uint32_t defaultMaxAgeS )
+{
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        client->useCache = true;
+        client->cacheMaxAgeS = defaultMaxAgeS;
+    }
+}
+
+/* name and value are sent as they are, they must stay valid until the response or error callback */
+bool httpClient_addHeader( tHttpClient_client *client, const char *name, const char *value )
+{
+    bool result = ( NULL != client ) && ( client->isInitalized ) && ( NULL != name ) && ( NULL != value ) &&
+                  ( client->headerCount < HTTP_CLIENT_MAX_HEADERS );
+
+    if( result )
+    {
+        client->headers[client->headerCount].name = name;
+        client->headers[client->headerCount].value = value;
+        client->headerCount++;
+    }
+
+    return result;
+}
+
+/* Body already in RAM, sent from there without a copy, it must stay valid until the response or error callback */
+void httpClient_setBody( tHttpClient_client *client, const char *contentType, const char *body, size_t length )
+{
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        client->contentType = contentType;
+        client->body = body;
+        client->bodyLength = ( NULL != body ) ? length : 0;
+        client->bodyProvider = NULL;
+    }
+}
+
+/* Body produced while it is sent, length can be HTTP_CLIENT_BODY_LENGTH_UNKNOWN. The provider runs on the session task */
+void httpClient_setBodyProvider( tHttpClient_client *client, const char *contentType, size_t length,
+                                 tHttpClient_bodyProvider provider, void *context )
+{
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        client->contentType = contentType;
+        client->body = NULL;
+        client->bodyLength = ( NULL != provider ) ? length : 0;
+        client->bodyProvider = provider;
+        client->bodyContext = context;
+    }
+}
+
+/* timeoutMs 0 only polls, one task at a time may wait. The result is valid once the request is not pending */
+tHttpClient_requestState httpClient_wait( tHttpClient_client *client, uint32_t timeoutMs )
+{
+    tHttpClient_requestState state = HTTP_CLIENT_REQUEST_IDLE;
+
+    if( ( NULL != client ) && ( client->isInitalized ) )
+    {
+        if( ( HTTP_CLIENT_REQUEST_PENDING == client->requestState ) && ( 0u != timeoutMs ) && ( NULL != client->completion ) )
+        {
+            osSemaphoreAcquire( client->completion, timeoutMs );
+        }
+
+        state = client->requestState;
+    }
+
+    return state;
+}
+
+const tHttpClient_result *httpClient_getResult( const tHttpClient_client *client )
+{
+    return ( ( NULL != client ) && ( client->isInitalized ) ) ? &client->result : NULL;
+}
+
+/* A client with a request in flight is cancelled and freed by the session task once the request ends */
 void httpClient_deleteClient( tHttpClient_client** client )
 {
-    if( NULL != client )
+    if( ( NULL != client ) && ( NULL != *client ) )
     {
-        vPortFree(*client);
+        tHttpClient_client *deleted = *client;
+        char *responseBuffer = NULL;
+
+        taskENTER_CRITICAL();
+        if( HTTP_CLIENT_REQUEST_PENDING == deleted->requestState )
+        {
+            deleted->cancelRequested = true;
+            deleted->deleteRequested = true;
+        }
+        else
+        {
+            responseBuffer = takeResponseBuffer( deleted );
+            deleted->isInitalized = false;
+        }
+        taskEXIT_CRITICAL();
+
+        httpBufferPool_release( responseBuffer );
         *client = NULL;
     }
 }
 
+/* Marks the client pending, false if it already is. The body of the previous result is given back */
+bool httpClient_beginRequest( tHttpClient_client *client )
+{
+    bool result = false;
+    char *responseBuffer = NULL;
+
+    taskENTER_CRITICAL();
+    if( HTTP_CLIENT_REQUEST_PENDING != client->requestState )
+    {
+        responseBuffer = takeResponseBuffer( client );
+        client->requestState = HTTP_CLIENT_REQUEST_PENDING;
+        client->cancelRequested = false;
+        result = true;
+    }
+    taskEXIT_CRITICAL();
+
+    if( result )
+    {
+        httpBufferPool_release( responseBuffer );
+        memset( &client->result, 0, sizeof( client->result ) );
+
+        // A waiter that timed out on the previous request left a release behind
+        if( NULL != client->completion )
+        {
+            osSemaphoreAcquire( client->completion, 0 );
+        }
+    }
+
+    return result;
+}
+
+/*
+ * Ends the request with the result already filled in. A leased body given in responseBuffer is
+ * kept as result.body and set to NULL, unless the client was deleted meanwhile. Then it is left
+ * for the caller to release, the client is freed now and false is returned.
+ */
+bool httpClient_completeRequest( tHttpClient_client *client, tHttpClient_requestState state, char **responseBuffer )
+{
+    bool result = true;
+
+    taskENTER_CRITICAL();
+    if( client->deleteRequested )
+    {
+        client->deleteRequested = false;
+        client->requestState = HTTP_CLIENT_REQUEST_IDLE;
+        client->isInitalized = false;
+        result = false;
+    }
+    else
+    {
+        // Handed over together with the state, a delete sees both or neither
+        if( ( NULL != responseBuffer ) && ( NULL != *responseBuffer ) )
+        {
+            client->result.body = *responseBuffer;
+            *responseBuffer = NULL;
+        }
+        client->holdsResponseBuffer = ( NULL != client->result.body );
+        client->requestState = state;
+    }
+    taskEXIT_CRITICAL();
+
+    if( result && ( NULL != client->completion ) )
+    {
+        osSemaphoreRelease( client->completion );
+    }
+
+    return result;
+}
+
 /************************************************************************************
  * PRIVATE FUNTCTION DEFINITIONS
  ***********************************************************************************/
+/* With the scheduler locked, the buffer is released by the caller afterwards */
+static char *takeResponseBuffer( tHttpClient_client *client )
+{
+    char *responseBuffer = client->holdsResponseBuffer ? client->responseBuffer : NULL;
+
+    client->holdsResponseBuffer = false;
+    client->result.body = NULL;
+
+    return responseBuffer;
+}
+
+/* Every part is checked against its field, a URL that does not fit is refused instead of cut */
 static bool parseUrl( const char *url, char *protocol, char *hostname, char *path )
 {
     bool result = false;
@@ -79,9 +338,10 @@ static bool parseUrl( const char *url, char *protocol, char *hostname, char *pat
     const char *protocol_end = NULL;
     const char *hostname_start = NULL;
     const char *hostname_end = NULL;
+    size_t hostnameLength;
 
     protocol_end = strstr( url_ptr, URL_PROTOCOL_END_MARKER );
-    if( NULL != protocol_end )
+    if( ( NULL != protocol_end ) && ( (size_t)( protocol_end - url_ptr ) < HTTP_CLIENT_MAX_PROTOCOL_LENGTH ) )
     {
         strncpy( protocol, url_ptr, protocol_end - url_ptr );
         protocol[protocol_end - url_ptr] = '\0';
@@ -89,22 +349,28 @@ static bool parseUrl( const char *url, char *protocol, char *hostname, char *pat
         hostname_start = protocol_end + URL_PROTOCOL_END_MARKER_LEGNTH;
 
         hostname_end = strchr( hostname_start, URL_HOSTNAME_END_MARKER );
-
         if( NULL == hostname_end )
         {
             // No path, so everything else is hostname
-            strcpy( hostname, hostname_start );
-            strcpy( path, "/" );
+            hostname_end = hostname_start + strlen( hostname_start );
         }
-        else
+
+        hostnameLength = (size_t)( hostname_end - hostname_start );
+
+        if( ( hostnameLength < HTTP_CLIENT_MAX_HOSTNAME_LENGTH ) && ( strlen( hostname_end ) < HTTP_CLIENT_MAX_PATH_LENGTH ) )
         {
-            strncpy( hostname, hostname_start, hostname_end - hostname_start );
-            hostname[hostname_end - hostname_start] = '\0';
+            memcpy( hostname, hostname_start, hostnameLength );
+            hostname[hostnameLength] = '\0';
 
-            strcpy( path, hostname_end );
+            strcpy( path, ( '\0' == *hostname_end ) ? "/" : hostname_end );
             result = true;
         }
     }
 
+    if( !result )
+    {
+        LOG_ERROR( "Invalid or too long URL: %.32s...", url );
+    }
+
     return result;
-}
\ No newline at end of file
+}
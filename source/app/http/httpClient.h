@@ -2,7 +2,10 @@
 #define _HTTP_CLIENT_H_
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "cmsis_os.h"
 #include "lwip/ip_addr.h"
 
 #define HTTP_CLIENT_MAX_PROTOCOL_LENGTH ( sizeof( "HTTPS" ) + 1 )
@@ -19,16 +22,69 @@
 #define REQUEST_TYPE_ENUM( TYPE )   TYPE,
 #define REQUEST_TYPE_STRING( TYPE ) #TYPE,
 
-#define HTTP_REQUEST_BUFFER_SIZE  ( 128u )
-#define HTTP_RESPONSE_BUFFER_SIZE ( 2048u )
+/* Clients that can exist at once, they live in a static pool */
+#ifndef HTTP_CLIENT_POOL_SIZE
+#define HTTP_CLIENT_POOL_SIZE ( 4u )
+#endif
+
+/* Leased responseBuffer, terminating zero included, see httpClient_setResponseSize() */
+#define HTTP_RESPONSE_BUFFER_SIZE  ( 2048u )
+#define HTTP_RESPONSE_DEFAULT_SIZE ( 1024u )
+
+/* Extra request headers, the strings are not copied */
+#ifndef HTTP_CLIENT_MAX_HEADERS
+#define HTTP_CLIENT_MAX_HEADERS ( 4u )
+#endif
+
+/* Body length of a provider that does not know it upfront, sent with chunked encoding */
+#define HTTP_CLIENT_BODY_LENGTH_UNKNOWN ( SIZE_MAX )
 
 typedef enum
 {
     HTTP_CLIENT_REQUEST_TYPE( REQUEST_TYPE_ENUM )
 } tHttpClient_requestType;
 
+/* Order in which queued requests get a session slot, in arrival order within a priority */
+typedef enum
+{
+    HTTP_CLIENT_PRIORITY_LOW,
+    HTTP_CLIENT_PRIORITY_NORMAL,
+    HTTP_CLIENT_PRIORITY_HIGH,
+} tHttpClient_priority;
+
+/* Progress of the last request of a client, see httpClient_wait() */
+typedef enum
+{
+    HTTP_CLIENT_REQUEST_IDLE,
+    HTTP_CLIENT_REQUEST_PENDING,
+    HTTP_CLIENT_REQUEST_DONE,
+    HTTP_CLIENT_REQUEST_FAILED,
+    HTTP_CLIENT_REQUEST_CANCELLED,
+} tHttpClient_requestState;
+
+/* Outcome of the last request, valid once it is no longer pending */
+typedef struct
+{
+    uint16_t statusCode;
+    const char* body;  // Zero terminated, only without response and body callbacks. Kept until the next request or the delete
+    size_t bodyLength;
+    uint32_t error;    // errno value of a failed or cancelled request
+} tHttpClient_result;
+
 typedef void ( *tHttpClient_responeCallback )( const char* data, size_t dataSize );
 typedef void ( *tHttpClient_errorCallback )( uint32_t errorCode );
+/* Every header of the final response, before any of its body */
+typedef void ( *tHttpClient_headerCallback )( uint16_t statusCode, const char* name, const char* value, void* context );
+/* Body data as it arrives, with a body callback the response callback gets no data and the body length */
+typedef void ( *tHttpClient_bodyCallback )( const char* data, size_t length, void* context );
+/* Fills buffer with the request body from offset on, returns how much was written, 0 at the end */
+typedef size_t ( *tHttpClient_bodyProvider )( char* buffer, size_t size, size_t offset, void* context );
+
+typedef struct
+{
+    const char* name;
+    const char* value;
+} tHttpClient_header;
 
 typedef struct
 {
@@ -36,18 +92,56 @@ typedef struct
     char host[HTTP_CLIENT_MAX_HOSTNAME_LENGTH];
     char path[HTTP_CLIENT_MAX_PATH_LENGTH];
     tHttpClient_requestType requestType;
+    tHttpClient_priority priority;
     uint16_t port;
+    // Request headers and body, referenced until the response or error callback
+    tHttpClient_header headers[HTTP_CLIENT_MAX_HEADERS];
+    uint8_t headerCount;
+    const char *contentType;
+    const char *body;
+    size_t bodyLength;
+    tHttpClient_bodyProvider bodyProvider;
+    void *bodyContext;
     tHttpClient_responeCallback responseCallback;
     tHttpClient_errorCallback errorCallback;
-    char requestBuffer[HTTP_REQUEST_BUFFER_SIZE];
-    char responseBuffer[HTTP_RESPONSE_BUFFER_SIZE];
-    size_t bytesReceived;
-    bool headerReceived;
+    tHttpClient_headerCallback headerCallback;
+    tHttpClient_bodyCallback bodyCallback;
+    void *streamContext;
+    bool useCache;          // GET responses are kept in the response cache, see httpResponseCache.h
+    uint32_t cacheMaxAgeS;  // Freshness when the server gives none
+    // Leased by the session manager for the time of a request only
+    char *responseBuffer;
+    size_t responseBufferSize;
+    size_t responseSize;  // Of the responseBuffer to lease, terminating zero included
+    size_t bytesReceived;  // Of the body, also the ones handed to the body callback
+    uint16_t statusCode;   // Of the last response, valid in the response callback
+    // Shared by the caller and the session task
+    volatile tHttpClient_requestState requestState;
+    volatile bool cancelRequested;
+    volatile bool deleteRequested;  // Deleted while in flight, the session task frees it when the request ends
+    bool holdsResponseBuffer;       // result.body is a leased buffer
+    tHttpClient_result result;
+    osSemaphoreId_t completion;     // Released when the request ends, created once per pool slot
     bool isInitalized;
 } tHttpClient_client;
 
 tHttpClient_client *httpClient_createNewHttpClient( tHttpClient_responeCallback responseCallback, tHttpClient_errorCallback errorCallback );
 void httpClient_configureRequest( tHttpClient_client *client, const char *url, uint16_t port, tHttpClient_requestType type );
+void httpClient_setPriority( tHttpClient_client *client, tHttpClient_priority priority );
+void httpClient_setResponseSize( tHttpClient_client *client, size_t size );
+void httpClient_enableCache( tHttpClient_client *client, uint32_t defaultMaxAgeS );
+bool httpClient_addHeader( tHttpClient_client *client, const char *name, const char *value );
+void httpClient_setBody( tHttpClient_client *client, const char *contentType, const char *body, size_t length );
+void httpClient_setBodyProvider( tHttpClient_client *client, const char *contentType, size_t length,
+                                 tHttpClient_bodyProvider provider, void *context );
+void httpClient_setStreamCallbacks( tHttpClient_client *client, tHttpClient_headerCallback headerCallback,
+                                    tHttpClient_bodyCallback bodyCallback, void *context );
+tHttpClient_requestState httpClient_wait( tHttpClient_client *client, uint32_t timeoutMs );
+const tHttpClient_result *httpClient_getResult( const tHttpClient_client *client );
 void httpClient_deleteClient( tHttpClient_client** client );
 
+/* For the session manager only */
+bool httpClient_beginRequest( tHttpClient_client *client );
+bool httpClient_completeRequest( tHttpClient_client *client, tHttpClient_requestState state, char **responseBuffer );
+
 #endif /* _HTTP_CLIENT_H_ */
\ No newline at end of file
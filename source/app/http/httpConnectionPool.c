@@ -0,0 +1,195 @@
+#include "httpConnectionPool.h"
+
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "httpClient.h"
+#include "logger.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_HTTP
+
+/* Given up this long before the server's Keep-Alive timeout, so a request does not race its close */
+#define HTTP_CONNECTION_CLOSE_MARGIN_MS ( 1000u )
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    int socket_fd;  // -1 when the slot is free
+    char host[HTTP_CLIENT_MAX_HOSTNAME_LENGTH];
+    uint16_t port;
+    uint16_t requestsLeft;  // 0 - the server did not give a limit
+    uint32_t expiry;        // Kernel tick
+} tHttpConnectionPool_entry;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void closeEntry( tHttpConnectionPool_entry *entry, const char *reason );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tHttpConnectionPool_entry m_httpConnectionPool[HTTP_CONNECTION_POOL_SIZE];
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void httpConnectionPool_init( void )
+{
+    for( uint8_t i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        m_httpConnectionPool[i].socket_fd = -1;
+    }
+}
+
+/* Returns the socket of an idle connection to host:port and removes it from the pool, -1 if there is none */
+int httpConnectionPool_take( const char *host, uint16_t port, uint16_t *requestsLeft )
+{
+    int socket_fd = -1;
+
+    for( uint8_t i = 0; ( socket_fd < 0 ) && ( i < HTTP_CONNECTION_POOL_SIZE ); i++ )
+    {
+        tHttpConnectionPool_entry *entry = &m_httpConnectionPool[i];
+
+        if( ( entry->socket_fd >= 0 ) && ( port == entry->port ) && ( 0 == strcmp( host, entry->host ) ) )
+        {
+            socket_fd = entry->socket_fd;
+            *requestsLeft = entry->requestsLeft;
+            entry->socket_fd = -1;
+        }
+    }
+
+    return socket_fd;
+}
+
+/* Takes over the socket, the oldest idle connection makes room when the pool is full */
+void httpConnectionPool_give( int socket_fd, const char *host, uint16_t port, uint32_t idleTimeoutMs, uint16_t requestsLeft )
+{
+    tHttpConnectionPool_entry *slot = &m_httpConnectionPool[0];
+
+    for( uint8_t i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        tHttpConnectionPool_entry *entry = &m_httpConnectionPool[i];
+
+        if( entry->socket_fd < 0 )
+        {
+            slot = entry;
+            break;
+        }
+
+        if( (int32_t)( entry->expiry - slot->expiry ) < 0 )
+        {
+            slot = entry;
+        }
+    }
+
+    if( slot->socket_fd >= 0 )
+    {
+        closeEntry( slot, "evicted" );
+    }
+
+    if( ( 0 == idleTimeoutMs ) || ( idleTimeoutMs > HTTP_CONNECTION_IDLE_TIMEOUT_MS ) )
+    {
+        idleTimeoutMs = HTTP_CONNECTION_IDLE_TIMEOUT_MS;
+    }
+    else
+    {
+        idleTimeoutMs = ( idleTimeoutMs > HTTP_CONNECTION_CLOSE_MARGIN_MS ) ? ( idleTimeoutMs - HTTP_CONNECTION_CLOSE_MARGIN_MS ) : 0;
+    }
+
+    slot->socket_fd = socket_fd;
+    strncpy( slot->host, host, sizeof( slot->host ) - 1u );
+    slot->host[sizeof( slot->host ) - 1u] = '\0';
+    slot->port = port;
+    slot->requestsLeft = requestsLeft;
+    slot->expiry = osKernelGetTickCount() + idleTimeoutMs;
+
+    LOG_DEBUG( "Connection to %s:%u idle for %u ms", slot->host, (unsigned int)port, (unsigned int)idleTimeoutMs );
+}
+
+/* An idle socket becomes readable when the server closes it */
+int httpConnectionPool_addToSet( fd_set *read_fds, int maxFd )
+{
+    for( uint8_t i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        if( m_httpConnectionPool[i].socket_fd >= 0 )
+        {
+            FD_SET( m_httpConnectionPool[i].socket_fd, read_fds );
+            maxFd = ( m_httpConnectionPool[i].socket_fd > maxFd ) ? m_httpConnectionPool[i].socket_fd : maxFd;
+        }
+    }
+
+    return maxFd;
+}
+
+/* Closes the connections the server closed or that stayed idle too long, NULL checks the timeouts only */
+void httpConnectionPool_process( const fd_set *read_fds )
+{
+    uint32_t now = osKernelGetTickCount();
+
+    for( uint8_t i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        tHttpConnectionPool_entry *entry = &m_httpConnectionPool[i];
+
+        if( entry->socket_fd < 0 )
+        {
+            continue;
+        }
+
+        if( ( NULL != read_fds ) && FD_ISSET( entry->socket_fd, read_fds ) )
+        {
+            // Nothing is expected on an idle connection, data or not it cannot be used anymore
+            closeEntry( entry, "closed by server" );
+        }
+        else if( (int32_t)( now - entry->expiry ) >= 0 )
+        {
+            closeEntry( entry, "idle timeout" );
+        }
+    }
+}
+
+/* Time until the next idle timeout, osWaitForever when the pool is empty */
+uint32_t httpConnectionPool_waitTime( void )
+{
+    uint32_t now = osKernelGetTickCount();
+    uint32_t waitMs = osWaitForever;
+
+    for( uint8_t i = 0; i < HTTP_CONNECTION_POOL_SIZE; i++ )
+    {
+        int32_t remaining = (int32_t)( m_httpConnectionPool[i].expiry - now );
+
+        if( m_httpConnectionPool[i].socket_fd >= 0 )
+        {
+            waitMs = ( remaining <= 0 ) ? 0 : ( ( (uint32_t)remaining < waitMs ) ? (uint32_t)remaining : waitMs );
+        }
+    }
+
+    return waitMs;
+}
+
+bool httpConnectionPool_isEmpty( void )
+{
+    bool empty = true;
+
+    for( uint8_t i = 0; empty && ( i < HTTP_CONNECTION_POOL_SIZE ); i++ )
+    {
+        empty = ( m_httpConnectionPool[i].socket_fd < 0 );
+    }
+
+    return empty;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void closeEntry( tHttpConnectionPool_entry *entry, const char *reason )
+{
+    LOG_DEBUG( "Idle connection to %s:%u %s", entry->host, (unsigned int)entry->port, reason );
+    close( entry->socket_fd );
+    entry->socket_fd = -1;
+}
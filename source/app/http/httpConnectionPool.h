@@ -0,0 +1,31 @@
+#ifndef _HTTP_CONNECTION_POOL_H_
+#define _HTTP_CONNECTION_POOL_H_
+
+#include <lwip/sockets.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Idle persistent connections of the HTTP session manager, one slot per socket and
+ * keyed by host and port. A connection stays until it is taken for a new request,
+ * its idle timeout expires or the server closes it. Only the session task uses it.
+ */
+
+#ifndef HTTP_CONNECTION_POOL_SIZE
+#define HTTP_CONNECTION_POOL_SIZE ( 2u )
+#endif
+
+/* Upper bound of the idle time, a shorter Keep-Alive timeout of the server is followed */
+#ifndef HTTP_CONNECTION_IDLE_TIMEOUT_MS
+#define HTTP_CONNECTION_IDLE_TIMEOUT_MS ( 15000u )
+#endif
+
+void httpConnectionPool_init( void );
+int httpConnectionPool_take( const char *host, uint16_t port, uint16_t *requestsLeft );
+void httpConnectionPool_give( int socket_fd, const char *host, uint16_t port, uint32_t idleTimeoutMs, uint16_t requestsLeft );
+int httpConnectionPool_addToSet( fd_set *read_fds, int maxFd );
+void httpConnectionPool_process( const fd_set *read_fds );
+uint32_t httpConnectionPool_waitTime( void );
+bool httpConnectionPool_isEmpty( void );
+
+#endif /* _HTTP_CONNECTION_POOL_H_ */
@@ -0,0 +1,312 @@
+#include "httpRequestWriter.h"
+
+#include <lwip/sockets.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lwip/errno.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define HTTP_DEFAULT_PORT ( 80u )
+
+/* Method line and Host, 4 per header, the condition, Content-Type, the length line and the empty line */
+#define HTTP_REQUEST_WRITER_MAX_SEGMENTS ( 7u + ( 4u * HTTP_CLIENT_MAX_HEADERS ) + 1u + 3u + 1u + 1u )
+
+#define HTTP_CRLF             "\r\n"
+#define HTTP_LAST_CHUNK       "0\r\n\r\n"
+#define HTTP_LAST_CHUNK_SIZE  ( sizeof( HTTP_LAST_CHUNK ) - 1u )
+#define HTTP_CRLF_SIZE        ( sizeof( HTTP_CRLF ) - 1u )
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static uint8_t headSegments( const tHttpRequestWriter *writer, struct iovec *iov );
+static uint8_t bodySegments( const tHttpRequestWriter *writer, struct iovec *iov );
+static bool nextFrame( tHttpRequestWriter *writer );
+static bool hasBody( const tHttpClient_client *client );
+static void addSegment( struct iovec *iov, uint8_t *count, const void *data, size_t length );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static const char *m_httpRequestWriter_methods[] = {
+    HTTP_CLIENT_REQUEST_TYPE( REQUEST_TYPE_STRING )
+};
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void httpRequestWriter_init( tHttpRequestWriter *writer, const tHttpClient_client *client, char *chunkBuffer, size_t chunkSize )
+{
+    struct iovec iov[HTTP_REQUEST_WRITER_MAX_SEGMENTS];
+    uint8_t count;
+
+    memset( writer, 0, sizeof( *writer ) );
+    writer->client = client;
+    writer->chunkBuffer = chunkBuffer;
+    writer->chunkSize = chunkSize;
+
+    if( ( 0u != client->port ) && ( HTTP_DEFAULT_PORT != client->port ) )
+    {
+        snprintf( writer->portText, sizeof( writer->portText ), ":%u", (unsigned int)client->port );
+    }
+
+    if( !hasBody( client ) )
+    {
+        // A POST or PUT without a body still tells the server there is none
+        if( ( POST == client->requestType ) || ( PUT == client->requestType ) )
+        {
+            strcpy( writer->lengthText, "Content-Length: 0" HTTP_CRLF );
+        }
+    }
+    else if( HTTP_CLIENT_BODY_LENGTH_UNKNOWN == client->bodyLength )
+    {
+        strcpy( writer->lengthText, "Transfer-Encoding: chunked" HTTP_CRLF );
+    }
+    else
+    {
+        snprintf( writer->lengthText, sizeof( writer->lengthText ), "Content-Length: %lu" HTTP_CRLF, (unsigned long)client->bodyLength );
+    }
+
+    count = headSegments( writer, iov );
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        writer->headLength += iov[i].iov_len;
+    }
+
+    httpRequestWriter_rewind( writer );
+}
+
+/* Makes the request conditional, before the first write only */
+void httpRequestWriter_setCondition( tHttpRequestWriter *writer, const char *name, const char *value )
+{
+    int length = snprintf( writer->conditionText, sizeof( writer->conditionText ), "%s: %s" HTTP_CRLF, name, value );
+
+    if( ( length > 0 ) && ( (size_t)length < sizeof( writer->conditionText ) ) )
+    {
+        writer->headLength += (size_t)length;
+    }
+    else
+    {
+        writer->conditionText[0] = '\0';
+    }
+}
+
+/* Starts over, for a request sent again on a new connection */
+void httpRequestWriter_rewind( tHttpRequestWriter *writer )
+{
+    writer->phase = HTTP_REQUEST_WRITER_HEAD;
+    writer->sent = 0;
+    writer->chunkLength = 0;
+    writer->frameLength = 0;
+    writer->bodyOffset = 0;
+    writer->lastFrame = false;
+    writer->error = 0;
+}
+
+/* Writes as much as the socket takes, on HTTP_REQUEST_WRITER_ERROR the reason is in writer->error */
+tHttpRequestWriter_result httpRequestWriter_write( tHttpRequestWriter *writer, int socket_fd )
+{
+    tHttpRequestWriter_result result = HTTP_REQUEST_WRITER_DONE;
+
+    while( ( HTTP_REQUEST_WRITER_FINISHED != writer->phase ) && ( HTTP_REQUEST_WRITER_DONE == result ) )
+    {
+        struct iovec iov[HTTP_REQUEST_WRITER_MAX_SEGMENTS];
+        uint8_t count;
+        uint8_t first = 0;
+        size_t skip = writer->sent;
+        ssize_t written;
+
+        if( ( HTTP_REQUEST_WRITER_BODY == writer->phase ) && ( writer->sent == writer->frameLength ) )
+        {
+            if( writer->lastFrame )
+            {
+                writer->phase = HTTP_REQUEST_WRITER_FINISHED;
+            }
+            else if( !nextFrame( writer ) )
+            {
+                result = HTTP_REQUEST_WRITER_ERROR;
+            }
+            continue;
+        }
+
+        count = ( HTTP_REQUEST_WRITER_HEAD == writer->phase ) ? headSegments( writer, iov ) : bodySegments( writer, iov );
+
+        // Leaves out what an earlier partial write already sent
+        while( ( first < count ) && ( skip >= iov[first].iov_len ) )
+        {
+            skip -= iov[first].iov_len;
+            first++;
+        }
+        iov[first].iov_base = (char *)iov[first].iov_base + skip;
+        iov[first].iov_len -= skip;
+
+        written = lwip_writev( socket_fd, &iov[first], count - first );
+
+        if( written > 0 )
+        {
+            writer->sent += (size_t)written;
+
+            if( ( HTTP_REQUEST_WRITER_HEAD == writer->phase ) && ( writer->sent == writer->headLength ) )
+            {
+                writer->phase = hasBody( writer->client ) ? HTTP_REQUEST_WRITER_BODY : HTTP_REQUEST_WRITER_FINISHED;
+                writer->sent = 0;
+                writer->frameLength = 0;
+            }
+        }
+        else if( ( 0 == written ) || ( EAGAIN == errno ) || ( EWOULDBLOCK == errno ) )
+        {
+            result = HTTP_REQUEST_WRITER_BLOCKED;
+        }
+        else
+        {
+            writer->error = errno;
+            result = HTTP_REQUEST_WRITER_ERROR;
+        }
+    }
+
+    return result;
+}
+
+/* A body provider is read through a chunk buffer, everything else is sent from where it is */
+bool httpRequestWriter_needsChunkBuffer( const tHttpClient_client *client )
+{
+    return hasBody( client ) && ( NULL != client->bodyProvider );
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static uint8_t headSegments( const tHttpRequestWriter *writer, struct iovec *iov )
+{
+    const tHttpClient_client *client = writer->client;
+    const char *method = m_httpRequestWriter_methods[client->requestType];
+    uint8_t count = 0;
+
+    addSegment( iov, &count, method, strlen( method ) );
+    addSegment( iov, &count, " ", 1u );
+    addSegment( iov, &count, client->path, strlen( client->path ) );
+    addSegment( iov, &count, " HTTP/1.1" HTTP_CRLF "Host: ", sizeof( " HTTP/1.1" HTTP_CRLF "Host: " ) - 1u );
+    addSegment( iov, &count, client->host, strlen( client->host ) );
+    addSegment( iov, &count, writer->portText, strlen( writer->portText ) );
+    // HTTP/1.1 keeps the connection open unless one side says otherwise
+    addSegment( iov, &count, HTTP_CRLF "Accept: */*" HTTP_CRLF, sizeof( HTTP_CRLF "Accept: */*" HTTP_CRLF ) - 1u );
+
+    for( uint8_t i = 0; i < client->headerCount; i++ )
+    {
+        addSegment( iov, &count, client->headers[i].name, strlen( client->headers[i].name ) );
+        addSegment( iov, &count, ": ", 2u );
+        addSegment( iov, &count, client->headers[i].value, strlen( client->headers[i].value ) );
+        addSegment( iov, &count, HTTP_CRLF, HTTP_CRLF_SIZE );
+    }
+
+    addSegment( iov, &count, writer->conditionText, strlen( writer->conditionText ) );
+
+    if( hasBody( client ) && ( NULL != client->contentType ) )
+    {
+        addSegment( iov, &count, "Content-Type: ", sizeof( "Content-Type: " ) - 1u );
+        addSegment( iov, &count, client->contentType, strlen( client->contentType ) );
+        addSegment( iov, &count, HTTP_CRLF, HTTP_CRLF_SIZE );
+    }
+
+    addSegment( iov, &count, writer->lengthText, strlen( writer->lengthText ) );
+    addSegment( iov, &count, HTTP_CRLF, HTTP_CRLF_SIZE );
+
+    return count;
+}
+
+static uint8_t bodySegments( const tHttpRequestWriter *writer, struct iovec *iov )
+{
+    const tHttpClient_client *client = writer->client;
+    uint8_t count = 0;
+
+    if( NULL != client->body )
+    {
+        addSegment( iov, &count, client->body, client->bodyLength );
+    }
+    else if( HTTP_CLIENT_BODY_LENGTH_UNKNOWN != client->bodyLength )
+    {
+        addSegment( iov, &count, writer->chunkBuffer, writer->chunkLength );
+    }
+    else if( 0 == writer->chunkLength )
+    {
+        addSegment( iov, &count, HTTP_LAST_CHUNK, HTTP_LAST_CHUNK_SIZE );
+    }
+    else
+    {
+        addSegment( iov, &count, writer->chunkSizeText, strlen( writer->chunkSizeText ) );
+        addSegment( iov, &count, writer->chunkBuffer, writer->chunkLength );
+        addSegment( iov, &count, HTTP_CRLF, HTTP_CRLF_SIZE );
+    }
+
+    return count;
+}
+
+/* Gets the next piece of the body ready, a provider that gives more than asked or ends early fails the request */
+static bool nextFrame( tHttpRequestWriter *writer )
+{
+    const tHttpClient_client *client = writer->client;
+    bool result = true;
+
+    writer->sent = 0;
+
+    if( NULL != client->body )
+    {
+        writer->frameLength = client->bodyLength;
+        writer->lastFrame = true;
+    }
+    else if( HTTP_CLIENT_BODY_LENGTH_UNKNOWN != client->bodyLength )
+    {
+        size_t remaining = client->bodyLength - writer->bodyOffset;
+        size_t size = ( remaining < writer->chunkSize ) ? remaining : writer->chunkSize;
+
+        writer->chunkLength = client->bodyProvider( writer->chunkBuffer, size, writer->bodyOffset, client->bodyContext );
+        result = ( writer->chunkLength > 0 ) && ( writer->chunkLength <= size );
+
+        writer->bodyOffset += writer->chunkLength;
+        writer->frameLength = writer->chunkLength;
+        writer->lastFrame = ( writer->bodyOffset == client->bodyLength );
+    }
+    else
+    {
+        writer->chunkLength = client->bodyProvider( writer->chunkBuffer, writer->chunkSize, writer->bodyOffset, client->bodyContext );
+        result = ( writer->chunkLength <= writer->chunkSize );
+
+        writer->bodyOffset += writer->chunkLength;
+        writer->lastFrame = ( 0 == writer->chunkLength );
+
+        if( writer->lastFrame )
+        {
+            writer->frameLength = HTTP_LAST_CHUNK_SIZE;
+        }
+        else
+        {
+            snprintf( writer->chunkSizeText, sizeof( writer->chunkSizeText ), "%lx" HTTP_CRLF, (unsigned long)writer->chunkLength );
+            writer->frameLength = strlen( writer->chunkSizeText ) + writer->chunkLength + HTTP_CRLF_SIZE;
+        }
+    }
+
+    if( !result )
+    {
+        writer->error = EIO;
+    }
+
+    return result;
+}
+
+static bool hasBody( const tHttpClient_client *client )
+{
+    return ( ( NULL != client->body ) || ( NULL != client->bodyProvider ) ) && ( 0 != client->bodyLength );
+}
+
+static void addSegment( struct iovec *iov, uint8_t *count, const void *data, size_t length )
+{
+    if( length > 0 )
+    {
+        iov[*count].iov_base = (void *)data;
+        iov[*count].iov_len = length;
+        ( *count )++;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef _HTTP_REQUEST_WRITER_H_
+#define _HTTP_REQUEST_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "httpClient.h"
+#include "httpResponseCache.h"
+
+/*
+ * Writes the request of a client to a non-blocking socket without formatting it into
+ * one buffer first. The method line, Host, the client's headers and the body are
+ * handed to lwip_writev() as a scatter list that points at the client's own strings,
+ * only numbers and the cache condition are formatted into the writer. A body from a provider is pulled one
+ * chunk buffer at a time and sent with Content-Length, or with chunked encoding when
+ * its length is unknown. A partial write carries on from where it stopped.
+ */
+
+#define HTTP_REQUEST_WRITER_CONDITION_SIZE ( sizeof( "If-Modified-Since: \r\n" ) + HTTP_RESPONSE_CACHE_VALIDATOR_SIZE )
+
+typedef enum
+{
+    HTTP_REQUEST_WRITER_DONE,
+    HTTP_REQUEST_WRITER_BLOCKED,  // The send buffer is full, wait until the socket is writable
+    HTTP_REQUEST_WRITER_ERROR,
+} tHttpRequestWriter_result;
+
+typedef enum
+{
+    HTTP_REQUEST_WRITER_HEAD,
+    HTTP_REQUEST_WRITER_BODY,
+    HTTP_REQUEST_WRITER_FINISHED,
+} tHttpRequestWriter_phase;
+
+typedef struct
+{
+    const tHttpClient_client *client;
+    tHttpRequestWriter_phase phase;
+    size_t headLength;
+    size_t sent;            // Of the head, or of the current body frame
+    char *chunkBuffer;      // For a body provider only
+    size_t chunkSize;
+    size_t chunkLength;     // Provider data in chunkBuffer
+    size_t frameLength;     // Chunk data and its chunked framing
+    size_t bodyOffset;      // Handed to the provider so far
+    bool lastFrame;
+    char portText[8];       // ":8080", empty for port 80
+    char lengthText[40];    // Content-Length or Transfer-Encoding line
+    char chunkSizeText[12];
+    char conditionText[HTTP_REQUEST_WRITER_CONDITION_SIZE];  // If-None-Match or If-Modified-Since line
+    int error;
+} tHttpRequestWriter;
+
+void httpRequestWriter_init( tHttpRequestWriter *writer, const tHttpClient_client *client, char *chunkBuffer, size_t chunkSize );
+void httpRequestWriter_setCondition( tHttpRequestWriter *writer, const char *name, const char *value );
+void httpRequestWriter_rewind( tHttpRequestWriter *writer );
+tHttpRequestWriter_result httpRequestWriter_write( tHttpRequestWriter *writer, int socket_fd );
+bool httpRequestWriter_needsChunkBuffer( const tHttpClient_client *client );
+
+#endif /* _HTTP_REQUEST_WRITER_H_ */
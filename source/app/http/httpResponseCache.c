@@ -0,0 +1,267 @@
+#include "httpResponseCache.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "httpResponseParser.h"
+#include "logger.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_HTTP
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static bool makeKey( const tHttpClient_client *client, char *key );
+static tHttpResponseCache_entry *findEntry( const char *key );
+static tHttpResponseCache_entry *takeEntry( const char *key );
+static void setFreshness( tHttpResponseCache_entry *entry, const tHttpClient_client *client, const tHttpResponseCache_meta *meta );
+static void parseCacheControl( tHttpResponseCache_meta *meta, const char *value );
+static void copyValidator( char *validator, const char *value );
+static uint32_t parseSeconds( const char *text );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tHttpResponseCache_entry m_httpResponseCache_entries[HTTP_RESPONSE_CACHE_ENTRIES];
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+/* Entry for the URL of the client, fresh or not, NULL if there is none */
+const tHttpResponseCache_entry *httpResponseCache_find( const tHttpClient_client *client )
+{
+    char key[HTTP_RESPONSE_CACHE_KEY_SIZE];
+    tHttpResponseCache_entry *entry = makeKey( client, key ) ? findEntry( key ) : NULL;
+
+    if( NULL != entry )
+    {
+        entry->usedTick = osKernelGetTickCount();
+    }
+
+    return entry;
+}
+
+bool httpResponseCache_isFresh( const tHttpResponseCache_entry *entry )
+{
+    return ( NULL != entry ) && ( ( osKernelGetTickCount() - entry->storedTick ) < entry->maxAgeMs );
+}
+
+/* Called for every header of the response, the ones without caching information are skipped */
+void httpResponseCache_parseHeader( tHttpResponseCache_meta *meta, const char *name, const char *value )
+{
+    size_t nameLength = strlen( name );
+
+    if( httpResponseParser_isName( name, nameLength, "Cache-Control" ) )
+    {
+        parseCacheControl( meta, value );
+    }
+    else if( httpResponseParser_isName( name, nameLength, "ETag" ) )
+    {
+        copyValidator( meta->etag, value );
+    }
+    else if( httpResponseParser_isName( name, nameLength, "Last-Modified" ) )
+    {
+        copyValidator( meta->lastModified, value );
+    }
+    else if( httpResponseParser_isName( name, nameLength, "Age" ) )
+    {
+        meta->ageS = parseSeconds( value );
+    }
+}
+
+/* Body of a 200 response, kept only when it can be served fresh or revalidated later */
+void httpResponseCache_store( const tHttpClient_client *client, const tHttpResponseCache_meta *meta, const char *body, size_t length )
+{
+    char key[HTTP_RESPONSE_CACHE_KEY_SIZE];
+    tHttpResponseCache_entry *entry;
+
+    if( !makeKey( client, key ) )
+    {
+        return;
+    }
+
+    entry = findEntry( key );
+
+    if( meta->noStore || ( length > HTTP_RESPONSE_CACHE_BODY_SIZE ) )
+    {
+        // The old body is outdated by now
+        if( NULL != entry )
+        {
+            entry->isValid = false;
+        }
+        return;
+    }
+
+    entry = takeEntry( key );
+    memcpy( entry->body, body, length );
+    entry->length = length;
+    strcpy( entry->etag, meta->etag );
+    strcpy( entry->lastModified, meta->lastModified );
+    setFreshness( entry, client, meta );
+
+    // Useless without freshness or a validator
+    entry->isValid = ( entry->maxAgeMs > 0 ) || ( '\0' != entry->etag[0] ) || ( '\0' != entry->lastModified[0] );
+
+    LOG_DEBUG( "Cached %u bytes of %s for %u ms", (unsigned int)length, key, (unsigned int)entry->maxAgeMs );
+}
+
+/* A 304 makes the entry fresh again, NULL when it was evicted meanwhile */
+const tHttpResponseCache_entry *httpResponseCache_revalidate( const tHttpClient_client *client, const tHttpResponseCache_meta *meta )
+{
+    char key[HTTP_RESPONSE_CACHE_KEY_SIZE];
+    tHttpResponseCache_entry *entry = makeKey( client, key ) ? findEntry( key ) : NULL;
+
+    if( NULL != entry )
+    {
+        // A 304 carries the validators of the current representation if they changed
+        if( '\0' != meta->etag[0] )
+        {
+            strcpy( entry->etag, meta->etag );
+        }
+        if( '\0' != meta->lastModified[0] )
+        {
+            strcpy( entry->lastModified, meta->lastModified );
+        }
+
+        setFreshness( entry, client, meta );
+        // Served this once, not kept for the next request
+        entry->isValid = !meta->noStore;
+    }
+
+    return entry;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static bool makeKey( const tHttpClient_client *client, char *key )
+{
+    int length = snprintf( key, HTTP_RESPONSE_CACHE_KEY_SIZE, "%s:%u%s", client->host, (unsigned int)client->port, client->path );
+
+    return ( length > 0 ) && ( (size_t)length < HTTP_RESPONSE_CACHE_KEY_SIZE );
+}
+
+static tHttpResponseCache_entry *findEntry( const char *key )
+{
+    tHttpResponseCache_entry *entry = NULL;
+
+    for( uint8_t i = 0; ( NULL == entry ) && ( i < HTTP_RESPONSE_CACHE_ENTRIES ); i++ )
+    {
+        if( m_httpResponseCache_entries[i].isValid && ( 0 == strcmp( m_httpResponseCache_entries[i].key, key ) ) )
+        {
+            entry = &m_httpResponseCache_entries[i];
+        }
+    }
+
+    return entry;
+}
+
+/* The entry of the key, a free one or the least recently used one */
+static tHttpResponseCache_entry *takeEntry( const char *key )
+{
+    tHttpResponseCache_entry *entry = findEntry( key );
+    uint32_t now = osKernelGetTickCount();
+
+    for( uint8_t i = 0; ( NULL == entry ) && ( i < HTTP_RESPONSE_CACHE_ENTRIES ); i++ )
+    {
+        if( !m_httpResponseCache_entries[i].isValid )
+        {
+            entry = &m_httpResponseCache_entries[i];
+        }
+    }
+
+    if( NULL == entry )
+    {
+        entry = &m_httpResponseCache_entries[0];
+
+        for( uint8_t i = 1; i < HTTP_RESPONSE_CACHE_ENTRIES; i++ )
+        {
+            if( ( now - m_httpResponseCache_entries[i].usedTick ) > ( now - entry->usedTick ) )
+            {
+                entry = &m_httpResponseCache_entries[i];
+            }
+        }
+
+        LOG_DEBUG( "Evicting %s from the response cache", entry->key );
+    }
+
+    strcpy( entry->key, key );
+    entry->usedTick = now;
+
+    return entry;
+}
+
+/* max-age of the server less the time the response spent in caches on the way, otherwise the default of the client */
+static void setFreshness( tHttpResponseCache_entry *entry, const tHttpClient_client *client, const tHttpResponseCache_meta *meta )
+{
+    uint32_t maxAgeS = meta->hasMaxAge ? meta->maxAgeS : client->cacheMaxAgeS;
+
+    maxAgeS = ( maxAgeS > meta->ageS ) ? ( maxAgeS - meta->ageS ) : 0;
+    maxAgeS = ( maxAgeS < HTTP_RESPONSE_CACHE_MAX_AGE_S ) ? maxAgeS : HTTP_RESPONSE_CACHE_MAX_AGE_S;
+
+    entry->maxAgeMs = maxAgeS * 1000u;
+    entry->storedTick = osKernelGetTickCount();
+}
+
+/* Cache-Control: max-age=3600, no-cache */
+static void parseCacheControl( tHttpResponseCache_meta *meta, const char *value )
+{
+    while( '\0' != *value )
+    {
+        size_t length = strcspn( value, "," );
+        size_t nameLength = strcspn( value, "=," );
+
+        if( httpResponseParser_isName( value, nameLength, "max-age" ) && ( nameLength < length ) )
+        {
+            meta->maxAgeS = parseSeconds( value + nameLength + 1u );
+            meta->hasMaxAge = true;
+        }
+        else if( httpResponseParser_isName( value, nameLength, "no-cache" ) )
+        {
+            // May be stored, but is revalidated every time
+            meta->maxAgeS = 0;
+            meta->hasMaxAge = true;
+        }
+        else if( httpResponseParser_isName( value, nameLength, "no-store" ) )
+        {
+            meta->noStore = true;
+        }
+
+        value += length;
+        while( ( ',' == *value ) || ( ' ' == *value ) )
+        {
+            value++;
+        }
+    }
+}
+
+/* A validator that does not fit is dropped, a cut one would never match */
+static void copyValidator( char *validator, const char *value )
+{
+    size_t length = strlen( value );
+
+    if( length < HTTP_RESPONSE_CACHE_VALIDATOR_SIZE )
+    {
+        memcpy( validator, value, length + 1u );
+    }
+}
+
+/* Leading digits, saturated instead of overflowing */
+static uint32_t parseSeconds( const char *text )
+{
+    uint32_t seconds = 0;
+
+    for( ; isdigit( (unsigned char)*text ); text++ )
+    {
+        uint32_t digit = (uint32_t)( *text - '0' );
+
+        seconds = ( seconds <= ( ( UINT32_MAX - digit ) / 10u ) ) ? ( seconds * 10u + digit ) : UINT32_MAX;
+    }
+
+    return seconds;
+}
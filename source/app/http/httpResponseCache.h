@@ -0,0 +1,64 @@
+#ifndef _HTTP_RESPONSE_CACHE_H_
+#define _HTTP_RESPONSE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "httpClient.h"
+
+/*
+ * Bodies of GET responses kept by the HTTP session manager for clients that enabled
+ * the cache, keyed by host, port and path. A fresh entry answers a request without
+ * any network traffic. A stale one is revalidated with If-None-Match or
+ * If-Modified-Since and a 304 is answered from the stored body. Freshness comes from
+ * Cache-Control max-age minus Age, or the default of the client when the server
+ * gives none. Only the session task uses it.
+ */
+
+#ifndef HTTP_RESPONSE_CACHE_ENTRIES
+#define HTTP_RESPONSE_CACHE_ENTRIES ( 2u )
+#endif
+
+/* Larger bodies are not cached */
+#ifndef HTTP_RESPONSE_CACHE_BODY_SIZE
+#define HTTP_RESPONSE_CACHE_BODY_SIZE ( 512u )
+#endif
+
+#define HTTP_RESPONSE_CACHE_KEY_SIZE       ( 128u )
+#define HTTP_RESPONSE_CACHE_VALIDATOR_SIZE ( 64u )
+
+/* Upper bound of the freshness, keeps tick differences far from wrapping */
+#define HTTP_RESPONSE_CACHE_MAX_AGE_S ( 7u * 24u * 3600u )
+
+/* Caching information of one response, collected from its headers */
+typedef struct
+{
+    char etag[HTTP_RESPONSE_CACHE_VALIDATOR_SIZE];
+    char lastModified[HTTP_RESPONSE_CACHE_VALIDATOR_SIZE];
+    uint32_t maxAgeS;
+    uint32_t ageS;
+    bool hasMaxAge;  // max-age or no-cache was given
+    bool noStore;
+} tHttpResponseCache_meta;
+
+typedef struct
+{
+    char key[HTTP_RESPONSE_CACHE_KEY_SIZE];
+    char body[HTTP_RESPONSE_CACHE_BODY_SIZE];
+    size_t length;
+    char etag[HTTP_RESPONSE_CACHE_VALIDATOR_SIZE];
+    char lastModified[HTTP_RESPONSE_CACHE_VALIDATOR_SIZE];
+    uint32_t storedTick;  // Of the response or its last revalidation
+    uint32_t maxAgeMs;
+    uint32_t usedTick;    // For the eviction of the least recently used entry
+    bool isValid;
+} tHttpResponseCache_entry;
+
+const tHttpResponseCache_entry *httpResponseCache_find( const tHttpClient_client *client );
+bool httpResponseCache_isFresh( const tHttpResponseCache_entry *entry );
+void httpResponseCache_parseHeader( tHttpResponseCache_meta *meta, const char *name, const char *value );
+void httpResponseCache_store( const tHttpClient_client *client, const tHttpResponseCache_meta *meta, const char *body, size_t length );
+const tHttpResponseCache_entry *httpResponseCache_revalidate( const tHttpClient_client *client, const tHttpResponseCache_meta *meta );
+
+#endif /* _HTTP_RESPONSE_CACHE_H_ */
@@ -0,0 +1,425 @@
+#include "httpResponseParser.h"
+
+#include <ctype.h>
+#include <string.h>
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define HTTP_VERSION_PREFIX        ( "HTTP/1." )
+#define HTTP_VERSION_PREFIX_LENGTH ( 7u )
+#define HTTP_STATUS_CODE_OFFSET    ( 9u )  // "HTTP/1.1 200"
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static size_t feedLine( tHttpResponseParser *parser, const char *data, size_t length );
+static size_t feedBody( tHttpResponseParser *parser, const char *data, size_t length );
+static void handleLine( tHttpResponseParser *parser );
+static void handleStatusLine( tHttpResponseParser *parser );
+static void handleHeader( tHttpResponseParser *parser );
+static void handleHeadersEnd( tHttpResponseParser *parser );
+static void handleChunkSize( tHttpResponseParser *parser );
+static void handleKeepAlive( tHttpResponseParser *parser, const char *value );
+static bool hasToken( const char *value, const char *token );
+static bool parseNumber( const char *text, uint8_t base, size_t *number );
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void httpResponseParser_init( tHttpResponseParser *parser, bool noBody, const tHttpResponseParser_callbacks *callbacks, void *context )
+{
+    static const tHttpResponseParser_callbacks noCallbacks = { 0 };
+
+    memset( parser, 0, sizeof( *parser ) );
+    parser->state = HTTP_RESPONSE_PARSER_STATUS_LINE;
+    parser->noBody = noBody;
+    parser->callbacks = ( NULL != callbacks ) ? callbacks : &noCallbacks;
+    parser->context = context;
+}
+
+/* Returns how much was consumed, less than length only when the response ended or was malformed */
+size_t httpResponseParser_feed( tHttpResponseParser *parser, const char *data, size_t length )
+{
+    size_t consumed = 0;
+
+    while( ( consumed < length ) &&
+           ( HTTP_RESPONSE_PARSER_COMPLETE != parser->state ) && ( HTTP_RESPONSE_PARSER_ERROR != parser->state ) )
+    {
+        if( ( HTTP_RESPONSE_PARSER_BODY == parser->state ) || ( HTTP_RESPONSE_PARSER_CHUNK_DATA == parser->state ) )
+        {
+            consumed += feedBody( parser, data + consumed, length - consumed );
+        }
+        else
+        {
+            consumed += feedLine( parser, data + consumed, length - consumed );
+        }
+    }
+
+    return consumed;
+}
+
+/* The peer closed the connection, which also ends a body without Content-Length */
+bool httpResponseParser_finish( tHttpResponseParser *parser )
+{
+    if( ( HTTP_RESPONSE_PARSER_BODY == parser->state ) && !parser->hasContentLength )
+    {
+        parser->state = HTTP_RESPONSE_PARSER_COMPLETE;
+    }
+
+    return ( HTTP_RESPONSE_PARSER_COMPLETE == parser->state );
+}
+
+bool httpResponseParser_isComplete( const tHttpResponseParser *parser )
+{
+    return ( HTTP_RESPONSE_PARSER_COMPLETE == parser->state );
+}
+
+bool httpResponseParser_hasFailed( const tHttpResponseParser *parser )
+{
+    return ( HTTP_RESPONSE_PARSER_ERROR == parser->state );
+}
+
+/* The connection may carry another request after this response */
+bool httpResponseParser_isPersistent( const tHttpResponseParser *parser )
+{
+    return ( HTTP_RESPONSE_PARSER_COMPLETE == parser->state ) && !parser->connectionClose &&
+           ( ( parser->versionMinor >= 1u ) || parser->connectionKeepAlive );
+}
+
+/* Header names and tokens compare without case, name does not need to end with NUL */
+bool httpResponseParser_isName( const char *name, size_t nameLength, const char *expected )
+{
+    bool result = ( strlen( expected ) == nameLength );
+
+    for( size_t i = 0; result && ( i < nameLength ); i++ )
+    {
+        result = ( tolower( (unsigned char)name[i] ) == tolower( (unsigned char)expected[i] ) );
+    }
+
+    return result;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static size_t feedLine( tHttpResponseParser *parser, const char *data, size_t length )
+{
+    const char *end = memchr( data, '\n', length );
+    size_t taken = ( NULL != end ) ? (size_t)( end - data ) : length;
+    size_t space = HTTP_RESPONSE_PARSER_LINE_SIZE - 1u - parser->lineLength;
+
+    if( ( HTTP_RESPONSE_PARSER_STATUS_LINE == parser->state ) || ( HTTP_RESPONSE_PARSER_HEADERS == parser->state ) )
+    {
+        parser->headerSize += taken + ( ( NULL != end ) ? 1u : 0u );
+        if( parser->headerSize > HTTP_RESPONSE_PARSER_MAX_HEADER_SIZE )
+        {
+            parser->state = HTTP_RESPONSE_PARSER_ERROR;
+            return length;
+        }
+    }
+
+    // Whatever does not fit is dropped, the start of a line is all that is looked at
+    memcpy( parser->line + parser->lineLength, data, ( taken < space ) ? taken : space );
+    parser->lineLength += ( taken < space ) ? taken : space;
+    parser->lineCut = parser->lineCut || ( taken > space );
+
+    if( NULL != end )
+    {
+        if( ( parser->lineLength > 0 ) && ( '\r' == parser->line[parser->lineLength - 1u] ) )
+        {
+            parser->lineLength--;
+        }
+        parser->line[parser->lineLength] = '\0';
+
+        handleLine( parser );
+        parser->lineLength = 0;
+        parser->lineCut = false;
+        taken++;
+    }
+
+    return taken;
+}
+
+static size_t feedBody( tHttpResponseParser *parser, const char *data, size_t length )
+{
+    bool delimited = ( HTTP_RESPONSE_PARSER_CHUNK_DATA == parser->state ) || parser->hasContentLength;
+    size_t taken = ( delimited && ( parser->remaining < length ) ) ? parser->remaining : length;
+
+    if( ( taken > 0 ) && ( NULL != parser->callbacks->body ) )
+    {
+        parser->callbacks->body( data, taken, parser->context );
+    }
+
+    if( delimited )
+    {
+        parser->remaining -= taken;
+
+        if( 0 == parser->remaining )
+        {
+            parser->state = ( HTTP_RESPONSE_PARSER_CHUNK_DATA == parser->state ) ? HTTP_RESPONSE_PARSER_CHUNK_DATA_END
+                                                                                : HTTP_RESPONSE_PARSER_COMPLETE;
+        }
+    }
+
+    return taken;
+}
+
+static void handleLine( tHttpResponseParser *parser )
+{
+    switch( parser->state )
+    {
+        case HTTP_RESPONSE_PARSER_STATUS_LINE:
+            handleStatusLine( parser );
+            break;
+
+        case HTTP_RESPONSE_PARSER_HEADERS:
+            if( 0 == parser->lineLength )
+            {
+                handleHeadersEnd( parser );
+            }
+            else
+            {
+                handleHeader( parser );
+            }
+            break;
+
+        case HTTP_RESPONSE_PARSER_CHUNK_SIZE:
+            handleChunkSize( parser );
+            break;
+
+        case HTTP_RESPONSE_PARSER_CHUNK_DATA_END:
+            parser->state = ( 0 == parser->lineLength ) ? HTTP_RESPONSE_PARSER_CHUNK_SIZE : HTTP_RESPONSE_PARSER_ERROR;
+            break;
+
+        case HTTP_RESPONSE_PARSER_TRAILERS:
+            // Trailer fields are not used
+            if( 0 == parser->lineLength )
+            {
+                parser->state = HTTP_RESPONSE_PARSER_COMPLETE;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void handleStatusLine( tHttpResponseParser *parser )
+{
+    size_t statusCode = 0;
+    char code[4] = { 0 };
+
+    if( 0 == parser->lineLength )
+    {
+        // Tolerated before the status line
+        return;
+    }
+
+    if( ( parser->lineLength < ( HTTP_STATUS_CODE_OFFSET + 3u ) ) ||
+        ( 0 != strncmp( parser->line, HTTP_VERSION_PREFIX, HTTP_VERSION_PREFIX_LENGTH ) ) ||
+        !isdigit( (unsigned char)parser->line[HTTP_VERSION_PREFIX_LENGTH] ) )
+    {
+        parser->state = HTTP_RESPONSE_PARSER_ERROR;
+        return;
+    }
+
+    memcpy( code, parser->line + HTTP_STATUS_CODE_OFFSET, 3u );
+
+    if( !parseNumber( code, 10u, &statusCode ) )
+    {
+        parser->state = HTTP_RESPONSE_PARSER_ERROR;
+        return;
+    }
+
+    parser->versionMinor = (uint8_t)( parser->line[HTTP_VERSION_PREFIX_LENGTH] - '0' );
+    parser->statusCode = (uint16_t)statusCode;
+    parser->chunked = false;
+    parser->hasContentLength = false;
+    parser->connectionClose = false;
+    parser->connectionKeepAlive = false;
+    parser->keepAliveTimeout = 0;
+    parser->keepAliveMax = 0;
+    parser->state = HTTP_RESPONSE_PARSER_HEADERS;
+
+    // An interim response is not reported, the final one follows
+    if( ( statusCode >= 200u ) && ( NULL != parser->callbacks->status ) )
+    {
+        parser->callbacks->status( parser->statusCode, parser->context );
+    }
+}
+
+static void handleHeader( tHttpResponseParser *parser )
+{
+    char *colon = strchr( parser->line, ':' );
+    char *value;
+    size_t nameLength;
+
+    if( parser->lineCut || ( NULL == colon ) )
+    {
+        // Only the start of it is known, a value read from it could be wrong
+        parser->headersCut = true;
+        return;
+    }
+
+    nameLength = (size_t)( colon - parser->line );
+    value = colon + 1;
+    while( ( ' ' == *value ) || ( '\t' == *value ) )
+    {
+        value++;
+    }
+    for( size_t end = strlen( value ); ( end > 0 ) && ( ( ' ' == value[end - 1u] ) || ( '\t' == value[end - 1u] ) ); end-- )
+    {
+        value[end - 1u] = '\0';
+    }
+
+    if( httpResponseParser_isName( parser->line, nameLength, "Content-Length" ) )
+    {
+        parser->hasContentLength = parseNumber( value, 10u, &parser->remaining );
+        if( !parser->hasContentLength )
+        {
+            parser->state = HTTP_RESPONSE_PARSER_ERROR;
+        }
+    }
+    else if( httpResponseParser_isName( parser->line, nameLength, "Transfer-Encoding" ) )
+    {
+        parser->chunked = hasToken( value, "chunked" );
+    }
+    else if( httpResponseParser_isName( parser->line, nameLength, "Connection" ) )
+    {
+        parser->connectionClose = hasToken( value, "close" );
+        parser->connectionKeepAlive = hasToken( value, "keep-alive" );
+    }
+    else if( httpResponseParser_isName( parser->line, nameLength, "Keep-Alive" ) )
+    {
+        handleKeepAlive( parser, value );
+    }
+
+    if( ( parser->statusCode >= 200u ) && ( NULL != parser->callbacks->header ) )
+    {
+        *colon = '\0';
+        parser->callbacks->header( parser->line, value, parser->context );
+    }
+}
+
+static void handleHeadersEnd( tHttpResponseParser *parser )
+{
+    if( ( parser->statusCode >= 100u ) && ( parser->statusCode < 200u ) )
+    {
+        // Interim response, the final one follows
+        parser->headerSize = 0;
+        parser->state = HTTP_RESPONSE_PARSER_STATUS_LINE;
+    }
+    else if( parser->noBody || ( 204u == parser->statusCode ) || ( 304u == parser->statusCode ) )
+    {
+        parser->state = HTTP_RESPONSE_PARSER_COMPLETE;
+    }
+    else if( parser->chunked )
+    {
+        // Chunked wins over Content-Length (RFC 9112, 6.3)
+        parser->hasContentLength = false;
+        parser->state = HTTP_RESPONSE_PARSER_CHUNK_SIZE;
+    }
+    else if( parser->hasContentLength )
+    {
+        parser->state = ( 0 == parser->remaining ) ? HTTP_RESPONSE_PARSER_COMPLETE : HTTP_RESPONSE_PARSER_BODY;
+    }
+    else
+    {
+        // Only the close of the connection ends this body, it cannot be reused
+        parser->connectionClose = true;
+        parser->state = HTTP_RESPONSE_PARSER_BODY;
+    }
+}
+
+static void handleChunkSize( tHttpResponseParser *parser )
+{
+    char *extension = strchr( parser->line, ';' );
+
+    if( NULL != extension )
+    {
+        *extension = '\0';
+    }
+
+    if( !parseNumber( parser->line, 16u, &parser->remaining ) )
+    {
+        parser->state = HTTP_RESPONSE_PARSER_ERROR;
+    }
+    else
+    {
+        parser->state = ( 0 == parser->remaining ) ? HTTP_RESPONSE_PARSER_TRAILERS : HTTP_RESPONSE_PARSER_CHUNK_DATA;
+    }
+}
+
+/* Keep-Alive: timeout=5, max=100 */
+static void handleKeepAlive( tHttpResponseParser *parser, const char *value )
+{
+    char parameter[16];
+    size_t number;
+
+    while( '\0' != *value )
+    {
+        size_t length = strcspn( value, "," );
+        size_t copied = ( length < sizeof( parameter ) ) ? length : ( sizeof( parameter ) - 1u );
+
+        memcpy( parameter, value, copied );
+        parameter[copied] = '\0';
+
+        if( ( 0 == strncmp( parameter, "timeout=", 8u ) ) && parseNumber( parameter + 8, 10u, &number ) )
+        {
+            parser->keepAliveTimeout = (uint32_t)number;
+        }
+        else if( ( 0 == strncmp( parameter, "max=", 4u ) ) && parseNumber( parameter + 4, 10u, &number ) )
+        {
+            parser->keepAliveMax = ( number > UINT16_MAX ) ? UINT16_MAX : (uint16_t)number;
+        }
+
+        value += length;
+        while( ( ',' == *value ) || ( ' ' == *value ) )
+        {
+            value++;
+        }
+    }
+}
+
+/* Comma separated list, compared without case */
+static bool hasToken( const char *value, const char *token )
+{
+    bool result = false;
+
+    while( !result && ( '\0' != *value ) )
+    {
+        size_t length = strcspn( value, ", " );
+
+        result = httpResponseParser_isName( value, length, token );
+        value += length;
+        while( ( ',' == *value ) || ( ' ' == *value ) )
+        {
+            value++;
+        }
+    }
+
+    return result;
+}
+
+/* Digits up to the end of the text or trailing whitespace, anything else or an overflow fails */
+static bool parseNumber( const char *text, uint8_t base, size_t *number )
+{
+    size_t value = 0;
+    bool result = ( 0 != isxdigit( (unsigned char)*text ) );
+
+    for( ; result && ( '\0' != *text ) && ( ' ' != *text ) && ( '\t' != *text ); text++ )
+    {
+        int digit = isdigit( (unsigned char)*text ) ? ( *text - '0' ) : ( tolower( (unsigned char)*text ) - 'a' + 10 );
+
+        result = isxdigit( (unsigned char)*text ) && ( digit < (int)base ) && ( value <= ( ( SIZE_MAX - (size_t)digit ) / base ) );
+        value = value * base + (size_t)digit;
+    }
+
+    if( result )
+    {
+        *number = value;
+    }
+
+    return result;
+}
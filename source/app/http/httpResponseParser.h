@@ -0,0 +1,79 @@
+#ifndef _HTTP_RESPONSE_PARSER_H_
+#define _HTTP_RESPONSE_PARSER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Incremental HTTP/1.x response parser. Data is fed as it comes from the socket, in
+ * pieces of any size. The status, every header and the body with the framing removed
+ * are handed to callbacks as they are parsed, nothing of the body is buffered. The
+ * end of the body is found from Content-Length, chunked encoding or the close of the
+ * connection, so a persistent connection can carry the next response right after.
+ *
+ * Interim 1xx responses are skipped. Header lines longer than
+ * HTTP_RESPONSE_PARSER_LINE_SIZE are not reported (headersCut is set), a header
+ * section longer than HTTP_RESPONSE_PARSER_MAX_HEADER_SIZE fails the response.
+ */
+
+#ifndef HTTP_RESPONSE_PARSER_LINE_SIZE
+#define HTTP_RESPONSE_PARSER_LINE_SIZE ( 128u )
+#endif
+
+#ifndef HTTP_RESPONSE_PARSER_MAX_HEADER_SIZE
+#define HTTP_RESPONSE_PARSER_MAX_HEADER_SIZE ( 4096u )
+#endif
+
+typedef enum
+{
+    HTTP_RESPONSE_PARSER_STATUS_LINE,
+    HTTP_RESPONSE_PARSER_HEADERS,
+    HTTP_RESPONSE_PARSER_BODY,            // Content-Length or until the connection closes
+    HTTP_RESPONSE_PARSER_CHUNK_SIZE,
+    HTTP_RESPONSE_PARSER_CHUNK_DATA,
+    HTTP_RESPONSE_PARSER_CHUNK_DATA_END,  // CRLF after the data of a chunk
+    HTTP_RESPONSE_PARSER_TRAILERS,
+    HTTP_RESPONSE_PARSER_COMPLETE,
+    HTTP_RESPONSE_PARSER_ERROR,
+} tHttpResponseParser_state;
+
+/* Any of them may be NULL */
+typedef struct
+{
+    void ( *status )( uint16_t statusCode, void *context );
+    void ( *header )( const char *name, const char *value, void *context );
+    void ( *body )( const char *data, size_t length, void *context );
+} tHttpResponseParser_callbacks;
+
+typedef struct
+{
+    tHttpResponseParser_state state;
+    char line[HTTP_RESPONSE_PARSER_LINE_SIZE];
+    size_t lineLength;
+    size_t headerSize;           // Of the current header section, status line included
+    size_t remaining;            // Of the body or the current chunk
+    uint32_t keepAliveTimeout;   // Seconds, from the Keep-Alive header, 0 if not given
+    uint16_t keepAliveMax;       // Requests left on the connection, 0 if not given
+    uint16_t statusCode;
+    uint8_t versionMinor;
+    bool noBody;                 // Response to HEAD
+    bool chunked;
+    bool hasContentLength;
+    bool connectionClose;
+    bool connectionKeepAlive;
+    bool lineCut;
+    bool headersCut;             // A header line did not fit and was not reported
+    const tHttpResponseParser_callbacks *callbacks;
+    void *context;
+} tHttpResponseParser;
+
+void httpResponseParser_init( tHttpResponseParser *parser, bool noBody, const tHttpResponseParser_callbacks *callbacks, void *context );
+size_t httpResponseParser_feed( tHttpResponseParser *parser, const char *data, size_t length );
+bool httpResponseParser_finish( tHttpResponseParser *parser );
+bool httpResponseParser_isComplete( const tHttpResponseParser *parser );
+bool httpResponseParser_hasFailed( const tHttpResponseParser *parser );
+bool httpResponseParser_isPersistent( const tHttpResponseParser *parser );
+bool httpResponseParser_isName( const char *name, size_t nameLength, const char *expected );
+
+#endif /* _HTTP_RESPONSE_PARSER_H_ */
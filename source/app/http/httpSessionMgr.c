@@ -6,29 +6,56 @@
 
 #include "cmsis_os.h"
 #include "dns_resolver.h"
+#include "httpBufferPool.h"
+#include "httpConnectionPool.h"
+#include "httpRequestWriter.h"
+#include "httpResponseCache.h"
+#include "httpResponseParser.h"
 #include "logger.h"
 #include "lwip/errno.h"
 #include "lwip/ip_addr.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
 /************************************************************************************
  * PRIVATE MACROS
  ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_HTTP
 #define HTTP_SESION_QUEUE_SIZE ( 5u )
 
+/* Requests in flight at once, each one holds a socket (see MEMP_NUM_NETCONN) */
+#ifndef HTTP_SESSION_SLOTS
+#define HTTP_SESSION_SLOTS ( 3u )
+#endif
+
+/* Requests sent ahead on a persistent connection while the response to the first one is awaited */
+#ifndef HTTP_SESSION_PIPELINE_DEPTH
+#define HTTP_SESSION_PIPELINE_DEPTH ( 2u )
+#endif
+
 #define HTTP_CONNECTION_TIMEOUT_MS ( 5000u )
 #define HTTP_SEND_TIMOEUT_MS       ( 5000u )
 #define HTTP_RECEIVE_TIMEOUT_MS    ( 20000u )
 
+#define HTTP_RECEIVE_CHUNK_SIZE ( 512u )
+
+/* Body provider data is pulled in pieces of this size */
+#define HTTP_REQUEST_CHUNK_SIZE ( 512u )
+
 #define SESSION_STATE( X )                 \
     X( DISCONNECTED_WAIT_FOR_NEW_SESSION ) \
-    X( CONNECTIING )                       \
+    X( RESOLVING_HOST )                    \
     X( WAIT_FOR_CONNECTION )               \
     X( CONNECTED_SENDING_REQUEST )         \
-    X( CONNECTED_WAIT_FOR_RESPONSE )       \
-    X( ERROR_STATE )
+    X( CONNECTED_WAIT_FOR_RESPONSE )
 
 #define SESSION_STATE_ENUM( NAME )   NAME,
 #define SESSION_STATE_STRING( NAME ) #NAME,
 
+/* The idle connections and the wake up socket take more */
+_Static_assert( ( HTTP_SESSION_SLOTS + HTTP_CONNECTION_POOL_SIZE + 1u ) < MEMP_NUM_NETCONN, "Not enough lwIP sockets for the HTTP sessions" );
+_Static_assert( LWIP_NETIF_LOOPBACK, "The wake up datagram needs the loopback interface" );
+_Static_assert( HTTP_SESSION_PIPELINE_DEPTH >= 1u, "A session carries at least one request" );
+
 /************************************************************************************
  * PRIVATE TYPES DECLARATION
  ***********************************************************************************/
@@ -40,48 +67,137 @@ typedef enum
 
 typedef struct
 {
-    osMessageQueueId_t sessionQueue;
-    int socket_fd;
     tHttpClient_client *client;
-    osThreadId_t taskHandler;
+    uint32_t queuedTick;
+} tHttpSessionMgr_request;
+
+/* Kernel ticks of the milestones of a request, for the latency statistics */
+typedef struct
+{
+    uint32_t queued;
+    uint32_t started;
+    uint32_t connected;
+    uint32_t sent;
+    uint32_t firstByte;
+} tHttpSessionMgr_timing;
+
+/* One request and its response on the connection of a session, it owns the buffers leased for the client */
+typedef struct
+{
+    tHttpClient_client *client;
+    tHttpSessionMgr_timing timing;
+    tHttpRequestWriter writer;
+    char *chunkBuffer;  // Only for a body provider
+    char *responseBuffer;
+    bool overflow;     // The body did not fit responseBuffer, the response is reported as an error
+    bool conditional;  // Revalidates a cached response, a 304 is answered from the cache
+} tHttpSessionMgr_exchange;
+
+/* One connection in use, the slot is free in DISCONNECTED_WAIT_FOR_NEW_SESSION */
+typedef struct
+{
+    int socket_fd;
     tHttpSessionMgr_state state;
-    bool isInitalized;
-    bool isConnected;
-    uint32_t errorCode;
+    uint32_t deadline;  // Kernel tick the current state times out at
+    tHttpSessionMgr_exchange exchanges[HTTP_SESSION_PIPELINE_DEPTH];  // Responses come in this order
+    uint8_t exchangeCount;
+    uint8_t sendIndex;          // First exchange whose request is not fully written
+    uint16_t requestsLeft;      // Allowed on the connection by the server, 0 - no limit given
+    uint32_t keepAliveMs;       // Idle timeout of the server, 0 - not given
+    bool reused;                // The connection carried a response before, the server may have dropped it meanwhile
+    bool responseStarted;       // Data of the response to exchanges[0] arrived
+    tHttpResponseParser parser;
+    tHttpResponseCache_meta cacheMeta;  // Of the response to exchanges[0]
+    tDnsResolver_lookup lookup;         // In RESOLVING_HOST, the session has no socket yet
+    uint8_t index;
 } tHttpSessionMgr_session;
 
-typedef void ( *tHttpSessionMgr_stateHandler )( void );
+typedef struct
+{
+    osMessageQueueId_t sessionQueue;
+    osThreadId_t taskHandler;
+    tHttpSessionMgr_request pending[HTTP_SESION_QUEUE_SIZE];  // Taken from the queue, in arrival order
+    uint8_t pendingCount;
+    tHttpSessionMgr_session sessions[HTTP_SESSION_SLOTS];
+    int wakeSocket;             // Readable when a request was queued, so select() also waits for the queue
+    struct udp_pcb *wakePcb;    // Sends the wake up datagrams from the caller side, with the core locked
+    uint16_t wakePort;
+    volatile bool wakePending;    // One datagram is enough until the task drains the socket, set with the core locked
+    volatile bool buffersWanted;  // A block given back by another task wakes the session task for the pending requests
+    bool buffersShort;            // A pending request waits for a free block
+    tHttpSessionMgr_latencyStats stats;
+    bool isInitalized;
+} tHttpSessionMgr;
+
+/* Called when select() reports the socket of the session ready for its state */
+typedef void ( *tHttpSessionMgr_stateHandler )( tHttpSessionMgr_session *session );
 
 /************************************************************************************
  * PRIVATE FUNTCTION DECLERATION
  ***********************************************************************************/
 static void httpSessionTask( void *args );
 
+static bool createWakeSocket( void );
+static void wakeTask( void );
+static void sendWake( void );
+static void drainWakeSocket( void );
+static void bufferReleased( void );
+static void acceptRequests( void );
+static void startPendingSessions( void );
+static void cancelRequests( void );
+static bool takePending( const tHttpClient_client *peer, bool idempotentOnly, tHttpSessionMgr_request *request );
+static void returnPending( const tHttpSessionMgr_request *request );
+static bool hasActiveSessions( void );
+static bool canPipeline( const tHttpSessionMgr_session *session );
+static bool isIdempotent( const tHttpClient_client *client );
+static bool isSameServer( const tHttpClient_client *client, const tHttpClient_client *peer );
+static void waitForEvents( void );
+static void startSession( tHttpSessionMgr_session *session, const tHttpSessionMgr_request *request );
+static bool addExchange( tHttpSessionMgr_session *session, const tHttpSessionMgr_request *request );
+static bool leaseBuffers( tHttpSessionMgr_exchange *exchange );
+static bool fitsBuffers( const tHttpClient_client *client );
+static bool usesCache( const tHttpClient_client *client );
+static bool serveFromCache( const tHttpSessionMgr_request *request );
+static void addCondition( tHttpSessionMgr_exchange *exchange );
+static void updateCache( tHttpSessionMgr_session *session, tHttpSessionMgr_exchange *exchange );
+static void releaseBuffers( tHttpSessionMgr_exchange *exchange );
+static void openConnection( tHttpSessionMgr_session *session );
+static void connectTo( tHttpSessionMgr_session *session, const ip_addr_t *server_ip );
+static void connectionReady( tHttpSessionMgr_session *session );
+static void completeExchange( tHttpSessionMgr_session *session );
+static void failConnection( tHttpSessionMgr_session *session, int errorCode, bool retry );
+static void releaseSession( tHttpSessionMgr_session *session );
+static void finishRequest( tHttpClient_client *client, uint32_t errorCode, char **responseBuffer );
+static void resetResponse( tHttpSessionMgr_session *session );
+static void storeStatus( uint16_t statusCode, void *context );
+static void storeHeader( const char *name, const char *value, void *context );
+static void storeBody( const char *data, size_t length, void *context );
+static void recordLatency( const tHttpSessionMgr_timing *timing, uint8_t index, bool success );
+static void addSample( tHttpSessionMgr_latencyPhase phase, uint32_t from, uint32_t to );
 static void closeSocket( int *socket_fd );
-static void setState( tHttpSessionMgr_state newState );
-static void handleWaitForRequestState( void );
-static void handleConnectingState( void );
-static void handleWaitForConnection( void );
-static void handleSendRequestState( void );
-static void handleWaitForResponse( void );
-static void handleErrorState( void );
+static void setState( tHttpSessionMgr_session *session, tHttpSessionMgr_state newState, uint32_t timeoutMs );
+static void handleResolvingHost( tHttpSessionMgr_session *session );
+static void handleWaitForConnection( tHttpSessionMgr_session *session );
+static void handleSendRequestState( tHttpSessionMgr_session *session );
+static void handleWaitForResponse( tHttpSessionMgr_session *session );
 
 /************************************************************************************
  * PRIVATE VARIABLES DECLERATION
  ***********************************************************************************/
-static tHttpSessionMgr_session m_httpSessionMgr_session;
+static tHttpSessionMgr m_httpSessionMgr;
 
 static const tHttpSessionMgr_stateHandler m_httpSessionMgr_stateMachine[] = {
-    [DISCONNECTED_WAIT_FOR_NEW_SESSION] = handleWaitForRequestState,
-    [CONNECTIING] = handleConnectingState,
+    [DISCONNECTED_WAIT_FOR_NEW_SESSION] = NULL,
+    [RESOLVING_HOST] = handleResolvingHost,
     [WAIT_FOR_CONNECTION] = handleWaitForConnection,
     [CONNECTED_SENDING_REQUEST] = handleSendRequestState,
     [CONNECTED_WAIT_FOR_RESPONSE] = handleWaitForResponse,
-    [ERROR_STATE] = handleErrorState,
 };
 
-static const char *m_httpSessionMgr_requestTypes[] = {
-    HTTP_CLIENT_REQUEST_TYPE( REQUEST_TYPE_STRING )
+static const tHttpResponseParser_callbacks m_httpSessionMgr_parserCallbacks = {
+    .status = storeStatus,
+    .header = storeHeader,
+    .body = storeBody,
 };
 
 static const char *m_httpSessionMgr_sessionStateName[] = {
@@ -93,373 +209,1179 @@ static const char *m_httpSessionMgr_sessionStateName[] = {
  ***********************************************************************************/
 void httpSessionMgr_init( void )
 {
-    if( !m_httpSessionMgr_session.isInitalized )
+    if( !m_httpSessionMgr.isInitalized )
     {
-        m_httpSessionMgr_session.socket_fd = -1;
-        m_httpSessionMgr_session.client = NULL;
-        m_httpSessionMgr_session.isConnected = false;
+        for( uint8_t i = 0; i < HTTP_SESSION_SLOTS; i++ )
+        {
+            m_httpSessionMgr.sessions[i].socket_fd = -1;
+            m_httpSessionMgr.sessions[i].exchangeCount = 0;
+            m_httpSessionMgr.sessions[i].state = DISCONNECTED_WAIT_FOR_NEW_SESSION;
+            m_httpSessionMgr.sessions[i].index = i;
+        }
 
-        m_httpSessionMgr_session.state = DISCONNECTED_WAIT_FOR_NEW_SESSION;
+        httpConnectionPool_init();
+        m_httpSessionMgr.sessionQueue = osMessageQueueNew( HTTP_SESION_QUEUE_SIZE, sizeof( tHttpSessionMgr_request ), NULL );
 
-        m_httpSessionMgr_session.sessionQueue = osMessageQueueNew( HTTP_SESION_QUEUE_SIZE, sizeof( m_httpSessionMgr_session.client ), NULL );
+        if( ( NULL != m_httpSessionMgr.sessionQueue ) && createWakeSocket() )
+        {
+            // A finished query wakes the select() of the sessions resolving their host
+            dnsResolver_setListener( sendWake );
+            // A request waiting for a buffer is tried again when one is given back
+            httpBufferPool_setListener( bufferReleased );
 
-        const osThreadAttr_t attr = {
-            .name = "httpSessionMgr",
-            .priority = (osPriority_t)osPriorityHigh1,
-            .stack_size = 4096
-        };
+            const osThreadAttr_t attr = {
+                .name = "httpSessionMgr",
+                .priority = (osPriority_t)osPriorityHigh1,
+                .stack_size = 4096
+            };
 
-        m_httpSessionMgr_session.taskHandler = osThreadNew( httpSessionTask, NULL, &attr );
-        m_httpSessionMgr_session.isInitalized = true;
+            m_httpSessionMgr.taskHandler = osThreadNew( httpSessionTask, NULL, &attr );
+            m_httpSessionMgr.isInitalized = true;
+        }
+        else
+        {
+            LOG_ERROR( "Failed to create HTTP session queue" );
+        }
     }
 }
 
-void httpSessionMgr_startNewSession( tHttpClient_client *client )
+/* The client is the handle of the request, it must not be changed until httpClient_wait() or a callback reports the end */
+bool httpSessionMgr_startNewSession( tHttpClient_client *client )
 {
-    client->bytesReceived = 0;
-    client->headerReceived = false;
+    bool result = false;
 
-    memset( client->requestBuffer, 0, HTTP_REQUEST_BUFFER_SIZE );
-    memset( client->responseBuffer, 0, HTTP_RESPONSE_BUFFER_SIZE );
-
-    if( ( m_httpSessionMgr_session.isInitalized ) && ( NULL != client ) &&
+    if( ( m_httpSessionMgr.isInitalized ) && ( NULL != client ) &&
         ( client->isInitalized ) && ( NOT_SPECIFIED != client->requestType ) )
     {
-        osMessageQueuePut( m_httpSessionMgr_session.sessionQueue, &client, 0, 0 );
+        tHttpSessionMgr_request request = {
+            .client = client,
+            .queuedTick = osKernelGetTickCount(),
+        };
+
+        if( !httpClient_beginRequest( client ) )
+        {
+            LOG_WARNING( "Request to %s already in progress, duplicate dropped", client->host );
+        }
+        else if( osOK == osMessageQueuePut( m_httpSessionMgr.sessionQueue, &request, 0, 0 ) )
+        {
+            wakeTask();
+            result = true;
+        }
+        else
+        {
+            LOG_WARNING( "Session queue full, request to %s dropped", client->host );
+            client->result.error = (uint32_t)ENOBUFS;
+            httpClient_completeRequest( client, HTTP_CLIENT_REQUEST_FAILED, NULL );
+        }
+    }
+
+    return result;
+}
+
+/* The request ends as HTTP_CLIENT_REQUEST_CANCELLED without callbacks, unless its response is already being delivered */
+void httpSessionMgr_cancel( tHttpClient_client *client )
+{
+    if( ( m_httpSessionMgr.isInitalized ) && ( NULL != client ) && ( HTTP_CLIENT_REQUEST_PENDING == client->requestState ) )
+    {
+        client->cancelRequested = true;
+        wakeTask();
+    }
+}
+
+/* Counters are updated by the session task, a copy taken meanwhile may be off by one request */
+void httpSessionMgr_getLatencyStats( tHttpSessionMgr_latencyStats *stats )
+{
+    if( NULL != stats )
+    {
+        memcpy( stats, &m_httpSessionMgr.stats, sizeof( *stats ) );
     }
 }
 
 /************************************************************************************
  * PRIVATE FUNTCTION DEFINITIONS
  ***********************************************************************************/
-static void setState( tHttpSessionMgr_state newState )
+static void httpSessionTask( void *args )
 {
-    LOG_DEBUG( "State transition: %s -> %s", m_httpSessionMgr_sessionStateName[m_httpSessionMgr_session.state], m_httpSessionMgr_sessionStateName[newState] );
-    m_httpSessionMgr_session.state = newState;
+    LOG_INFO( "Starting HTTP session manager task, %u slots", (unsigned int)HTTP_SESSION_SLOTS );
+
+    while( true )
+    {
+        acceptRequests();
+        cancelRequests();
+        startPendingSessions();
+        waitForEvents();
+    }
 }
 
-static void closeSocket( int *socket_fd )
+static bool createWakeSocket( void )
 {
-    if( *socket_fd >= 0 )
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = 0,
+        .sin_addr.s_addr = PP_HTONL( INADDR_LOOPBACK ),
+    };
+    socklen_t length = sizeof( address );
+    bool result = false;
+
+    m_httpSessionMgr.wakeSocket = socket( AF_INET, SOCK_DGRAM, 0 );
+
+    if( ( m_httpSessionMgr.wakeSocket >= 0 ) &&
+        ( 0 == bind( m_httpSessionMgr.wakeSocket, (struct sockaddr *)&address, sizeof( address ) ) ) &&
+        ( 0 == getsockname( m_httpSessionMgr.wakeSocket, (struct sockaddr *)&address, &length ) ) )
     {
-        close( *socket_fd );
-        *socket_fd = -1;
+        int flags = fcntl( m_httpSessionMgr.wakeSocket, F_GETFL, 0 );
+        fcntl( m_httpSessionMgr.wakeSocket, F_SETFL, flags | O_NONBLOCK );
+
+        m_httpSessionMgr.wakePort = ntohs( address.sin_port );
+
+        LOCK_TCPIP_CORE();
+        m_httpSessionMgr.wakePcb = udp_new();
+        UNLOCK_TCPIP_CORE();
+
+        result = ( NULL != m_httpSessionMgr.wakePcb );
+    }
+
+    if( !result )
+    {
+        LOG_ERROR( "Failed to create the wake up socket" );
+        closeSocket( &m_httpSessionMgr.wakeSocket );
     }
+
+    return result;
+}
+
+/* Runs on the caller, a datagram to the wake up socket ends the select() of the session task */
+static void wakeTask( void )
+{
+    LOCK_TCPIP_CORE();
+    sendWake();
+    UNLOCK_TCPIP_CORE();
 }
 
-static void handleWaitForRequestState( void )
+/* Core locked. Pending only after a datagram went out, after a failure the next request or cancel tries again */
+static void sendWake( void )
 {
-    if( osOK == osMessageQueueGet( m_httpSessionMgr_session.sessionQueue, &m_httpSessionMgr_session.client, NULL, osWaitForever ) )
+    if( !m_httpSessionMgr.wakePending )
     {
-        if( NULL != m_httpSessionMgr_session.client )
+        const ip_addr_t loopback = IPADDR4_INIT( PP_HTONL( IPADDR_LOOPBACK ) );
+        struct pbuf *p = pbuf_alloc( PBUF_TRANSPORT, 1, PBUF_RAM );
+        err_t err = ERR_MEM;
+
+        if( NULL != p )
         {
-            setState( CONNECTIING );
+            *(uint8_t *)p->payload = 0;
+            err = udp_sendto( m_httpSessionMgr.wakePcb, p, &loopback, m_httpSessionMgr.wakePort );
+            pbuf_free( p );
+        }
+
+        m_httpSessionMgr.wakePending = ( ERR_OK == err );
+    }
+}
+
+/* Called from waitForEvents(), the task loop then goes through the request queue, the cancels and the pending requests */
+static void drainWakeSocket( void )
+{
+    uint8_t datagram;
+
+    while( recv( m_httpSessionMgr.wakeSocket, &datagram, sizeof( datagram ), 0 ) > 0 )
+    {
+    }
+
+    // Cleared once the socket is empty, the next request sends a new datagram. One queued before this line
+    // sent none, it is taken by acceptRequests() before the next select()
+    LOCK_TCPIP_CORE();
+    m_httpSessionMgr.wakePending = false;
+    UNLOCK_TCPIP_CORE();
+}
+
+/* Runs on the task giving a block back, never with the core locked. The session task itself tries again before its next select() */
+static void bufferReleased( void )
+{
+    if( m_httpSessionMgr.buffersWanted && ( osThreadGetId() != m_httpSessionMgr.taskHandler ) )
+    {
+        wakeTask();
+    }
+}
+
+static void acceptRequests( void )
+{
+    tHttpSessionMgr_request request;
+    // Nothing to multiplex, sleep on the queue until a request arrives
+    uint32_t timeout = ( hasActiveSessions() || ( m_httpSessionMgr.pendingCount > 0 ) || !httpConnectionPool_isEmpty() ) ? 0 : osWaitForever;
+
+    while( ( m_httpSessionMgr.pendingCount < HTTP_SESION_QUEUE_SIZE ) &&
+           ( osOK == osMessageQueueGet( m_httpSessionMgr.sessionQueue, &request, NULL, timeout ) ) )
+    {
+        if( serveFromCache( &request ) )
+        {
+            // Answered without a session
         }
         else
         {
-            LOG_ERROR( "Received request from NULL client" );
+            m_httpSessionMgr.pending[m_httpSessionMgr.pendingCount++] = request;
         }
+        timeout = 0;
     }
 }
 
-static void handleConnectingState( void )
+/* Stops at the first request whose buffers are all leased, it keeps its place and is tried again when a block is given back */
+static void startPendingSessions( void )
 {
-    tHttpClient_client *client = m_httpSessionMgr_session.client;
-    ip_addr_t server_ip = { 0 };
+    tHttpSessionMgr_request request;
 
-    if( dnsResolver_resolveHostname( client->host, &server_ip ) )
+    // Set before the leases, a block given back meanwhile wakes the task for another try
+    m_httpSessionMgr.buffersWanted = ( m_httpSessionMgr.pendingCount > 0 );
+    m_httpSessionMgr.buffersShort = false;
+
+    for( uint8_t i = 0; !m_httpSessionMgr.buffersShort && ( i < HTTP_SESSION_SLOTS ) && ( m_httpSessionMgr.pendingCount > 0 ); i++ )
     {
-        m_httpSessionMgr_session.socket_fd = socket( AF_INET, SOCK_STREAM, 0 );
-        if( m_httpSessionMgr_session.socket_fd < 0 )
+        tHttpSessionMgr_session *session = &m_httpSessionMgr.sessions[i];
+
+        if( ( DISCONNECTED_WAIT_FOR_NEW_SESSION == session->state ) && takePending( NULL, false, &request ) )
         {
-            LOG_ERROR( "Failed to create socket" );
-            setState( ERROR_STATE );
-            return;
+            startSession( session, &request );
         }
+    }
 
-        // Setting the socket to non-blocking mode
-        int flags = fcntl( m_httpSessionMgr_session.socket_fd, F_GETFL, 0 );
-        fcntl( m_httpSessionMgr_session.socket_fd, F_SETFL, flags | O_NONBLOCK );
+    // Every slot is busy, requests to a server that keeps its connections open are pipelined behind the running ones
+    for( uint8_t i = 0; !m_httpSessionMgr.buffersShort && ( i < HTTP_SESSION_SLOTS ) && ( m_httpSessionMgr.pendingCount > 0 ); i++ )
+    {
+        tHttpSessionMgr_session *session = &m_httpSessionMgr.sessions[i];
 
-        struct sockaddr_in server_addr = {
-            .sin_family = AF_INET,
-            .sin_port = htons( client->port ),
-            .sin_addr.s_addr = server_ip.addr
-        };
+        while( !m_httpSessionMgr.buffersShort && canPipeline( session ) && takePending( session->exchanges[0].client, true, &request ) )
+        {
+            if( addExchange( session, &request ) && ( CONNECTED_WAIT_FOR_RESPONSE == session->state ) )
+            {
+                setState( session, CONNECTED_SENDING_REQUEST, HTTP_SEND_TIMOEUT_MS );
+                handleSendRequestState( session );
+            }
+        }
+    }
 
-        int result = connect( m_httpSessionMgr_session.socket_fd, (struct sockaddr *)&server_addr, sizeof( server_addr ) );
-        if( result == 0 )
+    m_httpSessionMgr.buffersWanted = m_httpSessionMgr.buffersShort;
+}
+
+/* Highest priority first, in arrival order within a priority. With a peer only requests to the same server are taken */
+static bool takePending( const tHttpClient_client *peer, bool idempotentOnly, tHttpSessionMgr_request *request )
+{
+    int8_t best = -1;
+
+    for( uint8_t i = 0; i < m_httpSessionMgr.pendingCount; i++ )
+    {
+        const tHttpClient_client *client = m_httpSessionMgr.pending[i].client;
+
+        if( ( NULL != peer ) && ( !isSameServer( client, peer ) || ( idempotentOnly && !isIdempotent( client ) ) ) )
         {
-            // Connection completed immediately successfully
-            LOG_INFO( "Connected to %s", client->host );
-            m_httpSessionMgr_session.isConnected = true;
-            setState( CONNECTED_SENDING_REQUEST );
+            continue;
         }
-        else if( errno == EINPROGRESS )
+
+        if( ( best < 0 ) || ( client->priority > m_httpSessionMgr.pending[best].client->priority ) )
         {
-            LOG_INFO( "Connection in progress..." );
-            setState( WAIT_FOR_CONNECTION );
+            best = (int8_t)i;
+        }
+    }
+
+    if( best >= 0 )
+    {
+        *request = m_httpSessionMgr.pending[best];
+        m_httpSessionMgr.pendingCount--;
+        memmove( &m_httpSessionMgr.pending[best], &m_httpSessionMgr.pending[best + 1],
+                 ( m_httpSessionMgr.pendingCount - best ) * sizeof( m_httpSessionMgr.pending[0] ) );
+    }
+
+    return ( best >= 0 );
+}
+
+/* Back to its place in arrival order, the pending list has room for the request just taken from it */
+static void returnPending( const tHttpSessionMgr_request *request )
+{
+    uint8_t index = 0;
+
+    while( ( index < m_httpSessionMgr.pendingCount ) &&
+           ( (int32_t)( m_httpSessionMgr.pending[index].queuedTick - request->queuedTick ) <= 0 ) )
+    {
+        index++;
+    }
+
+    memmove( &m_httpSessionMgr.pending[index + 1], &m_httpSessionMgr.pending[index],
+             ( m_httpSessionMgr.pendingCount - index ) * sizeof( m_httpSessionMgr.pending[0] ) );
+    m_httpSessionMgr.pending[index] = *request;
+    m_httpSessionMgr.pendingCount++;
+}
+
+/* Pending requests are dropped, a connection is closed only when it carries nothing else. Pipelined ones end with their response */
+static void cancelRequests( void )
+{
+    for( uint8_t i = 0; i < m_httpSessionMgr.pendingCount; )
+    {
+        tHttpClient_client *client = m_httpSessionMgr.pending[i].client;
+
+        if( client->cancelRequested )
+        {
+            m_httpSessionMgr.pendingCount--;
+            memmove( &m_httpSessionMgr.pending[i], &m_httpSessionMgr.pending[i + 1],
+                     ( m_httpSessionMgr.pendingCount - i ) * sizeof( m_httpSessionMgr.pending[0] ) );
+            finishRequest( client, (uint32_t)ECONNABORTED, NULL );
         }
         else
         {
-            LOG_ERROR( "Connection failed immediately: %d", errno );
-            closeSocket( &m_httpSessionMgr_session.socket_fd );
-            setState( ERROR_STATE );
+            i++;
         }
     }
-    else
+
+    for( uint8_t i = 0; i < HTTP_SESSION_SLOTS; i++ )
+    {
+        tHttpSessionMgr_session *session = &m_httpSessionMgr.sessions[i];
+
+        if( ( DISCONNECTED_WAIT_FOR_NEW_SESSION != session->state ) && ( 1u == session->exchangeCount ) &&
+            session->exchanges[0].client->cancelRequested )
+        {
+            LOG_INFO( "Session %u: request to %s cancelled", (unsigned int)session->index, session->exchanges[0].client->host );
+            failConnection( session, ECONNABORTED, false );
+        }
+    }
+}
+
+static bool hasActiveSessions( void )
+{
+    bool active = false;
+
+    for( uint8_t i = 0; !active && ( i < HTTP_SESSION_SLOTS ); i++ )
+    {
+        active = ( DISCONNECTED_WAIT_FOR_NEW_SESSION != m_httpSessionMgr.sessions[i].state );
+    }
+
+    return active;
+}
+
+/* Only on a connection the server already kept open, and only requests that can be sent again if it drops */
+static bool canPipeline( const tHttpSessionMgr_session *session )
+{
+    bool result = ( ( CONNECTED_SENDING_REQUEST == session->state ) || ( CONNECTED_WAIT_FOR_RESPONSE == session->state ) ) &&
+                  session->reused && ( session->exchangeCount < HTTP_SESSION_PIPELINE_DEPTH ) &&
+                  ( ( 0 == session->requestsLeft ) || ( session->exchangeCount < session->requestsLeft ) );
+
+    for( uint8_t i = 0; result && ( i < session->exchangeCount ); i++ )
     {
-        LOG_ERROR( "DNS resolution failed for %s", client->host );
-        setState( ERROR_STATE );
+        result = isIdempotent( session->exchanges[i].client );
     }
+
+    return result;
 }
 
-static void handleWaitForConnection( void )
+static bool isIdempotent( const tHttpClient_client *client )
 {
-    struct timeval timeout;
-    timeout.tv_sec = HTTP_CONNECTION_TIMEOUT_MS / 1000;
-    timeout.tv_usec = ( HTTP_CONNECTION_TIMEOUT_MS % 1000 ) * 1000;
+    return ( GET == client->requestType ) || ( HEAD == client->requestType );
+}
 
+static bool isSameServer( const tHttpClient_client *client, const tHttpClient_client *peer )
+{
+    return ( client->port == peer->port ) && ( 0 == strcmp( client->host, peer->host ) );
+}
+
+/* One select() over every running session, the idle connections and the wake up socket, then each ready or expired session is advanced */
+static void waitForEvents( void )
+{
+    fd_set read_fds;
     fd_set write_fds;
+    int maxFd = m_httpSessionMgr.wakeSocket;
+    uint32_t now = osKernelGetTickCount();
+    uint32_t waitMs;
+
+    if( !hasActiveSessions() && httpConnectionPool_isEmpty() && !m_httpSessionMgr.buffersShort )
+    {
+        // Back to acceptRequests(), which sleeps on the queue itself. A request waiting for a block needs the wake up socket
+        return;
+    }
+
+    FD_ZERO( &read_fds );
     FD_ZERO( &write_fds );
-    FD_SET( m_httpSessionMgr_session.socket_fd, &write_fds );
+    FD_SET( m_httpSessionMgr.wakeSocket, &read_fds );
+    maxFd = httpConnectionPool_addToSet( &read_fds, maxFd );
+    waitMs = httpConnectionPool_waitTime();
 
-    int result = select( m_httpSessionMgr_session.socket_fd + 1, NULL, &write_fds, NULL, &timeout );
-    if( result > 0 )
+    for( uint8_t i = 0; i < HTTP_SESSION_SLOTS; i++ )
     {
-        if( FD_ISSET( m_httpSessionMgr_session.socket_fd, &write_fds ) )
+        tHttpSessionMgr_session *session = &m_httpSessionMgr.sessions[i];
+        int32_t remaining = (int32_t)( session->deadline - now );
+
+        if( DISCONNECTED_WAIT_FOR_NEW_SESSION == session->state )
         {
-            // Checking the connection status
-            int so_error;
-            socklen_t len = sizeof( so_error );
-            getsockopt( m_httpSessionMgr_session.socket_fd, SOL_SOCKET, SO_ERROR, &so_error, &len );
+            continue;
+        }
 
-            if( so_error == 0 )
-            {
-                LOG_INFO( "Connection established" );
-                m_httpSessionMgr_session.isConnected = true;
-                setState( CONNECTED_SENDING_REQUEST );
-            }
-            else
-            {
-                LOG_ERROR( "Connection failed: %d", so_error );
-                closeSocket( &m_httpSessionMgr_session.socket_fd );
-                setState( ERROR_STATE );
-            }
+        if( RESOLVING_HOST == session->state )
+        {
+            // No socket yet, the resolver sends a wake up datagram when the query ends
+        }
+        else if( CONNECTED_WAIT_FOR_RESPONSE == session->state )
+        {
+            FD_SET( session->socket_fd, &read_fds );
         }
+        else
+        {
+            FD_SET( session->socket_fd, &write_fds );
+        }
+
+        maxFd = ( session->socket_fd > maxFd ) ? session->socket_fd : maxFd;
+        waitMs = ( remaining <= 0 ) ? 0 : ( ( (uint32_t)remaining < waitMs ) ? (uint32_t)remaining : waitMs );
+    }
+
+    struct timeval timeout = {
+        .tv_sec = waitMs / 1000,
+        .tv_usec = ( waitMs % 1000 ) * 1000,
+    };
+    // Only a request waiting for a block and nothing else to watch, no deadline until one is given back
+    int result = select( maxFd + 1, &read_fds, &write_fds, NULL, ( osWaitForever == waitMs ) ? NULL : &timeout );
+
+    if( result < 0 )
+    {
+        LOG_ERROR( "select() error: %d", errno );
     }
-    else if( result == 0 )
+    else if( FD_ISSET( m_httpSessionMgr.wakeSocket, &read_fds ) )
     {
-        // Timeout
-        LOG_ERROR( "Connection timed out" );
-        closeSocket( &m_httpSessionMgr_session.socket_fd );
-        setState( ERROR_STATE );
+        drainWakeSocket();
+    }
+
+    // Before the sessions, a socket handed over to the pool below may still be marked readable
+    httpConnectionPool_process( ( result < 0 ) ? NULL : &read_fds );
+
+    now = osKernelGetTickCount();
+
+    for( uint8_t i = 0; i < HTTP_SESSION_SLOTS; i++ )
+    {
+        tHttpSessionMgr_session *session = &m_httpSessionMgr.sessions[i];
+
+        if( DISCONNECTED_WAIT_FOR_NEW_SESSION == session->state )
+        {
+            continue;
+        }
+
+        if( result < 0 )
+        {
+            failConnection( session, errno, false );
+        }
+        else if( RESOLVING_HOST == session->state )
+        {
+            // Checked on every pass, the lookup fails by itself at its deadline
+            handleResolvingHost( session );
+        }
+        else if( FD_ISSET( session->socket_fd, &read_fds ) || FD_ISSET( session->socket_fd, &write_fds ) )
+        {
+            m_httpSessionMgr_stateMachine[session->state]( session );
+        }
+        else if( (int32_t)( now - session->deadline ) >= 0 )
+        {
+            LOG_ERROR( "Session %u timed out in %s", (unsigned int)session->index, m_httpSessionMgr_sessionStateName[session->state] );
+            failConnection( session, ETIMEDOUT, false );
+        }
+    }
+}
+
+static void startSession( tHttpSessionMgr_session *session, const tHttpSessionMgr_request *request )
+{
+    tHttpClient_client *client = request->client;
+
+    session->exchangeCount = 0;
+    session->sendIndex = 0;
+    session->keepAliveMs = 0;
+
+    if( addExchange( session, request ) )
+    {
+        session->socket_fd = httpConnectionPool_take( client->host, client->port, &session->requestsLeft );
+
+        if( session->socket_fd >= 0 )
+        {
+            LOG_INFO( "Session %u reuses the connection to %s", (unsigned int)session->index, client->host );
+            session->reused = true;
+            resetResponse( session );
+            connectionReady( session );
+        }
+        else
+        {
+            openConnection( session );
+        }
+    }
+}
+
+/* Appends the request to the session. Without a free block it goes back to the pending ones, only one that fits no block class goes to the error callback */
+static bool addExchange( tHttpSessionMgr_session *session, const tHttpSessionMgr_request *request )
+{
+    tHttpSessionMgr_exchange *exchange = &session->exchanges[session->exchangeCount];
+    bool result;
+
+    memset( exchange, 0, sizeof( *exchange ) );
+    exchange->client = request->client;
+    result = leaseBuffers( exchange );
+
+    if( result )
+    {
+        addCondition( exchange );
+        exchange->timing.queued = request->queuedTick;
+        exchange->timing.started = osKernelGetTickCount();
+
+        if( ( CONNECTED_SENDING_REQUEST == session->state ) || ( CONNECTED_WAIT_FOR_RESPONSE == session->state ) )
+        {
+            exchange->timing.connected = exchange->timing.started;
+        }
+
+        session->exchangeCount++;
+    }
+    else if( fitsBuffers( request->client ) )
+    {
+        LOG_DEBUG( "No free buffers for the request to %s, waiting for one", request->client->host );
+        returnPending( request );
+        m_httpSessionMgr.buffersShort = true;
     }
     else
     {
-        LOG_ERROR( "select() error: %d", errno );
-        closeSocket( &m_httpSessionMgr_session.socket_fd );
-        setState( ERROR_STATE );
+        LOG_ERROR( "No buffers for the request to %s", request->client->host );
+        m_httpSessionMgr.stats.failed++;
+        finishRequest( request->client, (uint32_t)ENOBUFS, NULL );
     }
+
+    return result;
 }
 
-static void handleSendRequestState( void )
+/* The request is written from the client itself, only a body provider needs a chunk buffer. The response buffer has the size the client asked for */
+static bool leaseBuffers( tHttpSessionMgr_exchange *exchange )
 {
-    if( m_httpSessionMgr_session.isConnected )
+    tHttpClient_client *client = exchange->client;
+    size_t size = 0;
+    bool result = true;
+
+    if( httpRequestWriter_needsChunkBuffer( client ) )
+    {
+        exchange->chunkBuffer = httpBufferPool_lease( HTTP_REQUEST_CHUNK_SIZE, &size );
+        result = ( NULL != exchange->chunkBuffer );
+    }
+
+    if( result )
+    {
+        httpRequestWriter_init( &exchange->writer, client, exchange->chunkBuffer, size );
+
+        if( NULL == client->bodyCallback )
+        {
+            // The terminating zero is inside the block, a default sized request takes a block of its class
+            exchange->responseBuffer = httpBufferPool_lease( client->responseSize, &size );
+            result = ( NULL != exchange->responseBuffer );
+            client->responseBuffer = exchange->responseBuffer;
+            client->responseBufferSize = size;
+        }
+    }
+
+    if( !result )
+    {
+        releaseBuffers( exchange );
+    }
+
+    return result;
+}
+
+/* The buffers leaseBuffers() needs exist in the pool, they may just be leased right now */
+static bool fitsBuffers( const tHttpClient_client *client )
+{
+    return ( !httpRequestWriter_needsChunkBuffer( client ) || httpBufferPool_fits( HTTP_REQUEST_CHUNK_SIZE ) ) &&
+           ( ( NULL != client->bodyCallback ) || httpBufferPool_fits( client->responseSize ) );
+}
+
+/* Only buffered GET responses, a streamed body is never held in one piece */
+static bool usesCache( const tHttpClient_client *client )
+{
+    return client->useCache && ( GET == client->requestType ) && ( NULL == client->bodyCallback );
+}
+
+/* A fresh cached response goes to the client right away, with status 200 and without headers */
+static bool serveFromCache( const tHttpSessionMgr_request *request )
+{
+    tHttpClient_client *client = request->client;
+    const tHttpResponseCache_entry *entry = usesCache( client ) ? httpResponseCache_find( client ) : NULL;
+    char *buffer = NULL;
+    size_t size = 0;
+
+    if( httpResponseCache_isFresh( entry ) && ( entry->length < client->responseSize ) )
+    {
+        buffer = httpBufferPool_lease( client->responseSize, &size );
+    }
+
+    if( NULL != buffer )
     {
-        tHttpClient_client *client = m_httpSessionMgr_session.client;
+        LOG_DEBUG( "Response of %s%s served from the cache", client->host, client->path );
+
+        memcpy( buffer, entry->body, entry->length );
+        buffer[entry->length] = '\0';
+        client->responseBuffer = buffer;
+        client->responseBufferSize = size;
+        client->bytesReceived = entry->length;
+        client->statusCode = 200u;
+        m_httpSessionMgr.stats.cacheHits++;
+
+        finishRequest( client, 0, &buffer );
+        httpBufferPool_release( buffer );
+        return true;
+    }
 
-        size_t requestLength = snprintf( client->requestBuffer, HTTP_REQUEST_BUFFER_SIZE,
-                                         "%s %s HTTP/1.1\r\n"
-                                         "Host: %s\r\n"
-                                         "Accept: */*\r\n"
-                                         "Connection: close\r\n"
-                                         "\r\n",
-                                         m_httpSessionMgr_requestTypes[client->requestType],
-                                         client->path, client->host );
+    return false;
+}
 
-        size_t totalSent = 0;
+/* A stale cached response is revalidated, the ETag is preferred as it is exact */
+static void addCondition( tHttpSessionMgr_exchange *exchange )
+{
+    const tHttpResponseCache_entry *entry = usesCache( exchange->client ) ? httpResponseCache_find( exchange->client ) : NULL;
 
-        while( totalSent < requestLength )
+    if( NULL != entry )
+    {
+        if( '\0' != entry->etag[0] )
         {
-            struct timeval timeout;
-            timeout.tv_sec = HTTP_SEND_TIMOEUT_MS / 1000;
-            timeout.tv_usec = ( HTTP_SEND_TIMOEUT_MS % 1000 ) * 1000;
+            httpRequestWriter_setCondition( &exchange->writer, "If-None-Match", entry->etag );
+        }
+        else if( '\0' != entry->lastModified[0] )
+        {
+            httpRequestWriter_setCondition( &exchange->writer, "If-Modified-Since", entry->lastModified );
+        }
 
-            fd_set write_fds;
-            FD_ZERO( &write_fds );
-            FD_SET( m_httpSessionMgr_session.socket_fd, &write_fds );
+        exchange->conditional = ( '\0' != exchange->writer.conditionText[0] );
+    }
+}
 
-            int result = select( m_httpSessionMgr_session.socket_fd + 1, NULL, &write_fds, NULL, &timeout );
-            if( result > 0 )
-            {
-                if( FD_ISSET( m_httpSessionMgr_session.socket_fd, &write_fds ) )
-                {
-                    ssize_t sent = send( m_httpSessionMgr_session.socket_fd,
-                                         client->requestBuffer + totalSent,
-                                         requestLength - totalSent,
-                                         0 );
-
-                    if( sent > 0 )
-                    {
-                        totalSent += sent;
-                    }
-                    else if( sent < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
-                    {
-                        // Buffor is full, try again
-                        continue;
-                    }
-                    else
-                    {
-                        LOG_ERROR( "Failed to send request: %d", errno );
-                        closeSocket( &m_httpSessionMgr_session.socket_fd );
-                        setState( ERROR_STATE );
-                        return;
-                    }
-                }
-            }
-            else if( result == 0 )
-            {
-                // Timeout
-                LOG_ERROR( "Send timeout" );
-                closeSocket( &m_httpSessionMgr_session.socket_fd );
-                setState( ERROR_STATE );
-                return;
-            }
-            else
-            {
-                // select() error
-                LOG_ERROR( "select() failed: %d", errno );
-                closeSocket( &m_httpSessionMgr_session.socket_fd );
-                setState( ERROR_STATE );
-                return;
-            }
+/* A 200 is stored, a 304 to a conditional request gets the cached body as if it was a 200 */
+static void updateCache( tHttpSessionMgr_session *session, tHttpSessionMgr_exchange *exchange )
+{
+    tHttpClient_client *client = exchange->client;
+
+    if( ( 304u == client->statusCode ) && exchange->conditional )
+    {
+        const tHttpResponseCache_entry *entry = httpResponseCache_revalidate( client, &session->cacheMeta );
+
+        if( ( NULL != entry ) && ( entry->length < client->responseBufferSize ) )
+        {
+            LOG_DEBUG( "Response of %s%s not modified, served from the cache", client->host, client->path );
+            memcpy( client->responseBuffer, entry->body, entry->length );
+            client->bytesReceived = entry->length;
+            client->statusCode = 200u;
+        }
+        else
+        {
+            LOG_WARNING( "Cached response of %s%s is gone, 304 passed on", client->host, client->path );
         }
+    }
+    else if( 200u == client->statusCode )
+    {
+        httpResponseCache_store( client, &session->cacheMeta, client->responseBuffer, client->bytesReceived );
+    }
+}
+
+/* The client may be gone already, only the exchange knows the buffers */
+static void releaseBuffers( tHttpSessionMgr_exchange *exchange )
+{
+    httpBufferPool_release( exchange->chunkBuffer );
+    httpBufferPool_release( exchange->responseBuffer );
+    exchange->chunkBuffer = NULL;
+    exchange->responseBuffer = NULL;
+}
+
+/* New TCP connection for the exchanges of the session, all of them are sent from the start. The host is resolved without blocking */
+static void openConnection( tHttpSessionMgr_session *session )
+{
+    tHttpClient_client *client = session->exchanges[0].client;
+    ip_addr_t server_ip = { 0 };
+
+    session->reused = false;
+    session->requestsLeft = 0;
+    session->sendIndex = 0;
 
-        LOG_INFO( "Request sent successfully" );
-        setState( CONNECTED_WAIT_FOR_RESPONSE );
+    for( uint8_t i = 0; i < session->exchangeCount; i++ )
+    {
+        httpRequestWriter_rewind( &session->exchanges[i].writer );
+        session->exchanges[i].timing.connected = 0;
+        session->exchanges[i].timing.sent = 0;
     }
-    else
+
+    resetResponse( session );
+
+    switch( dnsResolver_startLookup( &session->lookup, client->host, &server_ip ) )
     {
-        setState( DISCONNECTED_WAIT_FOR_NEW_SESSION );
+        case DNS_LOOKUP_DONE:
+            connectTo( session, &server_ip );
+            break;
+
+        case DNS_LOOKUP_WAIT:
+            setState( session, RESOLVING_HOST, DNS_RESOLVER_QUERY_TIMEOUT_MS );
+            break;
+
+        default:
+            LOG_ERROR( "DNS resolution failed for %s", client->host );
+            failConnection( session, EHOSTUNREACH, false );
+            break;
     }
 }
 
-static void handleWaitForResponse( void )
+static void connectTo( tHttpSessionMgr_session *session, const ip_addr_t *server_ip )
 {
-    tHttpClient_client *client = m_httpSessionMgr_session.client;
-    char buffer[512];
-    ssize_t received = 0;
-    size_t totalReceived = 0;
+    tHttpClient_client *client = session->exchanges[0].client;
 
-    while( true )
+    session->socket_fd = socket( AF_INET, SOCK_STREAM, 0 );
+    if( session->socket_fd < 0 )
     {
-        struct timeval timeout;
-        timeout.tv_sec = HTTP_RECEIVE_TIMEOUT_MS / 1000;
-        timeout.tv_usec = ( HTTP_RECEIVE_TIMEOUT_MS % 1000 ) * 1000;
+        LOG_ERROR( "Failed to create socket" );
+        failConnection( session, errno, false );
+        return;
+    }
 
-        fd_set read_fds;
-        FD_ZERO( &read_fds );
-        FD_SET( m_httpSessionMgr_session.socket_fd, &read_fds );
+    // Setting the socket to non-blocking mode
+    int flags = fcntl( session->socket_fd, F_GETFL, 0 );
+    fcntl( session->socket_fd, F_SETFL, flags | O_NONBLOCK );
 
-        int result = select( m_httpSessionMgr_session.socket_fd + 1, &read_fds, NULL, NULL, &timeout );
-        if( result > 0 )
+    struct sockaddr_in server_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons( client->port ),
+        .sin_addr.s_addr = server_ip->addr
+    };
+
+    int result = connect( session->socket_fd, (struct sockaddr *)&server_addr, sizeof( server_addr ) );
+    if( result == 0 )
+    {
+        // Connection completed immediately successfully
+        LOG_INFO( "Session %u connected to %s", (unsigned int)session->index, client->host );
+        connectionReady( session );
+    }
+    else if( errno == EINPROGRESS )
+    {
+        LOG_DEBUG( "Session %u connecting to %s", (unsigned int)session->index, client->host );
+        setState( session, WAIT_FOR_CONNECTION, HTTP_CONNECTION_TIMEOUT_MS );
+    }
+    else
+    {
+        LOG_ERROR( "Connection failed immediately: %d", errno );
+        failConnection( session, errno, false );
+    }
+}
+
+static void connectionReady( tHttpSessionMgr_session *session )
+{
+    uint32_t now = osKernelGetTickCount();
+
+    for( uint8_t i = 0; i < session->exchangeCount; i++ )
+    {
+        if( 0 == session->exchanges[i].timing.connected )
         {
-            if( FD_ISSET( m_httpSessionMgr_session.socket_fd, &read_fds ) )
-            {
-                received = recv( m_httpSessionMgr_session.socket_fd, buffer, sizeof( buffer ) - 1, 0 );
-                if( received > 0 )
-                {
-                    buffer[received] = '\0';  // Null-terminate for logging/debugging
-                    if( !client->headerReceived )
-                    {
-                        char *body_start = strstr( buffer, "\r\n\r\n" );
-                        if( body_start != NULL )
-                        {
-                            client->headerReceived = true;
-                            body_start += 4;
-
-                            size_t body_len = received - ( body_start - buffer );
-                            memcpy( client->responseBuffer, body_start, body_len );
-                            totalReceived += body_len;
-                        }
-                    }
-                    else
-                    {
-                        memcpy( client->responseBuffer + totalReceived, buffer, received );
-                        totalReceived += received;
-                    }
-                }
-                else if( received == 0 )
-                {
-                    LOG_DEBUG( "Connection closed by peer" );
-                    break;
-                }
-                else if( errno == EAGAIN || errno == EWOULDBLOCK )
-                {
-                    // Wait for data
-                    continue;
-                }
-                else
-                {
-                    LOG_ERROR( "recv() failed: %d", errno );
-                    setState( ERROR_STATE );
-                    return;
-                }
-            }
+            session->exchanges[i].timing.connected = now;
         }
-        else if( result == 0 )
+    }
+
+    setState( session, CONNECTED_SENDING_REQUEST, HTTP_SEND_TIMOEUT_MS );
+
+    // A fresh connection has room in its send buffer, no need to wait for select()
+    handleSendRequestState( session );
+}
+
+/* The response to exchanges[0] is complete, the connection goes on with the next request, to the pool or is closed */
+static void completeExchange( tHttpSessionMgr_session *session )
+{
+    tHttpSessionMgr_exchange done = session->exchanges[0];
+    tHttpClient_client *client = done.client;
+    tHttpSessionMgr_request request;
+    bool persistent = httpResponseParser_isPersistent( &session->parser );
+
+    if( usesCache( client ) && !done.overflow )
+    {
+        updateCache( session, &done );
+    }
+
+    if( NULL == client->bodyCallback )
+    {
+        client->responseBuffer[client->bytesReceived] = '\0';
+        LOG_DEBUG( "Response fully received:\n%s\n", client->responseBuffer );
+    }
+
+    session->exchangeCount--;
+    session->sendIndex--;
+    memmove( &session->exchanges[0], &session->exchanges[1], session->exchangeCount * sizeof( session->exchanges[0] ) );
+
+    session->reused = true;
+    session->requestsLeft = session->parser.keepAliveMax;
+    session->keepAliveMs = session->parser.keepAliveTimeout * 1000u;
+
+    if( !persistent )
+    {
+        closeSocket( &session->socket_fd );
+
+        if( session->exchangeCount > 0 )
         {
-            // Timeout
-            LOG_ERROR( "Response timeout" );
-            setState( ERROR_STATE );
-            return;
+            LOG_DEBUG( "Session %u: connection closed by server, %u requests sent again", (unsigned int)session->index,
+                       (unsigned int)session->exchangeCount );
+            openConnection( session );
         }
         else
         {
-            // select() error
-            LOG_ERROR( "select() failed: %d", errno );
-            setState( ERROR_STATE );
-            return;
+            releaseSession( session );
         }
     }
+    else if( session->exchangeCount > 0 )
+    {
+        resetResponse( session );
+    }
+    else if( takePending( client, false, &request ) && addExchange( session, &request ) )
+    {
+        // Straight on with the next request to the same server
+        resetResponse( session );
+        setState( session, CONNECTED_SENDING_REQUEST, HTTP_SEND_TIMOEUT_MS );
+        handleSendRequestState( session );
+    }
+    else
+    {
+        httpConnectionPool_give( session->socket_fd, client->host, client->port, session->keepAliveMs, session->requestsLeft );
+        session->socket_fd = -1;
+        releaseSession( session );
+    }
+
+    recordLatency( &done.timing, session->index, !done.overflow );
+    finishRequest( client, done.overflow ? (uint32_t)EMSGSIZE : 0u, &done.responseBuffer );
+    releaseBuffers( &done );
+}
+
+/* With retry, requests on a connection that carried a response before are sent again on a new one */
+static void failConnection( tHttpSessionMgr_session *session, int errorCode, bool retry )
+{
+    tHttpSessionMgr_exchange failed[HTTP_SESSION_PIPELINE_DEPTH];
+    uint8_t count = session->exchangeCount;
+    bool idempotent = true;
+
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        idempotent = idempotent && isIdempotent( session->exchanges[i].client );
+    }
+
+    closeSocket( &session->socket_fd );
+
+    if( retry && session->reused && idempotent && ( count > 0 ) )
+    {
+        LOG_WARNING( "Connection to %s dropped (%d), retrying on a new one", session->exchanges[0].client->host, errorCode );
+        openConnection( session );
+        return;
+    }
 
-    LOG_DEBUG( "Response fully received:\n%s\n", client->responseBuffer );
-    client->responseBuffer[totalReceived] = '\0';
-    client->bytesReceived = totalReceived;
-    client->responseCallback( client->responseBuffer, client->bytesReceived );
+    memcpy( failed, session->exchanges, count * sizeof( failed[0] ) );
+    releaseSession( session );
 
-    closeSocket( &m_httpSessionMgr_session.socket_fd );
-    m_httpSessionMgr_session.isConnected = false;
-    setState( DISCONNECTED_WAIT_FOR_NEW_SESSION );
+    for( uint8_t i = 0; i < count; i++ )
+    {
+        recordLatency( &failed[i].timing, session->index, false );
+        finishRequest( failed[i].client, (uint32_t)errorCode, NULL );
+        releaseBuffers( &failed[i] );
+    }
 }
 
-static void handleErrorState( void )
+static void releaseSession( tHttpSessionMgr_session *session )
 {
-    LOG_ERROR( "An error occurred. Returning to wait state." );
+    // A cancelled or failed session may still wait for its host
+    dnsResolver_cancelLookup( &session->lookup );
+    closeSocket( &session->socket_fd );
+    session->exchangeCount = 0;
+    session->sendIndex = 0;
+    setState( session, DISCONNECTED_WAIT_FOR_NEW_SESSION, 0 );
+}
 
-    if( m_httpSessionMgr_session.socket_fd >= 0 )
+/* Every request ends here once. The callbacks run while it is still pending, a client deleted in them is freed right after */
+static void finishRequest( tHttpClient_client *client, uint32_t errorCode, char **responseBuffer )
+{
+    bool cancelled = client->cancelRequested;
+    tHttpClient_requestState state = cancelled ? HTTP_CLIENT_REQUEST_CANCELLED : ( ( 0u == errorCode ) ? HTTP_CLIENT_REQUEST_DONE : HTTP_CLIENT_REQUEST_FAILED );
+    bool keepBody;
+
+    if( !cancelled && ( 0u == errorCode ) && ( NULL != client->responseCallback ) )
+    {
+        client->responseCallback( ( NULL == client->bodyCallback ) ? client->responseBuffer : NULL, client->bytesReceived );
+    }
+    else if( !cancelled && ( 0u != errorCode ) && ( NULL != client->errorCallback ) )
     {
-        closeSocket( &m_httpSessionMgr_session.socket_fd );
+        client->errorCallback( errorCode );
     }
 
-    if( m_httpSessionMgr_session.client != NULL && m_httpSessionMgr_session.client->errorCallback != NULL )
+    client->result.statusCode = client->statusCode;
+    client->result.bodyLength = client->bytesReceived;
+    client->result.error = cancelled ? (uint32_t)ECONNABORTED : errorCode;
+
+    // Without callbacks the body stays with the client for httpClient_getResult(), otherwise the caller releases it
+    keepBody = ( HTTP_CLIENT_REQUEST_DONE == state ) && ( NULL == client->responseCallback ) && ( NULL == client->bodyCallback );
+
+    httpClient_completeRequest( client, state, keepBody ? responseBuffer : NULL );
+}
+
+/* Gets the parser ready for the response to exchanges[0] */
+static void resetResponse( tHttpSessionMgr_session *session )
+{
+    tHttpClient_client *client = session->exchanges[0].client;
+
+    session->responseStarted = false;
+    memset( &session->cacheMeta, 0, sizeof( session->cacheMeta ) );
+
+    if( session->exchangeCount > 0 )
     {
-        int errorCode = ( errno != 0 ) ? errno : -1;
-        m_httpSessionMgr_session.client->errorCallback( errorCode );
+        client->bytesReceived = 0;
+        client->statusCode = 0;
+        session->exchanges[0].overflow = false;
+        httpResponseParser_init( &session->parser, ( HEAD == client->requestType ), &m_httpSessionMgr_parserCallbacks, session );
     }
+}
 
-    m_httpSessionMgr_session.isConnected = false;
-    setState( DISCONNECTED_WAIT_FOR_NEW_SESSION );
+static void storeStatus( uint16_t statusCode, void *context )
+{
+    tHttpClient_client *client = ( (tHttpSessionMgr_session *)context )->exchanges[0].client;
+
+    LOG_DEBUG( "Status %u from %s", (unsigned int)statusCode, client->host );
+    client->statusCode = statusCode;
 }
 
-static void httpSessionTask( void *args )
+static void storeHeader( const char *name, const char *value, void *context )
 {
-    LOG_INFO( "Starting HTTP session manager task" );
+    tHttpSessionMgr_session *session = (tHttpSessionMgr_session *)context;
+    tHttpClient_client *client = session->exchanges[0].client;
 
-    while( true )
+    if( usesCache( client ) )
+    {
+        httpResponseCache_parseHeader( &session->cacheMeta, name, value );
+    }
+
+    if( ( NULL != client->headerCallback ) && !client->cancelRequested )
+    {
+        client->headerCallback( client->statusCode, name, value, client->streamContext );
+    }
+}
+
+/* Streamed to the client, or collected in responseBuffer which is never written past its end */
+static void storeBody( const char *data, size_t length, void *context )
+{
+    tHttpSessionMgr_exchange *exchange = &( (tHttpSessionMgr_session *)context )->exchanges[0];
+    tHttpClient_client *client = exchange->client;
+
+    if( NULL != client->bodyCallback )
+    {
+        if( !client->cancelRequested )
+        {
+            client->bodyCallback( data, length, client->streamContext );
+        }
+        client->bytesReceived += length;
+    }
+    else if( exchange->overflow || ( length > ( client->responseBufferSize - 1u - client->bytesReceived ) ) )
+    {
+        // The rest is still parsed so the connection stays usable
+        if( !exchange->overflow )
+        {
+            LOG_WARNING( "Response from %s does not fit %u bytes", client->host, (unsigned int)client->responseBufferSize - 1u );
+        }
+        exchange->overflow = true;
+    }
+    else
+    {
+        memcpy( client->responseBuffer + client->bytesReceived, data, length );
+        client->bytesReceived += length;
+    }
+}
+
+static void recordLatency( const tHttpSessionMgr_timing *timing, uint8_t index, bool success )
+{
+    uint32_t now = osKernelGetTickCount();
+
+    addSample( HTTP_LATENCY_QUEUED, timing->queued, timing->started );
+
+    // Phases a failed request did not reach are left out
+    if( 0 != timing->connected )
+    {
+        addSample( HTTP_LATENCY_CONNECT, timing->started, timing->connected );
+    }
+    if( 0 != timing->sent )
+    {
+        addSample( HTTP_LATENCY_SEND, timing->connected, timing->sent );
+    }
+    if( 0 != timing->firstByte )
+    {
+        addSample( HTTP_LATENCY_FIRST_BYTE, timing->sent, timing->firstByte );
+    }
+    addSample( HTTP_LATENCY_TOTAL, timing->queued, now );
+
+    if( success )
+    {
+        m_httpSessionMgr.stats.completed++;
+    }
+    else
+    {
+        m_httpSessionMgr.stats.failed++;
+    }
+
+    LOG_DEBUG( "Session %u %s in %u ms: queued %u, connect %u, send %u, first byte %u", (unsigned int)index,
+               success ? "done" : "failed", (unsigned int)( now - timing->queued ), (unsigned int)( timing->started - timing->queued ),
+               (unsigned int)( ( 0 != timing->connected ) ? ( timing->connected - timing->started ) : 0 ),
+               (unsigned int)( ( 0 != timing->sent ) ? ( timing->sent - timing->connected ) : 0 ),
+               (unsigned int)( ( 0 != timing->firstByte ) ? ( timing->firstByte - timing->sent ) : 0 ) );
+}
+
+/* Bucket 0 - below 1 ms, bucket n - [2^(n-1), 2^n) ms, the last one is open ended */
+static void addSample( tHttpSessionMgr_latencyPhase phase, uint32_t from, uint32_t to )
+{
+    uint32_t elapsedMs = to - from;
+    uint32_t bucket = ( 0 == elapsedMs ) ? 0 : ( 32u - (uint32_t)__builtin_clz( elapsedMs ) );
+
+    if( bucket >= HTTP_SESSION_LATENCY_BUCKETS )
+    {
+        bucket = HTTP_SESSION_LATENCY_BUCKETS - 1u;
+    }
+
+    m_httpSessionMgr.stats.histogram[phase][bucket]++;
+}
+
+static void closeSocket( int *socket_fd )
+{
+    if( *socket_fd >= 0 )
+    {
+        close( *socket_fd );
+        *socket_fd = -1;
+    }
+}
+
+static void setState( tHttpSessionMgr_session *session, tHttpSessionMgr_state newState, uint32_t timeoutMs )
+{
+    LOG_DEBUG( "Session %u: %s -> %s", (unsigned int)session->index,
+               m_httpSessionMgr_sessionStateName[session->state], m_httpSessionMgr_sessionStateName[newState] );
+    session->state = newState;
+    session->deadline = osKernelGetTickCount() + timeoutMs;
+}
+
+static void handleResolvingHost( tHttpSessionMgr_session *session )
+{
+    tHttpClient_client *client = session->exchanges[0].client;
+    ip_addr_t server_ip = { 0 };
+
+    switch( dnsResolver_checkLookup( &session->lookup, &server_ip ) )
+    {
+        case DNS_LOOKUP_DONE:
+            connectTo( session, &server_ip );
+            break;
+
+        case DNS_LOOKUP_WAIT:
+            break;
+
+        default:
+            LOG_ERROR( "DNS resolution failed for %s", client->host );
+            failConnection( session, EHOSTUNREACH, false );
+            break;
+    }
+}
+
+static void handleWaitForConnection( tHttpSessionMgr_session *session )
+{
+    // Checking the connection status
+    int so_error;
+    socklen_t len = sizeof( so_error );
+    getsockopt( session->socket_fd, SOL_SOCKET, SO_ERROR, &so_error, &len );
+
+    if( so_error == 0 )
+    {
+        LOG_INFO( "Session %u connected to %s", (unsigned int)session->index, session->exchanges[0].client->host );
+        connectionReady( session );
+    }
+    else
+    {
+        LOG_ERROR( "Connection failed: %d", so_error );
+        failConnection( session, so_error, false );
+    }
+}
+
+/* Writes the requests not sent yet in order, pipelined ones included */
+static void handleSendRequestState( tHttpSessionMgr_session *session )
+{
+    bool blocked = false;
+
+    while( !blocked && ( session->sendIndex < session->exchangeCount ) )
+    {
+        tHttpSessionMgr_exchange *exchange = &session->exchanges[session->sendIndex];
+        tHttpRequestWriter_result result = httpRequestWriter_write( &exchange->writer, session->socket_fd );
+
+        if( HTTP_REQUEST_WRITER_DONE == result )
+        {
+            LOG_INFO( "Request sent successfully" );
+            exchange->timing.sent = osKernelGetTickCount();
+            session->sendIndex++;
+        }
+        else if( HTTP_REQUEST_WRITER_BLOCKED == result )
+        {
+            // Buffor is full, wait for the next select()
+            blocked = true;
+        }
+        else
+        {
+            // An idle connection the server dropped only shows up here
+            LOG_ERROR( "Failed to send request: %d", exchange->writer.error );
+            failConnection( session, exchange->writer.error, true );
+            return;
+        }
+    }
+
+    if( !blocked )
+    {
+        setState( session, CONNECTED_WAIT_FOR_RESPONSE, HTTP_RECEIVE_TIMEOUT_MS );
+    }
+}
+
+static void handleWaitForResponse( tHttpSessionMgr_session *session )
+{
+    char buffer[HTTP_RECEIVE_CHUNK_SIZE];
+    ssize_t received = recv( session->socket_fd, buffer, sizeof( buffer ), 0 );
+
+    if( received > 0 )
+    {
+        size_t offset = 0;
+
+        // The receive timeout counts from the last data
+        session->deadline = osKernelGetTickCount() + HTTP_RECEIVE_TIMEOUT_MS;
+
+        while( ( offset < (size_t)received ) && ( CONNECTED_WAIT_FOR_RESPONSE == session->state ) )
+        {
+            if( !session->responseStarted )
+            {
+                session->responseStarted = true;
+                session->exchanges[0].timing.firstByte = osKernelGetTickCount();
+            }
+
+            offset += httpResponseParser_feed( &session->parser, buffer + offset, (size_t)received - offset );
+
+            if( httpResponseParser_isComplete( &session->parser ) )
+            {
+                if( ( offset < (size_t)received ) && ( 1u == session->exchangeCount ) )
+                {
+                    // More data than was asked for, the connection is out of step
+                    session->parser.connectionClose = true;
+                }
+                completeExchange( session );
+            }
+            else if( httpResponseParser_hasFailed( &session->parser ) )
+            {
+                LOG_ERROR( "Malformed response from %s", session->exchanges[0].client->host );
+                failConnection( session, EPROTO, false );
+            }
+        }
+    }
+    else if( received == 0 )
+    {
+        LOG_DEBUG( "Connection closed by peer" );
+
+        if( session->responseStarted && httpResponseParser_finish( &session->parser ) )
+        {
+            completeExchange( session );
+        }
+        else
+        {
+            // Nothing of the response yet, the server may have dropped a connection it kept open
+            failConnection( session, ECONNRESET, !session->responseStarted );
+        }
+    }
+    else if( errno == EAGAIN || errno == EWOULDBLOCK )
+    {
+        // Wait for data
+    }
+    else
     {
-        m_httpSessionMgr_stateMachine[m_httpSessionMgr_session.state]();
-        osDelay( 100 );
+        LOG_ERROR( "recv() failed: %d", errno );
+        failConnection( session, errno, !session->responseStarted );
     }
 }
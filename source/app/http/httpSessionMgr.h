@@ -1,9 +1,36 @@
 #ifndef _HTTP_SESSION_MGR_
 #define _HTTP_SESSION_MGR_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "httpClient.h"
 
+/* Log2 buckets of milliseconds, see httpSessionMgr_getLatencyStats() */
+#define HTTP_SESSION_LATENCY_BUCKETS ( 16u )
+
+typedef enum
+{
+    HTTP_LATENCY_QUEUED,      // Queued until a session slot took it
+    HTTP_LATENCY_CONNECT,     // DNS lookup and TCP handshake
+    HTTP_LATENCY_SEND,        // Writing the request
+    HTTP_LATENCY_FIRST_BYTE,  // Request sent until the first byte of the response
+    HTTP_LATENCY_TOTAL,       // Queued until the response or error callback
+    HTTP_LATENCY_PHASE_COUNT
+} tHttpSessionMgr_latencyPhase;
+
+/* histogram[phase][0] counts requests below 1 ms, [n] those in [2^(n-1), 2^n) ms, the last bucket is open ended */
+typedef struct
+{
+    uint32_t histogram[HTTP_LATENCY_PHASE_COUNT][HTTP_SESSION_LATENCY_BUCKETS];
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t cacheHits;  // Served from the response cache without a request, not in the histograms
+} tHttpSessionMgr_latencyStats;
+
 void httpSessionMgr_init( void );
-void httpSessionMgr_startNewSession( tHttpClient_client* client );
+bool httpSessionMgr_startNewSession( tHttpClient_client* client );
+void httpSessionMgr_cancel( tHttpClient_client* client );
+void httpSessionMgr_getLatencyStats( tHttpSessionMgr_latencyStats* stats );
 
 #endif /* _HTTP_SESSION_MGR_ */
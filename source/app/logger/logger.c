@@ -1,32 +1,52 @@
 #include "logger.h"
 
+#include <ctype.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "cmsis_os.h"
+#include "task.h"
 
 /************************************************************************************
  * PRIVATE MACROS
  ***********************************************************************************/
-#define LOG_OUTPUT_BUFFER_SIZE ( 1024 )
-#define LOG_QUEUE_SIZE         ( 20u )
+#define LOG_MAX_MESSAGE_SIZE   ( 256u )
+#define LOG_RING_BUFFER_SIZE   ( 2048u )
+#define LOG_DROP_NOTICE_FORMAT "%lu messages dropped"
+
+#define LOG_BINARY_FRAME_MAGIC     ( 0xA5u )
+#define LOG_BINARY_HEADER_SIZE     ( 10u )  // magic, payload size, site ID, timestamp
+#define LOG_BINARY_MAX_STRING_SIZE ( 32u )
+
+#define LOG_FLAG_DATA_PENDING ( 0x01u )
+#define LOG_FLAG_TX_COMPLETE  ( 0x02u )
+
+#define LOG_TX_TIMEOUT_MS ( 1000u )
 
 /************************************************************************************
  * PRIVATE TYPES DECLARATION
  ***********************************************************************************/
 typedef struct
 {
-    UART_HandleTypeDef *uartHandle;
-    osMessageQueueId_t logQueue;
-    tLogLevel currentLogLevel;
-} tLogger;
+    uint8_t buffer[LOG_RING_BUFFER_SIZE];
+    volatile size_t head;  // Next byte written by producers
+    volatile size_t tail;  // Next byte sent by the drain task
+    volatile uint32_t droppedMessages;
+} tLogRingBuffer;
 
 typedef struct
 {
-    char msg[LOG_OUTPUT_BUFFER_SIZE];
-    size_t msgSize;
-} tLogMessage;
+    UART_HandleTypeDef *uartHandle;
+    tLogRingBuffer ring;
+} tLogger;
+
+/************************************************************************************
+ * PUBLIC VARIABLES DECLERATION
+ ***********************************************************************************/
+volatile tLogLevel logger_moduleLogLevel[LOG_MODULE_COUNT];
 
 /************************************************************************************
  * PRIVATE VARIABLES DECLERATION
@@ -34,6 +54,12 @@ typedef struct
 static tLogger m_logger_log;
 static osThreadId_t m_logger_taskHandler;
 
+#if LOG_BINARY_MODE
+extern const char __start_log_strings[];
+
+static const char m_logger_dropNoticeSite[] LOG_SITE_ATTRIBUTE = LOG_SITE( LOG_LEVEL_WARNING, LOG_DROP_NOTICE_FORMAT );
+#endif
+
 static const char *m_logger_logLevelName[] = {
     [LOG_LEVEL_ERROR] = "ERROR",
     [LOG_LEVEL_WARNING] = "WARNING",
@@ -45,6 +71,18 @@ static const char *m_logger_logLevelName[] = {
  * PRIVATE FUNTCTION DECLERATION
  ***********************************************************************************/
 static void loggerTask( void *argument );
+static bool ringWrite( const char *data, size_t size );
+static size_t ringContiguousPending( void );
+static void countDroppedMessage( void );
+static void reportDroppedMessages( void );
+static bool logDropNotice( const char *format, ... );
+static bool logText( tLogLevel level, const char *file, int line, const char *format, va_list args );
+#if LOG_BINARY_MODE
+static bool logBinary( const char *site, const char *format, va_list args );
+static size_t encodeArguments( uint8_t *buffer, size_t capacity, const char *format, va_list args );
+static bool encodeBytes( uint8_t *buffer, size_t capacity, size_t *size, const void *data, size_t length );
+static bool encodeWord( uint8_t *buffer, size_t capacity, size_t *size, uint64_t value, size_t width );
+#endif
 
 /************************************************************************************
  * PUBLIC FUNTCTION DEFINTIONS
@@ -52,9 +90,11 @@ static void loggerTask( void *argument );
 void logger_init( UART_HandleTypeDef *huart )
 {
     m_logger_log.uartHandle = huart;
-    m_logger_log.currentLogLevel = LOG_LEVEL_INFO;
+    logger_setLogLevel( LOG_LEVEL_INFO );
 
-    m_logger_log.logQueue = osMessageQueueNew( LOG_QUEUE_SIZE, sizeof( tLogMessage ), NULL );
+    m_logger_log.ring.head = 0;
+    m_logger_log.ring.tail = 0;
+    m_logger_log.ring.droppedMessages = 0;
 
     const osThreadAttr_t attr = {
         .name = "loggerTask",
@@ -66,44 +106,382 @@ void logger_init( UART_HandleTypeDef *huart )
 
 void logger_setLogLevel( tLogLevel level )
 {
-    m_logger_log.currentLogLevel = level;
+    for( size_t module = 0; module < LOG_MODULE_COUNT; module++ )
+    {
+        logger_moduleLogLevel[module] = level;
+    }
 }
 
-void logger_print( tLogLevel level, const char *file, int line, const char *format, ... )
+void logger_setModuleLogLevel( tLogModule module, tLogLevel level )
 {
-    if( level <= m_logger_log.currentLogLevel )
+    if( module < LOG_MODULE_COUNT )
     {
-        va_list args;
-        va_start( args, format );
-        tLogMessage logMessage = { 0 };
-        size_t offset = snprintf( logMessage.msg, LOG_OUTPUT_BUFFER_SIZE, "[%s:%d] [%s] ", file, line, m_logger_logLevelName[level] );
-        size_t msgSize = vsnprintf( logMessage.msg + offset, LOG_OUTPUT_BUFFER_SIZE - offset, format, args );
-        msgSize += offset;
-        va_end( args );
+        logger_moduleLogLevel[module] = level;
+    }
+}
 
-        if( ( '\n' != logMessage.msg[msgSize - 1] ) && ( msgSize < LOG_OUTPUT_BUFFER_SIZE - 1 ) )
-        {
-            logMessage.msg[msgSize] = '\n';
-            msgSize++;
-        }
+tLogLevel logger_getModuleLogLevel( tLogModule module )
+{
+    return ( module < LOG_MODULE_COUNT ) ? logger_moduleLogLevel[module] : LOG_LEVEL_ERROR;
+}
 
-        logMessage.msgSize = msgSize;
+/* The level is checked by the LOG_* macros at the call site */
+void logger_print( tLogLevel level, const char *file, int line, const char *format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    if( !logText( level, file, line, format, args ) )
+    {
+        countDroppedMessage();
+    }
+    va_end( args );
+}
 
-        osMessageQueuePut( m_logger_log.logQueue, &logMessage, 0, 0 );
+#if LOG_BINARY_MODE
+void logger_printBinary( tLogLevel level, const char *site, const char *format, ... )
+{
+    va_list args;
+    va_start( args, format );
+    if( !logBinary( site, format, args ) )
+    {
+        countDroppedMessage();
     }
+    va_end( args );
 }
+#endif
 
 /************************************************************************************
  * PRIVATE FUNTCTION DEFINITIONS
  ***********************************************************************************/
+static bool ringWrite( const char *data, size_t size )
+{
+    tLogRingBuffer *ring = &m_logger_log.ring;
+    bool result = false;
+
+    taskENTER_CRITICAL();
+
+    size_t used = ring->head - ring->tail;
+
+    if( ( LOG_RING_BUFFER_SIZE - used ) >= size )
+    {
+        size_t start = ring->head % LOG_RING_BUFFER_SIZE;
+        size_t firstPart = LOG_RING_BUFFER_SIZE - start;
+
+        if( firstPart > size )
+        {
+            firstPart = size;
+        }
+
+        memcpy( &ring->buffer[start], data, firstPart );
+        memcpy( &ring->buffer[0], data + firstPart, size - firstPart );
+        ring->head += size;
+        result = true;
+    }
+
+    taskEXIT_CRITICAL();
+
+    return result;
+}
+
+/* Only messages of the callers are counted, a drop notice that does not fit is not a message of its own */
+static void countDroppedMessage( void )
+{
+    taskENTER_CRITICAL();
+    m_logger_log.ring.droppedMessages++;
+    taskEXIT_CRITICAL();
+}
+
+/* Number of pending bytes that can be handed to the DMA in one transfer */
+static size_t ringContiguousPending( void )
+{
+    tLogRingBuffer *ring = &m_logger_log.ring;
+
+    size_t pending = ring->head - ring->tail;
+    size_t untilEnd = LOG_RING_BUFFER_SIZE - ( ring->tail % LOG_RING_BUFFER_SIZE );
+
+    return ( pending < untilEnd ) ? pending : untilEnd;
+}
+
+static void reportDroppedMessages( void )
+{
+    uint32_t dropped = m_logger_log.ring.droppedMessages;
+
+    if( ( dropped > 0 ) && logDropNotice( LOG_DROP_NOTICE_FORMAT, (unsigned long)dropped ) )
+    {
+        taskENTER_CRITICAL();
+        m_logger_log.ring.droppedMessages -= dropped;
+        taskEXIT_CRITICAL();
+    }
+}
+
+static bool logDropNotice( const char *format, ... )
+{
+    va_list args;
+    va_start( args, format );
+#if LOG_BINARY_MODE
+    bool result = logBinary( m_logger_dropNoticeSite, format, args );
+#else
+    bool result = logText( LOG_LEVEL_WARNING, __FILE__, __LINE__, format, args );
+#endif
+    va_end( args );
+
+    return result;
+}
+
+static bool logText( tLogLevel level, const char *file, int line, const char *format, va_list args )
+{
+    char msg[LOG_MAX_MESSAGE_SIZE];
+    const char *fileName = strrchr( file, '/' );
+
+    fileName = ( NULL != fileName ) ? fileName + 1 : file;
+
+    int offset = snprintf( msg, LOG_MAX_MESSAGE_SIZE, "[%s:%d] [%s] ", fileName, line, m_logger_logLevelName[level] );
+
+    // Also the untruncated length, a prefix cut short leaves only the terminating zero for the message
+    offset = ( offset < 0 ) ? 0 : ( ( offset > (int)( LOG_MAX_MESSAGE_SIZE - 1 ) ) ? (int)( LOG_MAX_MESSAGE_SIZE - 1 ) : offset );
+    int length = vsnprintf( msg + offset, LOG_MAX_MESSAGE_SIZE - offset, format, args );
+
+    // vsnprintf returns the untruncated length, clamp it to what was actually written
+    size_t msgSize = offset + ( ( length < 0 ) ? 0 : length );
+    if( msgSize > LOG_MAX_MESSAGE_SIZE - 1 )
+    {
+        msgSize = LOG_MAX_MESSAGE_SIZE - 1;
+    }
+
+    if( ( ( 0 == msgSize ) || ( '\n' != msg[msgSize - 1] ) ) && ( msgSize < LOG_MAX_MESSAGE_SIZE - 1 ) )
+    {
+        msg[msgSize] = '\n';
+        msgSize++;
+    }
+
+    // Never block the caller: if the ring is full the message is dropped, logger_print() counts it
+    bool result = ringWrite( msg, msgSize );
+    if( result )
+    {
+        osThreadFlagsSet( m_logger_taskHandler, LOG_FLAG_DATA_PENDING );
+    }
+
+    return result;
+}
+
+#if LOG_BINARY_MODE
+static bool logBinary( const char *site, const char *format, va_list args )
+{
+    uint8_t frame[LOG_MAX_MESSAGE_SIZE];
+    size_t headerSize = 0;
+    uint32_t siteId = (uint32_t)( (uintptr_t)site - (uintptr_t)__start_log_strings );
+    size_t payloadSize = encodeArguments( &frame[LOG_BINARY_HEADER_SIZE], LOG_MAX_MESSAGE_SIZE - LOG_BINARY_HEADER_SIZE, format, args );
+
+    // Frame: magic, payload size, site ID, timestamp in ms, arguments
+    encodeWord( frame, LOG_BINARY_HEADER_SIZE, &headerSize, LOG_BINARY_FRAME_MAGIC, sizeof( uint8_t ) );
+    encodeWord( frame, LOG_BINARY_HEADER_SIZE, &headerSize, payloadSize, sizeof( uint8_t ) );
+    encodeWord( frame, LOG_BINARY_HEADER_SIZE, &headerSize, siteId, sizeof( uint32_t ) );
+    encodeWord( frame, LOG_BINARY_HEADER_SIZE, &headerSize, osKernelGetTickCount(), sizeof( uint32_t ) );
+
+    bool result = ringWrite( (const char *)frame, LOG_BINARY_HEADER_SIZE + payloadSize );
+    if( result )
+    {
+        osThreadFlagsSet( m_logger_taskHandler, LOG_FLAG_DATA_PENDING );
+    }
+
+    return result;
+}
+
+/*
+ * Walks the conversion specifiers of the format and stores the raw arguments:
+ * 64-bit integers (ll, j) as 8 bytes, other integers and pointers as 4 bytes,
+ * floating point values as 4-byte floats and strings as a length byte followed
+ * by at most LOG_BINARY_MAX_STRING_SIZE characters. Everything is little endian.
+ */
+static size_t encodeArguments( uint8_t *buffer, size_t capacity, const char *format, va_list args )
+{
+    size_t size = 0;
+    bool fits = true;
+
+    for( const char *c = format; fits && ( '\0' != *c ); c++ )
+    {
+        if( '%' != *c )
+        {
+            continue;
+        }
+
+        c++;
+        while( ( '\0' != *c ) && ( NULL != strchr( "-+ #0", *c ) ) )
+        {
+            c++;
+        }
+
+        // Width and precision, '*' takes its value from the arguments
+        while( ( '*' == *c ) || ( '.' == *c ) || isdigit( (unsigned char)*c ) )
+        {
+            if( '*' == *c )
+            {
+                uint32_t value = va_arg( args, unsigned int );
+                fits = fits && encodeWord( buffer, capacity, &size, value, sizeof( value ) );
+            }
+            c++;
+        }
+
+        char lengthModifier = '\0';
+        bool longLong = false;
+        while( ( '\0' != *c ) && ( NULL != strchr( "hlLjzt", *c ) ) )
+        {
+            longLong = longLong || ( 'j' == *c ) || ( ( 'l' == *c ) && ( 'l' == lengthModifier ) );
+            lengthModifier = *c;
+            c++;
+        }
+
+        switch( *c )
+        {
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+            case 'c':
+                if( longLong )
+                {
+                    uint64_t value = va_arg( args, unsigned long long );
+                    fits = encodeWord( buffer, capacity, &size, value, sizeof( value ) );
+                }
+                else
+                {
+                    uint32_t value;
+                    if( 'l' == lengthModifier )
+                    {
+                        value = (uint32_t)va_arg( args, unsigned long );
+                    }
+                    else if( ( 'z' == lengthModifier ) || ( 't' == lengthModifier ) )
+                    {
+                        value = (uint32_t)va_arg( args, size_t );
+                    }
+                    else
+                    {
+                        value = va_arg( args, unsigned int );
+                    }
+
+                    fits = encodeWord( buffer, capacity, &size, value, sizeof( value ) );
+                }
+                break;
+
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+            {
+                float value = ( 'L' == lengthModifier ) ? (float)va_arg( args, long double ) : (float)va_arg( args, double );
+                uint32_t bits;
+                memcpy( &bits, &value, sizeof( bits ) );
+                fits = encodeWord( buffer, capacity, &size, bits, sizeof( bits ) );
+                break;
+            }
+
+            case 's':
+            {
+                const char *value = va_arg( args, const char * );
+                value = ( NULL != value ) ? value : "(null)";
+                uint8_t length = (uint8_t)strnlen( value, LOG_BINARY_MAX_STRING_SIZE );
+                fits = encodeBytes( buffer, capacity, &size, &length, 1 ) && encodeBytes( buffer, capacity, &size, value, length );
+                break;
+            }
+
+            case 'p':
+            {
+                uint32_t value = (uint32_t)(uintptr_t)va_arg( args, void * );
+                fits = encodeWord( buffer, capacity, &size, value, sizeof( value ) );
+                break;
+            }
+
+            case 'n':
+                (void)va_arg( args, void * );
+                break;
+
+            case '\0':
+                c--;
+                break;
+
+            default:  // "%%" and unknown conversions carry no argument
+                break;
+        }
+    }
+
+    return size;
+}
+
+static bool encodeBytes( uint8_t *buffer, size_t capacity, size_t *size, const void *data, size_t length )
+{
+    if( ( capacity - *size ) < length )
+    {
+        return false;
+    }
+
+    memcpy( &buffer[*size], data, length );
+    *size += length;
+
+    return true;
+}
+
+static bool encodeWord( uint8_t *buffer, size_t capacity, size_t *size, uint64_t value, size_t width )
+{
+    uint8_t bytes[sizeof( uint64_t )];
+
+    for( size_t i = 0; i < width; i++ )
+    {
+        bytes[i] = (uint8_t)( value >> ( 8 * i ) );
+    }
+
+    return encodeBytes( buffer, capacity, size, bytes, width );
+}
+#endif  // LOG_BINARY_MODE
 static void loggerTask( void *argument )
 {
-    tLogMessage logMessage;
+    tLogRingBuffer *ring = &m_logger_log.ring;
+
     while( 1 )
     {
-        if( osOK == osMessageQueueGet( m_logger_log.logQueue, &logMessage, NULL, osWaitForever ) )
+        osThreadFlagsWait( LOG_FLAG_DATA_PENDING, osFlagsWaitAny, osWaitForever );
+
+        size_t spanSize = ringContiguousPending();
+
+        while( spanSize > 0 )
         {
-            HAL_UART_Transmit( m_logger_log.uartHandle, (uint8_t *)logMessage.msg, logMessage.msgSize, 1000 );
+            // Producers only move head, so the span between tail and head stays untouched during the transfer
+            osThreadFlagsClear( LOG_FLAG_TX_COMPLETE );
+            if( HAL_OK == HAL_UART_Transmit_DMA( m_logger_log.uartHandle, &ring->buffer[ring->tail % LOG_RING_BUFFER_SIZE], spanSize ) )
+            {
+                if( 0 != ( osThreadFlagsWait( LOG_FLAG_TX_COMPLETE, osFlagsWaitAny, LOG_TX_TIMEOUT_MS ) & osFlagsError ) )
+                {
+                    HAL_UART_AbortTransmit( m_logger_log.uartHandle );
+                }
+            }
+
+            taskENTER_CRITICAL();
+            ring->tail += spanSize;
+            taskEXIT_CRITICAL();
+
+            reportDroppedMessages();
+            spanSize = ringContiguousPending();
         }
     }
-}
\ No newline at end of file
+}
+
+void HAL_UART_TxCpltCallback( UART_HandleTypeDef *huart )
+{
+    if( huart == m_logger_log.uartHandle )
+    {
+        osThreadFlagsSet( m_logger_taskHandler, LOG_FLAG_TX_COMPLETE );
+    }
+}
+
+void HAL_UART_ErrorCallback( UART_HandleTypeDef *huart )
+{
+    if( huart == m_logger_log.uartHandle )
+    {
+        osThreadFlagsSet( m_logger_taskHandler, LOG_FLAG_TX_COMPLETE );
+    }
+}
@@ -6,24 +6,117 @@
 #include "FreeRTOS.h"
 #include "usart.h"
 
+/* 1 - log sites are tokenized and sent as binary records, decode them with tools/logDecoder */
+#ifndef LOG_BINARY_MODE
+#define LOG_BINARY_MODE 0
+#endif
+
+/* Highest level compiled in: 0 - ERROR, 1 - WARNING, 2 - INFO, 3 - DEBUG. Calls above it are removed with their arguments */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 3
+#endif
+
+/* Every file using LOG_* defines LOG_MODULE as one of these, its runtime level is set separately */
+#define LOG_MODULES( X ) \
+    X( SYSTEM )          \
+    X( NETWORK )         \
+    X( SENSOR )          \
+    X( HTTP )            \
+    X( MQTT )            \
+    X( DNS )             \
+    X( TIME_SYNC )       \
+    X( DISPLAY )
+
+#define LOG_MODULE_ENUM( MODULE ) LOG_MODULE_##MODULE,
+
 typedef enum
 {
-    LOG_LEVEL_ERROR,
-    LOG_LEVEL_WARNING,
-    LOG_LEVEL_INFO,
-    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARNING = 1,
+    LOG_LEVEL_INFO = 2,
+    LOG_LEVEL_DEBUG = 3,
 } tLogLevel;
 
+typedef enum
+{
+    LOG_MODULES( LOG_MODULE_ENUM )
+    LOG_MODULE_COUNT
+} tLogModule;
+
+/* Read by the LOG_* macros before any argument is evaluated, change it with logger_setModuleLogLevel() */
+extern volatile tLogLevel logger_moduleLogLevel[LOG_MODULE_COUNT];
+
 void logger_init( UART_HandleTypeDef *huart );
 void logger_setLogLevel( tLogLevel level );
+void logger_setModuleLogLevel( tLogModule module, tLogLevel level );
+tLogLevel logger_getModuleLogLevel( tLogModule module );
 void logger_print( tLogLevel level, const char *file, int line, const char *format, ... );
+void logger_printBinary( tLogLevel level, const char *site, const char *format, ... );
+
+#define LOG_STRINGIFY_( x ) #x
+#define LOG_STRINGIFY( x )  LOG_STRINGIFY_( x )
+
+/*
+ * Binary mode: every log site is a string "<level>\x1f<file>\x1f<line>\x1f<format>" placed in the
+ * log_strings section. Only its offset inside the section, a timestamp and the raw arguments are
+ * sent, the text is rebuilt on the host from the dictionary dumped from the ELF.
+ */
+#define LOG_SITE_SEPARATOR "\x1f"
+#define LOG_SITE_ATTRIBUTE __attribute__( ( section( "log_strings" ), used ) )
+#define LOG_SITE( LOG_LEVEL, format ) \
+    #LOG_LEVEL LOG_SITE_SEPARATOR __FILE__ LOG_SITE_SEPARATOR LOG_STRINGIFY( __LINE__ ) LOG_SITE_SEPARATOR format
+
+#define LOG_ENABLED( LOG_LEVEL ) ( ( LOG_LEVEL ) <= logger_moduleLogLevel[LOG_MODULE] )
+
+#if LOG_BINARY_MODE
+#define LOG_PRINT( LOG_LEVEL, format, ... )                                                                         \
+    do                                                                                                              \
+    {                                                                                                               \
+        if( LOG_ENABLED( LOG_LEVEL ) )                                                                              \
+        {                                                                                                           \
+            static const char logSite[] LOG_SITE_ATTRIBUTE = LOG_SITE( LOG_LEVEL, format );                         \
+            logger_printBinary( LOG_LEVEL, logSite, &logSite[sizeof( logSite ) - sizeof( format )], ##__VA_ARGS__ ); \
+        }                                                                                                           \
+    } while( 0 )
+#else
+#define LOG_PRINT( LOG_LEVEL, format, ... )                                            \
+    do                                                                                 \
+    {                                                                                  \
+        if( LOG_ENABLED( LOG_LEVEL ) )                                                 \
+        {                                                                              \
+            logger_print( LOG_LEVEL, __FILE__, __LINE__, format, ##__VA_ARGS__ );      \
+        }                                                                              \
+    } while( 0 )
+#endif
+
+/* Compiled out call, the arguments stay type checked and referenced but are never evaluated */
+#define LOG_DISCARD( LOG_LEVEL, format, ... )                                          \
+    do                                                                                 \
+    {                                                                                  \
+        if( 0 )                                                                        \
+        {                                                                              \
+            logger_print( LOG_LEVEL, __FILE__, __LINE__, format, ##__VA_ARGS__ );      \
+        }                                                                              \
+    } while( 0 )
+
+#define LOG_ERROR( format, ... ) LOG_PRINT( LOG_LEVEL_ERROR, format, ##__VA_ARGS__ )
+
+#if LOG_COMPILE_LEVEL >= 1
+#define LOG_WARNING( format, ... ) LOG_PRINT( LOG_LEVEL_WARNING, format, ##__VA_ARGS__ )
+#else
+#define LOG_WARNING( format, ... ) LOG_DISCARD( LOG_LEVEL_WARNING, format, ##__VA_ARGS__ )
+#endif
 
-#define __FILENAME__ ( strrchr( __FILE__, '/' ) ? strrchr( __FILE__, '/' ) + 1 : __FILE__ )
+#if LOG_COMPILE_LEVEL >= 2
+#define LOG_INFO( format, ... ) LOG_PRINT( LOG_LEVEL_INFO, format, ##__VA_ARGS__ )
+#else
+#define LOG_INFO( format, ... ) LOG_DISCARD( LOG_LEVEL_INFO, format, ##__VA_ARGS__ )
+#endif
 
-#define LOG_PRINT( LOG_LEVEL, format, ... ) logger_print( LOG_LEVEL, __FILENAME__, __LINE__, format, ##__VA_ARGS__ )
-#define LOG_INFO( format, ... )             LOG_PRINT( LOG_LEVEL_INFO, format, ##__VA_ARGS__ )
-#define LOG_WARNING( format, ... )          LOG_PRINT( LOG_LEVEL_WARNING, format, ##__VA_ARGS__ )
-#define LOG_DEBUG( format, ... )            LOG_PRINT( LOG_LEVEL_DEBUG, format, ##__VA_ARGS__ )
-#define LOG_ERROR( format, ... )            LOG_PRINT( LOG_LEVEL_ERROR, format, ##__VA_ARGS__ )
+#if LOG_COMPILE_LEVEL >= 3
+#define LOG_DEBUG( format, ... ) LOG_PRINT( LOG_LEVEL_DEBUG, format, ##__VA_ARGS__ )
+#else
+#define LOG_DEBUG( format, ... ) LOG_DISCARD( LOG_LEVEL_DEBUG, format, ##__VA_ARGS__ )
+#endif
 
 #endif  // LOGGER_H
@@ -2,19 +2,71 @@
 #include "mqttClient.h"
 
 #include <stdbool.h>
+#include <string.h>
 
 #include "cmsis_os.h"
 #include "dns_resolver.h"
 #include "logger.h"
 #include "lwip/apps/mqtt.h"
+#include "lwip/tcpip.h"
+#include "mqttReceiver.h"
+#include "mqttRouter.h"
+#include "mqttStreamer.h"
 
 /***********************************************************************************
  * PRIVATE MACROS DEFINTIONS
  ***********************************************************************************/
-#define MQTT_CLIENT_QUEUE_SIZE   ( 10U )
-#define MQTT_TOPIC_LENGTH        ( 100u )
-#define MQTT_CONNECTION_TIMEOUT  ( 1000u )
-#define MQTT_RECEIVE_BUFFER_SIZE ( 200U )
+#define LOG_MODULE LOG_MODULE_MQTT
+#define MQTT_CONNECTION_TIMEOUT  ( 10000u )
+
+#ifndef MQTT_CLIENT_PUBLISH_QOS
+#define MQTT_CLIENT_PUBLISH_QOS ( 1u )
+#endif
+
+/* Publishes waiting for PUBACK at once, each one takes a request slot of lwIP */
+#ifndef MQTT_CLIENT_INFLIGHT_WINDOW
+#define MQTT_CLIENT_INFLIGHT_WINDOW ( 3u )
+#endif
+
+/* Minimum time between two publishes, paces the replay of the outbox after a reconnect */
+#ifndef MQTT_CLIENT_DRAIN_INTERVAL_MS
+#define MQTT_CLIENT_DRAIN_INTERVAL_MS ( 100u )
+#endif
+
+#define MQTT_CLIENT_ACK_QUEUE_SIZE ( 2u * MQTT_CLIENT_INFLIGHT_WINDOW )
+#define MQTT_CLIENT_EVENT_QUEUE_SIZE ( 4u )
+
+/* Delay before a reconnection, doubled after every failed attempt and randomized by half */
+#ifndef MQTT_CLIENT_BACKOFF_MIN_MS
+#define MQTT_CLIENT_BACKOFF_MIN_MS ( 1000u )
+#endif
+
+#ifndef MQTT_CLIENT_BACKOFF_MAX_MS
+#define MQTT_CLIENT_BACKOFF_MAX_MS ( 60000u )
+#endif
+
+/* Delay before a subscription the broker refused or did not answer is sent again, doubled after every failure in a row */
+#ifndef MQTT_CLIENT_SUBSCRIBE_RETRY_MIN_MS
+#define MQTT_CLIENT_SUBSCRIBE_RETRY_MIN_MS ( 1000u )
+#endif
+
+#ifndef MQTT_CLIENT_SUBSCRIBE_RETRY_MAX_MS
+#define MQTT_CLIENT_SUBSCRIBE_RETRY_MAX_MS ( 60000u )
+#endif
+
+/* Thread flags of mqttClientTask, every source is also drained on any wake up */
+#define MQTT_CLIENT_FLAG_PUBLISH    ( 0x01u )
+#define MQTT_CLIENT_FLAG_ACK        ( 0x02u )
+#define MQTT_CLIENT_FLAG_CONNECTION ( 0x04u )
+#define MQTT_CLIENT_FLAG_REQUEST    ( 0x08u )
+#define MQTT_CLIENT_FLAG_STREAM     ( 0x10u )
+#define MQTT_CLIENT_FLAGS_ALL       ( MQTT_CLIENT_FLAG_PUBLISH | MQTT_CLIENT_FLAG_ACK | MQTT_CLIENT_FLAG_CONNECTION | MQTT_CLIENT_FLAG_REQUEST | MQTT_CLIENT_FLAG_STREAM )
+
+// lwIP builds the whole PUBLISH packet (fixed header, topic length, topic, payload) in its output ring buffer
+_Static_assert( ( 4u + MQTT_CLIENT_MESSAGE_TOPIC_LENGTH + MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE ) <= MQTT_OUTPUT_RINGBUF_SIZE,
+                "MQTT message block larger than the lwIP output buffer" );
+// One slot is left for subscribe requests
+_Static_assert( MQTT_CLIENT_INFLIGHT_WINDOW < MQTT_REQ_MAX_IN_FLIGHT, "In-flight window larger than lwIP request slots" );
 
 /***********************************************************************************
  * PRIVATE TYPES DEFINTIONS
@@ -27,41 +79,104 @@ typedef struct
     const char* brokerAddress;
     tMqttClient_userCallback userCallback;
     tMqttClient_disconnectCallback disconnectCallback;
+    tMqttClient_stateCallback stateCallback;
 } tMqttClient_config;
 
+typedef enum
+{
+    OUTBOX_ENTRY_PENDING,
+    OUTBOX_ENTRY_IN_FLIGHT,
+    OUTBOX_ENTRY_ACKED,
+} tMqttClient_outboxEntryState;
+
+typedef struct
+{
+    tMqttClient_message* message;
+    tMqttClient_outboxEntryState state;
+    uint16_t token;     // Identifies the publish in the lwIP callback, changes on every retransmission
+    bool errorLogged;   // A failed publish is reported once per message
+} tMqttClient_outboxEntry;
+
+/* FIFO of the blocks taken from the publish queue, an entry leaves it when it and every older one are acked */
 typedef struct
 {
-    char payload[MQTT_RECEIVE_BUFFER_SIZE];
-    uint16_t payload_len;
-    uint16_t received_len;
-} tMqttClient_msgInfo;
+    tMqttClient_outboxEntry entries[MQTT_CLIENT_MESSAGE_POOL_SIZE];
+    uint16_t head;
+    uint16_t count;
+    uint16_t inFlight;
+    uint16_t nextToken;
+    uint32_t lastPublishTick;
+    bool connected;
+} tMqttClient_outbox;
+
+typedef struct
+{
+    volatile tMqttClient_state state;
+    volatile bool requested;  // Set by mqttClient_connect(), cleared by mqttClient_disconnect()
+    uint32_t deadline;        // End of the connection timeout or of the backoff
+    uint32_t backoffMs;
+    uint32_t jitterSeed;
+} tMqttClient_connection;
+
+typedef struct
+{
+    uint32_t retryTick;  // Not sent again before this tick
+    uint32_t backoffMs;  // Of the last failure, 0 after a SUBACK
+} tMqttClient_subscriptionRetry;
+
+/* Result of a publish, posted from the lwIP thread to mqttClientTask */
+typedef struct
+{
+    uint16_t token;
+    err_t result;
+} tMqttClient_ack;
 
 /************************************************************************************
  * PRIVATE VARIABLES DECLERATION
  ***********************************************************************************/
 static osMessageQueueId_t m_mqttClient_mqttQueue;
-static osSemaphoreId_t m_mqttClient_syncSemaphore;
+static osMessageQueueId_t m_mqttClient_freeMessages;  // Free list of the pool, holds block pointers
+static osMessageQueueId_t m_mqttClient_ackQueue;
+static tMqttClient_outbox m_mqttClient_outbox;
+static tMqttClient_message m_mqttClient_messagePool[MQTT_CLIENT_MESSAGE_POOL_SIZE];
+static osMessageQueueId_t m_mqttClient_eventQueue;  // Connection status reported by lwIP
+static osThreadId_t m_mqttClient_taskId;
+static tMqttClient_connection m_mqttClient_connection;
 static bool m_mqttClient_initalized;
 
 static tMqttClient_config m_mqttClient_clientCfg;
 struct mqtt_connect_client_info_t m_mqttClient_connectionInfo;
-static tMqttClient_connectionResult m_mqttClient_connectionStatus;
 
 static mqtt_client_t* m_mqttClient_client;
-static char m_mqttClient_subTopic[MQTT_TOPIC_LENGTH];
-static bool m_mqttClient_connectionInProgress;
-static tMqttClient_msgInfo m_mqttClient_messageInfo;
+static uint32_t m_mqttClient_subscribed;  // Bit n - subscription n was sent on the current connection, changed with the lwIP core locked
+static tMqttClient_subscriptionRetry m_mqttClient_subscriptionRetry[MQTT_ROUTER_MAX_SUBSCRIPTIONS];  // Changed with the lwIP core locked
 
 /************************************************************************************
  * PRIVATE FUNTCTION DECLERATION
  ***********************************************************************************/
 static void mqttClientTask( void* args );
+static uint32_t nextWakeUp( void );
+static void connectionProcessEvents( void );
+static void connectionUpdate( void );
+static void connectionStart( void );
+static void connectionStop( void );
+static void connectionEstablished( void );
+static void connectionBackoff( tMqttClient_connectionResult reason );
+static void connectionSetState( tMqttClient_state state, tMqttClient_connectionResult reason );
+static uint32_t jitteredDelay( uint32_t delayMs );
+static tMqttClient_connectionResult connectionResultFromStatus( mqtt_connection_status_t status );
 static void connectionStatusCallback( mqtt_client_t* client, void* arg, mqtt_connection_status_t status );
-static void sendMessageOverMqtt( const tMqttClient_dataPacket* pMsg );
-static void subscribeTopic( mqtt_client_t* client, const char* topic );
+static uint32_t outboxWaitTime( void );
+static void outboxAppend( tMqttClient_message* message );
+static void outboxSetConnected( bool connected );
+static void outboxProcessAcks( void );
+static void outboxDrain( void );
+static err_t publishEntry( tMqttClient_outboxEntry* entry );
+static void publishResultCallback( void* arg, err_t result );
+static void streamProcess( void );
+static void subscribePending( void );
+static uint32_t subscribeWaitTime( void );
 static void subcribeResultCallback( void* arg, err_t result );
-static void incomingDataCallback( void* arg, const u8_t* data, u16_t len, u8_t flags );
-static void incommingPublishCallback( void* arg, const char* topic, u32_t tot_len );
 
 /************************************************************************************
  * PUBLIC FUNTCTION DEFINTIONS
@@ -70,9 +185,26 @@ void mqttClient_init( void )
 {
     if( !m_mqttClient_initalized )
     {
-        m_mqttClient_mqttQueue = osMessageQueueNew( MQTT_CLIENT_QUEUE_SIZE, sizeof( tMqttClient_dataPacket ), NULL );
+        // Both queues hold every block, so a producer owning a block can always enqueue it
+        m_mqttClient_mqttQueue = osMessageQueueNew( MQTT_CLIENT_MESSAGE_POOL_SIZE, sizeof( tMqttClient_message* ), NULL );
+        m_mqttClient_freeMessages = osMessageQueueNew( MQTT_CLIENT_MESSAGE_POOL_SIZE, sizeof( tMqttClient_message* ), NULL );
+        m_mqttClient_ackQueue = osMessageQueueNew( MQTT_CLIENT_ACK_QUEUE_SIZE, sizeof( tMqttClient_ack ), NULL );
+        m_mqttClient_eventQueue = osMessageQueueNew( MQTT_CLIENT_EVENT_QUEUE_SIZE, sizeof( mqtt_connection_status_t ), NULL );
+
+        mqttRouter_init();
+        mqttReceiver_init();
+
+        // Created before the task so no caller can see the client missing
+        LOCK_TCPIP_CORE();
+        m_mqttClient_client = mqtt_client_new();
+        if( NULL != m_mqttClient_client )
+        {
+            mqtt_set_inpub_callback( m_mqttClient_client, mqttReceiver_publishCallback, mqttReceiver_dataCallback, NULL );
+        }
+        UNLOCK_TCPIP_CORE();
 
-        if( NULL != m_mqttClient_mqttQueue )
+        if( ( NULL != m_mqttClient_mqttQueue ) && ( NULL != m_mqttClient_freeMessages ) && ( NULL != m_mqttClient_ackQueue ) &&
+            ( NULL != m_mqttClient_eventQueue ) && ( NULL != m_mqttClient_client ) )
         {
             const osThreadAttr_t attributes = {
                 .name = "mqttTask",
@@ -80,11 +212,17 @@ void mqttClient_init( void )
                 .priority = (osPriority_t)osPriorityNormal,
             };
 
-            m_mqttClient_initalized = true;
+            for( uint32_t i = 0; i < MQTT_CLIENT_MESSAGE_POOL_SIZE; i++ )
+            {
+                mqttClient_freeMessage( &m_mqttClient_messagePool[i] );
+            }
 
-            m_mqttClient_syncSemaphore = osSemaphoreNew( 1, 0, NULL );
+            m_mqttClient_connection.state = MQTT_CLIENT_STATE_IDLE;
+            m_mqttClient_connection.backoffMs = MQTT_CLIENT_BACKOFF_MIN_MS;
 
-            osThreadNew( mqttClientTask, NULL, &attributes );
+            m_mqttClient_taskId = osThreadNew( mqttClientTask, NULL, &attributes );
+            m_mqttClient_initalized = ( NULL != m_mqttClient_taskId );
+            mqttStreamer_init( m_mqttClient_taskId, MQTT_CLIENT_FLAG_STREAM );
         }
         else
         {
@@ -101,8 +239,6 @@ void mqttClient_clientCreate( const char* clientId, const tMqttClient_brokerInfo
         m_mqttClient_clientCfg.brokerPort = brokerInfo->brokerPort;
         m_mqttClient_clientCfg.brokerAddress = brokerInfo->brokerAddres;
 
-        strncpy( m_mqttClient_subTopic, subTopic, MQTT_TOPIC_LENGTH );
-
         m_mqttClient_connectionInfo.client_id = m_mqttClient_clientCfg.clientId;
         m_mqttClient_connectionInfo.keep_alive = 50;
 
@@ -110,50 +246,174 @@ void mqttClient_clientCreate( const char* clientId, const tMqttClient_brokerInfo
         LOG_INFO( "mqtt client id: %s", m_mqttClient_clientCfg.clientId );
         LOG_INFO( "mqtt broker address: %s", m_mqttClient_clientCfg.brokerAddress );
         LOG_INFO( "mqtt broker port: %d", m_mqttClient_clientCfg.brokerPort );
-        LOG_INFO( "mqtt subscribe topic: %s", m_mqttClient_subTopic );
+
+        if( ( NULL != subTopic ) && ( '\0' != subTopic[0] ) )
+        {
+            LOG_INFO( "mqtt subscribe topic: %s", subTopic );
+            mqttRouter_add( subTopic, 0, NULL, NULL );
+        }
     }
 }
 
-tMqttClient_connectionResult mqttClient_connect( void )
+/* Handler NULL - the callback of mqttClient_registerCallbacks(). Sent now if connected and on every reconnection */
+bool mqttClient_subscribe( const char* filter, uint8_t qos, tMqttClient_userCallback handler )
 {
-    tMqttClient_connectionResult result = CONNECTION_ERROR;
-    m_mqttClient_connectionInProgress = true;
-    ip_addr_t ipaddr;
+    bool result = m_mqttClient_initalized && ( mqttRouter_add( filter, qos, handler, NULL ) >= 0 );
 
-    if( dnsResolver_resolveHostname( m_mqttClient_clientCfg.brokerAddress, &ipaddr ) )
+    if( result )
     {
-        LOG_INFO( "Connecting to %s", ip4addr_ntoa( (const ip4_addr_t*)&ipaddr ) );
-        if( ERR_OK == mqtt_client_connect( m_mqttClient_client, &ipaddr, m_mqttClient_clientCfg.brokerPort,
-                                           connectionStatusCallback, NULL, &m_mqttClient_connectionInfo ) )
+        osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_REQUEST );
+    }
+
+    return result;
+}
+
+/* The handler gets every publish on the filter as it arrives, without the size limit of assembled messages */
+bool mqttClient_subscribeStream( const char* filter, uint8_t qos, tMqttClient_streamCallback handler )
+{
+    bool result = m_mqttClient_initalized && ( NULL != handler ) && ( mqttRouter_add( filter, qos, NULL, handler ) >= 0 );
+
+    if( result )
+    {
+        osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_REQUEST );
+    }
+
+    return result;
+}
+
+/* Starts connecting in the background, follow the progress with the state callback */
+bool mqttClient_connect( void )
+{
+    bool result = m_mqttClient_initalized && ( NULL != m_mqttClient_clientCfg.clientId ) && ( NULL != m_mqttClient_clientCfg.brokerAddress );
+
+    if( result )
+    {
+        m_mqttClient_connection.requested = true;
+        osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_REQUEST );
+    }
+
+    return result;
+}
+
+void mqttClient_disconnect( void )
+{
+    if( m_mqttClient_initalized )
+    {
+        m_mqttClient_connection.requested = false;
+        osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_REQUEST );
+    }
+}
+
+tMqttClient_state mqttClient_getState( void )
+{
+    return m_mqttClient_connection.state;
+}
+
+/* Copies the data into a pool block, never blocks */
+tMqttClient_sendResult mqttClient_sendMessage( const char* topic, const void* data, size_t length )
+{
+    tMqttClient_sendResult result = MQTT_SEND_TOO_LARGE;
+
+    if( length <= MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE )
+    {
+        tMqttClient_message* message = mqttClient_allocMessage( topic );
+
+        result = MQTT_SEND_NO_BUFFER;
+
+        if( NULL != message )
         {
-            if( ( osOK == osSemaphoreAcquire( m_mqttClient_syncSemaphore, osWaitForever ) ) && ( CONNECTION_ACCEPTED == m_mqttClient_connectionStatus ) )
-            {
-                subscribeTopic( m_mqttClient_client, m_mqttClient_subTopic );
-            }
-            result = m_mqttClient_connectionStatus;
+            memcpy( message->payload, data, length );
+            message->length = (uint16_t)length;
+            result = mqttClient_publishMessage( message );
+        }
+    }
+
+    return result;
+}
+
+/* Returns a block with the topic set and an empty payload, or NULL if the pool is exhausted or the topic too long */
+tMqttClient_message* mqttClient_allocMessage( const char* topic )
+{
+    tMqttClient_message* message = NULL;
+    size_t topicLength = ( NULL != topic ) ? strlen( topic ) : MQTT_CLIENT_MESSAGE_TOPIC_LENGTH;
+
+    if( m_mqttClient_initalized && ( topicLength < MQTT_CLIENT_MESSAGE_TOPIC_LENGTH ) &&
+        ( osOK == osMessageQueueGet( m_mqttClient_freeMessages, &message, NULL, 0 ) ) )
+    {
+        memcpy( message->topic, topic, topicLength + 1 );
+        message->length = 0;
+    }
+
+    return message;
+}
+
+/* Takes the ownership of the block, it returns to the pool once acknowledged by the broker or dropped */
+tMqttClient_sendResult mqttClient_publishMessage( tMqttClient_message* message )
+{
+    tMqttClient_sendResult result = MQTT_SEND_NOT_READY;
+
+    if( NULL != message )
+    {
+        if( message->length > MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE )
+        {
+            result = MQTT_SEND_TOO_LARGE;
+        }
+        else if( osOK == osMessageQueuePut( m_mqttClient_mqttQueue, &message, 0, 0 ) )
+        {
+            osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_PUBLISH );
+            result = MQTT_SEND_OK;
+        }
+
+        if( MQTT_SEND_OK != result )
+        {
+            mqttClient_freeMessage( message );
         }
     }
 
     return result;
 }
 
-void mqttClient_sendMessage( const char* topic, const char* msg )
+void mqttClient_freeMessage( tMqttClient_message* message )
 {
-    if( ( NULL != topic ) && ( NULL != msg ) )
+    if( NULL != message )
     {
-        tMqttClient_dataPacket data = {
-            .data = msg,
-            .topic = topic
-        };
+        osMessageQueuePut( m_mqttClient_freeMessages, &message, 0, 0 );
+    }
+}
 
-        osMessageQueuePut( m_mqttClient_mqttQueue, &data, 0, osWaitForever );
+/*
+ * Publishes length bytes pulled from the provider in chunks, for payloads that do not fit a
+ * message block. Sent with QoS 0 once the broker is connected and nothing else is in flight,
+ * the provider and context must stay valid until done is called. A stream cut by a disconnect
+ * is not resent.
+ */
+tMqttClient_sendResult mqttClient_publishStream( const char* topic, size_t length, tMqttClient_payloadProvider provider,
+                                                 tMqttClient_streamDoneCallback done, void* context )
+{
+    tMqttClient_sendResult result = MQTT_SEND_NOT_READY;
+
+    if( m_mqttClient_initalized )
+    {
+        result = mqttStreamer_enqueue( topic, length, provider, done, context );
+        if( MQTT_SEND_OK == result )
+        {
+            osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_PUBLISH );
+        }
     }
+
+    return result;
 }
 
 void mqttClient_registerCallbacks( tMqttClient_userCallback userCallback, tMqttClient_disconnectCallback disconnectCallback )
 {
     m_mqttClient_clientCfg.disconnectCallback = disconnectCallback;
     m_mqttClient_clientCfg.userCallback = userCallback;
+    mqttReceiver_setDefaultHandler( userCallback );
+}
+
+void mqttClient_registerStateCallback( tMqttClient_stateCallback stateCallback )
+{
+    m_mqttClient_clientCfg.stateCallback = stateCallback;
 }
 
 /************************************************************************************
@@ -161,28 +421,257 @@ void mqttClient_registerCallbacks( tMqttClient_userCallback userCallback, tMqttC
  ***********************************************************************************/
 static void mqttClientTask( void* args )
 {
-    LOG_INFO( "Starting mqtt" );
+    tMqttClient_message* msg = NULL;
 
-    m_mqttClient_client = mqtt_client_new();
-    tMqttClient_dataPacket msg = { 0 };
+    LOG_INFO( "Starting mqtt" );
 
     while( 1 )
     {
-        if( osOK == osMessageQueueGet( m_mqttClient_mqttQueue, &msg, NULL, osWaitForever ) )
+        osThreadFlagsWait( MQTT_CLIENT_FLAGS_ALL, osFlagsWaitAny, nextWakeUp() );
+
+        // The outbox can hold every block of the pool, appending never fails
+        while( osOK == osMessageQueueGet( m_mqttClient_mqttQueue, &msg, NULL, 0 ) )
         {
-            sendMessageOverMqtt( &msg );
+            outboxAppend( msg );
         }
+
+        connectionProcessEvents();
+        connectionUpdate();
+        outboxProcessAcks();
+        streamProcess();
+        subscribePending();
+        outboxDrain();
     }
 }
 
-static void connectionStatusCallback( mqtt_client_t* client, void* arg, mqtt_connection_status_t status )
+static uint32_t nextWakeUp( void )
+{
+    tMqttClient_connection* connection = &m_mqttClient_connection;
+    uint32_t waitTime = outboxWaitTime();
+
+    if( ( MQTT_CLIENT_STATE_CONNECTED == connection->state ) && ( mqttStreamer_waitTime() < waitTime ) )
+    {
+        waitTime = mqttStreamer_waitTime();
+    }
+
+    if( MQTT_CLIENT_STATE_CONNECTED == connection->state )
+    {
+        uint32_t subscribeWait = subscribeWaitTime();
+        waitTime = ( subscribeWait < waitTime ) ? subscribeWait : waitTime;
+    }
+
+    if( ( MQTT_CLIENT_STATE_CONNECTING == connection->state ) || ( MQTT_CLIENT_STATE_BACKOFF == connection->state ) )
+    {
+        int32_t remaining = (int32_t)( connection->deadline - osKernelGetTickCount() );
+        uint32_t deadlineWait = ( remaining > 0 ) ? (uint32_t)remaining : 0;
+
+        if( deadlineWait < waitTime )
+        {
+            waitTime = deadlineWait;
+        }
+    }
+
+    return waitTime;
+}
+
+static void connectionProcessEvents( void )
+{
+    mqtt_connection_status_t status;
+
+    while( osOK == osMessageQueueGet( m_mqttClient_eventQueue, &status, NULL, 0 ) )
+    {
+        switch( m_mqttClient_connection.state )
+        {
+            case MQTT_CLIENT_STATE_CONNECTING:
+            {
+                if( MQTT_CONNECT_ACCEPTED == status )
+                {
+                    connectionEstablished();
+                }
+                else
+                {
+                    connectionBackoff( connectionResultFromStatus( status ) );
+                }
+            }
+            break;
+            case MQTT_CLIENT_STATE_CONNECTED:
+            {
+                if( MQTT_CONNECT_ACCEPTED != status )
+                {
+                    connectionBackoff( connectionResultFromStatus( status ) );
+
+                    if( NULL != m_mqttClient_clientCfg.disconnectCallback )
+                    {
+                        m_mqttClient_clientCfg.disconnectCallback();
+                    }
+                }
+            }
+            break;
+            default:
+            {
+                // Late event of a connection already given up
+            }
+            break;
+        }
+    }
+}
+
+static void connectionUpdate( void )
+{
+    tMqttClient_connection* connection = &m_mqttClient_connection;
+    bool expired = ( (int32_t)( osKernelGetTickCount() - connection->deadline ) >= 0 );
+
+    if( !connection->requested )
+    {
+        if( MQTT_CLIENT_STATE_IDLE != connection->state )
+        {
+            connectionStop();
+        }
+    }
+    else if( MQTT_CLIENT_STATE_IDLE == connection->state )
+    {
+        connectionStart();
+    }
+    else if( ( MQTT_CLIENT_STATE_BACKOFF == connection->state ) && expired )
+    {
+        connectionStart();
+    }
+    else if( ( MQTT_CLIENT_STATE_CONNECTING == connection->state ) && expired )
+    {
+        LOCK_TCPIP_CORE();
+        mqtt_disconnect( m_mqttClient_client );
+        UNLOCK_TCPIP_CORE();
+
+        connectionBackoff( CONNECTION_TIMEOUTED );
+    }
+}
+
+static void connectionStart( void )
+{
+    ip_addr_t ipaddr;
+    err_t err;
+
+    connectionSetState( MQTT_CLIENT_STATE_CONNECTING, CONNECTION_ERROR );
+
+    if( dnsResolver_resolveHostname( m_mqttClient_clientCfg.brokerAddress, &ipaddr ) )
+    {
+        LOG_INFO( "Connecting to %s", ip4addr_ntoa( (const ip4_addr_t*)&ipaddr ) );
+
+        LOCK_TCPIP_CORE();
+        err = mqtt_client_connect( m_mqttClient_client, &ipaddr, m_mqttClient_clientCfg.brokerPort,
+                                   connectionStatusCallback, NULL, &m_mqttClient_connectionInfo );
+        UNLOCK_TCPIP_CORE();
+
+        if( ERR_OK == err )
+        {
+            m_mqttClient_connection.deadline = osKernelGetTickCount() + MQTT_CONNECTION_TIMEOUT;
+        }
+        else
+        {
+            LOG_ERROR( "mqtt_client_connect return: %d", err );
+            connectionBackoff( CONNECTION_ERROR );
+        }
+    }
+    else
+    {
+        connectionBackoff( CONNECTION_BROKER_NOT_AVAILABLE );
+    }
+}
+
+static void connectionStop( void )
+{
+    if( MQTT_CLIENT_STATE_CONNECTED == m_mqttClient_connection.state )
+    {
+        mqttStreamer_abort( m_mqttClient_client );
+        outboxSetConnected( false );
+    }
+
+    // No status callback is called for a disconnect requested by the client
+    LOCK_TCPIP_CORE();
+    mqtt_disconnect( m_mqttClient_client );
+    UNLOCK_TCPIP_CORE();
+
+    m_mqttClient_connection.backoffMs = MQTT_CLIENT_BACKOFF_MIN_MS;
+    connectionSetState( MQTT_CLIENT_STATE_IDLE, CONNECTION_ERROR );
+}
+
+static void connectionEstablished( void )
+{
+    m_mqttClient_connection.backoffMs = MQTT_CLIENT_BACKOFF_MIN_MS;
+    connectionSetState( MQTT_CLIENT_STATE_CONNECTED, CONNECTION_ACCEPTED );
+
+    // The broker keeps no session for us (clean session), subscribe on every connection without waiting for old retries
+    LOCK_TCPIP_CORE();
+    m_mqttClient_subscribed = 0;
+    memset( m_mqttClient_subscriptionRetry, 0, sizeof( m_mqttClient_subscriptionRetry ) );
+    UNLOCK_TCPIP_CORE();
+    outboxSetConnected( true );
+}
+
+static void connectionBackoff( tMqttClient_connectionResult reason )
+{
+    tMqttClient_connection* connection = &m_mqttClient_connection;
+    uint32_t delayMs = jitteredDelay( connection->backoffMs );
+
+    if( MQTT_CLIENT_STATE_CONNECTED == connection->state )
+    {
+        mqttStreamer_abort( m_mqttClient_client );
+        outboxSetConnected( false );
+    }
+
+    connection->backoffMs = ( connection->backoffMs < ( MQTT_CLIENT_BACKOFF_MAX_MS / 2u ) ) ? ( 2u * connection->backoffMs ) : MQTT_CLIENT_BACKOFF_MAX_MS;
+    connection->deadline = osKernelGetTickCount() + delayMs;
+
+    LOG_WARNING( "Broker connection failed: %d, retrying in %u ms", reason, (unsigned int)delayMs );
+    connectionSetState( MQTT_CLIENT_STATE_BACKOFF, reason );
+}
+
+static void connectionSetState( tMqttClient_state state, tMqttClient_connectionResult reason )
 {
+    m_mqttClient_connection.state = state;
+
+    LOG_DEBUG( "Connection state: %d", state );
+
+    if( NULL != m_mqttClient_clientCfg.stateCallback )
+    {
+        m_mqttClient_clientCfg.stateCallback( state, reason );
+    }
+}
+
+/* Half of the delay is random so a fleet that lost the broker at once does not reconnect at once */
+static uint32_t jitteredDelay( uint32_t delayMs )
+{
+    uint32_t x = m_mqttClient_connection.jitterSeed;
+
+    if( 0 == x )
+    {
+        // Seeded on first use with the client id and the time it took to get here
+        x = osKernelGetTickCount();
+        for( const char* c = m_mqttClient_clientCfg.clientId; ( NULL != c ) && ( '\0' != *c ); c++ )
+        {
+            x = ( x * 31u ) + (uint8_t)*c;
+        }
+        x = ( 0 != x ) ? x : 1u;
+    }
+
+    // xorshift32
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m_mqttClient_connection.jitterSeed = x;
+
+    return ( delayMs / 2u ) + ( x % ( ( delayMs / 2u ) + 1u ) );
+}
+
+static tMqttClient_connectionResult connectionResultFromStatus( mqtt_connection_status_t status )
+{
+    tMqttClient_connectionResult result;
+
     switch( status )
     {
         case MQTT_CONNECT_ACCEPTED:
         {
-            LOG_DEBUG( "connectionStatusCallback: connection accepted" );
-            m_mqttClient_connectionStatus = CONNECTION_ACCEPTED;
+            result = CONNECTION_ACCEPTED;
         }
         break;
         case MQTT_CONNECT_REFUSED_PROTOCOL_VERSION:
@@ -191,107 +680,317 @@ static void connectionStatusCallback( mqtt_client_t* client, void* arg, mqtt_con
         case MQTT_CONNECT_REFUSED_USERNAME_PASS:
         case MQTT_CONNECT_REFUSED_NOT_AUTHORIZED_:
         {
-            LOG_DEBUG( "connectionStatusCallback: received unnkown status" );
-            m_mqttClient_connectionStatus = CONNECTION_REFUSED;
+            result = CONNECTION_REFUSED;
         }
         break;
         case MQTT_CONNECT_TIMEOUT:
         {
-            m_mqttClient_connectionStatus = CONNECTION_TIMEOUTED;
-            LOG_DEBUG( "connectionStatusCallback: timeout durring connection" );
-        };
+            result = CONNECTION_TIMEOUTED;
+        }
         break;
         case MQTT_CONNECT_DISCONNECTED:
         {
-            LOG_DEBUG( "connectionStatusCallback: disconnected" );
-            m_mqttClient_connectionStatus = CONNECTION_BROKER_NOT_AVAILABLE;
-            if( ( NULL != m_mqttClient_clientCfg.disconnectCallback ) && !m_mqttClient_connectionInProgress )
-            {
-                m_mqttClient_clientCfg.disconnectCallback();
-            }
+            result = CONNECTION_BROKER_NOT_AVAILABLE;
         }
         break;
         default:
         {
-            LOG_ERROR( "connectionStatusCallback: received unnkown status" );
+            result = CONNECTION_ERROR;
         }
         break;
     }
 
-    m_mqttClient_connectionInProgress = false;
-    osSemaphoreRelease( m_mqttClient_syncSemaphore );
+    return result;
+}
+
+/* Callback required by mqtt API, runs on the lwIP thread and only forwards the status */
+static void connectionStatusCallback( mqtt_client_t* client, void* arg, mqtt_connection_status_t status )
+{
+    LOG_DEBUG( "connectionStatusCallback: status %d", status );
+
+    if( osOK != osMessageQueuePut( m_mqttClient_eventQueue, &status, 0, 0 ) )
+    {
+        LOG_ERROR( "connectionStatusCallback: event lost" );
+    }
+
+    osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_CONNECTION );
+}
+
+static uint32_t outboxWaitTime( void )
+{
+    tMqttClient_outbox* outbox = &m_mqttClient_outbox;
+    uint32_t waitTime = osWaitForever;
+
+    if( outbox->connected && !mqttStreamer_waiting() && ( outbox->count > outbox->inFlight ) && ( outbox->inFlight < MQTT_CLIENT_INFLIGHT_WINDOW ) )
+    {
+        uint32_t elapsed = osKernelGetTickCount() - outbox->lastPublishTick;
+        waitTime = ( elapsed < MQTT_CLIENT_DRAIN_INTERVAL_MS ) ? ( MQTT_CLIENT_DRAIN_INTERVAL_MS - elapsed ) : 0;
+    }
+
+    return waitTime;
 }
 
-static void sendMessageOverMqtt( const tMqttClient_dataPacket* pMsg )
+static void outboxAppend( tMqttClient_message* message )
 {
-    if( mqtt_client_is_connected( m_mqttClient_client ) )
+    tMqttClient_outbox* outbox = &m_mqttClient_outbox;
+    tMqttClient_outboxEntry* entry = &outbox->entries[( outbox->head + outbox->count ) % MQTT_CLIENT_MESSAGE_POOL_SIZE];
+
+    entry->message = message;
+    entry->state = OUTBOX_ENTRY_PENDING;
+    entry->token = 0;
+    entry->errorLogged = false;
+    outbox->count++;
+}
+
+static void outboxSetConnected( bool connected )
+{
+    tMqttClient_outbox* outbox = &m_mqttClient_outbox;
+
+    if( connected && !outbox->connected )
+    {
+        LOG_INFO( "Broker connected, %u messages in outbox", (unsigned int)outbox->count );
+    }
+    else if( !connected && outbox->connected )
     {
-        uint8_t qos = 0;
-        uint8_t retain = 0;
-        size_t messageLength = strlen( pMsg->data ) + 1;
-        err_t err = mqtt_publish( m_mqttClient_client, pMsg->topic, pMsg->data, messageLength, qos, retain, NULL, NULL );
-        if( ERR_OK != err )
+        // lwIP drops its pending requests on close without calling them back, send them again
+        for( uint16_t i = 0; i < outbox->count; i++ )
         {
-            LOG_ERROR( "Publish err: %d\r\n", err );
+            tMqttClient_outboxEntry* entry = &outbox->entries[( outbox->head + i ) % MQTT_CLIENT_MESSAGE_POOL_SIZE];
+
+            if( OUTBOX_ENTRY_IN_FLIGHT == entry->state )
+            {
+                entry->state = OUTBOX_ENTRY_PENDING;
+            }
         }
+
+        LOG_WARNING( "Broker disconnected, holding %u messages", (unsigned int)outbox->count );
+        outbox->inFlight = 0;
     }
-    else
+
+    outbox->connected = connected;
+}
+
+static void outboxProcessAcks( void )
+{
+    tMqttClient_outbox* outbox = &m_mqttClient_outbox;
+    tMqttClient_ack ack;
+
+    while( osOK == osMessageQueueGet( m_mqttClient_ackQueue, &ack, NULL, 0 ) )
     {
-        LOG_ERROR( "Cannot send message! Client is not connected" );
+        for( uint16_t i = 0; i < outbox->count; i++ )
+        {
+            tMqttClient_outboxEntry* entry = &outbox->entries[( outbox->head + i ) % MQTT_CLIENT_MESSAGE_POOL_SIZE];
+
+            // Results of publishes from before a disconnect no longer match any entry
+            if( ( OUTBOX_ENTRY_IN_FLIGHT == entry->state ) && ( ack.token == entry->token ) )
+            {
+                if( ERR_OK == ack.result )
+                {
+                    entry->state = OUTBOX_ENTRY_ACKED;
+                }
+                else
+                {
+                    LOG_WARNING( "Publish on %s not acknowledged: %d, retrying", entry->message->topic, ack.result );
+                    entry->state = OUTBOX_ENTRY_PENDING;
+                }
+                outbox->inFlight--;
+                break;
+            }
+        }
+    }
+
+    while( ( outbox->count > 0 ) && ( OUTBOX_ENTRY_ACKED == outbox->entries[outbox->head].state ) )
+    {
+        mqttClient_freeMessage( outbox->entries[outbox->head].message );
+        outbox->head = ( outbox->head + 1u ) % MQTT_CLIENT_MESSAGE_POOL_SIZE;
+        outbox->count--;
     }
 }
 
-static void subcribeResultCallback( void* arg, err_t result )
+static void outboxDrain( void )
 {
-    LOG_DEBUG( "Subscribe result: %d", result );
+    tMqttClient_outbox* outbox = &m_mqttClient_outbox;
+
+    // A waiting stream needs lwIP idle, the outbox holds its messages until the stream is done
+    if( outbox->connected && !mqttStreamer_waiting() && ( outbox->inFlight < MQTT_CLIENT_INFLIGHT_WINDOW ) &&
+        ( ( osKernelGetTickCount() - outbox->lastPublishTick ) >= MQTT_CLIENT_DRAIN_INTERVAL_MS ) )
+    {
+        // Oldest pending entry first, a retransmission goes before newer messages
+        for( uint16_t i = 0; i < outbox->count; i++ )
+        {
+            tMqttClient_outboxEntry* entry = &outbox->entries[( outbox->head + i ) % MQTT_CLIENT_MESSAGE_POOL_SIZE];
+
+            if( OUTBOX_ENTRY_PENDING == entry->state )
+            {
+                err_t err = publishEntry( entry );
+
+                // A failed attempt is paced too, the next one waits for the drain interval
+                outbox->lastPublishTick = osKernelGetTickCount();
+
+                if( ERR_OK == err )
+                {
+                    outbox->inFlight++;
+                }
+                else if( ( ERR_MEM != err ) && !entry->errorLogged )
+                {
+                    // ERR_MEM only means lwIP is out of buffers or request slots for now
+                    LOG_ERROR( "Publish on %s failed: %d", entry->message->topic, err );
+                    entry->errorLogged = true;
+                }
+                break;
+            }
+        }
+    }
 }
 
-static void subscribeTopic( mqtt_client_t* client, const char* topic )
+static err_t publishEntry( tMqttClient_outboxEntry* entry )
 {
-    uint8_t qos = 0;
-    mqtt_set_inpub_callback( m_mqttClient_client, incommingPublishCallback, incomingDataCallback, NULL );
-    err_t err = mqtt_subscribe( client, topic, qos, subcribeResultCallback, NULL );
+    tMqttClient_outbox* outbox = &m_mqttClient_outbox;
+    uint8_t retain = 0;
+    err_t err;
+
+    outbox->nextToken++;
+    if( 0 == outbox->nextToken )
+    {
+        outbox->nextToken++;
+    }
+
+    // The state is set first, the result callback runs on the lwIP thread and only posts the token
+    entry->token = outbox->nextToken;
+    entry->state = OUTBOX_ENTRY_IN_FLIGHT;
+
+    LOCK_TCPIP_CORE();
+    err = mqtt_publish( m_mqttClient_client, entry->message->topic, entry->message->payload, entry->message->length,
+                        MQTT_CLIENT_PUBLISH_QOS, retain, publishResultCallback, (void*)(uintptr_t)entry->token );
+    UNLOCK_TCPIP_CORE();
     if( ERR_OK != err )
     {
-        LOG_ERROR( "mqtt_subscribe return: %d\n", err );
+        entry->state = OUTBOX_ENTRY_PENDING;
     }
+
+    return err;
 }
 
-/* Callback required by mqtt API */
-static void incomingDataCallback( void* arg, const u8_t* data, u16_t len, u8_t flags )
+/* Callback required by mqtt API, PUBACK received (QoS 1), packet sent (QoS 0) or request timed out */
+static void publishResultCallback( void* arg, err_t result )
 {
-    LOG_DEBUG( "Incoming publish payload with length %d, flags %u", len, (unsigned int)flags );
+    tMqttClient_ack ack = {
+        .token = (uint16_t)(uintptr_t)arg,
+        .result = result,
+    };
+
+    if( osOK != osMessageQueuePut( m_mqttClient_ackQueue, &ack, 0, 0 ) )
+    {
+        // Cannot happen while the queue is larger than the window, the entry would be retried on reconnect only
+        LOG_ERROR( "Publish result lost" );
+    }
 
-    if( m_mqttClient_messageInfo.received_len + len < MQTT_RECEIVE_BUFFER_SIZE )
+    osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_ACK );
+}
+
+static void streamProcess( void )
+{
+    if( ( MQTT_CLIENT_STATE_CONNECTED == m_mqttClient_connection.state ) &&
+        ( MQTT_STREAMER_BROKEN == mqttStreamer_process( m_mqttClient_client ) ) )
     {
-        memcpy( m_mqttClient_messageInfo.payload + m_mqttClient_messageInfo.received_len, data, len );
-        m_mqttClient_messageInfo.received_len += len;
+        // The broker is in the middle of a packet that will never end
+        LOCK_TCPIP_CORE();
+        mqtt_disconnect( m_mqttClient_client );
+        UNLOCK_TCPIP_CORE();
 
-        if( flags & MQTT_DATA_FLAG_LAST )
+        connectionBackoff( CONNECTION_ERROR );
+
+        if( NULL != m_mqttClient_clientCfg.disconnectCallback )
         {
-            m_mqttClient_messageInfo.payload[m_mqttClient_messageInfo.received_len] = '\0';
+            m_mqttClient_clientCfg.disconnectCallback();
+        }
+    }
+}
 
-            if( NULL != m_mqttClient_clientCfg.userCallback )
+static void subscribePending( void )
+{
+    uint32_t count = mqttRouter_count();
+
+    for( uint32_t index = 0; ( MQTT_CLIENT_STATE_CONNECTED == m_mqttClient_connection.state ) && !mqttStreamer_waiting() && ( index < count ); index++ )
+    {
+        if( 0 == ( m_mqttClient_subscribed & ( 1u << index ) ) )
+        {
+            const tMqttRouter_subscription* subscription = mqttRouter_get( index );
+            const tMqttClient_subscriptionRetry* retry = &m_mqttClient_subscriptionRetry[index];
+            err_t err = ERR_OK;
+            bool due;
+
+            // Marked before the request, a failed SUBACK clears the bit again on the lwIP thread
+            LOCK_TCPIP_CORE();
+            due = ( 0u == retry->backoffMs ) || ( (int32_t)( osKernelGetTickCount() - retry->retryTick ) >= 0 );
+            if( due )
+            {
+                err = mqtt_subscribe( m_mqttClient_client, subscription->filter, subscription->qos, subcribeResultCallback, (void*)(uintptr_t)index );
+            }
+            if( due && ( ERR_OK == err ) )
             {
-                m_mqttClient_clientCfg.userCallback( m_mqttClient_subTopic, m_mqttClient_messageInfo.payload, m_mqttClient_messageInfo.received_len );
+                m_mqttClient_subscribed |= ( 1u << index );
             }
+            UNLOCK_TCPIP_CORE();
 
-            LOG_DEBUG( "Full message received on topic: %s, payload: %s", m_mqttClient_subTopic, m_mqttClient_messageInfo.payload );
+            if( ERR_OK != err )
+            {
+                // Out of request slots, tried again on the next wake up
+                LOG_DEBUG( "mqtt_subscribe return: %d", err );
+                break;
+            }
         }
     }
-    else
+}
+
+/* Time until the earliest subscription waiting for its retry is due */
+static uint32_t subscribeWaitTime( void )
+{
+    uint32_t count = mqttRouter_count();
+    uint32_t now = osKernelGetTickCount();
+    uint32_t waitTime = osWaitForever;
+
+    LOCK_TCPIP_CORE();
+    for( uint32_t index = 0; index < count; index++ )
     {
-        LOG_ERROR( "Payload too large, discarding message" );
+        const tMqttClient_subscriptionRetry* retry = &m_mqttClient_subscriptionRetry[index];
+
+        if( ( 0 == ( m_mqttClient_subscribed & ( 1u << index ) ) ) && ( 0u != retry->backoffMs ) )
+        {
+            int32_t remaining = (int32_t)( retry->retryTick - now );
+            uint32_t retryWait = ( remaining > 0 ) ? (uint32_t)remaining : 0;
+
+            waitTime = ( retryWait < waitTime ) ? retryWait : waitTime;
+        }
     }
+    UNLOCK_TCPIP_CORE();
+
+    return waitTime;
 }
 
-/* Callback required by mqtt API */
-static void incommingPublishCallback( void* arg, const char* topic, u32_t tot_len )
+/* Callback required by mqtt API, SUBACK received or request timed out. Runs with the lwIP core locked */
+static void subcribeResultCallback( void* arg, err_t result )
 {
-    LOG_DEBUG( "Incoming publish at topic %s with total length %u", topic, (unsigned int)tot_len );
+    uint32_t index = (uint32_t)(uintptr_t)arg;
+    const tMqttRouter_subscription* subscription = mqttRouter_get( index );
+    tMqttClient_subscriptionRetry* retry = &m_mqttClient_subscriptionRetry[index];
 
-    memset( m_mqttClient_messageInfo.payload, 0, MQTT_RECEIVE_BUFFER_SIZE );
+    if( ERR_OK == result )
+    {
+        LOG_DEBUG( "Subscribed to %s", subscription->filter );
+        retry->backoffMs = 0;
+    }
+    else
+    {
+        // Sent again by subscribePending() once the backoff is over
+        retry->backoffMs = ( 0u == retry->backoffMs ) ? MQTT_CLIENT_SUBSCRIBE_RETRY_MIN_MS : ( 2u * retry->backoffMs );
+        retry->backoffMs = ( retry->backoffMs < MQTT_CLIENT_SUBSCRIBE_RETRY_MAX_MS ) ? retry->backoffMs : MQTT_CLIENT_SUBSCRIBE_RETRY_MAX_MS;
+        retry->retryTick = osKernelGetTickCount() + retry->backoffMs;
+        m_mqttClient_subscribed &= ~( 1u << index );
+
+        LOG_ERROR( "Subscribe to %s failed: %d, retrying in %u ms", subscription->filter, result, (unsigned int)retry->backoffMs );
+    }
 
-    m_mqttClient_messageInfo.payload_len = tot_len;
-    m_mqttClient_messageInfo.received_len = 0;
+    // A request slot is free again, retry the subscriptions that did not get one
+    osThreadFlagsSet( m_mqttClient_taskId, MQTT_CLIENT_FLAG_ACK );
 }
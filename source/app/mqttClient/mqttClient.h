@@ -1,4 +1,9 @@
+#ifndef _MQTT_CLIENT_H_
+#define _MQTT_CLIENT_H_
+
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "lwip/ip_addr.h"
 
@@ -9,12 +14,29 @@ typedef struct
     uint16_t brokerPort;
 } tMqttClient_brokerInfo;
 
+/* Publishes are built in fixed blocks of a pool, topic and payload must fit one PUBLISH packet of lwIP */
+#define MQTT_CLIENT_MESSAGE_TOPIC_LENGTH ( 48u )
+#define MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE ( 200u )
+
+/* Blocks stay in the outbox until acknowledged, this also bounds what is kept while the broker is unreachable */
+#ifndef MQTT_CLIENT_MESSAGE_POOL_SIZE
+#define MQTT_CLIENT_MESSAGE_POOL_SIZE ( 24u )
+#endif
+
 typedef struct
 {
-    /* data */
-    const char* topic;
-    const char* data;
-} tMqttClient_dataPacket;
+    char topic[MQTT_CLIENT_MESSAGE_TOPIC_LENGTH];
+    uint8_t payload[MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE];
+    uint16_t length;  // Bytes of payload used, no terminator is sent
+} tMqttClient_message;
+
+typedef enum
+{
+    MQTT_SEND_OK,
+    MQTT_SEND_NO_BUFFER,  // Pool exhausted, the publisher is behind
+    MQTT_SEND_TOO_LARGE,
+    MQTT_SEND_NOT_READY,
+} tMqttClient_sendResult;
 
 
 typedef enum
@@ -26,11 +48,58 @@ typedef enum
     CONNECTION_ERROR,
 } tMqttClient_connectionResult;
 
+/* Connection owned by mqttClientTask, it reconnects with backoff until mqttClient_disconnect() */
+typedef enum
+{
+    MQTT_CLIENT_STATE_IDLE,
+    MQTT_CLIENT_STATE_CONNECTING,
+    MQTT_CLIENT_STATE_CONNECTED,
+    MQTT_CLIENT_STATE_BACKOFF,  // Waiting before the next connection attempt
+} tMqttClient_state;
+
+typedef enum
+{
+    MQTT_STREAM_DATA,
+    MQTT_STREAM_END,      // Last fragment, may be empty
+    MQTT_STREAM_ABORTED,  // The rest of the message was dropped, no data
+} tMqttClient_streamStatus;
+
+/* Piece of an inbound publish, data is only valid during the callback */
+typedef struct
+{
+    const char* topic;
+    tMqttClient_streamStatus status;
+    const uint8_t* data;
+    size_t length;
+    size_t offset;       // Of data within the payload
+    size_t totalLength;  // Of the whole payload
+} tMqttClient_fragment;
+
+/* Inbound handlers are called from mqttRxTask, never from the lwIP thread */
 typedef void (*tMqttClient_userCallback)(const char* topic, const char* payload, size_t payloadLength);
+typedef void (*tMqttClient_streamCallback)(const tMqttClient_fragment* fragment);
 typedef void (*tMqttClient_disconnectCallback)(void);
+/* Fills up to size bytes of a streamed payload starting at offset, returns the count written, 0 aborts the stream */
+typedef size_t (*tMqttClient_payloadProvider)(uint8_t* buffer, size_t size, size_t offset, void* context);
+/* Called from mqttClientTask once TCP acknowledged the whole packet, or with false when the stream failed */
+typedef void (*tMqttClient_streamDoneCallback)(bool delivered, void* context);
+/* Called from mqttClientTask, reason is the result of the last attempt when entering BACKOFF */
+typedef void (*tMqttClient_stateCallback)(tMqttClient_state state, tMqttClient_connectionResult reason);
 
 void mqttClient_init( void );
 void mqttClient_clientCreate( const char* clientId, const tMqttClient_brokerInfo* brokerInfo, const char* subTopic );
-tMqttClient_connectionResult mqttClient_connect( void );
-void mqttClient_sendMessage( const char* topic, const char* msg );
+bool mqttClient_connect( void );
+void mqttClient_disconnect( void );
+tMqttClient_state mqttClient_getState( void );
+bool mqttClient_subscribe( const char* filter, uint8_t qos, tMqttClient_userCallback handler );
+bool mqttClient_subscribeStream( const char* filter, uint8_t qos, tMqttClient_streamCallback handler );
+tMqttClient_sendResult mqttClient_sendMessage( const char* topic, const void* data, size_t length );
+tMqttClient_message* mqttClient_allocMessage( const char* topic );
+tMqttClient_sendResult mqttClient_publishMessage( tMqttClient_message* message );
+void mqttClient_freeMessage( tMqttClient_message* message );
+tMqttClient_sendResult mqttClient_publishStream( const char* topic, size_t length, tMqttClient_payloadProvider provider,
+                                                 tMqttClient_streamDoneCallback done, void* context );
 void mqttClient_registerCallbacks( tMqttClient_userCallback userCallback, tMqttClient_disconnectCallback disconnectCallback );
+void mqttClient_registerStateCallback( tMqttClient_stateCallback stateCallback );
+
+#endif /* _MQTT_CLIENT_H_ */
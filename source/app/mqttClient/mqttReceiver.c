@@ -0,0 +1,431 @@
+#include "mqttReceiver.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "logger.h"
+#include "mqttRouter.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_MQTT
+
+/* lwIP hands the payload over in pieces of its receive buffer, one block holds one piece */
+#define MQTT_RECEIVER_BLOCK_SIZE ( MQTT_VAR_HEADER_BUFFER_LEN )
+
+#ifndef MQTT_RECEIVER_BLOCKS
+#define MQTT_RECEIVER_BLOCKS ( 16u )
+#endif
+
+/* Largest message given to a non-stream handler, bigger ones only reach stream handlers */
+#ifndef MQTT_RECEIVER_ASSEMBLY_SIZE
+#define MQTT_RECEIVER_ASSEMBLY_SIZE ( 1024u )
+#endif
+
+/* Every block plus room for abort events, which carry no block */
+#define MQTT_RECEIVER_QUEUE_SIZE ( MQTT_RECEIVER_BLOCKS + 4u )
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    uint8_t data[MQTT_RECEIVER_BLOCK_SIZE];
+} tMqttReceiver_block;
+
+typedef enum
+{
+    RECEIVER_EVENT_START,  // Block holds the topic, offset is the total length
+    RECEIVER_EVENT_DATA,
+    RECEIVER_EVENT_ABORT,  // Rest of the message was dropped
+} tMqttReceiver_eventType;
+
+typedef struct
+{
+    tMqttReceiver_eventType type;
+    bool last;
+    uint16_t length;
+    uint32_t offset;
+    uint32_t routes;
+    tMqttReceiver_block* block;
+} tMqttReceiver_event;
+
+/* Used on the lwIP thread only */
+typedef struct
+{
+    uint32_t offset;
+    bool dropping;  // No subscription or out of blocks, skip up to the next publish
+} tMqttReceiver_input;
+
+/* Used on mqttRxTask only */
+typedef struct
+{
+    bool active;
+    bool assemble;  // Some handler wants the whole message and it fits
+    char topic[MQTT_RECEIVER_BLOCK_SIZE];
+    uint32_t routes;
+    uint32_t totalLength;
+    uint32_t expectedOffset;
+    char assembly[MQTT_RECEIVER_ASSEMBLY_SIZE + 1u];  // Terminated for handlers treating it as a string
+} tMqttReceiver_message;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void mqttRxTask( void* args );
+static void beginMessage( const tMqttReceiver_event* event );
+static void deliverFragment( const tMqttReceiver_event* event );
+static void abortMessage( void );
+static void callStreamHandlers( tMqttClient_streamStatus status, const uint8_t* data, size_t length, size_t offset );
+static tMqttClient_userCallback messageHandler( const tMqttRouter_subscription* subscription );
+static bool hasStreamHandler( uint32_t routes );
+static tMqttReceiver_block* allocBlock( void );
+static void freeBlock( tMqttReceiver_block* block );
+static void postAbort( void );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tMqttReceiver_block m_mqttReceiver_blocks[MQTT_RECEIVER_BLOCKS];
+static osMessageQueueId_t m_mqttReceiver_freeBlocks;
+static osMessageQueueId_t m_mqttReceiver_eventQueue;
+static tMqttReceiver_input m_mqttReceiver_input;
+static tMqttReceiver_message m_mqttReceiver_message;
+static tMqttClient_userCallback m_mqttReceiver_defaultHandler;
+static bool m_mqttReceiver_initalized = false;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void mqttReceiver_init( void )
+{
+    if( !m_mqttReceiver_initalized )
+    {
+        m_mqttReceiver_freeBlocks = osMessageQueueNew( MQTT_RECEIVER_BLOCKS, sizeof( tMqttReceiver_block* ), NULL );
+        m_mqttReceiver_eventQueue = osMessageQueueNew( MQTT_RECEIVER_QUEUE_SIZE, sizeof( tMqttReceiver_event ), NULL );
+
+        if( ( NULL != m_mqttReceiver_freeBlocks ) && ( NULL != m_mqttReceiver_eventQueue ) )
+        {
+            const osThreadAttr_t attributes = {
+                .name = "mqttRxTask",
+                .stack_size = 2048,
+                .priority = (osPriority_t)osPriorityNormal,
+            };
+
+            for( uint32_t i = 0; i < MQTT_RECEIVER_BLOCKS; i++ )
+            {
+                freeBlock( &m_mqttReceiver_blocks[i] );
+            }
+
+            m_mqttReceiver_initalized = ( NULL != osThreadNew( mqttRxTask, NULL, &attributes ) );
+        }
+        else
+        {
+            LOG_ERROR( "Failed to create mqtt receive queues!" );
+        }
+    }
+}
+
+void mqttReceiver_setDefaultHandler( tMqttClient_userCallback handler )
+{
+    m_mqttReceiver_defaultHandler = handler;
+}
+
+/* Callback required by mqtt API, runs on the lwIP thread */
+void mqttReceiver_publishCallback( void* arg, const char* topic, u32_t tot_len )
+{
+    tMqttReceiver_event event = {
+        .type = RECEIVER_EVENT_START,
+        .offset = tot_len,
+        .routes = mqttRouter_route( topic ),
+    };
+
+    LOG_DEBUG( "Incoming publish at topic %s with total length %u", topic, (unsigned int)tot_len );
+
+    m_mqttReceiver_input.offset = 0;
+    m_mqttReceiver_input.dropping = true;
+
+    if( !m_mqttReceiver_initalized )
+    {
+        // Nothing to deliver to
+    }
+    else if( 0 == event.routes )
+    {
+        LOG_WARNING( "No subscription for %s", topic );
+    }
+    else if( ( tot_len > MQTT_RECEIVER_ASSEMBLY_SIZE ) && !hasStreamHandler( event.routes ) )
+    {
+        // Not worth taking blocks, nobody could use it
+        LOG_WARNING( "%s: %u bytes do not fit the assembly buffer, dropped", topic, (unsigned int)tot_len );
+    }
+    else if( NULL == ( event.block = allocBlock() ) )
+    {
+        LOG_WARNING( "Receiver behind, message on %s dropped", topic );
+    }
+    else
+    {
+        strncpy( (char*)event.block->data, topic, MQTT_RECEIVER_BLOCK_SIZE - 1u );
+        event.block->data[MQTT_RECEIVER_BLOCK_SIZE - 1u] = '\0';
+
+        if( osOK == osMessageQueuePut( m_mqttReceiver_eventQueue, &event, 0, 0 ) )
+        {
+            m_mqttReceiver_input.dropping = false;
+        }
+        else
+        {
+            freeBlock( event.block );
+        }
+    }
+}
+
+/* Callback required by mqtt API, runs on the lwIP thread */
+void mqttReceiver_dataCallback( void* arg, const u8_t* data, u16_t len, u8_t flags )
+{
+    tMqttReceiver_event event = {
+        .type = RECEIVER_EVENT_DATA,
+        .last = ( 0 != ( flags & MQTT_DATA_FLAG_LAST ) ),
+        .length = len,
+        .offset = m_mqttReceiver_input.offset,
+    };
+
+    if( !m_mqttReceiver_input.dropping )
+    {
+        // An empty payload still ends the message
+        event.block = ( len > 0 ) ? allocBlock() : NULL;
+
+        if( ( len > 0 ) && ( NULL == event.block ) )
+        {
+            LOG_WARNING( "Receiver behind, rest of the message dropped" );
+            m_mqttReceiver_input.dropping = true;
+            postAbort();
+        }
+        else
+        {
+            if( len > 0 )
+            {
+                memcpy( event.block->data, data, len );
+            }
+
+            if( osOK == osMessageQueuePut( m_mqttReceiver_eventQueue, &event, 0, 0 ) )
+            {
+                m_mqttReceiver_input.offset += len;
+            }
+            else
+            {
+                freeBlock( event.block );
+                m_mqttReceiver_input.dropping = true;
+                postAbort();
+            }
+        }
+    }
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void mqttRxTask( void* args )
+{
+    tMqttReceiver_event event;
+
+    while( true )
+    {
+        if( osOK == osMessageQueueGet( m_mqttReceiver_eventQueue, &event, NULL, osWaitForever ) )
+        {
+            switch( event.type )
+            {
+                case RECEIVER_EVENT_START:
+                {
+                    if( m_mqttReceiver_message.active )
+                    {
+                        abortMessage();
+                    }
+                    beginMessage( &event );
+                }
+                break;
+                case RECEIVER_EVENT_DATA:
+                {
+                    if( m_mqttReceiver_message.active && ( event.offset != m_mqttReceiver_message.expectedOffset ) )
+                    {
+                        // A piece went missing without an abort event reaching us
+                        abortMessage();
+                    }
+                    else if( m_mqttReceiver_message.active )
+                    {
+                        deliverFragment( &event );
+                    }
+                }
+                break;
+                case RECEIVER_EVENT_ABORT:
+                {
+                    if( m_mqttReceiver_message.active )
+                    {
+                        abortMessage();
+                    }
+                }
+                break;
+                default:
+                    break;
+            }
+
+            freeBlock( event.block );
+        }
+    }
+}
+
+static void beginMessage( const tMqttReceiver_event* event )
+{
+    tMqttReceiver_message* message = &m_mqttReceiver_message;
+    bool wantsWhole = false;
+
+    memcpy( message->topic, event->block->data, MQTT_RECEIVER_BLOCK_SIZE );
+    message->routes = event->routes;
+    message->totalLength = event->offset;
+    message->expectedOffset = 0;
+    message->active = true;
+
+    for( uint32_t index = 0; index < MQTT_ROUTER_MAX_SUBSCRIPTIONS; index++ )
+    {
+        if( 0 != ( message->routes & ( 1u << index ) ) )
+        {
+            wantsWhole = wantsWhole || ( NULL != messageHandler( mqttRouter_get( index ) ) );
+        }
+    }
+
+    message->assemble = wantsWhole && ( message->totalLength <= MQTT_RECEIVER_ASSEMBLY_SIZE );
+
+    if( wantsWhole && !message->assemble )
+    {
+        LOG_WARNING( "%s: %u bytes do not fit the assembly buffer, only stream handlers get it", message->topic,
+                     (unsigned int)message->totalLength );
+    }
+}
+
+static void deliverFragment( const tMqttReceiver_event* event )
+{
+    tMqttReceiver_message* message = &m_mqttReceiver_message;
+    const uint8_t* data = ( NULL != event->block ) ? event->block->data : NULL;
+
+    if( message->assemble && ( ( event->offset + event->length ) <= MQTT_RECEIVER_ASSEMBLY_SIZE ) && ( NULL != data ) )
+    {
+        memcpy( &message->assembly[event->offset], data, event->length );
+    }
+
+    callStreamHandlers( event->last ? MQTT_STREAM_END : MQTT_STREAM_DATA, data, event->length, event->offset );
+    message->expectedOffset += event->length;
+
+    if( event->last )
+    {
+        message->active = false;
+
+        if( message->assemble )
+        {
+            message->assembly[message->expectedOffset] = '\0';
+
+            LOG_DEBUG( "Full message received on topic: %s, payload: %s", message->topic, message->assembly );
+
+            for( uint32_t index = 0; index < MQTT_ROUTER_MAX_SUBSCRIPTIONS; index++ )
+            {
+                if( 0 != ( message->routes & ( 1u << index ) ) )
+                {
+                    tMqttClient_userCallback handler = messageHandler( mqttRouter_get( index ) );
+
+                    if( NULL != handler )
+                    {
+                        handler( message->topic, message->assembly, message->expectedOffset );
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void abortMessage( void )
+{
+    LOG_WARNING( "Message on %s incomplete, %u of %u bytes", m_mqttReceiver_message.topic,
+                 (unsigned int)m_mqttReceiver_message.expectedOffset, (unsigned int)m_mqttReceiver_message.totalLength );
+
+    callStreamHandlers( MQTT_STREAM_ABORTED, NULL, 0, m_mqttReceiver_message.expectedOffset );
+    m_mqttReceiver_message.active = false;
+}
+
+static void callStreamHandlers( tMqttClient_streamStatus status, const uint8_t* data, size_t length, size_t offset )
+{
+    tMqttClient_fragment fragment = {
+        .topic = m_mqttReceiver_message.topic,
+        .status = status,
+        .data = data,
+        .length = length,
+        .offset = offset,
+        .totalLength = m_mqttReceiver_message.totalLength,
+    };
+
+    for( uint32_t index = 0; index < MQTT_ROUTER_MAX_SUBSCRIPTIONS; index++ )
+    {
+        if( 0 != ( m_mqttReceiver_message.routes & ( 1u << index ) ) )
+        {
+            const tMqttRouter_subscription* subscription = mqttRouter_get( index );
+
+            if( NULL != subscription->streamHandler )
+            {
+                subscription->streamHandler( &fragment );
+            }
+        }
+    }
+}
+
+/* Handler of a subscription that takes whole messages, NULL for stream subscriptions */
+static tMqttClient_userCallback messageHandler( const tMqttRouter_subscription* subscription )
+{
+    tMqttClient_userCallback handler = NULL;
+
+    if( NULL == subscription->streamHandler )
+    {
+        handler = ( NULL != subscription->handler ) ? subscription->handler : m_mqttReceiver_defaultHandler;
+    }
+
+    return handler;
+}
+
+static bool hasStreamHandler( uint32_t routes )
+{
+    bool result = false;
+
+    for( uint32_t index = 0; index < MQTT_ROUTER_MAX_SUBSCRIPTIONS; index++ )
+    {
+        if( 0 != ( routes & ( 1u << index ) ) )
+        {
+            result = result || ( NULL != mqttRouter_get( index )->streamHandler );
+        }
+    }
+
+    return result;
+}
+
+static tMqttReceiver_block* allocBlock( void )
+{
+    tMqttReceiver_block* block = NULL;
+
+    osMessageQueueGet( m_mqttReceiver_freeBlocks, &block, NULL, 0 );
+
+    return block;
+}
+
+static void freeBlock( tMqttReceiver_block* block )
+{
+    if( NULL != block )
+    {
+        osMessageQueuePut( m_mqttReceiver_freeBlocks, &block, 0, 0 );
+    }
+}
+
+static void postAbort( void )
+{
+    tMqttReceiver_event event = {
+        .type = RECEIVER_EVENT_ABORT,
+    };
+
+    // If even this does not fit, the task notices the gap in the offsets or the next start
+    osMessageQueuePut( m_mqttReceiver_eventQueue, &event, 0, 0 );
+}
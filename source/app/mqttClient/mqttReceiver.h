@@ -0,0 +1,20 @@
+#ifndef _MQTT_RECEIVER_H_
+#define _MQTT_RECEIVER_H_
+
+#include "lwip/apps/mqtt.h"
+#include "mqttClient.h"
+
+/*
+ * Inbound publishes of the MQTT client. The lwIP callbacks only copy each fragment
+ * (at most MQTT_VAR_HEADER_BUFFER_LEN bytes) into a pool block and queue it, the
+ * handlers run on mqttRxTask. Stream handlers get the fragments as they arrive,
+ * other handlers get the message assembled once it is complete.
+ */
+
+void mqttReceiver_init( void );
+void mqttReceiver_setDefaultHandler( tMqttClient_userCallback handler );
+
+void mqttReceiver_publishCallback( void* arg, const char* topic, u32_t tot_len );
+void mqttReceiver_dataCallback( void* arg, const u8_t* data, u16_t len, u8_t flags );
+
+#endif /* _MQTT_RECEIVER_H_ */
@@ -0,0 +1,326 @@
+#include "mqttRouter.h"
+
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "logger.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_MQTT
+
+/* Power of two, kept at least twice the table size so probing stays short */
+#define MQTT_ROUTER_BUCKETS ( 2u * MQTT_ROUTER_MAX_SUBSCRIPTIONS )
+#define MQTT_ROUTER_EMPTY   ( 0xFFu )
+
+#define MQTT_ROUTER_LEVEL_SEPARATOR '/'
+#define MQTT_ROUTER_SINGLE_LEVEL    '+'
+#define MQTT_ROUTER_MULTI_LEVEL     '#'
+
+#define FNV_OFFSET_BASIS ( 2166136261u )
+#define FNV_PRIME        ( 16777619u )
+
+_Static_assert( 0 == ( MQTT_ROUTER_BUCKETS & ( MQTT_ROUTER_BUCKETS - 1u ) ), "Bucket count must be a power of two" );
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    uint8_t offset;
+    uint8_t length;
+    uint32_t hash;
+} tMqttRouter_level;
+
+/* Topic or filter split into levels, levelCount above MQTT_ROUTER_MAX_LEVELS means longer than the table */
+typedef struct
+{
+    uint8_t levelCount;
+    tMqttRouter_level levels[MQTT_ROUTER_MAX_LEVELS];
+    uint32_t hash;  // Whole string
+} tMqttRouter_topic;
+
+typedef struct
+{
+    tMqttRouter_topic compiled;
+    uint8_t singleLevelMask;  // Bit n - level n is '+'
+    bool multiLevel;          // Last level is '#', it is not counted in levelCount
+    bool wildcard;
+} tMqttRouter_filter;
+
+typedef struct
+{
+    tMqttRouter_subscription subscriptions[MQTT_ROUTER_MAX_SUBSCRIPTIONS];
+    tMqttRouter_filter filters[MQTT_ROUTER_MAX_SUBSCRIPTIONS];
+    uint8_t exactBuckets[MQTT_ROUTER_BUCKETS];  // Index of a filter without wildcards, open addressing
+    uint32_t wildcardMask;                      // Filters matched level by level
+    volatile uint32_t count;                    // Written last, entries below it are complete
+    osMutexId_t mutex;                          // Serializes adding only
+} tMqttRouter;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static bool splitTopic( const char* topic, tMqttRouter_topic* result );
+static bool compileFilter( const char* filter, tMqttRouter_filter* result );
+static bool matchExact( uint32_t index, const char* topic, const tMqttRouter_topic* split );
+static bool matchWildcard( uint32_t index, const char* topic, const tMqttRouter_topic* split );
+static bool levelEquals( const char* a, const tMqttRouter_level* levelA, const char* b, const tMqttRouter_level* levelB );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tMqttRouter m_mqttRouter;
+static bool m_mqttRouter_initalized = false;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void mqttRouter_init( void )
+{
+    if( !m_mqttRouter_initalized )
+    {
+        memset( m_mqttRouter.exactBuckets, MQTT_ROUTER_EMPTY, sizeof( m_mqttRouter.exactBuckets ) );
+        m_mqttRouter.mutex = osMutexNew( NULL );
+        m_mqttRouter_initalized = ( NULL != m_mqttRouter.mutex );
+    }
+}
+
+/* Returns the index of the subscription or -1 if the filter is invalid or the table full */
+int32_t mqttRouter_add( const char* filter, uint8_t qos, tMqttClient_userCallback handler, tMqttClient_streamCallback streamHandler )
+{
+    int32_t result = -1;
+    tMqttRouter_filter compiled;
+
+    if( !m_mqttRouter_initalized || ( NULL == filter ) || ( strlen( filter ) >= MQTT_ROUTER_FILTER_LENGTH ) ||
+        !compileFilter( filter, &compiled ) )
+    {
+        LOG_ERROR( "Invalid topic filter: %s", ( NULL != filter ) ? filter : "(null)" );
+    }
+    else if( osOK == osMutexAcquire( m_mqttRouter.mutex, osWaitForever ) )
+    {
+        uint32_t index = m_mqttRouter.count;
+
+        if( index < MQTT_ROUTER_MAX_SUBSCRIPTIONS )
+        {
+            tMqttRouter_subscription* subscription = &m_mqttRouter.subscriptions[index];
+
+            strcpy( subscription->filter, filter );
+            subscription->qos = qos;
+            subscription->handler = handler;
+            subscription->streamHandler = streamHandler;
+            m_mqttRouter.filters[index] = compiled;
+
+            if( compiled.wildcard )
+            {
+                m_mqttRouter.wildcardMask |= ( 1u << index );
+            }
+            else
+            {
+                uint32_t bucket = compiled.compiled.hash & ( MQTT_ROUTER_BUCKETS - 1u );
+
+                while( MQTT_ROUTER_EMPTY != m_mqttRouter.exactBuckets[bucket] )
+                {
+                    bucket = ( bucket + 1u ) & ( MQTT_ROUTER_BUCKETS - 1u );
+                }
+                m_mqttRouter.exactBuckets[bucket] = (uint8_t)index;
+            }
+
+            // Routing ignores anything at or above count, publish the entry only now
+            __DMB();
+            m_mqttRouter.count = index + 1u;
+            result = (int32_t)index;
+        }
+        else
+        {
+            LOG_ERROR( "Subscription table full, %s not added", filter );
+        }
+
+        osMutexRelease( m_mqttRouter.mutex );
+    }
+
+    return result;
+}
+
+uint32_t mqttRouter_count( void )
+{
+    return m_mqttRouter.count;
+}
+
+const tMqttRouter_subscription* mqttRouter_get( uint32_t index )
+{
+    return ( index < m_mqttRouter.count ) ? &m_mqttRouter.subscriptions[index] : NULL;
+}
+
+/* Returns a mask of the subscriptions matching the topic, bit n - subscription n */
+uint32_t mqttRouter_route( const char* topic )
+{
+    uint32_t routes = 0;
+    uint32_t count = m_mqttRouter.count;
+    tMqttRouter_topic split;
+
+    __DMB();
+
+    if( ( NULL != topic ) && splitTopic( topic, &split ) )
+    {
+        uint32_t bucket = split.hash & ( MQTT_ROUTER_BUCKETS - 1u );
+        uint32_t wildcards = m_mqttRouter.wildcardMask;
+
+        while( MQTT_ROUTER_EMPTY != m_mqttRouter.exactBuckets[bucket] )
+        {
+            uint32_t index = m_mqttRouter.exactBuckets[bucket];
+
+            if( ( index < count ) && matchExact( index, topic, &split ) )
+            {
+                routes |= ( 1u << index );
+            }
+            bucket = ( bucket + 1u ) & ( MQTT_ROUTER_BUCKETS - 1u );
+        }
+
+        for( uint32_t index = 0; index < count; index++ )
+        {
+            if( ( 0 != ( wildcards & ( 1u << index ) ) ) && matchWildcard( index, topic, &split ) )
+            {
+                routes |= ( 1u << index );
+            }
+        }
+    }
+
+    return routes;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static bool splitTopic( const char* topic, tMqttRouter_topic* result )
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    uint32_t levelHash = FNV_OFFSET_BASIS;
+    size_t start = 0;
+    size_t i = 0;
+
+    result->levelCount = 0;
+
+    for( ;; i++ )
+    {
+        char c = topic[i];
+
+        if( ( MQTT_ROUTER_LEVEL_SEPARATOR == c ) || ( '\0' == c ) )
+        {
+            if( result->levelCount < MQTT_ROUTER_MAX_LEVELS )
+            {
+                tMqttRouter_level* level = &result->levels[result->levelCount];
+
+                level->offset = (uint8_t)start;
+                level->length = (uint8_t)( i - start );
+                level->hash = levelHash;
+            }
+
+            // Saturates one above the limit, such a topic can only match a '#' filter
+            if( result->levelCount <= MQTT_ROUTER_MAX_LEVELS )
+            {
+                result->levelCount++;
+            }
+
+            levelHash = FNV_OFFSET_BASIS;
+            start = i + 1u;
+        }
+        else
+        {
+            levelHash = ( levelHash ^ (uint8_t)c ) * FNV_PRIME;
+        }
+
+        if( '\0' == c )
+        {
+            break;
+        }
+
+        hash = ( hash ^ (uint8_t)c ) * FNV_PRIME;
+
+        // Level offsets are 8-bit
+        if( i >= UINT8_MAX )
+        {
+            return false;
+        }
+    }
+
+    result->hash = hash;
+
+    return true;
+}
+
+static bool compileFilter( const char* filter, tMqttRouter_filter* result )
+{
+    bool valid = ( '\0' != filter[0] ) && splitTopic( filter, &result->compiled ) && ( result->compiled.levelCount <= MQTT_ROUTER_MAX_LEVELS );
+
+    result->singleLevelMask = 0;
+    result->multiLevel = false;
+
+    for( uint8_t n = 0; valid && ( n < result->compiled.levelCount ); n++ )
+    {
+        const tMqttRouter_level* level = &result->compiled.levels[n];
+        const char* text = &filter[level->offset];
+
+        if( ( 1u == level->length ) && ( MQTT_ROUTER_SINGLE_LEVEL == text[0] ) )
+        {
+            result->singleLevelMask |= ( 1u << n );
+        }
+        else if( ( 1u == level->length ) && ( MQTT_ROUTER_MULTI_LEVEL == text[0] ) )
+        {
+            // '#' is only allowed as the whole last level
+            valid = ( ( n + 1u ) == result->compiled.levelCount );
+            result->multiLevel = true;
+        }
+        else
+        {
+            valid = ( NULL == memchr( text, MQTT_ROUTER_SINGLE_LEVEL, level->length ) ) &&
+                    ( NULL == memchr( text, MQTT_ROUTER_MULTI_LEVEL, level->length ) );
+        }
+    }
+
+    if( result->multiLevel )
+    {
+        result->compiled.levelCount--;
+    }
+    result->wildcard = result->multiLevel || ( 0 != result->singleLevelMask );
+
+    return valid;
+}
+
+static bool matchExact( uint32_t index, const char* topic, const tMqttRouter_topic* split )
+{
+    const tMqttRouter_filter* filter = &m_mqttRouter.filters[index];
+
+    return ( filter->compiled.hash == split->hash ) && ( 0 == strcmp( m_mqttRouter.subscriptions[index].filter, topic ) );
+}
+
+static bool matchWildcard( uint32_t index, const char* topic, const tMqttRouter_topic* split )
+{
+    const tMqttRouter_filter* filter = &m_mqttRouter.filters[index];
+    const char* filterText = m_mqttRouter.subscriptions[index].filter;
+    uint8_t levels = filter->compiled.levelCount;
+    bool match = filter->multiLevel ? ( split->levelCount >= levels ) : ( split->levelCount == levels );
+
+    // Wildcards in the first level do not match system topics like $SYS
+    if( match && ( '$' == topic[0] ) && ( ( 0 == levels ) || ( 0 != ( filter->singleLevelMask & 1u ) ) ) )
+    {
+        match = false;
+    }
+
+    for( uint8_t n = 0; match && ( n < levels ); n++ )
+    {
+        if( 0 == ( filter->singleLevelMask & ( 1u << n ) ) )
+        {
+            match = ( filter->compiled.levels[n].hash == split->levels[n].hash ) &&
+                    levelEquals( filterText, &filter->compiled.levels[n], topic, &split->levels[n] );
+        }
+    }
+
+    return match;
+}
+
+static bool levelEquals( const char* a, const tMqttRouter_level* levelA, const char* b, const tMqttRouter_level* levelB )
+{
+    return ( levelA->length == levelB->length ) && ( 0 == memcmp( &a[levelA->offset], &b[levelB->offset], levelA->length ) );
+}
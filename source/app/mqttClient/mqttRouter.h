@@ -0,0 +1,43 @@
+#ifndef _MQTT_ROUTER_H_
+#define _MQTT_ROUTER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mqttClient.h"
+
+/*
+ * Subscription table of the MQTT client. Filters are compiled once when added: a
+ * filter without wildcards goes to a hash table keyed by the whole topic, a filter
+ * with '+' or '#' keeps a hash per level. Routing an inbound topic hashes it once
+ * and compares integers, strings are only compared to confirm a hash match.
+ *
+ * Subscriptions can only be added. mqttRouter_route() does not lock, it runs on the
+ * lwIP thread while other tasks add subscriptions.
+ */
+
+#ifndef MQTT_ROUTER_MAX_SUBSCRIPTIONS
+#define MQTT_ROUTER_MAX_SUBSCRIPTIONS ( 8u )
+#endif
+
+#define MQTT_ROUTER_FILTER_LENGTH ( 100u )
+#define MQTT_ROUTER_MAX_LEVELS    ( 8u )
+
+_Static_assert( MQTT_ROUTER_MAX_SUBSCRIPTIONS <= 32u, "Routes are returned as a 32-bit mask" );
+
+typedef struct
+{
+    char filter[MQTT_ROUTER_FILTER_LENGTH];
+    uint8_t qos;
+    tMqttClient_userCallback handler;  // NULL - the callback given to mqttClient_registerCallbacks()
+    tMqttClient_streamCallback streamHandler;  // Set - fragments go here instead of handler
+} tMqttRouter_subscription;
+
+void mqttRouter_init( void );
+int32_t mqttRouter_add( const char* filter, uint8_t qos, tMqttClient_userCallback handler, tMqttClient_streamCallback streamHandler );
+uint32_t mqttRouter_count( void );
+const tMqttRouter_subscription* mqttRouter_get( uint32_t index );
+uint32_t mqttRouter_route( const char* topic );
+
+#endif /* _MQTT_ROUTER_H_ */
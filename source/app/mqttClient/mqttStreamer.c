@@ -0,0 +1,490 @@
+#include "mqttStreamer.h"
+
+#include <string.h>
+
+#include "logger.h"
+#include "lwip/apps/mqtt_priv.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_MQTT
+
+/* Bytes asked from the provider at once, one segment keeps the copies into lwIP whole */
+#ifndef MQTT_STREAMER_CHUNK_SIZE
+#define MQTT_STREAMER_CHUNK_SIZE ( TCP_MSS )
+#endif
+
+#ifndef MQTT_STREAMER_QUEUE_SIZE
+#define MQTT_STREAMER_QUEUE_SIZE ( 2u )
+#endif
+
+/* A stream that neither writes nor gets acknowledged for this long is given up with the connection */
+#ifndef MQTT_STREAMER_STALL_TIMEOUT_MS
+#define MQTT_STREAMER_STALL_TIMEOUT_MS ( 20000u )
+#endif
+
+/* Wake up period while running, also keeps the keep-alive of lwIP from queueing a PINGREQ */
+#define MQTT_STREAMER_POLL_MS ( 1000u )
+
+/* Wake up period while waiting for lwIP to finish its pending requests */
+#define MQTT_STREAMER_RETRY_MS ( 100u )
+
+/* Largest Remaining Length of an MQTT packet, four bytes of variable length encoding */
+#define MQTT_STREAMER_MAX_REMAINING_LENGTH ( 268435455u )
+
+#define MQTT_STREAMER_PUBLISH_HEADER ( 0x30u )  // PUBLISH, QoS 0, no retain
+
+/* Fixed header, topic length and topic */
+#define MQTT_STREAMER_HEADER_MAX_SIZE ( 1u + 4u + 2u + MQTT_CLIENT_MESSAGE_TOPIC_LENGTH )
+
+_Static_assert( MQTT_STREAMER_HEADER_MAX_SIZE <= MQTT_STREAMER_CHUNK_SIZE, "Packet header does not fit one chunk" );
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    char topic[MQTT_CLIENT_MESSAGE_TOPIC_LENGTH];
+    size_t length;
+    tMqttClient_payloadProvider provider;
+    tMqttClient_streamDoneCallback done;
+    void* context;
+} tMqttStreamer_request;
+
+/* Callbacks of the MQTT client on the pcb, put back when the stream ends */
+typedef struct
+{
+    tcp_recv_fn recv;
+    tcp_sent_fn sent;
+    tcp_poll_fn poll;
+    u8_t pollInterval;
+} tMqttStreamer_hooks;
+
+typedef struct
+{
+    tMqttStreamer_request request;
+    bool pending;  // Request taken from the queue, waiting for the connection
+    bool active;
+    bool hooked;   // Changed with the core locked, also from the lwIP thread
+    struct tcp_pcb* pcb;
+    tMqttStreamer_hooks hooks;
+    size_t payloadOffset;  // Payload bytes taken from the provider
+    size_t written;        // Packet bytes handed to TCP
+    volatile uint32_t lastProgressTick;
+    uint16_t chunkOffset;
+    uint16_t chunkLength;
+    uint8_t chunk[MQTT_STREAMER_CHUNK_SIZE];
+} tMqttStreamer_stream;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void startNext( mqtt_client_t* client );
+static tMqttStreamer_status writeStream( mqtt_client_t* client );
+static bool fillChunk( void );
+static bool writeChunk( mqtt_client_t* client, bool* complete );
+static void finishStream( mqtt_client_t* client, bool delivered );
+static uint16_t encodeHeader( uint8_t* buffer, const char* topic, size_t length );
+static void hook( struct tcp_pcb* pcb );
+static void unhook( struct tcp_pcb* pcb );
+static err_t streamRecv( void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err );
+static err_t streamSent( void* arg, struct tcp_pcb* pcb, u16_t len );
+static err_t streamPoll( void* arg, struct tcp_pcb* pcb );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static osMessageQueueId_t m_mqttStreamer_queue;
+static tMqttStreamer_stream m_mqttStreamer_stream;
+static osThreadId_t m_mqttStreamer_owner;
+static uint32_t m_mqttStreamer_flag;
+static bool m_mqttStreamer_initalized = false;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+/* The owner is the task calling mqttStreamer_process(), woken with the flag by the TCP callbacks */
+void mqttStreamer_init( osThreadId_t owner, uint32_t flag )
+{
+    if( !m_mqttStreamer_initalized )
+    {
+        m_mqttStreamer_owner = owner;
+        m_mqttStreamer_flag = flag;
+        m_mqttStreamer_queue = osMessageQueueNew( MQTT_STREAMER_QUEUE_SIZE, sizeof( tMqttStreamer_request ), NULL );
+        m_mqttStreamer_initalized = ( NULL != m_mqttStreamer_queue );
+    }
+}
+
+tMqttClient_sendResult mqttStreamer_enqueue( const char* topic, size_t length, tMqttClient_payloadProvider provider,
+                                             tMqttClient_streamDoneCallback done, void* context )
+{
+    tMqttClient_sendResult result = MQTT_SEND_NOT_READY;
+    size_t topicLength = ( NULL != topic ) ? strlen( topic ) : MQTT_CLIENT_MESSAGE_TOPIC_LENGTH;
+
+    if( !m_mqttStreamer_initalized || ( NULL == provider ) )
+    {
+        // Nothing to stream with
+    }
+    else if( ( topicLength >= MQTT_CLIENT_MESSAGE_TOPIC_LENGTH ) || ( length > ( MQTT_STREAMER_MAX_REMAINING_LENGTH - 2u - topicLength ) ) )
+    {
+        result = MQTT_SEND_TOO_LARGE;
+    }
+    else
+    {
+        tMqttStreamer_request request = {
+            .length = length,
+            .provider = provider,
+            .done = done,
+            .context = context,
+        };
+
+        memcpy( request.topic, topic, topicLength + 1u );
+        result = ( osOK == osMessageQueuePut( m_mqttStreamer_queue, &request, 0, 0 ) ) ? MQTT_SEND_OK : MQTT_SEND_NO_BUFFER;
+    }
+
+    return result;
+}
+
+/* True while a stream is queued or running, the client should let its in-flight requests finish */
+bool mqttStreamer_waiting( void )
+{
+    return m_mqttStreamer_initalized &&
+           ( m_mqttStreamer_stream.pending || m_mqttStreamer_stream.active || ( osMessageQueueGetCount( m_mqttStreamer_queue ) > 0 ) );
+}
+
+uint32_t mqttStreamer_waitTime( void )
+{
+    uint32_t waitTime = osWaitForever;
+
+    if( m_mqttStreamer_stream.active )
+    {
+        waitTime = MQTT_STREAMER_POLL_MS;
+    }
+    else if( mqttStreamer_waiting() )
+    {
+        waitTime = MQTT_STREAMER_RETRY_MS;
+    }
+
+    return waitTime;
+}
+
+/* Called by the owner on every wake up while the client is connected */
+tMqttStreamer_status mqttStreamer_process( mqtt_client_t* client )
+{
+    tMqttStreamer_status status = MQTT_STREAMER_IDLE;
+
+    if( m_mqttStreamer_initalized && !m_mqttStreamer_stream.active )
+    {
+        startNext( client );
+    }
+
+    if( m_mqttStreamer_stream.active )
+    {
+        status = writeStream( client );
+    }
+
+    return status;
+}
+
+/* The connection is closing or gone, the running stream fails, queued ones wait for the next connection */
+void mqttStreamer_abort( mqtt_client_t* client )
+{
+    if( m_mqttStreamer_stream.active )
+    {
+        LOG_WARNING( "Stream on %s aborted at %u bytes", m_mqttStreamer_stream.request.topic, (unsigned int)m_mqttStreamer_stream.written );
+        finishStream( client, false );
+    }
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void startNext( mqtt_client_t* client )
+{
+    tMqttStreamer_stream* stream = &m_mqttStreamer_stream;
+    bool ready = false;
+
+    if( !stream->pending )
+    {
+        stream->pending = ( osOK == osMessageQueueGet( m_mqttStreamer_queue, &stream->request, NULL, 0 ) );
+    }
+
+    if( stream->pending )
+    {
+        LOCK_TCPIP_CORE();
+        // Anything lwIP still has to write or wait for would end up inside the packet
+        ready = ( NULL != client->conn ) && ( NULL == client->pend_req_queue ) && ( client->output.put == client->output.get );
+        if( ready )
+        {
+            stream->pcb = client->conn;
+            hook( stream->pcb );
+        }
+        UNLOCK_TCPIP_CORE();
+    }
+
+    if( ready )
+    {
+        stream->pending = false;
+        stream->active = true;
+        stream->payloadOffset = 0;
+        stream->written = 0;
+        stream->chunkOffset = 0;
+        stream->chunkLength = encodeHeader( stream->chunk, stream->request.topic, stream->request.length );
+        stream->lastProgressTick = osKernelGetTickCount();
+
+        LOG_INFO( "Streaming %u bytes on %s", (unsigned int)stream->request.length, stream->request.topic );
+    }
+}
+
+static tMqttStreamer_status writeStream( mqtt_client_t* client )
+{
+    tMqttStreamer_stream* stream = &m_mqttStreamer_stream;
+    tMqttStreamer_status status = MQTT_STREAMER_BUSY;
+    bool complete = false;
+    bool failed = false;
+
+    // Refill and write until TCP is full, the rest goes on the next sent callback
+    while( !failed && !complete )
+    {
+        if( ( stream->chunkOffset == stream->chunkLength ) && ( stream->payloadOffset < stream->request.length ) )
+        {
+            failed = !fillChunk();
+        }
+
+        if( !failed )
+        {
+            failed = !writeChunk( client, &complete );
+        }
+
+        if( !failed && !complete && ( stream->chunkOffset < stream->chunkLength ) )
+        {
+            break;
+        }
+
+        if( !failed && !complete && ( stream->payloadOffset == stream->request.length ) )
+        {
+            // Everything is written, waiting for the acknowledgements
+            break;
+        }
+    }
+
+    if( !failed && !complete && ( ( osKernelGetTickCount() - stream->lastProgressTick ) > MQTT_STREAMER_STALL_TIMEOUT_MS ) )
+    {
+        LOG_ERROR( "Stream on %s stalled at %u bytes", stream->request.topic, (unsigned int)stream->written );
+        failed = true;
+    }
+
+    if( complete )
+    {
+        LOG_DEBUG( "Stream on %s delivered", stream->request.topic );
+        finishStream( client, true );
+        status = MQTT_STREAMER_IDLE;
+    }
+    else if( failed )
+    {
+        // A packet cut short cannot be taken back, only closing the connection resyncs the broker
+        status = ( 0 != stream->written ) ? MQTT_STREAMER_BROKEN : MQTT_STREAMER_IDLE;
+        finishStream( client, false );
+    }
+
+    return status;
+}
+
+static bool fillChunk( void )
+{
+    tMqttStreamer_stream* stream = &m_mqttStreamer_stream;
+    size_t remaining = stream->request.length - stream->payloadOffset;
+    size_t size = ( remaining < MQTT_STREAMER_CHUNK_SIZE ) ? remaining : MQTT_STREAMER_CHUNK_SIZE;
+    size_t length = stream->request.provider( stream->chunk, size, stream->payloadOffset, stream->request.context );
+    bool result = ( length > 0 ) && ( length <= size );
+
+    if( result )
+    {
+        stream->chunkOffset = 0;
+        stream->chunkLength = (uint16_t)length;
+        stream->payloadOffset += length;
+    }
+    else
+    {
+        LOG_ERROR( "Stream on %s: provider failed at %u", stream->request.topic, (unsigned int)stream->payloadOffset );
+    }
+
+    return result;
+}
+
+static bool writeChunk( mqtt_client_t* client, bool* complete )
+{
+    tMqttStreamer_stream* stream = &m_mqttStreamer_stream;
+    bool result = true;
+
+    LOCK_TCPIP_CORE();
+    if( ( client->conn != stream->pcb ) || !stream->hooked )
+    {
+        // Closed by lwIP, the pcb may already be freed
+        result = false;
+    }
+    else
+    {
+        struct tcp_pcb* pcb = stream->pcb;
+
+        // The lwIP keep-alive would queue a PINGREQ after keep_alive of silence from the client
+        client->cyclic_tick = 0;
+        client->server_watchdog = 0;
+
+        while( result && ( stream->chunkOffset < stream->chunkLength ) && ( tcp_sndbuf( pcb ) > 0 ) &&
+               ( tcp_sndqueuelen( pcb ) < TCP_SND_QUEUELEN ) )
+        {
+            uint16_t length = stream->chunkLength - stream->chunkOffset;
+            bool more = ( stream->payloadOffset < stream->request.length );
+            err_t err;
+
+            if( length > tcp_sndbuf( pcb ) )
+            {
+                length = tcp_sndbuf( pcb );
+                more = true;
+            }
+
+            err = tcp_write( pcb, &stream->chunk[stream->chunkOffset], length, TCP_WRITE_FLAG_COPY | ( more ? TCP_WRITE_FLAG_MORE : 0 ) );
+            if( ERR_OK == err )
+            {
+                stream->chunkOffset += length;
+                stream->written += length;
+                stream->lastProgressTick = osKernelGetTickCount();
+            }
+            else if( ERR_MEM == err )
+            {
+                // Out of segments for now, retried on the next sent callback
+                break;
+            }
+            else
+            {
+                LOG_ERROR( "tcp_write return: %d", err );
+                result = false;
+            }
+        }
+
+        if( result )
+        {
+            tcp_output( pcb );
+            *complete = ( stream->chunkOffset == stream->chunkLength ) && ( stream->payloadOffset == stream->request.length ) &&
+                        ( NULL == pcb->unsent ) && ( NULL == pcb->unacked );
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    return result;
+}
+
+static void finishStream( mqtt_client_t* client, bool delivered )
+{
+    tMqttStreamer_stream* stream = &m_mqttStreamer_stream;
+
+    LOCK_TCPIP_CORE();
+    if( ( client->conn == stream->pcb ) && stream->hooked )
+    {
+        // Inbound data held back meanwhile is handed to the MQTT client on the next TCP timer
+        unhook( stream->pcb );
+    }
+    UNLOCK_TCPIP_CORE();
+
+    stream->active = false;
+    stream->pcb = NULL;
+
+    if( NULL != stream->request.done )
+    {
+        stream->request.done( delivered, stream->request.context );
+    }
+}
+
+static uint16_t encodeHeader( uint8_t* buffer, const char* topic, size_t length )
+{
+    uint16_t topicLength = (uint16_t)strlen( topic );
+    uint32_t remaining = (uint32_t)( 2u + topicLength + length );
+    uint16_t index = 0;
+
+    buffer[index++] = MQTT_STREAMER_PUBLISH_HEADER;
+
+    // Variable length encoding, 7 bits per byte, least significant first
+    do
+    {
+        uint8_t digit = (uint8_t)( remaining & 0x7Fu );
+
+        remaining >>= 7;
+        buffer[index++] = ( remaining > 0 ) ? ( digit | 0x80u ) : digit;
+    } while( remaining > 0 );
+
+    buffer[index++] = (uint8_t)( topicLength >> 8 );
+    buffer[index++] = (uint8_t)( topicLength );
+    memcpy( &buffer[index], topic, topicLength );
+
+    return index + topicLength;
+}
+
+static void hook( struct tcp_pcb* pcb )
+{
+    tMqttStreamer_hooks* hooks = &m_mqttStreamer_stream.hooks;
+
+    hooks->recv = pcb->recv;
+    hooks->sent = pcb->sent;
+    hooks->poll = pcb->poll;
+    hooks->pollInterval = pcb->pollinterval;
+
+    tcp_recv( pcb, streamRecv );
+    tcp_sent( pcb, streamSent );
+    tcp_poll( pcb, streamPoll, 2 );
+    m_mqttStreamer_stream.hooked = true;
+}
+
+static void unhook( struct tcp_pcb* pcb )
+{
+    tMqttStreamer_hooks* hooks = &m_mqttStreamer_stream.hooks;
+
+    tcp_recv( pcb, hooks->recv );
+    tcp_sent( pcb, hooks->sent );
+    tcp_poll( pcb, hooks->poll, hooks->pollInterval );
+    m_mqttStreamer_stream.hooked = false;
+}
+
+/* Runs on the lwIP thread */
+static err_t streamRecv( void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err )
+{
+    err_t result = ERR_MEM;  // lwIP keeps refused data and offers it again from its timer
+
+    if( NULL == p )
+    {
+        // Closed by the broker, give the connection back so the MQTT client closes it
+        tcp_recv_fn recv = m_mqttStreamer_stream.hooks.recv;
+
+        unhook( pcb );
+        result = recv( arg, pcb, p, err );
+        osThreadFlagsSet( m_mqttStreamer_owner, m_mqttStreamer_flag );
+    }
+
+    return result;
+}
+
+/* Runs on the lwIP thread */
+static err_t streamSent( void* arg, struct tcp_pcb* pcb, u16_t len )
+{
+    mqtt_client_t* client = (mqtt_client_t*)arg;
+
+    // Same as the MQTT client does, the broker is alive while it acknowledges
+    client->cyclic_tick = 0;
+    client->server_watchdog = 0;
+    m_mqttStreamer_stream.lastProgressTick = osKernelGetTickCount();
+
+    osThreadFlagsSet( m_mqttStreamer_owner, m_mqttStreamer_flag );
+
+    return ERR_OK;
+}
+
+/* Runs on the lwIP thread */
+static err_t streamPoll( void* arg, struct tcp_pcb* pcb )
+{
+    osThreadFlagsSet( m_mqttStreamer_owner, m_mqttStreamer_flag );
+
+    return ERR_OK;
+}
@@ -0,0 +1,39 @@
+#ifndef _MQTT_STREAMER_H_
+#define _MQTT_STREAMER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmsis_os.h"
+#include "lwip/apps/mqtt.h"
+#include "mqttClient.h"
+
+/*
+ * Outbound publishes larger than the output ring buffer of lwIP. The PUBLISH packet
+ * is written by mqttClientTask straight into the TCP connection of the client, one
+ * chunk at a time as the send window frees up, the payload comes from a provider
+ * callback so it never has to be in RAM at once.
+ *
+ * While a stream runs it owns the connection: the receive, sent and poll callbacks
+ * of the pcb are taken over (inbound data is left queued in lwIP) so that nothing
+ * of the MQTT client can be written in the middle of the packet. It only starts
+ * when lwIP has no request pending and its output buffer is empty.
+ */
+
+typedef enum
+{
+    MQTT_STREAMER_IDLE,    // No stream running, the client may use the connection
+    MQTT_STREAMER_BUSY,    // A stream owns the connection
+    MQTT_STREAMER_BROKEN,  // A stream failed half written, the connection has to be closed
+} tMqttStreamer_status;
+
+void mqttStreamer_init( osThreadId_t owner, uint32_t flag );
+tMqttClient_sendResult mqttStreamer_enqueue( const char* topic, size_t length, tMqttClient_payloadProvider provider,
+                                             tMqttClient_streamDoneCallback done, void* context );
+bool mqttStreamer_waiting( void );
+uint32_t mqttStreamer_waitTime( void );
+tMqttStreamer_status mqttStreamer_process( mqtt_client_t* client );
+void mqttStreamer_abort( mqtt_client_t* client );
+
+#endif /* _MQTT_STREAMER_H_ */
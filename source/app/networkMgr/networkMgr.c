@@ -6,12 +6,15 @@
 #include "logger.h"
 #include "mqttClient.h"
 #include "network.h"
+#include "telemetry.h"
 #include "timeSync.h"
 
 /************************************************************************************
  * PRIVATE MACROS
  ***********************************************************************************/
 
+#define LOG_MODULE LOG_MODULE_NETWORK
+
 /************************************************************************************
  * PRIVATE TYPES DECLARATION
  ***********************************************************************************/
@@ -160,6 +163,7 @@ static void startNetworkServices( void )
     LOG_INFO( "Stating network services" );
     dnsResolver_init();
     mqttClient_init();
+    telemetry_init();
     httpSessionMgr_init();
     timeSync_init();
 }
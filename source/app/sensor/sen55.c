@@ -4,14 +4,18 @@
 #include <string.h>
 
 #include "cmsis_os.h"
-#include "i2c.h"
+#include "i2cBus.h"
 #include "logger.h"
+#include "sensorHistory.h"
 
 /************************************************************************************
  * PRIVATE MACROS
  ***********************************************************************************/
 
-#define SEN55_I2C_ADDRESS ( 0x69 << 1 )
+#define LOG_MODULE LOG_MODULE_SENSOR
+
+#define SEN55_I2C_ADDRESS    ( 0x69 << 1 )
+#define SEN55_I2C_TIMEOUT_MS ( 100u )
 
 #define SEN55_START_MEASUREMENT    ( 0x0021 )
 #define SEN55_STOP_MEASUREMENT     ( 0x0104 )
@@ -25,15 +29,23 @@
 #define SEN55_DEFAULT_COMMAND_EXUCTION_TIME        ( 20 )
 #define SEN55_START_MEASUREMENT_CMD_EXUECTION_TIME ( 50 )
 
+// The sensor updates its measured values once per second
+#define SEN55_MEASUREMENT_INTERVAL_MS ( 1000u )
+#define SEN55_DATA_READY_POLL_MS      ( 50u )
+
 #define SEN55_PRODUCT_NAME_LEN ( 6u )
 
 #define SEN55_I2C_TX_COMMAND_SIZE           ( 2 )
+#define SEN55_I2C_RX_BUFFER_DATA_READY      ( 3 )
 #define SEN55_I2C_RX_BUFFER_DEVICE_STATUS   ( 6 )
 #define SEN55_I2C_RX_BUFFER_PRODUCT_NAME    ( 9 )
 #define SEN55_I2C_RX_BUFFER_MEASURED_VALUES ( 24 )
 
 #define SEN55_DEVICE_STATUS_MASK ( 0x2800F0 )
 
+// Sent for the PM values while the sensor has no measurement for them yet
+#define SEN55_PM_UNKNOWN ( 0xFFFFu )
+
 /************************************************************************************
  * PRIVATE TYPES DECLARATION
  ***********************************************************************************/
@@ -43,12 +55,25 @@ typedef enum
     SEN55_STATE_READ_PRODUCT_NAME,
     SEN55_STATE_CHECK_DEVICE_STATUS,
     SEN55_STATE_START_MEASUREMENT,
+    SEN55_STATE_CHECK_DATA_READY,
     SEN55_STATE_READ_DATA,
     SEN55_STATE_PROCESS_DATA,
     SEN55_STATE_IDLE,
     SEN55_STATE_ERROR
 } tSen55Controler_state;
 
+/*
+ * Double-buffered publication: the sensor task fills the buffer that is not
+ * published and then bumps the sequence, whose parity selects the published
+ * buffer. Readers never wait for the writer, they only retry a copy that
+ * overlapped with a new publication.
+ */
+typedef struct
+{
+    tSen55_sample buffers[2];
+    volatile uint32_t sequence;
+} tSen55_publication;
+
 /************************************************************************************
  * PRIVATE FUNTCTION DECLERATION
  ***********************************************************************************/
@@ -58,26 +83,25 @@ static bool checkDeviceStatus( void );
 static uint8_t calcCrc( const uint8_t *data, uint8_t length );
 static bool readProductName( uint8_t *productName, size_t productNameMaxLen );
 static bool startMeasurement( void );
+static bool readDataReady( bool *dataReady );
 static bool readMeasurement( void );
 static bool validateCRC( uint8_t *data, size_t length );
-static void parseSensorData( const uint8_t *buffer, tSen55_data *data );
+static bool parseRawData( const uint8_t *buffer, tSen55_rawData *raw );
+static void parseSensorData( const tSen55_rawData *raw, tSen55_data *data );
 static float getAQISegment( float concentration, const float breakpoints[][2], const int aqi[], int size );
 static void sen55Task( void *args );
 static void dumpSensorData( const tSen55_data *sensorData );
+static void publishSample( const tSen55_data *data, const tSen55_rawData *raw, uint32_t timestamp );
 
 /************************************************************************************
  * PRIVATE VARIABLES DECLERATION
  ***********************************************************************************/
-extern I2C_HandleTypeDef hi2c1;
-
 static tSen55Controler_state m_sen55_currentState = SEN55_STATE_INIT;
+static uint32_t m_sen55_nextReadTick;
+static uint32_t m_sen55_wakeTick;
 static uint8_t i2cTxBuffer[SEN55_I2C_TX_COMMAND_SIZE];
 static uint8_t i2cRxBuffer[24];
-static bool i2cRxTransferComplete = false;
-static bool i2cTxTransferComplete = false;
-static bool i2cErrorOccurred = false;
-static osMutexId_t m_sen55_dataMutex;
-static tSen55_data m_sen55_sensorData;
+static tSen55_publication m_sen55_publication;
 static bool m_sen55_initalized = false;
 
 static uint8_t m_sen55_productName[SEN55_PRODUCT_NAME_LEN];
@@ -91,6 +115,18 @@ const float pm10Breakpoints[][2] = {
 };
 const int aqi[] = { 0, 50, 100, 150, 200, 300, 400, 500 };
 
+// Scale factors of the raw values, see the READ_MEASURED_VALUES description in the datasheet
+static const float m_sen55_scaleFactor[SEN55_VALUE_COUNT] = {
+    [SEN55_VALUE_PM1_0] = 10.0f,
+    [SEN55_VALUE_PM2_5] = 10.0f,
+    [SEN55_VALUE_PM4_0] = 10.0f,
+    [SEN55_VALUE_PM10] = 10.0f,
+    [SEN55_VALUE_HUMIDITY] = 100.0f,
+    [SEN55_VALUE_TEMPERATURE] = 200.0f,
+    [SEN55_VALUE_VOC_INDEX] = 10.0f,
+    [SEN55_VALUE_NOX_INDEX] = 10.0f,
+};
+
 /************************************************************************************
  * PUBLIC FUNTCTION DEFINTIONS
  ***********************************************************************************/
@@ -98,6 +134,8 @@ void sen55_init( void )
 {
     if( !m_sen55_initalized )
     {
+        sensorHistory_init();
+
         const osThreadAttr_t attributes = {
             .name = "Sen55Task",
             .stack_size = 2048,
@@ -117,37 +155,73 @@ float sen55_calculateAQI( uint16_t pm25, uint16_t pm10 )
     return fmaxf( aqiPM25, aqiPM10 );
 }
 
+/* NaN for a value the sensor does not know yet */
+float sen55_rawToFloat( tSen55_value value, int16_t raw )
+{
+    float result = 0.0f;
+
+    if( SEN55_SIGNED_UNKNOWN == raw )
+    {
+        result = NAN;
+    }
+    else if( value < SEN55_VALUE_COUNT )
+    {
+        result = raw / m_sen55_scaleFactor[value];
+    }
+
+    return result;
+}
+
 bool sen55_getSensorData( tSen55_data *data )
 {
-    bool result = false;
+    tSen55_sample sample;
+    bool result = sen55_getSample( &sample );
 
-    if( osMutexAcquire( m_sen55_dataMutex, osWaitForever ) == osOK )
+    if( result )
     {
-        memcpy( data, &m_sen55_sensorData, sizeof( tSen55_data ) );
-        osMutexRelease( m_sen55_dataMutex );
-        result = true;
+        memcpy( data, &sample.data, sizeof( tSen55_data ) );
     }
 
     return result;
 }
 
+bool sen55_getSample( tSen55_sample *sample )
+{
+    return sen55_getSampleIfNewer( 0, sample );
+}
+
+bool sen55_getSampleIfNewer( uint32_t lastSequence, tSen55_sample *sample )
+{
+    uint32_t sequence;
+
+    do
+    {
+        sequence = m_sen55_publication.sequence;
+        if( ( 0 == sequence ) || ( sequence == lastSequence ) )
+        {
+            return false;
+        }
+
+        __DMB();
+        memcpy( sample, &m_sen55_publication.buffers[sequence & 1u], sizeof( tSen55_sample ) );
+        __DMB();
+    } while( sequence != m_sen55_publication.sequence );
+
+    return true;
+}
+
 /************************************************************************************
  * PRIVATE FUNTCTION DEFINITIONS
  ***********************************************************************************/
 
 void sen55Task( void *args )
 {
-    m_sen55_dataMutex = osMutexNew( NULL );
-
     for( ;; )
     {
         switch( m_sen55_currentState )
         {
             case SEN55_STATE_INIT:
             {
-                i2cTxTransferComplete = false;
-                i2cRxTransferComplete = false;
-                i2cErrorOccurred = false;
                 m_sen55_currentState = SEN55_STATE_READ_PRODUCT_NAME;
             }
             break;
@@ -184,7 +258,9 @@ void sen55Task( void *args )
                 if( startMeasurement() )
                 {
                     LOG_INFO( "Starting measurement" );
-                    m_sen55_currentState = SEN55_STATE_READ_DATA;
+                    // The first sample is available one measurement interval after the start
+                    m_sen55_nextReadTick = osKernelGetTickCount() + SEN55_MEASUREMENT_INTERVAL_MS;
+                    m_sen55_currentState = SEN55_STATE_IDLE;
                 }
                 else
                 {
@@ -193,6 +269,29 @@ void sen55Task( void *args )
             }
             break;
 
+            case SEN55_STATE_CHECK_DATA_READY:
+            {
+                bool dataReady = false;
+
+                if( !readDataReady( &dataReady ) )
+                {
+                    m_sen55_currentState = SEN55_STATE_ERROR;
+                }
+                else if( dataReady )
+                {
+                    // Counted from the wake-up, not from now, so the I2C time does not shift the cadence
+                    m_sen55_nextReadTick = m_sen55_wakeTick + SEN55_MEASUREMENT_INTERVAL_MS;
+                    m_sen55_currentState = SEN55_STATE_READ_DATA;
+                }
+                else
+                {
+                    // Woke up ahead of the sensor, retry shortly which also moves the schedule behind its sample
+                    m_sen55_nextReadTick = m_sen55_wakeTick + SEN55_DATA_READY_POLL_MS;
+                    m_sen55_currentState = SEN55_STATE_IDLE;
+                }
+            }
+            break;
+
             case SEN55_STATE_READ_DATA:
             {
                 if( readMeasurement() )
@@ -208,17 +307,21 @@ void sen55Task( void *args )
 
             case SEN55_STATE_PROCESS_DATA:
             {
+                tSen55_rawData rawData;
                 tSen55_data tempData;
-                parseSensorData( i2cRxBuffer, &tempData );
 
-                // Update global sensor data with mutex protection
-                if( osMutexAcquire( m_sen55_dataMutex, osWaitForever ) == osOK )
+                if( parseRawData( i2cRxBuffer, &rawData ) )
                 {
-                    memcpy( &m_sen55_sensorData, &tempData, sizeof( tSen55_data ) );
-                    osMutexRelease( m_sen55_dataMutex );
-                }
+                    parseSensorData( &rawData, &tempData );
+                    publishSample( &tempData, &rawData, m_sen55_wakeTick );
+                    sensorHistory_append( &rawData, m_sen55_wakeTick );
 
-                dumpSensorData( &m_sen55_sensorData );
+                    dumpSensorData( &tempData );
+                }
+                else
+                {
+                    LOG_DEBUG( "PM values not known yet, reading dropped" );
+                }
 
                 m_sen55_currentState = SEN55_STATE_IDLE;
                 break;
@@ -231,8 +334,17 @@ void sen55Task( void *args )
                 break;
 
             case SEN55_STATE_IDLE:
-                osDelay( 1000 );
-                m_sen55_currentState = SEN55_STATE_READ_DATA;
+                // Absolute wake-up time, the time spent on I2C and processing does not add up
+                if( (int32_t)( m_sen55_nextReadTick - osKernelGetTickCount() ) > 0 )
+                {
+                    osDelayUntil( m_sen55_nextReadTick );
+                    m_sen55_wakeTick = m_sen55_nextReadTick;
+                }
+                else
+                {
+                    m_sen55_wakeTick = osKernelGetTickCount();
+                }
+                m_sen55_currentState = SEN55_STATE_CHECK_DATA_READY;
                 break;
 
             default:
@@ -246,41 +358,21 @@ static bool sendCommand( uint16_t command, uint32_t delayMs )
 {
     i2cTxBuffer[0] = ( command >> 8 ) & 0xFF;
     i2cTxBuffer[1] = command & 0xFF;
-    if( HAL_I2C_Master_Transmit_IT( &hi2c1, SEN55_I2C_ADDRESS, i2cTxBuffer, 2 ) == HAL_OK )
+
+    bool result = ( I2C_BUS_OK == i2cBus_write( SEN55_I2C_ADDRESS, i2cTxBuffer, SEN55_I2C_TX_COMMAND_SIZE, SEN55_I2C_TIMEOUT_MS ) );
+
+    if( result )
     {
-        while( !i2cTxTransferComplete && !i2cErrorOccurred )
-        {
-            osDelay( 1 );
-        }
-        if( i2cErrorOccurred )
-        {
-            i2cErrorOccurred = false;
-            return false;
-        }
-        i2cTxTransferComplete = false;
-        return true;
+        // The sensor does not respond until the command has been executed
+        osDelay( delayMs );
     }
-    return false;
+
+    return result;
 }
 
 static bool receiveData( uint8_t *buffer, size_t length )
 {
-    if( HAL_I2C_Master_Receive_IT( &hi2c1, SEN55_I2C_ADDRESS, buffer, length ) == HAL_OK )
-    {
-        while( !i2cRxTransferComplete && !i2cErrorOccurred )
-        {
-            osDelay( 1 );
-        }
-        if( i2cErrorOccurred )
-        {
-            i2cErrorOccurred = false;
-            return false;
-        }
-        i2cRxTransferComplete = false;
-        return true;
-    }
-
-    return false;
+    return ( I2C_BUS_OK == i2cBus_read( SEN55_I2C_ADDRESS, buffer, length, SEN55_I2C_TIMEOUT_MS ) );
 }
 
 static bool readProductName( uint8_t *productName, size_t productNameMaxLen )
@@ -341,6 +433,28 @@ static bool startMeasurement( void )
     return result;
 }
 
+static bool readDataReady( bool *dataReady )
+{
+    bool result = false;
+
+    if( sendCommand( SEN55_READ_DATA_READY_FLAG, SEN55_DEFAULT_COMMAND_EXUCTION_TIME ) &&
+        receiveData( i2cRxBuffer, SEN55_I2C_RX_BUFFER_DATA_READY ) )
+    {
+        if( validateCRC( i2cRxBuffer, SEN55_I2C_RX_BUFFER_DATA_READY ) )
+        {
+            // First byte is padding, the second one holds the flag
+            *dataReady = ( 0 != i2cRxBuffer[1] );
+            result = true;
+        }
+        else
+        {
+            LOG_ERROR( "CRC error in data ready response" );
+        }
+    }
+
+    return result;
+}
+
 static bool readMeasurement( void )
 {
     bool result = false;
@@ -357,6 +471,25 @@ static bool readMeasurement( void )
     return result;
 }
 
+static void publishSample( const tSen55_data *data, const tSen55_rawData *raw, uint32_t timestamp )
+{
+    // Only this task writes, the buffer of the next sequence is not visible to readers yet
+    uint32_t sequence = m_sen55_publication.sequence + 1;
+    if( 0 == sequence )
+    {
+        sequence = 2;  // 0 means "no sample", keep the parity when wrapping
+    }
+
+    tSen55_sample *sample = &m_sen55_publication.buffers[sequence & 1u];
+    memcpy( &sample->data, data, sizeof( tSen55_data ) );
+    memcpy( &sample->raw, raw, sizeof( tSen55_rawData ) );
+    sample->timestamp = timestamp;
+    sample->sequence = sequence;
+
+    __DMB();
+    m_sen55_publication.sequence = sequence;
+}
+
 static bool validateCRC( uint8_t *data, size_t length )
 {
     for( size_t i = 0; i < length; i += 3 )
@@ -369,31 +502,52 @@ static bool validateCRC( uint8_t *data, size_t length )
     return true;
 }
 
-static void parseSensorData( const uint8_t *buffer, tSen55_data *data )
+/* False when a PM value is unknown, the word would read as -1 once cast. The other values stay SEN55_SIGNED_UNKNOWN */
+static bool parseRawData( const uint8_t *buffer, tSen55_rawData *raw )
+{
+    bool result = true;
+
+    // Every value is a big endian word followed by its CRC
+    for( size_t i = 0; i < SEN55_VALUE_COUNT; i++ )
+    {
+        uint16_t word = (uint16_t)( ( buffer[i * 3] << 8 ) | buffer[i * 3 + 1] );
+
+        if( ( i <= SEN55_VALUE_PM10 ) && ( SEN55_PM_UNKNOWN == word ) )
+        {
+            result = false;
+        }
+
+        raw->values[i] = (int16_t)word;
+    }
+
+    return result;
+}
+
+static void parseSensorData( const tSen55_rawData *raw, tSen55_data *data )
 {
     // PM1.0 (µg/m³) - scale factor = 10
-    data->pm1_0 = ( ( buffer[0] << 8 ) | buffer[1] ) / 10.0f;
+    data->pm1_0 = sen55_rawToFloat( SEN55_VALUE_PM1_0, raw->values[SEN55_VALUE_PM1_0] );
 
     // PM2.5 (µg/m³) - scale factor = 10
-    data->pm2_5 = ( ( buffer[3] << 8 ) | buffer[4] ) / 10.0f;
+    data->pm2_5 = sen55_rawToFloat( SEN55_VALUE_PM2_5, raw->values[SEN55_VALUE_PM2_5] );
 
     // PM4.0 (µg/m³) - scale factor = 10
-    data->pm4_0 = ( ( buffer[6] << 8 ) | buffer[7] ) / 10.0f;
+    data->pm4_0 = sen55_rawToFloat( SEN55_VALUE_PM4_0, raw->values[SEN55_VALUE_PM4_0] );
 
     // PM10 (µg/m³) - scale factor = 10
-    data->pm10 = ( ( buffer[9] << 8 ) | buffer[10] ) / 10.0f;
+    data->pm10 = sen55_rawToFloat( SEN55_VALUE_PM10, raw->values[SEN55_VALUE_PM10] );
 
     // Humidity (%) - scale factor = 100
-    data->humidity = ( ( buffer[12] << 8 ) | buffer[13] ) / 100.0f;
+    data->humidity = sen55_rawToFloat( SEN55_VALUE_HUMIDITY, raw->values[SEN55_VALUE_HUMIDITY] );
 
     // Temperature (°C) - scale factor = 200
-    data->temperature = ( ( buffer[15] << 8 ) | buffer[16] ) / 200.0f;
+    data->temperature = sen55_rawToFloat( SEN55_VALUE_TEMPERATURE, raw->values[SEN55_VALUE_TEMPERATURE] );
 
     // VOC Index - scale factor = 10
-    data->vocIndex = ( ( buffer[18] << 8 ) | buffer[19] ) / 10.0f;
+    data->vocIndex = sen55_rawToFloat( SEN55_VALUE_VOC_INDEX, raw->values[SEN55_VALUE_VOC_INDEX] );
 
     // NOx Index - scale factor = 10
-    data->noxIndex = ( ( buffer[21] << 8 ) | buffer[22] ) / 10.0f;
+    data->noxIndex = sen55_rawToFloat( SEN55_VALUE_NOX_INDEX, raw->values[SEN55_VALUE_NOX_INDEX] );
 }
 
 static uint8_t calcCrc( const uint8_t *data, uint8_t length )
@@ -441,28 +595,3 @@ static void dumpSensorData( const tSen55_data *sensorData )
     LOG_DEBUG( "VOC Index: %.2f\n", sensorData->vocIndex );    // VOC Index
     LOG_DEBUG( "NOx Index: %.2f\n", sensorData->noxIndex );    // NOx Index
 }
-
-// HAL I2C Callbacks
-void HAL_I2C_MasterTxCpltCallback( I2C_HandleTypeDef *hi2c )
-{
-    if( hi2c == &hi2c1 )
-    {
-        i2cTxTransferComplete = true;
-    }
-}
-
-void HAL_I2C_MasterRxCpltCallback( I2C_HandleTypeDef *hi2c )
-{
-    if( hi2c == &hi2c1 )
-    {
-        i2cRxTransferComplete = true;
-    }
-}
-
-void HAL_I2C_ErrorCallback( I2C_HandleTypeDef *hi2c )
-{
-    if( hi2c == &hi2c1 )
-    {
-        i2cErrorOccurred = true;
-    }
-}
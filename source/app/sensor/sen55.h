@@ -4,6 +4,30 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/* Order of the values in the READ_MEASURED_VALUES response */
+typedef enum
+{
+    SEN55_VALUE_PM1_0,
+    SEN55_VALUE_PM2_5,
+    SEN55_VALUE_PM4_0,
+    SEN55_VALUE_PM10,
+    SEN55_VALUE_HUMIDITY,
+    SEN55_VALUE_TEMPERATURE,
+    SEN55_VALUE_VOC_INDEX,
+    SEN55_VALUE_NOX_INDEX,
+    SEN55_VALUE_COUNT
+} tSen55_value;
+
+/* Sent for humidity, temperature and the indices while the sensor does not know them yet, e.g. during warm-up */
+#define SEN55_SIGNED_UNKNOWN ( 0x7FFF )
+
+/* Values as sent by the sensor, scaled integers (PM ranges 0..10000 also fit int16) */
+typedef struct
+{
+    int16_t values[SEN55_VALUE_COUNT];
+} tSen55_rawData;
+
+/* An unknown value is NaN */
 typedef struct
 {
     float pm1_0;
@@ -16,8 +40,19 @@ typedef struct
     float noxIndex;
 } tSen55_data;
 
+typedef struct
+{
+    tSen55_data data;
+    tSen55_rawData raw;
+    uint32_t timestamp;  // Kernel tick of the read cycle that fetched the values
+    uint32_t sequence;   // Incremented for every new sample, 0 until the first one
+} tSen55_sample;
+
 void sen55_init( void );
 float sen55_calculateAQI( uint16_t pm25, uint16_t pm10 );
 bool sen55_getSensorData( tSen55_data *data );
+bool sen55_getSample( tSen55_sample *sample );
+bool sen55_getSampleIfNewer( uint32_t lastSequence, tSen55_sample *sample );
+float sen55_rawToFloat( tSen55_value value, int16_t raw );
 
 #endif /* _SEN55_H_ */
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "sensorHistory.h"
+
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "logger.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_SENSOR
+
+/*
+ * Every tier is a ring of blocks. A block starts with a keyframe (absolute values)
+ * followed by zigzag varint deltas to the previous record, 1 byte per value while the
+ * change stays within +-63. With typical sensor noise this keeps roughly 25 minutes
+ * of 1 Hz samples, 10 hours of minutes and a week of hours in ~37 KB.
+ */
+#define SENSOR_HISTORY_SECOND_BLOCKS     ( 24u )
+#define SENSOR_HISTORY_SECOND_BLOCK_SIZE ( 512u )
+#define SENSOR_HISTORY_MINUTE_BLOCKS     ( 16u )
+#define SENSOR_HISTORY_MINUTE_BLOCK_SIZE ( 1024u )
+#define SENSOR_HISTORY_HOUR_BLOCKS       ( 6u )
+#define SENSOR_HISTORY_HOUR_BLOCK_SIZE   ( 1024u )
+
+#define SENSOR_HISTORY_SECOND_MS ( 1000u )
+#define SENSOR_HISTORY_MINUTE_MS ( 60u * SENSOR_HISTORY_SECOND_MS )
+#define SENSOR_HISTORY_HOUR_MS   ( 60u * SENSOR_HISTORY_MINUTE_MS )
+
+// Aggregated tiers store min, max and mean of every value
+#define SENSOR_HISTORY_MAX_CHANNELS ( 3u * SEN55_VALUE_COUNT )
+#define SENSOR_HISTORY_MAX_DELTA_SIZE ( 3u )
+
+#define SENSOR_HISTORY_LOCK_TIMEOUT_MS ( 100u )
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    uint32_t start;      // Timestamp of the keyframe, record n is at start + n * period
+    uint16_t count;      // Records in the block, including the keyframe
+    uint16_t size;       // Bytes of deltas used
+    int16_t keyframe[SENSOR_HISTORY_MAX_CHANNELS];
+} tSensorHistory_block;
+
+typedef struct
+{
+    uint32_t periodMs;
+    uint8_t channels;
+    uint16_t blockCount;
+    uint16_t blockSize;
+    tSensorHistory_block *blocks;
+    uint8_t *storage;  // blockCount * blockSize bytes of deltas
+    uint16_t oldest;
+    uint16_t used;
+    int16_t last[SENSOR_HISTORY_MAX_CHANNELS];  // Last record appended, base of the next delta
+} tSensorHistory_series;
+
+typedef struct
+{
+    uint32_t period;                    // Index of the minute or hour being accumulated
+    uint32_t samples;                   // Records merged so far
+    uint32_t count[SEN55_VALUE_COUNT];  // Samples merged so far with the value known
+    int16_t min[SEN55_VALUE_COUNT];
+    int16_t max[SEN55_VALUE_COUNT];
+    int32_t sum[SEN55_VALUE_COUNT];
+} tSensorHistory_accumulator;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void appendRecord( tSensorHistory_series *series, uint32_t timestamp, const int16_t *values );
+static void accumulate( tSensorHistory_tier tier, uint32_t timestamp, const int16_t *min, const int16_t *max, const int32_t *sum, const uint32_t *count );
+static void flushAccumulator( tSensorHistory_tier tier );
+static size_t encodeDelta( uint8_t *buffer, int16_t delta );
+static int16_t decodeDelta( const uint8_t *buffer, size_t *offset );
+static int16_t roundedMean( int32_t sum, uint32_t count );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tSensorHistory_block m_sensorHistory_secondBlocks[SENSOR_HISTORY_SECOND_BLOCKS];
+static tSensorHistory_block m_sensorHistory_minuteBlocks[SENSOR_HISTORY_MINUTE_BLOCKS];
+static tSensorHistory_block m_sensorHistory_hourBlocks[SENSOR_HISTORY_HOUR_BLOCKS];
+
+static uint8_t m_sensorHistory_secondStorage[SENSOR_HISTORY_SECOND_BLOCKS * SENSOR_HISTORY_SECOND_BLOCK_SIZE];
+static uint8_t m_sensorHistory_minuteStorage[SENSOR_HISTORY_MINUTE_BLOCKS * SENSOR_HISTORY_MINUTE_BLOCK_SIZE];
+static uint8_t m_sensorHistory_hourStorage[SENSOR_HISTORY_HOUR_BLOCKS * SENSOR_HISTORY_HOUR_BLOCK_SIZE];
+
+static tSensorHistory_series m_sensorHistory_series[SENSOR_HISTORY_TIER_COUNT] = {
+    [SENSOR_HISTORY_TIER_SECOND] = {
+        .periodMs = SENSOR_HISTORY_SECOND_MS,
+        .channels = SEN55_VALUE_COUNT,
+        .blockCount = SENSOR_HISTORY_SECOND_BLOCKS,
+        .blockSize = SENSOR_HISTORY_SECOND_BLOCK_SIZE,
+        .blocks = m_sensorHistory_secondBlocks,
+        .storage = m_sensorHistory_secondStorage,
+    },
+    [SENSOR_HISTORY_TIER_MINUTE] = {
+        .periodMs = SENSOR_HISTORY_MINUTE_MS,
+        .channels = SENSOR_HISTORY_MAX_CHANNELS,
+        .blockCount = SENSOR_HISTORY_MINUTE_BLOCKS,
+        .blockSize = SENSOR_HISTORY_MINUTE_BLOCK_SIZE,
+        .blocks = m_sensorHistory_minuteBlocks,
+        .storage = m_sensorHistory_minuteStorage,
+    },
+    [SENSOR_HISTORY_TIER_HOUR] = {
+        .periodMs = SENSOR_HISTORY_HOUR_MS,
+        .channels = SENSOR_HISTORY_MAX_CHANNELS,
+        .blockCount = SENSOR_HISTORY_HOUR_BLOCKS,
+        .blockSize = SENSOR_HISTORY_HOUR_BLOCK_SIZE,
+        .blocks = m_sensorHistory_hourBlocks,
+        .storage = m_sensorHistory_hourStorage,
+    },
+};
+
+static tSensorHistory_accumulator m_sensorHistory_accumulator[SENSOR_HISTORY_TIER_COUNT];
+static osMutexId_t m_sensorHistory_mutex;
+static bool m_sensorHistory_initalized = false;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void sensorHistory_init( void )
+{
+    if( !m_sensorHistory_initalized )
+    {
+        const osMutexAttr_t attributes = {
+            .name = "sensorHistory",
+            .attr_bits = osMutexPrioInherit,
+        };
+        m_sensorHistory_mutex = osMutexNew( &attributes );
+        m_sensorHistory_initalized = ( NULL != m_sensorHistory_mutex );
+    }
+}
+
+void sensorHistory_append( const tSen55_rawData *raw, uint32_t timestamp )
+{
+    if( m_sensorHistory_initalized && ( osOK == osMutexAcquire( m_sensorHistory_mutex, SENSOR_HISTORY_LOCK_TIMEOUT_MS ) ) )
+    {
+        int32_t sum[SEN55_VALUE_COUNT];
+        uint32_t count[SEN55_VALUE_COUNT];
+
+        for( size_t i = 0; i < SEN55_VALUE_COUNT; i++ )
+        {
+            bool known = ( SEN55_SIGNED_UNKNOWN != raw->values[i] );
+
+            sum[i] = known ? raw->values[i] : 0;
+            count[i] = known ? 1u : 0u;
+        }
+
+        appendRecord( &m_sensorHistory_series[SENSOR_HISTORY_TIER_SECOND], timestamp, raw->values );
+        accumulate( SENSOR_HISTORY_TIER_MINUTE, timestamp, raw->values, raw->values, sum, count );
+
+        osMutexRelease( m_sensorHistory_mutex );
+    }
+    else
+    {
+        LOG_WARNING( "Sample %lu not stored in history", (unsigned long)timestamp );
+    }
+}
+
+size_t sensorHistory_read( tSensorHistory_tier tier, uint32_t since, tSensorHistory_visitor visitor, void *context )
+{
+    size_t visited = 0;
+
+    if( ( tier >= SENSOR_HISTORY_TIER_COUNT ) || !m_sensorHistory_initalized ||
+        ( osOK != osMutexAcquire( m_sensorHistory_mutex, osWaitForever ) ) )
+    {
+        return 0;
+    }
+
+    const tSensorHistory_series *series = &m_sensorHistory_series[tier];
+    bool proceed = true;
+
+    for( uint16_t b = 0; proceed && ( b < series->used ); b++ )
+    {
+        const tSensorHistory_block *block = &series->blocks[( series->oldest + b ) % series->blockCount];
+        const uint8_t *deltas = &series->storage[( ( series->oldest + b ) % series->blockCount ) * series->blockSize];
+
+        // Skip whole blocks that end before the requested time, ticks compared wrap safe
+        if( (int32_t)( ( block->start + ( block->count - 1u ) * series->periodMs ) - since ) < 0 )
+        {
+            continue;
+        }
+
+        int16_t values[SENSOR_HISTORY_MAX_CHANNELS];
+        size_t offset = 0;
+        memcpy( values, block->keyframe, series->channels * sizeof( int16_t ) );
+
+        for( uint16_t record = 0; proceed && ( record < block->count ); record++ )
+        {
+            if( record > 0 )
+            {
+                for( uint8_t channel = 0; channel < series->channels; channel++ )
+                {
+                    values[channel] = (int16_t)( values[channel] + decodeDelta( deltas, &offset ) );
+                }
+            }
+
+            uint32_t timestamp = block->start + record * series->periodMs;
+            if( (int32_t)( timestamp - since ) >= 0 )
+            {
+                tSensorHistory_entry entry = { .timestamp = timestamp };
+
+                if( SENSOR_HISTORY_TIER_SECOND == tier )
+                {
+                    memcpy( entry.min, values, sizeof( entry.min ) );
+                    memcpy( entry.max, values, sizeof( entry.max ) );
+                    memcpy( entry.mean, values, sizeof( entry.mean ) );
+                }
+                else
+                {
+                    memcpy( entry.min, &values[0], sizeof( entry.min ) );
+                    memcpy( entry.max, &values[SEN55_VALUE_COUNT], sizeof( entry.max ) );
+                    memcpy( entry.mean, &values[2 * SEN55_VALUE_COUNT], sizeof( entry.mean ) );
+                }
+
+                visited++;
+                proceed = visitor( &entry, context );
+            }
+        }
+    }
+
+    osMutexRelease( m_sensorHistory_mutex );
+
+    return visited;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void appendRecord( tSensorHistory_series *series, uint32_t timestamp, const int16_t *values )
+{
+    tSensorHistory_block *block = NULL;
+    bool newBlock = ( 0 == series->used );
+
+    if( !newBlock )
+    {
+        uint16_t newest = ( series->oldest + series->used - 1u ) % series->blockCount;
+        block = &series->blocks[newest];
+
+        // Timestamps are implicit, a missed sample or a full block starts a new one
+        int32_t drift = (int32_t)( timestamp - ( block->start + block->count * series->periodMs ) );
+        bool continuous = ( drift > -(int32_t)( series->periodMs / 2 ) ) && ( drift < (int32_t)( series->periodMs / 2 ) );
+        bool fits = ( block->size + series->channels * SENSOR_HISTORY_MAX_DELTA_SIZE ) <= series->blockSize;
+
+        newBlock = !continuous || !fits;
+    }
+
+    if( newBlock )
+    {
+        if( series->used == series->blockCount )
+        {
+            series->oldest = ( series->oldest + 1u ) % series->blockCount;
+            series->used--;
+        }
+
+        block = &series->blocks[( series->oldest + series->used ) % series->blockCount];
+        series->used++;
+
+        block->start = timestamp;
+        block->count = 1;
+        block->size = 0;
+        memcpy( block->keyframe, values, series->channels * sizeof( int16_t ) );
+    }
+    else
+    {
+        uint8_t *deltas = &series->storage[( block - series->blocks ) * series->blockSize];
+
+        for( uint8_t channel = 0; channel < series->channels; channel++ )
+        {
+            block->size += encodeDelta( &deltas[block->size], (int16_t)( values[channel] - series->last[channel] ) );
+        }
+        block->count++;
+    }
+
+    memcpy( series->last, values, series->channels * sizeof( int16_t ) );
+}
+
+/* Values with a count of 0 are unknown, their min, max and sum are ignored */
+static void accumulate( tSensorHistory_tier tier, uint32_t timestamp, const int16_t *min, const int16_t *max, const int32_t *sum, const uint32_t *count )
+{
+    tSensorHistory_accumulator *accumulator = &m_sensorHistory_accumulator[tier];
+    uint32_t period = timestamp / m_sensorHistory_series[tier].periodMs;
+
+    if( ( accumulator->samples > 0 ) && ( accumulator->period != period ) )
+    {
+        flushAccumulator( tier );
+    }
+
+    if( 0 == accumulator->samples )
+    {
+        accumulator->period = period;
+        memset( accumulator->count, 0, sizeof( accumulator->count ) );
+        memset( accumulator->sum, 0, sizeof( accumulator->sum ) );
+    }
+
+    for( size_t i = 0; i < SEN55_VALUE_COUNT; i++ )
+    {
+        if( 0 == count[i] )
+        {
+            continue;
+        }
+
+        if( 0 == accumulator->count[i] )
+        {
+            accumulator->min[i] = min[i];
+            accumulator->max[i] = max[i];
+        }
+
+        accumulator->min[i] = ( min[i] < accumulator->min[i] ) ? min[i] : accumulator->min[i];
+        accumulator->max[i] = ( max[i] > accumulator->max[i] ) ? max[i] : accumulator->max[i];
+        accumulator->sum[i] += sum[i];
+        accumulator->count[i] += count[i];
+    }
+    accumulator->samples++;
+}
+
+static void flushAccumulator( tSensorHistory_tier tier )
+{
+    tSensorHistory_accumulator *accumulator = &m_sensorHistory_accumulator[tier];
+    uint32_t start = accumulator->period * m_sensorHistory_series[tier].periodMs;
+    int16_t record[SENSOR_HISTORY_MAX_CHANNELS];
+
+    for( size_t i = 0; i < SEN55_VALUE_COUNT; i++ )
+    {
+        bool known = ( accumulator->count[i] > 0 );
+
+        record[i] = known ? accumulator->min[i] : SEN55_SIGNED_UNKNOWN;
+        record[SEN55_VALUE_COUNT + i] = known ? accumulator->max[i] : SEN55_SIGNED_UNKNOWN;
+        record[2 * SEN55_VALUE_COUNT + i] = known ? roundedMean( accumulator->sum[i], accumulator->count[i] ) : SEN55_SIGNED_UNKNOWN;
+    }
+
+    appendRecord( &m_sensorHistory_series[tier], start, record );
+
+    // The next tier is built from the sums, so its mean is weighted by the number of samples
+    if( ( tier + 1 ) < SENSOR_HISTORY_TIER_COUNT )
+    {
+        accumulate( tier + 1, start, accumulator->min, accumulator->max, accumulator->sum, accumulator->count );
+    }
+
+    accumulator->samples = 0;
+}
+
+static size_t encodeDelta( uint8_t *buffer, int16_t delta )
+{
+    uint16_t zigzag = (uint16_t)( ( (uint16_t)delta << 1 ) ^ (uint16_t)( delta >> 15 ) );
+    size_t size = 0;
+
+    do
+    {
+        uint8_t byte = zigzag & 0x7F;
+        zigzag >>= 7;
+        buffer[size++] = ( 0 != zigzag ) ? ( byte | 0x80 ) : byte;
+    } while( 0 != zigzag );
+
+    return size;
+}
+
+static int16_t decodeDelta( const uint8_t *buffer, size_t *offset )
+{
+    uint16_t zigzag = 0;
+    uint8_t shift = 0;
+    uint8_t byte;
+
+    do
+    {
+        byte = buffer[( *offset )++];
+        zigzag |= (uint16_t)( byte & 0x7F ) << shift;
+        shift += 7;
+    } while( 0 != ( byte & 0x80 ) );
+
+    return (int16_t)( ( zigzag >> 1 ) ^ ( ~( zigzag & 1u ) + 1u ) );
+}
+
+static int16_t roundedMean( int32_t sum, uint32_t count )
+{
+    int32_t half = (int32_t)( count / 2 );
+
+    return (int16_t)( ( ( sum >= 0 ) ? ( sum + half ) : ( sum - half ) ) / (int32_t)count );
+}
@@ -0,0 +1,41 @@
+#ifndef _SENSOR_HISTORY_H_
+#define _SENSOR_HISTORY_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sen55.h"
+
+/*
+ * RAM history of the SEN55 samples in three tiers: every sample (1 Hz), 1-minute
+ * and 1-hour min/max/mean. Values are kept as the raw scaled integers of the sensor,
+ * convert them with sen55_rawToFloat(). A value the sensor did not know is kept as
+ * SEN55_SIGNED_UNKNOWN and left out of min/max/mean, a minute or hour without any
+ * known value holds SEN55_SIGNED_UNKNOWN as well.
+ */
+
+typedef enum
+{
+    SENSOR_HISTORY_TIER_SECOND,
+    SENSOR_HISTORY_TIER_MINUTE,
+    SENSOR_HISTORY_TIER_HOUR,
+    SENSOR_HISTORY_TIER_COUNT
+} tSensorHistory_tier;
+
+typedef struct
+{
+    uint32_t timestamp;  // Kernel tick of the sample, or of the start of the minute/hour
+    int16_t min[SEN55_VALUE_COUNT];
+    int16_t max[SEN55_VALUE_COUNT];
+    int16_t mean[SEN55_VALUE_COUNT];  // min, max and mean are equal in the second tier
+} tSensorHistory_entry;
+
+/* Called for every entry from the oldest one, return false to stop. Runs with the history locked */
+typedef bool ( *tSensorHistory_visitor )( const tSensorHistory_entry *entry, void *context );
+
+void sensorHistory_init( void );
+void sensorHistory_append( const tSen55_rawData *raw, uint32_t timestamp );
+size_t sensorHistory_read( tSensorHistory_tier tier, uint32_t since, tSensorHistory_visitor visitor, void *context );
+
+#endif /* _SENSOR_HISTORY_H_ */
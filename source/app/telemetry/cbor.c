@@ -0,0 +1,507 @@
+#include "cbor.h"
+
+#include <string.h>
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define CBOR_MAJOR_UINT   ( 0u )
+#define CBOR_MAJOR_NEGINT ( 1u )
+#define CBOR_MAJOR_BYTES  ( 2u )
+#define CBOR_MAJOR_TEXT   ( 3u )
+#define CBOR_MAJOR_ARRAY  ( 4u )
+#define CBOR_MAJOR_MAP    ( 5u )
+#define CBOR_MAJOR_TAG    ( 6u )
+#define CBOR_MAJOR_SIMPLE ( 7u )
+
+#define CBOR_INFO_UINT8      ( 24u )
+#define CBOR_INFO_UINT16     ( 25u )
+#define CBOR_INFO_UINT32     ( 26u )
+#define CBOR_INFO_UINT64     ( 27u )
+#define CBOR_INFO_INDEFINITE ( 31u )
+
+#define CBOR_INFO_HALF   CBOR_INFO_UINT16
+#define CBOR_INFO_SINGLE CBOR_INFO_UINT32
+#define CBOR_INFO_DOUBLE CBOR_INFO_UINT64
+
+/* Nested containers followed by cbor_skip(), deeper items are reported as errors */
+#define CBOR_SKIP_MAX_DEPTH ( 4u )
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void writeHead( tCbor_writer *writer, uint8_t major, uint32_t argument );
+static void writeBytes( tCbor_writer *writer, const uint8_t *data, size_t length );
+static bool readHead( tCbor_reader *reader, uint8_t *major, uint8_t *info, uint64_t *argument );
+static bool readExpected( tCbor_reader *reader, uint8_t major, uint32_t *argument, bool *indefinite );
+static bool readBytes( tCbor_reader *reader, size_t length );
+static bool skipItem( tCbor_reader *reader, uint8_t depth );
+static bool fail( tCbor_reader *reader );
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void cbor_writerInit( tCbor_writer *writer, uint8_t *buffer, size_t size )
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+size_t cbor_writerLength( const tCbor_writer *writer )
+{
+    return writer->overflow ? 0 : writer->length;
+}
+
+size_t cbor_writerSpace( const tCbor_writer *writer )
+{
+    return writer->overflow ? 0 : ( writer->size - writer->length );
+}
+
+void cbor_writeUint( tCbor_writer *writer, uint32_t value )
+{
+    writeHead( writer, CBOR_MAJOR_UINT, value );
+}
+
+void cbor_writeInt( tCbor_writer *writer, int32_t value )
+{
+    if( value >= 0 )
+    {
+        writeHead( writer, CBOR_MAJOR_UINT, (uint32_t)value );
+    }
+    else
+    {
+        // Negative integers are sent as -1 - n
+        writeHead( writer, CBOR_MAJOR_NEGINT, (uint32_t)( -1 - value ) );
+    }
+}
+
+void cbor_writeHalf( tCbor_writer *writer, float value )
+{
+    uint16_t half = cbor_floatToHalf( value );
+    uint8_t encoded[CBOR_HALF_SIZE] = {
+        (uint8_t)( ( CBOR_MAJOR_SIMPLE << 5 ) | CBOR_INFO_HALF ),
+        (uint8_t)( half >> 8 ),
+        (uint8_t)( half ),
+    };
+
+    writeBytes( writer, encoded, sizeof( encoded ) );
+}
+
+void cbor_writeText( tCbor_writer *writer, const char *text, size_t length )
+{
+    writeHead( writer, CBOR_MAJOR_TEXT, (uint32_t)length );
+    writeBytes( writer, (const uint8_t *)text, length );
+}
+
+void cbor_writeArray( tCbor_writer *writer, uint32_t count )
+{
+    writeHead( writer, CBOR_MAJOR_ARRAY, count );
+}
+
+void cbor_writeMap( tCbor_writer *writer, uint32_t count )
+{
+    writeHead( writer, CBOR_MAJOR_MAP, count );
+}
+
+void cbor_writeIndefiniteArray( tCbor_writer *writer )
+{
+    uint8_t head = (uint8_t)( ( CBOR_MAJOR_ARRAY << 5 ) | CBOR_INFO_INDEFINITE );
+
+    writeBytes( writer, &head, sizeof( head ) );
+}
+
+void cbor_writeBreak( tCbor_writer *writer )
+{
+    uint8_t head = CBOR_BREAK;
+
+    writeBytes( writer, &head, sizeof( head ) );
+}
+
+void cbor_writeNull( tCbor_writer *writer )
+{
+    uint8_t head = CBOR_NULL;
+
+    writeBytes( writer, &head, sizeof( head ) );
+}
+
+void cbor_readerInit( tCbor_reader *reader, const uint8_t *buffer, size_t size )
+{
+    reader->buffer = buffer;
+    reader->size = size;
+    reader->offset = 0;
+    reader->error = false;
+}
+
+bool cbor_readUint( tCbor_reader *reader, uint32_t *value )
+{
+    bool indefinite = false;
+
+    return readExpected( reader, CBOR_MAJOR_UINT, value, &indefinite ) && ( !indefinite || fail( reader ) );
+}
+
+bool cbor_readInt( tCbor_reader *reader, int32_t *value )
+{
+    uint8_t major;
+    uint8_t info;
+    uint64_t argument;
+    bool result = readHead( reader, &major, &info, &argument ) && ( info != CBOR_INFO_INDEFINITE );
+
+    if( result && ( CBOR_MAJOR_UINT == major ) && ( argument <= INT32_MAX ) )
+    {
+        *value = (int32_t)argument;
+    }
+    else if( result && ( CBOR_MAJOR_NEGINT == major ) && ( argument <= INT32_MAX ) )
+    {
+        *value = -1 - (int32_t)argument;
+    }
+    else
+    {
+        result = fail( reader );
+    }
+
+    return result;
+}
+
+bool cbor_readFloat( tCbor_reader *reader, float *value )
+{
+    uint8_t major;
+    uint8_t info;
+    uint64_t argument;
+    bool result = readHead( reader, &major, &info, &argument ) && ( CBOR_MAJOR_SIMPLE == major );
+
+    if( result && ( CBOR_INFO_HALF == info ) )
+    {
+        *value = cbor_halfToFloat( (uint16_t)argument );
+    }
+    else if( result && ( CBOR_INFO_SINGLE == info ) )
+    {
+        uint32_t bits = (uint32_t)argument;
+        memcpy( value, &bits, sizeof( *value ) );
+    }
+    else if( result && ( CBOR_INFO_DOUBLE == info ) )
+    {
+        double wide;
+        memcpy( &wide, &argument, sizeof( wide ) );
+        *value = (float)wide;
+    }
+    else
+    {
+        result = fail( reader );
+    }
+
+    return result;
+}
+
+bool cbor_readArray( tCbor_reader *reader, uint32_t *count, bool *indefinite )
+{
+    return readExpected( reader, CBOR_MAJOR_ARRAY, count, indefinite );
+}
+
+bool cbor_readMap( tCbor_reader *reader, uint32_t *count )
+{
+    bool indefinite = false;
+
+    return readExpected( reader, CBOR_MAJOR_MAP, count, &indefinite ) && ( !indefinite || fail( reader ) );
+}
+
+bool cbor_readBreak( tCbor_reader *reader )
+{
+    bool result = !reader->error && ( reader->offset < reader->size ) && ( CBOR_BREAK == reader->buffer[reader->offset] );
+
+    if( result )
+    {
+        reader->offset++;
+    }
+
+    return result;
+}
+
+/* Consumes the next item only when it is null, like cbor_readBreak() */
+bool cbor_readNull( tCbor_reader *reader )
+{
+    bool result = !reader->error && ( reader->offset < reader->size ) && ( CBOR_NULL == reader->buffer[reader->offset] );
+
+    if( result )
+    {
+        reader->offset++;
+    }
+
+    return result;
+}
+
+bool cbor_skip( tCbor_reader *reader )
+{
+    return skipItem( reader, 0 );
+}
+
+uint16_t cbor_floatToHalf( float value )
+{
+    uint32_t bits;
+    uint16_t sign;
+    int32_t exponent;
+    uint32_t mantissa;
+    uint16_t half;
+
+    memcpy( &bits, &value, sizeof( bits ) );
+    sign = (uint16_t)( ( bits >> 16 ) & 0x8000u );
+    exponent = (int32_t)( ( bits >> 23 ) & 0xFFu ) - 127 + 15;
+    mantissa = bits & 0x007FFFFFu;
+
+    if( ( ( bits >> 23 ) & 0xFFu ) == 0xFFu )
+    {
+        // Infinity keeps an empty mantissa, any NaN becomes a quiet NaN
+        half = (uint16_t)( sign | 0x7C00u | ( ( 0u != mantissa ) ? 0x0200u : 0u ) );
+    }
+    else if( exponent >= 31 )
+    {
+        half = (uint16_t)( sign | 0x7C00u );
+    }
+    else if( exponent <= 0 )
+    {
+        if( exponent < -10 )
+        {
+            half = sign;
+        }
+        else
+        {
+            // Subnormal half, shift in the implicit bit and round to nearest even
+            uint32_t shift = (uint32_t)( 14 - exponent );
+            uint32_t halfway = 1u << ( shift - 1u );
+            uint32_t remainder;
+
+            mantissa |= 0x00800000u;
+            half = (uint16_t)( mantissa >> shift );
+            remainder = mantissa & ( ( 1u << shift ) - 1u );
+            if( ( remainder > halfway ) || ( ( remainder == halfway ) && ( 0u != ( half & 1u ) ) ) )
+            {
+                half++;
+            }
+            half |= sign;
+        }
+    }
+    else
+    {
+        uint32_t remainder = mantissa & 0x1FFFu;
+
+        half = (uint16_t)( ( (uint32_t)exponent << 10 ) | ( mantissa >> 13 ) );
+        // A carry out of the mantissa correctly bumps the exponent, up to infinity
+        if( ( remainder > 0x1000u ) || ( ( remainder == 0x1000u ) && ( 0u != ( half & 1u ) ) ) )
+        {
+            half++;
+        }
+        half |= sign;
+    }
+
+    return half;
+}
+
+float cbor_halfToFloat( uint16_t half )
+{
+    uint32_t sign = (uint32_t)( half & 0x8000u ) << 16;
+    uint32_t exponent = ( half >> 10 ) & 0x1Fu;
+    uint32_t mantissa = half & 0x03FFu;
+    uint32_t bits;
+    float value;
+
+    if( 0u == exponent )
+    {
+        // Zero and subnormals, mantissa x 2^-24
+        value = (float)mantissa / 16777216.0f;
+        return ( 0u != sign ) ? -value : value;
+    }
+
+    if( 0x1Fu == exponent )
+    {
+        bits = sign | 0x7F800000u | ( mantissa << 13 );
+    }
+    else
+    {
+        bits = sign | ( ( exponent + 127u - 15u ) << 23 ) | ( mantissa << 13 );
+    }
+
+    memcpy( &value, &bits, sizeof( value ) );
+
+    return value;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void writeHead( tCbor_writer *writer, uint8_t major, uint32_t argument )
+{
+    uint8_t head[CBOR_HEAD_MAX_SIZE];
+    size_t length;
+
+    major = (uint8_t)( major << 5 );
+
+    if( argument < CBOR_INFO_UINT8 )
+    {
+        head[0] = (uint8_t)( major | argument );
+        length = 1;
+    }
+    else if( argument <= UINT8_MAX )
+    {
+        head[0] = (uint8_t)( major | CBOR_INFO_UINT8 );
+        head[1] = (uint8_t)argument;
+        length = 2;
+    }
+    else if( argument <= UINT16_MAX )
+    {
+        head[0] = (uint8_t)( major | CBOR_INFO_UINT16 );
+        head[1] = (uint8_t)( argument >> 8 );
+        head[2] = (uint8_t)( argument );
+        length = 3;
+    }
+    else
+    {
+        head[0] = (uint8_t)( major | CBOR_INFO_UINT32 );
+        head[1] = (uint8_t)( argument >> 24 );
+        head[2] = (uint8_t)( argument >> 16 );
+        head[3] = (uint8_t)( argument >> 8 );
+        head[4] = (uint8_t)( argument );
+        length = 5;
+    }
+
+    writeBytes( writer, head, length );
+}
+
+static void writeBytes( tCbor_writer *writer, const uint8_t *data, size_t length )
+{
+    if( !writer->overflow && ( length <= ( writer->size - writer->length ) ) )
+    {
+        memcpy( &writer->buffer[writer->length], data, length );
+        writer->length += length;
+    }
+    else
+    {
+        writer->overflow = true;
+    }
+}
+
+static bool readHead( tCbor_reader *reader, uint8_t *major, uint8_t *info, uint64_t *argument )
+{
+    size_t length = 0;
+    bool result = !reader->error && ( reader->offset < reader->size );
+
+    if( result )
+    {
+        *major = reader->buffer[reader->offset] >> 5;
+        *info = reader->buffer[reader->offset] & 0x1Fu;
+        *argument = *info;
+        reader->offset++;
+
+        if( *info >= CBOR_INFO_UINT8 && *info <= CBOR_INFO_UINT64 )
+        {
+            length = (size_t)1u << ( *info - CBOR_INFO_UINT8 );
+            *argument = 0;
+        }
+        else if( ( *info > CBOR_INFO_UINT64 ) && ( *info < CBOR_INFO_INDEFINITE ) )
+        {
+            result = fail( reader );
+        }
+    }
+
+    if( result && ( length > 0 ) )
+    {
+        result = ( length <= ( reader->size - reader->offset ) ) || fail( reader );
+
+        for( size_t i = 0; result && ( i < length ); i++ )
+        {
+            *argument = ( *argument << 8 ) | reader->buffer[reader->offset++];
+        }
+    }
+
+    return result;
+}
+
+static bool readExpected( tCbor_reader *reader, uint8_t major, uint32_t *argument, bool *indefinite )
+{
+    uint8_t actualMajor;
+    uint8_t info;
+    uint64_t value;
+    bool result = readHead( reader, &actualMajor, &info, &value );
+
+    if( result && ( major == actualMajor ) && ( value <= UINT32_MAX ) )
+    {
+        *indefinite = ( CBOR_INFO_INDEFINITE == info );
+        *argument = *indefinite ? 0 : (uint32_t)value;
+    }
+    else
+    {
+        result = fail( reader );
+    }
+
+    return result;
+}
+
+static bool readBytes( tCbor_reader *reader, size_t length )
+{
+    bool result = ( length <= ( reader->size - reader->offset ) ) || fail( reader );
+
+    if( result )
+    {
+        reader->offset += length;
+    }
+
+    return result;
+}
+
+static bool skipItem( tCbor_reader *reader, uint8_t depth )
+{
+    uint8_t major;
+    uint8_t info;
+    uint64_t argument;
+    bool result = ( depth < CBOR_SKIP_MAX_DEPTH ) ? readHead( reader, &major, &info, &argument ) : fail( reader );
+
+    if( result && ( CBOR_INFO_INDEFINITE == info ) )
+    {
+        // Indefinite strings are chunk sequences, arrays and maps are item sequences
+        result = ( CBOR_MAJOR_UINT != major ) && ( CBOR_MAJOR_NEGINT != major ) &&
+                 ( CBOR_MAJOR_TAG != major ) && ( CBOR_MAJOR_SIMPLE != major );
+        while( result && !cbor_readBreak( reader ) )
+        {
+            result = skipItem( reader, depth + 1 ) && ( ( CBOR_MAJOR_MAP != major ) || skipItem( reader, depth + 1 ) );
+        }
+        if( !result )
+        {
+            fail( reader );
+        }
+    }
+    else if( result )
+    {
+        switch( major )
+        {
+            case CBOR_MAJOR_BYTES:
+            case CBOR_MAJOR_TEXT:
+                result = ( argument <= SIZE_MAX ) && readBytes( reader, (size_t)argument );
+                break;
+
+            case CBOR_MAJOR_ARRAY:
+            case CBOR_MAJOR_MAP:
+                argument *= ( CBOR_MAJOR_MAP == major ) ? 2u : 1u;
+                for( uint64_t i = 0; result && ( i < argument ); i++ )
+                {
+                    result = skipItem( reader, depth + 1 );
+                }
+                break;
+
+            case CBOR_MAJOR_TAG:
+                result = skipItem( reader, depth + 1 );
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return result || fail( reader );
+}
+
+static bool fail( tCbor_reader *reader )
+{
+    reader->error = true;
+
+    return false;
+}
@@ -0,0 +1,71 @@
+#ifndef _CBOR_H_
+#define _CBOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Minimal streaming CBOR (RFC 8949) writer and reader working on a caller buffer, no
+ * heap and no RTOS dependencies so the same code runs on the target and on the host.
+ *
+ * Writer errors are sticky: once an item does not fit, nothing more is written and
+ * cbor_writerLength() returns 0. Reader calls return false on a type mismatch or a
+ * truncated item and leave the reader in the error state.
+ */
+
+#define CBOR_BREAK ( 0xFFu )
+#define CBOR_NULL  ( 0xF6u )
+
+/* Longest encoding of a single head (major type + 32 bit argument) */
+#define CBOR_HEAD_MAX_SIZE ( 5u )
+
+/* Longest encoding of an integer from -65536 to 65535, the difference of two int16 fits */
+#define CBOR_INT16_MAX_SIZE ( 3u )
+
+/* Encoded size of a half precision float */
+#define CBOR_HALF_SIZE ( 3u )
+
+typedef struct
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} tCbor_writer;
+
+typedef struct
+{
+    const uint8_t *buffer;
+    size_t size;
+    size_t offset;
+    bool error;
+} tCbor_reader;
+
+void cbor_writerInit( tCbor_writer *writer, uint8_t *buffer, size_t size );
+size_t cbor_writerLength( const tCbor_writer *writer );
+size_t cbor_writerSpace( const tCbor_writer *writer );
+void cbor_writeUint( tCbor_writer *writer, uint32_t value );
+void cbor_writeInt( tCbor_writer *writer, int32_t value );
+void cbor_writeHalf( tCbor_writer *writer, float value );
+void cbor_writeText( tCbor_writer *writer, const char *text, size_t length );
+void cbor_writeArray( tCbor_writer *writer, uint32_t count );
+void cbor_writeMap( tCbor_writer *writer, uint32_t count );
+void cbor_writeIndefiniteArray( tCbor_writer *writer );
+void cbor_writeBreak( tCbor_writer *writer );
+void cbor_writeNull( tCbor_writer *writer );
+
+void cbor_readerInit( tCbor_reader *reader, const uint8_t *buffer, size_t size );
+bool cbor_readUint( tCbor_reader *reader, uint32_t *value );
+bool cbor_readInt( tCbor_reader *reader, int32_t *value );
+bool cbor_readFloat( tCbor_reader *reader, float *value );
+bool cbor_readArray( tCbor_reader *reader, uint32_t *count, bool *indefinite );
+bool cbor_readMap( tCbor_reader *reader, uint32_t *count );
+bool cbor_readBreak( tCbor_reader *reader );
+bool cbor_readNull( tCbor_reader *reader );
+bool cbor_skip( tCbor_reader *reader );
+
+uint16_t cbor_floatToHalf( float value );
+float cbor_halfToFloat( uint16_t half );
+
+#endif /* _CBOR_H_ */
@@ -0,0 +1,160 @@
+#include "telemetry.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmsis_os.h"
+#include "logger.h"
+#include "mqttClient.h"
+#include "sen55.h"
+#include "telemetryCodec.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_MQTT
+
+#ifndef TELEMETRY_TOPIC
+#define TELEMETRY_TOPIC "weatherStation/telemetry"
+#endif
+
+/* A batch is published when either limit is reached */
+#ifndef TELEMETRY_BATCH_SIZE
+#define TELEMETRY_BATCH_SIZE ( 10u )
+#endif
+
+#ifndef TELEMETRY_BATCH_PERIOD_MS
+#define TELEMETRY_BATCH_PERIOD_MS ( 15000u )
+#endif
+
+/* The sensor publishes at 1 Hz, polling faster only keeps the sample timestamps accurate */
+#define TELEMETRY_POLL_PERIOD_MS ( 250u )
+
+#ifndef TELEMETRY_SCHEMA
+#define TELEMETRY_SCHEMA TELEMETRY_CODEC_SCHEMA_SCALED_DELTA
+#endif
+
+/* Map header and start tick, kept generous so at least one worst case sample always fits */
+#define TELEMETRY_HEADER_MAX_SIZE ( 16u )
+
+_Static_assert( TELEMETRY_HEADER_MAX_SIZE + TELEMETRY_CODEC_SAMPLE_MAX_SIZE + 1u <= MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE, "Sample does not fit one MQTT message" );
+_Static_assert( sizeof( TELEMETRY_TOPIC ) <= MQTT_CLIENT_MESSAGE_TOPIC_LENGTH, "Topic does not fit one MQTT message" );
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    tTelemetryCodec_encoder encoder;  // Writes into the payload of the message
+    tMqttClient_message *message;     // Encoded in place, owned until published
+} tTelemetry_batch;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void telemetryTask( void *args );
+static bool startBatch( uint32_t start );
+static bool appendSample( const tSen55_sample *sample );
+static void publishBatch( void );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tTelemetry_batch m_telemetry_batch;
+static bool m_telemetry_initalized = false;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void telemetry_init( void )
+{
+    if( !m_telemetry_initalized )
+    {
+        const osThreadAttr_t attributes = {
+            .name = "telemetryTask",
+            .stack_size = 1024,
+            .priority = (osPriority_t)osPriorityBelowNormal,
+        };
+
+        m_telemetry_initalized = true;
+
+        osThreadNew( telemetryTask, NULL, &attributes );
+    }
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void telemetryTask( void *args )
+{
+    tSen55_sample sample;
+    uint32_t lastSequence = 0;
+
+    LOG_INFO( "Publishing telemetry on %s, %u samples or %u ms per batch", TELEMETRY_TOPIC,
+              (unsigned int)TELEMETRY_BATCH_SIZE, (unsigned int)TELEMETRY_BATCH_PERIOD_MS );
+
+    while( true )
+    {
+        if( sen55_getSampleIfNewer( lastSequence, &sample ) )
+        {
+            lastSequence = sample.sequence;
+
+            if( ( NULL != m_telemetry_batch.message ) && !appendSample( &sample ) )
+            {
+                // The payload is full, close the batch and start the next one with this sample
+                publishBatch();
+            }
+
+            if( ( NULL == m_telemetry_batch.message ) && !( startBatch( sample.timestamp ) && appendSample( &sample ) ) )
+            {
+                LOG_WARNING( "No MQTT buffer, sample %u dropped", (unsigned int)sample.sequence );
+            }
+        }
+
+        if( ( NULL != m_telemetry_batch.message ) &&
+            ( ( m_telemetry_batch.encoder.count >= TELEMETRY_BATCH_SIZE ) ||
+              ( ( osKernelGetTickCount() - m_telemetry_batch.encoder.start ) >= TELEMETRY_BATCH_PERIOD_MS ) ) )
+        {
+            publishBatch();
+        }
+
+        osDelay( TELEMETRY_POLL_PERIOD_MS );
+    }
+}
+
+static bool startBatch( uint32_t start )
+{
+    m_telemetry_batch.message = mqttClient_allocMessage( TELEMETRY_TOPIC );
+
+    if( NULL != m_telemetry_batch.message )
+    {
+        telemetryCodec_begin( &m_telemetry_batch.encoder, m_telemetry_batch.message->payload,
+                              MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE, TELEMETRY_SCHEMA, start );
+    }
+
+    return ( NULL != m_telemetry_batch.message );
+}
+
+static bool appendSample( const tSen55_sample *sample )
+{
+    return telemetryCodec_addSample( &m_telemetry_batch.encoder, &sample->data, sample->timestamp );
+}
+
+static void publishBatch( void )
+{
+    tMqttClient_message *message = m_telemetry_batch.message;
+    tMqttClient_sendResult result;
+
+    message->length = (uint16_t)telemetryCodec_end( &m_telemetry_batch.encoder );
+
+    LOG_DEBUG( "Publishing %u samples, %u bytes", (unsigned int)m_telemetry_batch.encoder.count, (unsigned int)message->length );
+
+    result = mqttClient_publishMessage( message );
+    if( MQTT_SEND_OK != result )
+    {
+        LOG_WARNING( "Telemetry batch dropped: %d", result );
+    }
+
+    m_telemetry_batch.message = NULL;
+}
@@ -0,0 +1,16 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+/*
+ * Publishes the SEN55 samples over MQTT in batches. A batch is closed after
+ * TELEMETRY_BATCH_SIZE samples, TELEMETRY_BATCH_PERIOD_MS since its first sample or
+ * when the next sample would not fit the message, whichever comes first.
+ *
+ * The payload is CBOR with the layout and schema ids described in telemetryCodec.h,
+ * TELEMETRY_SCHEMA selects delta coded scaled integers (default), plain scaled integers
+ * or half precision floats.
+ */
+
+void telemetry_init( void );
+
+#endif /* _TELEMETRY_H_ */
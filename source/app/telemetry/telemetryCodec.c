@@ -0,0 +1,281 @@
+#include "telemetryCodec.h"
+
+#include <math.h>
+#include <string.h>
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define TELEMETRY_CODEC_SAMPLE_ITEMS ( 1u + SEN55_VALUE_COUNT )
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+/* Last decoded sample, the base of the next one in the delta schema */
+typedef struct
+{
+    tTelemetryCodec_schema schema;
+    uint32_t start;
+    uint32_t timestamp;
+    int32_t scaled[SEN55_VALUE_COUNT];  // Last known values, null leaves them as they are
+    float values[SEN55_VALUE_COUNT];
+    uint32_t count;
+} tTelemetryCodec_decoder;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static bool decodeSamples( tCbor_reader *reader, tTelemetryCodec_decoder *decoder, tTelemetryCodec_visitor visitor, void *context );
+static bool decodeSample( tCbor_reader *reader, tTelemetryCodec_decoder *decoder );
+static bool isSchema( uint32_t schema );
+static int16_t toScaled( tSen55_value value, float data );
+static void dataToValues( const tSen55_data *data, float *values );
+static void valuesToData( const float *values, tSen55_data *data );
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+// Same scaling as the raw values of the sensor, part of both scaled schemas
+static const float m_telemetryCodec_scale[SEN55_VALUE_COUNT] = {
+    [SEN55_VALUE_PM1_0] = 10.0f,
+    [SEN55_VALUE_PM2_5] = 10.0f,
+    [SEN55_VALUE_PM4_0] = 10.0f,
+    [SEN55_VALUE_PM10] = 10.0f,
+    [SEN55_VALUE_HUMIDITY] = 100.0f,
+    [SEN55_VALUE_TEMPERATURE] = 200.0f,
+    [SEN55_VALUE_VOC_INDEX] = 10.0f,
+    [SEN55_VALUE_NOX_INDEX] = 10.0f,
+};
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void telemetryCodec_begin( tTelemetryCodec_encoder *encoder, uint8_t *buffer, size_t size, tTelemetryCodec_schema schema, uint32_t start )
+{
+    encoder->schema = schema;
+    encoder->start = start;
+    encoder->last = start;
+    encoder->count = 0;
+    memset( encoder->lastValues, 0, sizeof( encoder->lastValues ) );
+
+    cbor_writerInit( &encoder->writer, buffer, size );
+    cbor_writeMap( &encoder->writer, TELEMETRY_CODEC_KEY_COUNT );
+    cbor_writeUint( &encoder->writer, TELEMETRY_CODEC_KEY_SCHEMA );
+    cbor_writeUint( &encoder->writer, (uint32_t)schema );
+    cbor_writeUint( &encoder->writer, TELEMETRY_CODEC_KEY_START );
+    cbor_writeUint( &encoder->writer, start );
+    cbor_writeUint( &encoder->writer, TELEMETRY_CODEC_KEY_SAMPLES );
+    cbor_writeIndefiniteArray( &encoder->writer );
+}
+
+bool telemetryCodec_addSample( tTelemetryCodec_encoder *encoder, const tSen55_data *data, uint32_t timestamp )
+{
+    float values[SEN55_VALUE_COUNT];
+    bool delta = ( TELEMETRY_CODEC_SCHEMA_SCALED_DELTA == encoder->schema ) && ( encoder->count > 0 );
+    // Room for the closing break is kept so telemetryCodec_end() cannot fail
+    bool result = ( cbor_writerSpace( &encoder->writer ) >= ( TELEMETRY_CODEC_SAMPLE_MAX_SIZE + 1u ) ) && ( encoder->count < UINT16_MAX );
+
+    if( result )
+    {
+        dataToValues( data, values );
+
+        cbor_writeArray( &encoder->writer, TELEMETRY_CODEC_SAMPLE_ITEMS );
+        cbor_writeUint( &encoder->writer, timestamp - ( delta ? encoder->last : encoder->start ) );
+
+        for( uint8_t i = 0; i < SEN55_VALUE_COUNT; i++ )
+        {
+            if( isnan( values[i] ) )
+            {
+                cbor_writeNull( &encoder->writer );
+            }
+            else if( TELEMETRY_CODEC_SCHEMA_HALF == encoder->schema )
+            {
+                cbor_writeHalf( &encoder->writer, values[i] );
+            }
+            else
+            {
+                int16_t scaled = toScaled( (tSen55_value)i, values[i] );
+
+                cbor_writeInt( &encoder->writer, delta ? ( (int32_t)scaled - encoder->lastValues[i] ) : scaled );
+                encoder->lastValues[i] = scaled;
+            }
+        }
+
+        encoder->last = timestamp;
+        encoder->count++;
+    }
+
+    return result;
+}
+
+size_t telemetryCodec_end( tTelemetryCodec_encoder *encoder )
+{
+    cbor_writeBreak( &encoder->writer );
+
+    return cbor_writerLength( &encoder->writer );
+}
+
+bool telemetryCodec_decode( const uint8_t *payload, size_t length, tTelemetryCodec_visitor visitor, void *context )
+{
+    tTelemetryCodec_decoder decoder = { 0 };
+    tCbor_reader reader;
+    uint32_t entries = 0;
+    uint32_t key;
+    uint32_t schema = 0;
+    uint32_t start = 0;
+    bool hasStart = false;
+    bool result;
+
+    cbor_readerInit( &reader, payload, length );
+    result = cbor_readMap( &reader, &entries );
+
+    for( uint32_t i = 0; result && ( i < entries ); i++ )
+    {
+        result = cbor_readUint( &reader, &key );
+        if( !result )
+        {
+            break;
+        }
+
+        switch( key )
+        {
+            case TELEMETRY_CODEC_KEY_SCHEMA:
+                result = cbor_readUint( &reader, &schema ) && isSchema( schema );
+                break;
+
+            case TELEMETRY_CODEC_KEY_START:
+                result = cbor_readUint( &reader, &start );
+                hasStart = result;
+                break;
+
+            case TELEMETRY_CODEC_KEY_SAMPLES:
+                // The encoder writes the samples last, both fields are needed to read them
+                decoder.schema = (tTelemetryCodec_schema)schema;
+                decoder.start = start;
+                result = ( 0 != schema ) && hasStart && decodeSamples( &reader, &decoder, visitor, context );
+                break;
+
+            default:
+                result = cbor_skip( &reader );
+                break;
+        }
+    }
+
+    return result && !reader.error;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static bool decodeSamples( tCbor_reader *reader, tTelemetryCodec_decoder *decoder, tTelemetryCodec_visitor visitor, void *context )
+{
+    tSen55_data data;
+    uint32_t count = 0;
+    bool indefinite = false;
+    bool proceed = true;
+    bool result = cbor_readArray( reader, &count, &indefinite );
+
+    // After the visitor stops, the remaining samples are still parsed to validate the payload
+    while( result && ( indefinite ? !cbor_readBreak( reader ) : ( count-- > 0 ) ) )
+    {
+        result = decodeSample( reader, decoder );
+        if( result && proceed )
+        {
+            valuesToData( decoder->values, &data );
+            proceed = visitor( decoder->timestamp, &data, context );
+        }
+    }
+
+    return result && !reader->error;
+}
+
+static bool decodeSample( tCbor_reader *reader, tTelemetryCodec_decoder *decoder )
+{
+    bool delta = ( TELEMETRY_CODEC_SCHEMA_SCALED_DELTA == decoder->schema ) && ( decoder->count > 0 );
+    uint32_t items = 0;
+    uint32_t offset = 0;
+    bool indefinite = false;
+    bool result = cbor_readArray( reader, &items, &indefinite ) && !indefinite &&
+                  ( TELEMETRY_CODEC_SAMPLE_ITEMS == items ) && cbor_readUint( reader, &offset );
+
+    // The first sample is counted from the start of the batch, the other ones from the sample before in the delta schema
+    decoder->timestamp = ( delta ? decoder->timestamp : decoder->start ) + offset;
+
+    for( uint8_t i = 0; result && ( i < SEN55_VALUE_COUNT ); i++ )
+    {
+        if( cbor_readNull( reader ) )
+        {
+            decoder->values[i] = NAN;
+        }
+        else if( TELEMETRY_CODEC_SCHEMA_HALF == decoder->schema )
+        {
+            result = cbor_readFloat( reader, &decoder->values[i] );
+        }
+        else
+        {
+            int32_t scaled;
+
+            // The encoder only writes int16 values and their differences
+            result = cbor_readInt( reader, &scaled ) && ( scaled >= -UINT16_MAX ) && ( scaled <= UINT16_MAX );
+            decoder->scaled[i] = delta ? ( decoder->scaled[i] + scaled ) : scaled;
+            result = result && ( decoder->scaled[i] >= INT16_MIN ) && ( decoder->scaled[i] <= INT16_MAX );
+            decoder->values[i] = (float)decoder->scaled[i] / m_telemetryCodec_scale[i];
+        }
+    }
+
+    decoder->count++;
+
+    return result;
+}
+
+static bool isSchema( uint32_t schema )
+{
+    return ( TELEMETRY_CODEC_SCHEMA_SCALED == schema ) || ( TELEMETRY_CODEC_SCHEMA_HALF == schema ) ||
+           ( TELEMETRY_CODEC_SCHEMA_SCALED_DELTA == schema );
+}
+
+static int16_t toScaled( tSen55_value value, float data )
+{
+    float scaled = data * m_telemetryCodec_scale[value];
+    int16_t result;
+
+    // Unknown values never get here, out of range ones are clamped
+    if( !( scaled > (float)INT16_MIN ) )
+    {
+        result = INT16_MIN;
+    }
+    else if( !( scaled < (float)INT16_MAX ) )
+    {
+        result = INT16_MAX;
+    }
+    else
+    {
+        result = (int16_t)( scaled + ( ( scaled >= 0.0f ) ? 0.5f : -0.5f ) );
+    }
+
+    return result;
+}
+
+static void dataToValues( const tSen55_data *data, float *values )
+{
+    values[SEN55_VALUE_PM1_0] = data->pm1_0;
+    values[SEN55_VALUE_PM2_5] = data->pm2_5;
+    values[SEN55_VALUE_PM4_0] = data->pm4_0;
+    values[SEN55_VALUE_PM10] = data->pm10;
+    values[SEN55_VALUE_HUMIDITY] = data->humidity;
+    values[SEN55_VALUE_TEMPERATURE] = data->temperature;
+    values[SEN55_VALUE_VOC_INDEX] = data->vocIndex;
+    values[SEN55_VALUE_NOX_INDEX] = data->noxIndex;
+}
+
+static void valuesToData( const float *values, tSen55_data *data )
+{
+    data->pm1_0 = values[SEN55_VALUE_PM1_0];
+    data->pm2_5 = values[SEN55_VALUE_PM2_5];
+    data->pm4_0 = values[SEN55_VALUE_PM4_0];
+    data->pm10 = values[SEN55_VALUE_PM10];
+    data->humidity = values[SEN55_VALUE_HUMIDITY];
+    data->temperature = values[SEN55_VALUE_TEMPERATURE];
+    data->vocIndex = values[SEN55_VALUE_VOC_INDEX];
+    data->noxIndex = values[SEN55_VALUE_NOX_INDEX];
+}
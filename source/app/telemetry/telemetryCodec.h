@@ -0,0 +1,70 @@
+#ifndef _TELEMETRY_CODEC_H_
+#define _TELEMETRY_CODEC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cbor.h"
+#include "sen55.h"
+
+/*
+ * CBOR encoding of a batch of SEN55 samples, written straight into a caller buffer:
+ *
+ *   { 0: schema id, 1: kernel tick of the first sample, 2: [_ sample, sample, ... ] }
+ *   sample = [ offset from the first sample in ms, SEN55_VALUE_COUNT x value ]
+ *
+ * The values are ordered as tSen55_value. The schema id tells how they are encoded:
+ *   TELEMETRY_CODEC_SCHEMA_SCALED       - integers in the sensor's own scaling: x10, humidity x100, temperature x200
+ *   TELEMETRY_CODEC_SCHEMA_HALF         - half precision floats
+ *   TELEMETRY_CODEC_SCHEMA_SCALED_DELTA - scaled integers, every sample after the first one holds
+ *                                         the difference to the previous sample, the offset included
+ *
+ * A value the sensor does not know yet (NaN in tSen55_data) is sent as null in every schema.
+ * In the delta schema it leaves the base of the next difference as it was, the base starts at 0.
+ *
+ * Values of a slow changing sensor differ by a few units from one sample to the next, so
+ * the delta schema takes about one byte per value instead of three.
+ *
+ * Unknown map keys are skipped by the decoder so fields can be added without a new id.
+ * The codec has no RTOS dependencies and builds on the host for the backend.
+ */
+
+typedef enum
+{
+    TELEMETRY_CODEC_SCHEMA_SCALED = 1,
+    TELEMETRY_CODEC_SCHEMA_HALF = 2,
+    TELEMETRY_CODEC_SCHEMA_SCALED_DELTA = 3,
+} tTelemetryCodec_schema;
+
+typedef enum
+{
+    TELEMETRY_CODEC_KEY_SCHEMA = 0,
+    TELEMETRY_CODEC_KEY_START = 1,
+    TELEMETRY_CODEC_KEY_SAMPLES = 2,
+    TELEMETRY_CODEC_KEY_COUNT
+} tTelemetryCodec_key;
+
+/* Worst case of one sample: array head, 32 bit offset and an int16, its difference or a half per value */
+#define TELEMETRY_CODEC_VALUE_MAX_SIZE  ( ( CBOR_INT16_MAX_SIZE > CBOR_HALF_SIZE ) ? CBOR_INT16_MAX_SIZE : CBOR_HALF_SIZE )
+#define TELEMETRY_CODEC_SAMPLE_MAX_SIZE ( 1u + CBOR_HEAD_MAX_SIZE + SEN55_VALUE_COUNT * TELEMETRY_CODEC_VALUE_MAX_SIZE )
+
+typedef struct
+{
+    tCbor_writer writer;
+    tTelemetryCodec_schema schema;
+    uint32_t start;
+    uint32_t last;                          // Timestamp of the previous sample
+    int16_t lastValues[SEN55_VALUE_COUNT];  // Last known scaled values, base of the next delta
+    uint16_t count;
+} tTelemetryCodec_encoder;
+
+/* Called for every decoded sample, return false to stop */
+typedef bool ( *tTelemetryCodec_visitor )( uint32_t timestamp, const tSen55_data *data, void *context );
+
+void telemetryCodec_begin( tTelemetryCodec_encoder *encoder, uint8_t *buffer, size_t size, tTelemetryCodec_schema schema, uint32_t start );
+bool telemetryCodec_addSample( tTelemetryCodec_encoder *encoder, const tSen55_data *data, uint32_t timestamp );
+size_t telemetryCodec_end( tTelemetryCodec_encoder *encoder );
+bool telemetryCodec_decode( const uint8_t *payload, size_t length, tTelemetryCodec_visitor visitor, void *context );
+
+#endif /* _TELEMETRY_CODEC_H_ */
@@ -17,6 +17,7 @@
 /************************************************************************************
  * PRIVATE MACROS
  ***********************************************************************************/
+#define LOG_MODULE LOG_MODULE_TIME_SYNC
 #define NTP_PORT        123
 #define NTP_PACKET_SIZE 48
 #define UNIX_OFFSET     2208988800UL  // Seconds from 1900 to 1970
@@ -24,9 +25,16 @@
 
 #define TIMEZONE_SERVER "http://ip-api.com/json"
 #define TIMEZONE_PORT   ( 80 )
+/* The JSON of ip-api.com is about 300 bytes */
+#define TIMEZONE_RESPONSE_SIZE ( 512u )
+/* The location of a station does not change often, used when the server gives no max-age */
+#define TIMEZONE_CACHE_MAX_AGE_S ( 24u * 3600u )
 
 #define TIMEZONE_MAX_HTTP_RETRIES 3
 #define TIMEZONE_REQUEST_TIMEOUT  30000
+#define TIMEZONE_RETRY_DELAY_MS   ( 1000u )
+/* A cancelled request ends on the next wake up of the HTTP task */
+#define TIMEZONE_CANCEL_TIMEOUT   ( 1000u )
 
 /************************************************************************************
  * PRIVATE TYPES DECLARATION
@@ -70,8 +78,7 @@ typedef struct
  ***********************************************************************************/
 static void timeSyncTask( void *pvParameters );
 static bool parseTimeZoneInfo( const char *data, size_t dataSize );
-static void timeZoneHttpResponseCallback( const char *data, size_t dataSize );
-static void timeZoneHttpErrorCallback( uint32_t errorCode );
+static bool handleTimeZoneResponse( tHttpClient_requestState state );
 static bool getNtpTime( tTimeSync_serverType serverType, uint32_t *timestamp );
 static void syncRtcWithTime( uint32_t ntpTimestamp );
 static int32_t getTimezoneOffset( const char *timezoneName, const struct tm *timeinfo );
@@ -150,38 +157,58 @@ static void timeSyncTask( void *pvParameters )
             {
                 memset( &m_timeSync_localizationInfo, 0, sizeof( tTimeSync_localizationInfo ) );
 
-                m_timeSync_timeZoneHttpClient = httpClient_createNewHttpClient( timeZoneHttpResponseCallback, timeZoneHttpErrorCallback );
+                // No callbacks, the response is waited for in TIME_SYNC_WAIT_FOR_TIMEZONE_RESPONSE
+                m_timeSync_timeZoneHttpClient = httpClient_createNewHttpClient( NULL, NULL );
                 httpClient_configureRequest( m_timeSync_timeZoneHttpClient, TIMEZONE_SERVER, TIMEZONE_PORT, GET );
+                httpClient_setResponseSize( m_timeSync_timeZoneHttpClient, TIMEZONE_RESPONSE_SIZE );
+                httpClient_enableCache( m_timeSync_timeZoneHttpClient, TIMEZONE_CACHE_MAX_AGE_S );
 
                 m_timeSync_state = TIME_SYNC_GET_TIMEZONE;
             }
             break;
             case TIME_SYNC_GET_TIMEZONE:
             {
-                if( m_timeSync_httpRetryCount < TIMEZONE_MAX_HTTP_RETRIES )
-                {
-                    httpSessionMgr_startNewSession( m_timeSync_timeZoneHttpClient );
-                }
-                else
+                if( m_timeSync_httpRetryCount >= TIMEZONE_MAX_HTTP_RETRIES )
                 {
                     // After 3 failed attempts, fall back to UTC timezone
                     snprintf( m_timeSync_localizationInfo.timezone, sizeof( m_timeSync_localizationInfo.timezone ), "UTC" );
+                    httpClient_deleteClient( &m_timeSync_timeZoneHttpClient );
                     m_timeSync_state = TIME_SYNC_GET_NTP_TIME;
                 }
-
-                vTaskDelay( 1000 );
+                else if( httpSessionMgr_startNewSession( m_timeSync_timeZoneHttpClient ) )
+                {
+                    m_timeSync_state = TIME_SYNC_WAIT_FOR_TIMEZONE_RESPONSE;
+                }
+                else
+                {
+                    m_timeSync_httpRetryCount++;
+                    vTaskDelay( TIMEZONE_RETRY_DELAY_MS );
+                }
             }
             break;
             case TIME_SYNC_WAIT_FOR_TIMEZONE_RESPONSE:
             {
-                // Wait for HTTP response or timeout
-                vTaskDelay( TIMEZONE_REQUEST_TIMEOUT );
-                if( ( m_timeSync_httpRetryCount < TIMEZONE_MAX_HTTP_RETRIES ) && ( TIME_SYNC_WAIT_FOR_TIMEZONE_RESPONSE == m_timeSync_state ) )
-                {  // No response or error
+                tHttpClient_requestState requestState = httpClient_wait( m_timeSync_timeZoneHttpClient, TIMEZONE_REQUEST_TIMEOUT );
+
+                if( HTTP_CLIENT_REQUEST_PENDING == requestState )
+                {
+                    LOG_WARNING( "Timezone request timed out" );
+                    httpSessionMgr_cancel( m_timeSync_timeZoneHttpClient );
+                    requestState = httpClient_wait( m_timeSync_timeZoneHttpClient, TIMEZONE_CANCEL_TIMEOUT );
+                }
+
+                if( handleTimeZoneResponse( requestState ) )
+                {
+                    httpClient_deleteClient( &m_timeSync_timeZoneHttpClient );
+                    m_timeSync_state = TIME_SYNC_GET_NTP_TIME;
+                }
+                else
+                {
+                    // Retry the request
                     m_timeSync_httpRetryCount++;
-                    m_timeSync_state = TIME_SYNC_GET_TIMEZONE;  // Retry the request
+                    m_timeSync_state = TIME_SYNC_GET_TIMEZONE;
+                    vTaskDelay( TIMEZONE_RETRY_DELAY_MS );
                 }
-                break;
             }
             break;
             case TIME_SYNC_GET_NTP_TIME:
@@ -220,42 +247,26 @@ static void timeSyncTask( void *pvParameters )
     }
 }
 
-static void timeZoneHttpResponseCallback( const char *data, size_t dataSize )
+/* True when the timezone was parsed from a successful response */
+static bool handleTimeZoneResponse( tHttpClient_requestState state )
 {
-    if( data == NULL || dataSize == 0 )
+    const tHttpClient_result *result = httpClient_getResult( m_timeSync_timeZoneHttpClient );
+    bool parsed = false;
+
+    if( HTTP_CLIENT_REQUEST_DONE != state )
     {
-        LOG_ERROR( "Error: No data received from HTTP request" );
-        return;
+        LOG_ERROR( "Http Error recevied with error code 0x%X", (unsigned int)result->error );
     }
-
-    // Parse the received JSON data
-    if( parseTimeZoneInfo( data, dataSize ) )
+    else if( ( 200u != result->statusCode ) || ( NULL == result->body ) || ( 0u == result->bodyLength ) )
     {
-        // Free httpClient
-        httpClient_deleteClient( &m_timeSync_timeZoneHttpClient );
-        // Successfully parsed the timezone info, proceed to next state
-        m_timeSync_state = TIME_SYNC_GET_NTP_TIME;
+        LOG_ERROR( "Error: No data received from HTTP request, status %u", (unsigned int)result->statusCode );
     }
     else
     {
-        // Retry if the parsing fails
-        m_timeSync_httpRetryCount++;
-        if( m_timeSync_httpRetryCount < TIMEZONE_MAX_HTTP_RETRIES )
-        {
-            m_timeSync_state = TIME_SYNC_GET_TIMEZONE;  // Retry
-        }
-        else
-        {
-            // Fallback to UTC if retries exceed the limit
-            snprintf( m_timeSync_localizationInfo.timezone, sizeof( m_timeSync_localizationInfo.timezone ), "UTC" );
-            m_timeSync_state = TIME_SYNC_GET_NTP_TIME;  // Proceed to NTP time retrieval
-        }
+        parsed = parseTimeZoneInfo( result->body, result->bodyLength );
     }
-}
 
-static void timeZoneHttpErrorCallback( uint32_t errorCode )
-{
-    LOG_ERROR( "Http Error recevied with error code 0x%X", errorCode );
+    return parsed;
 }
 
 static bool parseTimeZoneInfo( const char *data, size_t dataSize )
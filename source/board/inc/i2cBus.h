@@ -0,0 +1,48 @@
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Transaction layer on top of hi2c1. Transfers are serialized by a bus mutex (waiters
+ * are queued by priority), run on IT or DMA and the calling task sleeps on a thread
+ * flag until the completion callback fires or the timeout expires.
+ */
+
+/* Thread flag reserved by the bus in every task that calls it */
+#define I2C_BUS_THREAD_FLAG ( 0x00010000u )
+
+    typedef enum
+    {
+        I2C_BUS_OK,
+        I2C_BUS_ERROR,
+        I2C_BUS_TIMEOUT,
+        I2C_BUS_BUSY,
+    } tI2cBus_status;
+
+    typedef struct
+    {
+        uint16_t devAddress;
+        const uint8_t *txData;  // Written first, may be NULL
+        size_t txLength;
+        uint8_t *rxData;  // Read after the write without releasing the bus, may be NULL
+        size_t rxLength;
+        uint32_t timeoutMs;  // Whole transaction, including the wait for the bus
+    } tI2cBus_transfer;
+
+    void i2cBus_init( void );
+    tI2cBus_status i2cBus_transfer( const tI2cBus_transfer *transfer );
+    tI2cBus_status i2cBus_write( uint16_t devAddress, const uint8_t *data, size_t length, uint32_t timeoutMs );
+    tI2cBus_status i2cBus_read( uint16_t devAddress, uint8_t *data, size_t length, uint32_t timeoutMs );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __I2C_BUS_H__ */
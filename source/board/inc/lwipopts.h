@@ -116,6 +116,13 @@
 #define LWIP_NETIF_STATUS_CALLBACK 1
 #define LWIP_DNS 1
 #define LWIP_SOCKET 1
+/* HTTP session slots and idle connections, the NTP socket and spares */
+#define MEMP_NUM_NETCONN 8
+/* HTTP sessions and idle connections, MQTT and connections in TIME_WAIT */
+#define MEMP_NUM_TCP_PCB 8
+/* The HTTP session task is woken with a datagram to 127.0.0.1 */
+#define LWIP_NETIF_LOOPBACK 1
+#define MEMP_NUM_UDP_PCB 6
 
 /* USER CODE END 1 */
 
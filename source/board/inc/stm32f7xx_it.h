@@ -58,6 +58,9 @@ extern "C"
     void ETH_IRQHandler( void );
     void SPI1_IRQHandler( void );
     void USART3_IRQHandler( void );
+    void DMA1_Stream0_IRQHandler( void );
+    void DMA1_Stream3_IRQHandler( void );
+    void DMA1_Stream6_IRQHandler( void );
     void DMA2_Stream3_IRQHandler( void );
     void I2C1_EV_IRQHandler( void );
     void I2C1_ER_IRQHandler( void );
@@ -1,6 +1,8 @@
 #include "i2c.h"
 
 I2C_HandleTypeDef hi2c1;
+DMA_HandleTypeDef hdma_i2c1_rx;
+DMA_HandleTypeDef hdma_i2c1_tx;
 
 void I2C1_Init( void )
 {
@@ -63,10 +65,55 @@ void HAL_I2C_MspInit( I2C_HandleTypeDef* i2cHandle )
         /* I2C1 clock enable */
         __HAL_RCC_I2C1_CLK_ENABLE();
 
+        /* I2C1 DMA Init */
+        __HAL_RCC_DMA1_CLK_ENABLE();
+
+        /* I2C1_RX Init */
+        hdma_i2c1_rx.Instance = DMA1_Stream0;
+        hdma_i2c1_rx.Init.Channel = DMA_CHANNEL_1;
+        hdma_i2c1_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+        hdma_i2c1_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_i2c1_rx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_i2c1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_i2c1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_i2c1_rx.Init.Mode = DMA_NORMAL;
+        hdma_i2c1_rx.Init.Priority = DMA_PRIORITY_LOW;
+        hdma_i2c1_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+        if( HAL_DMA_Init( &hdma_i2c1_rx ) != HAL_OK )
+        {
+            Error_Handler();
+        }
+
+        __HAL_LINKDMA( i2cHandle, hdmarx, hdma_i2c1_rx );
+
+        /* I2C1_TX Init */
+        hdma_i2c1_tx.Instance = DMA1_Stream6;
+        hdma_i2c1_tx.Init.Channel = DMA_CHANNEL_1;
+        hdma_i2c1_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+        hdma_i2c1_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_i2c1_tx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_i2c1_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_i2c1_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_i2c1_tx.Init.Mode = DMA_NORMAL;
+        hdma_i2c1_tx.Init.Priority = DMA_PRIORITY_LOW;
+        hdma_i2c1_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+        if( HAL_DMA_Init( &hdma_i2c1_tx ) != HAL_OK )
+        {
+            Error_Handler();
+        }
+
+        __HAL_LINKDMA( i2cHandle, hdmatx, hdma_i2c1_tx );
+
+        /* Completion callbacks wake the waiting task, keep them at or below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY */
+        HAL_NVIC_SetPriority( DMA1_Stream0_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( DMA1_Stream0_IRQn );
+        HAL_NVIC_SetPriority( DMA1_Stream6_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( DMA1_Stream6_IRQn );
+
         /* I2C1 interrupt Init */
-        HAL_NVIC_SetPriority( I2C1_EV_IRQn, 0, 0 );
+        HAL_NVIC_SetPriority( I2C1_EV_IRQn, 5, 0 );
         HAL_NVIC_EnableIRQ( I2C1_EV_IRQn );
-        HAL_NVIC_SetPriority( I2C1_ER_IRQn, 0, 0 );
+        HAL_NVIC_SetPriority( I2C1_ER_IRQn, 5, 0 );
         HAL_NVIC_EnableIRQ( I2C1_ER_IRQn );
     }
 }
@@ -86,6 +133,10 @@ void HAL_I2C_MspDeInit( I2C_HandleTypeDef* i2cHandle )
 
         HAL_GPIO_DeInit( GPIOB, GPIO_PIN_9 );
 
+        /* I2C1 DMA DeInit */
+        HAL_DMA_DeInit( i2cHandle->hdmarx );
+        HAL_DMA_DeInit( i2cHandle->hdmatx );
+
         /* I2C1 interrupt Deinit */
         HAL_NVIC_DisableIRQ( I2C1_EV_IRQn );
         HAL_NVIC_DisableIRQ( I2C1_ER_IRQn );
@@ -0,0 +1,207 @@
+#include "i2cBus.h"
+
+#include <stdbool.h>
+
+#include "cmsis_os.h"
+#include "i2c.h"
+
+/*********************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+/* Shorter transfers go through the interrupt path, the DMA setup costs more than it saves */
+#define I2C_BUS_DMA_MIN_LENGTH ( 8u )
+
+#define I2C_BUS_ABORT_TIMEOUT_MS ( 10u )
+
+/*********************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    osMutexId_t mutex;
+    osThreadId_t owner;  // Task waiting for the current transfer
+    volatile bool errorOccurred;
+} tI2cBus;
+
+/*********************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static tI2cBus_status transmit( uint16_t devAddress, const uint8_t *data, size_t length, uint32_t deadline );
+static tI2cBus_status receive( uint16_t devAddress, uint8_t *data, size_t length, uint32_t deadline );
+static tI2cBus_status waitForCompletion( uint16_t devAddress, uint32_t deadline );
+static uint32_t remainingTime( uint32_t deadline );
+static void notifyOwner( I2C_HandleTypeDef *hi2c, bool error );
+
+/*********************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static tI2cBus m_i2cBus;
+static bool m_i2cBus_initalized = false;
+
+/*********************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void i2cBus_init( void )
+{
+    if( !m_i2cBus_initalized )
+    {
+        const osMutexAttr_t attributes = {
+            .name = "i2cBus",
+            .attr_bits = osMutexPrioInherit,
+        };
+        m_i2cBus.mutex = osMutexNew( &attributes );
+        m_i2cBus_initalized = ( NULL != m_i2cBus.mutex );
+    }
+}
+
+tI2cBus_status i2cBus_transfer( const tI2cBus_transfer *transfer )
+{
+    tI2cBus_status result = I2C_BUS_BUSY;
+    uint32_t deadline = osKernelGetTickCount() + transfer->timeoutMs;
+
+    if( m_i2cBus_initalized && ( osOK == osMutexAcquire( m_i2cBus.mutex, transfer->timeoutMs ) ) )
+    {
+        m_i2cBus.owner = osThreadGetId();
+        result = I2C_BUS_OK;
+
+        if( ( NULL != transfer->txData ) && ( transfer->txLength > 0 ) )
+        {
+            result = transmit( transfer->devAddress, transfer->txData, transfer->txLength, deadline );
+        }
+
+        if( ( I2C_BUS_OK == result ) && ( NULL != transfer->rxData ) && ( transfer->rxLength > 0 ) )
+        {
+            result = receive( transfer->devAddress, transfer->rxData, transfer->rxLength, deadline );
+        }
+
+        m_i2cBus.owner = NULL;
+        osMutexRelease( m_i2cBus.mutex );
+    }
+
+    return result;
+}
+
+tI2cBus_status i2cBus_write( uint16_t devAddress, const uint8_t *data, size_t length, uint32_t timeoutMs )
+{
+    const tI2cBus_transfer transfer = {
+        .devAddress = devAddress,
+        .txData = data,
+        .txLength = length,
+        .timeoutMs = timeoutMs,
+    };
+
+    return i2cBus_transfer( &transfer );
+}
+
+tI2cBus_status i2cBus_read( uint16_t devAddress, uint8_t *data, size_t length, uint32_t timeoutMs )
+{
+    const tI2cBus_transfer transfer = {
+        .devAddress = devAddress,
+        .rxData = data,
+        .rxLength = length,
+        .timeoutMs = timeoutMs,
+    };
+
+    return i2cBus_transfer( &transfer );
+}
+
+/*********************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static tI2cBus_status transmit( uint16_t devAddress, const uint8_t *data, size_t length, uint32_t deadline )
+{
+    HAL_StatusTypeDef status;
+
+    // A late callback of a timed out transfer may have left the flag set
+    osThreadFlagsClear( I2C_BUS_THREAD_FLAG );
+    m_i2cBus.errorOccurred = false;
+
+    if( length >= I2C_BUS_DMA_MIN_LENGTH )
+    {
+        status = HAL_I2C_Master_Transmit_DMA( &hi2c1, devAddress, (uint8_t *)data, length );
+    }
+    else
+    {
+        status = HAL_I2C_Master_Transmit_IT( &hi2c1, devAddress, (uint8_t *)data, length );
+    }
+
+    return ( HAL_OK == status ) ? waitForCompletion( devAddress, deadline ) : I2C_BUS_ERROR;
+}
+
+static tI2cBus_status receive( uint16_t devAddress, uint8_t *data, size_t length, uint32_t deadline )
+{
+    HAL_StatusTypeDef status;
+
+    osThreadFlagsClear( I2C_BUS_THREAD_FLAG );
+    m_i2cBus.errorOccurred = false;
+
+    if( length >= I2C_BUS_DMA_MIN_LENGTH )
+    {
+        status = HAL_I2C_Master_Receive_DMA( &hi2c1, devAddress, data, length );
+    }
+    else
+    {
+        status = HAL_I2C_Master_Receive_IT( &hi2c1, devAddress, data, length );
+    }
+
+    return ( HAL_OK == status ) ? waitForCompletion( devAddress, deadline ) : I2C_BUS_ERROR;
+}
+
+static tI2cBus_status waitForCompletion( uint16_t devAddress, uint32_t deadline )
+{
+    tI2cBus_status result = I2C_BUS_OK;
+    uint32_t flags = osThreadFlagsWait( I2C_BUS_THREAD_FLAG, osFlagsWaitAny, remainingTime( deadline ) );
+
+    if( 0 != ( flags & osFlagsError ) )
+    {
+        // Stop the peripheral so the buffer is not written after the caller gave it up
+        if( HAL_OK == HAL_I2C_Master_Abort_IT( &hi2c1, devAddress ) )
+        {
+            osThreadFlagsWait( I2C_BUS_THREAD_FLAG, osFlagsWaitAny, I2C_BUS_ABORT_TIMEOUT_MS );
+        }
+        result = I2C_BUS_TIMEOUT;
+    }
+    else if( m_i2cBus.errorOccurred )
+    {
+        result = I2C_BUS_ERROR;
+    }
+
+    return result;
+}
+
+static uint32_t remainingTime( uint32_t deadline )
+{
+    int32_t remaining = (int32_t)( deadline - osKernelGetTickCount() );
+
+    return ( remaining > 0 ) ? (uint32_t)remaining : 0;
+}
+
+static void notifyOwner( I2C_HandleTypeDef *hi2c, bool error )
+{
+    if( ( hi2c == &hi2c1 ) && ( NULL != m_i2cBus.owner ) )
+    {
+        m_i2cBus.errorOccurred = error;
+        osThreadFlagsSet( m_i2cBus.owner, I2C_BUS_THREAD_FLAG );
+    }
+}
+
+// HAL I2C Callbacks
+void HAL_I2C_MasterTxCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+    notifyOwner( hi2c, false );
+}
+
+void HAL_I2C_MasterRxCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+    notifyOwner( hi2c, false );
+}
+
+void HAL_I2C_ErrorCallback( I2C_HandleTypeDef *hi2c )
+{
+    notifyOwner( hi2c, true );
+}
+
+void HAL_I2C_AbortCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+    notifyOwner( hi2c, true );
+}
@@ -6,6 +6,9 @@ extern ETH_HandleTypeDef heth;
 extern TIM_HandleTypeDef htim6;
 extern UART_HandleTypeDef huart3;
 extern DMA_HandleTypeDef hdma_spi1_tx;
+extern DMA_HandleTypeDef hdma_usart3_tx;
+extern DMA_HandleTypeDef hdma_i2c1_rx;
+extern DMA_HandleTypeDef hdma_i2c1_tx;
 extern SPI_HandleTypeDef hspi1;
 extern I2C_HandleTypeDef hi2c1;
 
@@ -68,6 +71,21 @@ void SPI1_IRQHandler( void )
     HAL_SPI_IRQHandler( &hspi1 );
 }
 
+void DMA1_Stream0_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &hdma_i2c1_rx );
+}
+
+void DMA1_Stream3_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &hdma_usart3_tx );
+}
+
+void DMA1_Stream6_IRQHandler( void )
+{
+    HAL_DMA_IRQHandler( &hdma_i2c1_tx );
+}
+
 void DMA2_Stream3_IRQHandler( void )
 {
     HAL_DMA_IRQHandler( &hdma_spi1_tx );
@@ -3,6 +3,7 @@
 #include "gpio.h"
 
 UART_HandleTypeDef huart3;
+DMA_HandleTypeDef hdma_usart3_tx;
 
 /* USART3 init function */
 void MX_USART3_UART_Init( void )
@@ -52,6 +53,35 @@ void HAL_UART_MspInit( UART_HandleTypeDef* uartHandle )
         GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
         GPIO_InitStruct.Alternate = GPIO_AF7_USART3;
         HAL_GPIO_Init( GPIOD, &GPIO_InitStruct );
+
+        /* USART3 DMA Init */
+        /* USART3_TX Init */
+        __HAL_RCC_DMA1_CLK_ENABLE();
+
+        hdma_usart3_tx.Instance = DMA1_Stream3;
+        hdma_usart3_tx.Init.Channel = DMA_CHANNEL_4;
+        hdma_usart3_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+        hdma_usart3_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+        hdma_usart3_tx.Init.MemInc = DMA_MINC_ENABLE;
+        hdma_usart3_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+        hdma_usart3_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+        hdma_usart3_tx.Init.Mode = DMA_NORMAL;
+        hdma_usart3_tx.Init.Priority = DMA_PRIORITY_LOW;
+        hdma_usart3_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+        if( HAL_DMA_Init( &hdma_usart3_tx ) != HAL_OK )
+        {
+            Error_Handler();
+        }
+
+        __HAL_LINKDMA( uartHandle, hdmatx, hdma_usart3_tx );
+
+        /* Completion callbacks use the RTOS API, keep them at or below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY */
+        HAL_NVIC_SetPriority( DMA1_Stream3_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( DMA1_Stream3_IRQn );
+
+        /* USART3 interrupt Init */
+        HAL_NVIC_SetPriority( USART3_IRQn, 5, 0 );
+        HAL_NVIC_EnableIRQ( USART3_IRQn );
     }
 }
 
@@ -67,5 +97,11 @@ void HAL_UART_MspDeInit( UART_HandleTypeDef* uartHandle )
         PD9     ------> USART3_RX
         */
         HAL_GPIO_DeInit( GPIOD, STLK_RX_Pin | STLK_TX_Pin );
+
+        /* USART3 DMA DeInit */
+        HAL_DMA_DeInit( uartHandle->hdmatx );
+
+        /* USART3 interrupt Deinit */
+        HAL_NVIC_DisableIRQ( USART3_IRQn );
     }
 }
@@ -0,0 +1,77 @@
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/*-----------------------------------------------------------
+ * Host (FreeRTOS POSIX port) configuration.
+ *
+ * Mirrors source/board/inc/FreeRTOSConfig.h so the application sees the same
+ * scheduler behaviour (tick rate, priorities, hooks), with the Cortex-M specific
+ * parts removed. Each FreeRTOS task runs on its own pthread.
+ *----------------------------------------------------------*/
+
+#include <assert.h>
+#include <stdint.h>
+
+extern uint32_t SystemCoreClock;
+
+#define configUSE_PREEMPTION                     1
+#define configSUPPORT_STATIC_ALLOCATION          1
+#define configSUPPORT_DYNAMIC_ALLOCATION         1
+#define configUSE_IDLE_HOOK                      0
+#define configUSE_TICK_HOOK                      1
+#define configCPU_CLOCK_HZ                       ( SystemCoreClock )
+#define configTICK_RATE_HZ                       ((TickType_t)1000)
+#define configMAX_PRIORITIES                     ( 56 )
+#define configMINIMAL_STACK_SIZE                 ((uint16_t)( 16384 / sizeof( StackType_t ) ))
+/* Twice the target heap: pointers and StackType_t are 8 bytes wide on x86-64 */
+#define configTOTAL_HEAP_SIZE                    ((size_t)(15360 * 20))
+#define configMAX_TASK_NAME_LEN                  ( 16 )
+#define configUSE_TRACE_FACILITY                 1
+#define configUSE_16_BIT_TICKS                   0
+#define configUSE_MUTEXES                        1
+#define configQUEUE_REGISTRY_SIZE                8
+#define configUSE_RECURSIVE_MUTEXES              1
+#define configUSE_COUNTING_SEMAPHORES            1
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+#define configUSE_MALLOC_FAILED_HOOK             1
+/* Task stacks are pthread stacks on the host, overflow checking does not apply */
+#define configCHECK_FOR_STACK_OVERFLOW           0
+#define configMESSAGE_BUFFER_LENGTH_TYPE         size_t
+
+/* Co-routine definitions. */
+#define configUSE_CO_ROUTINES                    0
+#define configMAX_CO_ROUTINE_PRIORITIES          ( 2 )
+
+/* Software timer definitions. */
+#define configUSE_TIMERS                         1
+#define configTIMER_TASK_PRIORITY                ( 2 )
+#define configTIMER_QUEUE_LENGTH                 10
+#define configTIMER_TASK_STACK_DEPTH             configMINIMAL_STACK_SIZE
+
+#define configUSE_NEWLIB_REENTRANT               0
+
+/* Set the following definitions to 1 to include the API function, or zero
+to exclude the API function. */
+#define INCLUDE_vTaskPrioritySet             1
+#define INCLUDE_uxTaskPriorityGet            1
+#define INCLUDE_vTaskDelete                  1
+#define INCLUDE_vTaskCleanUpResources        0
+#define INCLUDE_vTaskSuspend                 1
+#define INCLUDE_vTaskDelayUntil              1
+#define INCLUDE_vTaskDelay                   1
+#define INCLUDE_xTaskGetSchedulerState       1
+#define INCLUDE_xTimerPendFunctionCall       1
+#define INCLUDE_xQueueGetMutexHolder         1
+#define INCLUDE_uxTaskGetStackHighWaterMark  1
+#define INCLUDE_eTaskGetState                1
+#define INCLUDE_xTaskGetCurrentTaskHandle    1
+
+/*
+ * The CMSIS-RTOS V2 FreeRTOS wrapper is dependent on the heap implementation used
+ * by the application thus the correct define need to be enabled below
+ */
+#define USE_FreeRTOS_HEAP_4
+
+#define configASSERT( x ) assert( x )
+
+#endif /* FREERTOS_CONFIG_H */
@@ -0,0 +1,62 @@
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+/*
+ * Host stand-in for the CMSIS compiler abstraction. There are no exception handlers on
+ * the host: every CMSIS-RTOS call runs in thread mode with interrupts enabled.
+ */
+
+#include <stdint.h>
+
+#ifndef __INLINE
+#define __INLINE inline
+#endif
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE static inline
+#endif
+#ifndef __WEAK
+#define __WEAK __attribute__( ( weak ) )
+#endif
+#ifndef __weak
+#define __weak __attribute__( ( weak ) )
+#endif
+#ifndef __ALIGN_BEGIN
+#define __ALIGN_BEGIN
+#endif
+#ifndef __ALIGN_END
+#define __ALIGN_END __attribute__( ( aligned( 4 ) ) )
+#endif
+
+__STATIC_INLINE uint32_t __get_IPSR( void )
+{
+    return 0U;
+}
+
+__STATIC_INLINE uint32_t __get_PRIMASK( void )
+{
+    return 0U;
+}
+
+__STATIC_INLINE uint32_t __get_BASEPRI( void )
+{
+    return 0U;
+}
+
+__STATIC_INLINE void __disable_irq( void )
+{
+}
+
+__STATIC_INLINE void __enable_irq( void )
+{
+}
+
+__STATIC_INLINE void __NOP( void )
+{
+}
+
+__STATIC_INLINE void __DMB( void )
+{
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+}
+
+#endif /* __CMSIS_COMPILER_H */
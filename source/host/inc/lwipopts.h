@@ -0,0 +1,51 @@
+#ifndef __LWIPOPTS__H__
+#define __LWIPOPTS__H__
+
+/*
+ * Host lwIP configuration. Same stack tuning as source/board/inc/lwipopts.h, but
+ * checksums are computed in software (there is no ETH checksum offload behind the
+ * TAP device) and errno comes from the C library so it does not clash with glibc.
+ */
+
+#include "error.h"
+
+#define WITH_RTOS 1
+#define CHECKSUM_BY_HARDWARE 0
+
+#define LWIP_ERRNO_STDINCLUDE 1
+
+#define LWIP_DHCP 1
+#define MEM_ALIGNMENT 8
+#define MEMP_NUM_SYS_TIMEOUT 6
+#define LWIP_ETHERNET 1
+#define LWIP_DNS_SECURE 7
+#define TCP_SND_QUEUELEN 9
+#define TCP_SNDLOWAT 1071
+#define TCP_SNDQUEUELOWAT 5
+#define TCP_WND_UPDATE_THRESHOLD 536
+#define LWIP_NETIF_LINK_CALLBACK 1
+#define TCPIP_THREAD_STACKSIZE 1024*4
+#define TCPIP_THREAD_PRIO 24
+#define TCPIP_MBOX_SIZE 6
+#define SLIPIF_THREAD_STACKSIZE 1024
+#define SLIPIF_THREAD_PRIO 3
+#define DEFAULT_THREAD_STACKSIZE 1024
+#define DEFAULT_THREAD_PRIO 3
+#define DEFAULT_UDP_RECVMBOX_SIZE 6
+#define DEFAULT_TCP_RECVMBOX_SIZE 6
+#define DEFAULT_ACCEPTMBOX_SIZE 6
+#define RECV_BUFSIZE_DEFAULT 2000000000
+#define LWIP_STATS 0
+
+#define LWIP_NETIF_STATUS_CALLBACK 1
+#define LWIP_DNS 1
+#define LWIP_SOCKET 1
+/* HTTP session slots and idle connections, the NTP socket and spares */
+#define MEMP_NUM_NETCONN 8
+/* HTTP sessions and idle connections, MQTT and connections in TIME_WAIT */
+#define MEMP_NUM_TCP_PCB 8
+/* The HTTP session task is woken with a datagram to 127.0.0.1 */
+#define LWIP_NETIF_LOOPBACK 1
+#define MEMP_NUM_UDP_PCB 6
+
+#endif /*__LWIPOPTS__H__ */
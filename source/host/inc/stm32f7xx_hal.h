@@ -0,0 +1,199 @@
+#ifndef __STM32F7xx_HAL_H
+#define __STM32F7xx_HAL_H
+
+/*
+ * Host stand-in for the STM32F7 HAL. Only the subset of types and functions used by
+ * the application and the shared board headers is provided. Peripherals are emulated
+ * in source/host/src.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmsis_compiler.h"
+
+#define __IO volatile
+
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    RESET = 0U,
+    SET = !RESET
+} FlagStatus,
+    ITStatus;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+/************************************************************************************
+ * GPIO
+ ***********************************************************************************/
+typedef enum
+{
+    GPIO_PIN_RESET = 0U,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+    uint32_t ODR;
+    uint32_t IDR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+    uint32_t Pin;
+    uint32_t Mode;
+    uint32_t Pull;
+    uint32_t Speed;
+    uint32_t Alternate;
+} GPIO_InitTypeDef;
+
+extern GPIO_TypeDef host_gpioA, host_gpioB, host_gpioC, host_gpioD, host_gpioF, host_gpioG;
+
+#define GPIOA ( &host_gpioA )
+#define GPIOB ( &host_gpioB )
+#define GPIOC ( &host_gpioC )
+#define GPIOD ( &host_gpioD )
+#define GPIOF ( &host_gpioF )
+#define GPIOG ( &host_gpioG )
+
+#define GPIO_PIN_0  ( (uint16_t)0x0001 )
+#define GPIO_PIN_1  ( (uint16_t)0x0002 )
+#define GPIO_PIN_2  ( (uint16_t)0x0004 )
+#define GPIO_PIN_3  ( (uint16_t)0x0008 )
+#define GPIO_PIN_4  ( (uint16_t)0x0010 )
+#define GPIO_PIN_5  ( (uint16_t)0x0020 )
+#define GPIO_PIN_6  ( (uint16_t)0x0040 )
+#define GPIO_PIN_7  ( (uint16_t)0x0080 )
+#define GPIO_PIN_8  ( (uint16_t)0x0100 )
+#define GPIO_PIN_9  ( (uint16_t)0x0200 )
+#define GPIO_PIN_10 ( (uint16_t)0x0400 )
+#define GPIO_PIN_11 ( (uint16_t)0x0800 )
+#define GPIO_PIN_12 ( (uint16_t)0x1000 )
+#define GPIO_PIN_13 ( (uint16_t)0x2000 )
+#define GPIO_PIN_14 ( (uint16_t)0x4000 )
+#define GPIO_PIN_15 ( (uint16_t)0x8000 )
+
+void HAL_GPIO_Init( GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init );
+GPIO_PinState HAL_GPIO_ReadPin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin );
+void HAL_GPIO_WritePin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState );
+void HAL_GPIO_TogglePin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin );
+
+/************************************************************************************
+ * UART
+ ***********************************************************************************/
+typedef struct
+{
+    uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct __UART_HandleTypeDef
+{
+    UART_InitTypeDef Init;
+    int fd;
+} UART_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_UART_Transmit( UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size, uint32_t Timeout );
+HAL_StatusTypeDef HAL_UART_Transmit_DMA( UART_HandleTypeDef *huart, const uint8_t *pData, uint16_t Size );
+HAL_StatusTypeDef HAL_UART_AbortTransmit( UART_HandleTypeDef *huart );
+void HAL_UART_TxCpltCallback( UART_HandleTypeDef *huart );
+void HAL_UART_ErrorCallback( UART_HandleTypeDef *huart );
+
+/************************************************************************************
+ * I2C
+ ***********************************************************************************/
+typedef struct __I2C_HandleTypeDef
+{
+    uint16_t devAddress;
+    uint8_t *pBuffPtr;
+    uint16_t XferSize;
+} I2C_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size );
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size );
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size );
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size );
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress );
+void HAL_I2C_MasterTxCpltCallback( I2C_HandleTypeDef *hi2c );
+void HAL_I2C_MasterRxCpltCallback( I2C_HandleTypeDef *hi2c );
+void HAL_I2C_ErrorCallback( I2C_HandleTypeDef *hi2c );
+void HAL_I2C_AbortCpltCallback( I2C_HandleTypeDef *hi2c );
+
+/************************************************************************************
+ * SPI
+ ***********************************************************************************/
+typedef struct __SPI_HandleTypeDef
+{
+    uint32_t frames;
+} SPI_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_SPI_Transmit( SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout );
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA( SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size );
+void HAL_SPI_TxCpltCallback( SPI_HandleTypeDef *hspi );
+
+/************************************************************************************
+ * RTC
+ ***********************************************************************************/
+#define RTC_FORMAT_BIN 0x00000000U
+#define RTC_FORMAT_BCD 0x00000001U
+
+#define RTC_HOURFORMAT12_AM ( (uint8_t)0x00 )
+#define RTC_HOURFORMAT12_PM ( (uint8_t)0x40 )
+
+#define RTC_DAYLIGHTSAVING_NONE 0x00000000U
+#define RTC_STOREOPERATION_RESET 0x00000000U
+
+typedef struct
+{
+    uint8_t Hours;
+    uint8_t Minutes;
+    uint8_t Seconds;
+    uint8_t TimeFormat;
+    uint32_t SubSeconds;
+    uint32_t SecondFraction;
+    uint32_t DayLightSaving;
+    uint32_t StoreOperation;
+} RTC_TimeTypeDef;
+
+typedef struct
+{
+    uint8_t WeekDay;
+    uint8_t Month;
+    uint8_t Date;
+    uint8_t Year;
+} RTC_DateTypeDef;
+
+typedef struct
+{
+    int64_t offsetSeconds;
+} RTC_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_RTC_SetTime( RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format );
+HAL_StatusTypeDef HAL_RTC_GetTime( RTC_HandleTypeDef *hrtc, RTC_TimeTypeDef *sTime, uint32_t Format );
+HAL_StatusTypeDef HAL_RTC_SetDate( RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format );
+HAL_StatusTypeDef HAL_RTC_GetDate( RTC_HandleTypeDef *hrtc, RTC_DateTypeDef *sDate, uint32_t Format );
+
+/************************************************************************************
+ * ETH
+ ***********************************************************************************/
+typedef struct
+{
+    int tapFd;
+} ETH_HandleTypeDef;
+
+/************************************************************************************
+ * CORE
+ ***********************************************************************************/
+HAL_StatusTypeDef HAL_Init( void );
+uint32_t HAL_GetTick( void );
+void HAL_Delay( uint32_t Delay );
+
+#endif /* __STM32F7xx_HAL_H */
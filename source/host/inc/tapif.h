@@ -0,0 +1,21 @@
+#ifndef _TAPIF_H_
+#define _TAPIF_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Raw frame access to a Linux TAP device. Kept apart from ethernetif.c because the
+ * kernel network headers it needs clash with the socket compatibility headers of lwIP,
+ * so it is built without the lwIP include directories.
+ */
+
+/* Descriptor of the nonblocking device, -1 if it cannot be opened */
+int tapif_open( const char *interfaceName );
+
+/* Length of the frame read, 0 when none is pending */
+size_t tapif_read( int tapFd, void *frame, size_t size );
+
+bool tapif_write( int tapFd, const void *frame, size_t length );
+
+#endif /* _TAPIF_H_ */
@@ -0,0 +1,10 @@
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void Error_Handler( void )
+{
+    fprintf( stderr, "Error_Handler called\n" );
+    abort();
+}
@@ -0,0 +1,205 @@
+#include "ethernetif.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cmsis_os.h"
+#include "error.h"
+#include "lwip/opt.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "netif/etharp.h"
+#include "netif/ethernet.h"
+#include "tapif.h"
+
+/*
+ * ETH stand-in backed by a Linux TAP device. The interface name is taken from the
+ * CWS_TAP_IF environment variable ("tap0" by default), the device has to be created
+ * beforehand, e.g. `ip tuntap add tap0 mode tap user $USER`, and needs a DHCP server
+ * (or a bridge to one) because the application configures the netif through DHCP.
+ */
+
+/*********************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define INTERFACE_THREAD_STACK_SIZE ( 350 )
+#define TAP_DEFAULT_INTERFACE_NAME  "tap0"
+#define TAP_POLL_INTERVAL_MS        ( 1u )
+#define TAP_MAX_FRAME_SIZE          ( 1518u )
+
+#define IFNAME0 't'
+#define IFNAME1 'p'
+
+/*********************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void low_level_init( struct netif *netif );
+static err_t low_level_output( struct netif *netif, struct pbuf *p );
+static struct pbuf *low_level_input( struct netif *netif );
+
+/*********************************************************************************
+ * PUBLIC VARIABLES DECLERATION
+ ***********************************************************************************/
+ETH_HandleTypeDef heth = { .tapFd = -1 };
+
+/*********************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+err_t ethernetif_init( struct netif *netif )
+{
+    LWIP_ASSERT( "netif != NULL", ( netif != NULL ) );
+
+#if LWIP_NETIF_HOSTNAME
+    netif->hostname = "lwip";
+#endif /* LWIP_NETIF_HOSTNAME */
+
+    netif->name[0] = IFNAME0;
+    netif->name[1] = IFNAME1;
+    netif->output = etharp_output;
+    netif->linkoutput = low_level_output;
+
+    low_level_init( netif );
+
+    return ERR_OK;
+}
+
+void ethernetif_input( void *argument )
+{
+    struct netif *netif = (struct netif *)argument;
+
+    for( ;; )
+    {
+        struct pbuf *p = low_level_input( netif );
+
+        if( NULL != p )
+        {
+            if( ERR_OK != netif->input( p, netif ) )
+            {
+                pbuf_free( p );
+            }
+        }
+        else
+        {
+            // Nothing pending on the TAP device, the posix port cannot block on the fd
+            osDelay( TAP_POLL_INTERVAL_MS );
+        }
+    }
+}
+
+void ethernetif_set_link( void *argument )
+{
+    struct link_str *link_arg = (struct link_str *)argument;
+
+    for( ;; )
+    {
+        bool linkUp = ( heth.tapFd >= 0 );
+
+        if( !netif_is_link_up( link_arg->netif ) && linkUp )
+        {
+            netif_set_link_up( link_arg->netif );
+        }
+        else if( netif_is_link_up( link_arg->netif ) && !linkUp )
+        {
+            netif_set_link_down( link_arg->netif );
+        }
+
+        osDelay( 200 );
+    }
+}
+
+void ethernetif_update_config( struct netif *netif )
+{
+    ethernetif_notify_conn_changed( netif );
+}
+
+__weak void ethernetif_notify_conn_changed( struct netif *netif )
+{
+}
+
+u32_t sys_jiffies( void )
+{
+    return HAL_GetTick();
+}
+
+u32_t sys_now( void )
+{
+    return HAL_GetTick();
+}
+
+/*********************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void low_level_init( struct netif *netif )
+{
+    const char *interfaceName = getenv( "CWS_TAP_IF" );
+    osThreadAttr_t attributes;
+
+    if( NULL == interfaceName )
+    {
+        interfaceName = TAP_DEFAULT_INTERFACE_NAME;
+    }
+
+    heth.tapFd = tapif_open( interfaceName );
+    if( heth.tapFd >= 0 )
+    {
+        netif->flags |= NETIF_FLAG_LINK_UP;
+    }
+
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    netif->hwaddr[0] = 0x02;
+    netif->hwaddr[1] = 0x80;
+    netif->hwaddr[2] = 0xE1;
+    netif->hwaddr[3] = 0x00;
+    netif->hwaddr[4] = 0x00;
+    netif->hwaddr[5] = 0x01;
+    netif->mtu = 1500;
+    netif->flags |= NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP;
+
+    memset( &attributes, 0x0, sizeof( osThreadAttr_t ) );
+    attributes.name = "EthIf";
+    attributes.stack_size = INTERFACE_THREAD_STACK_SIZE * 4;
+    attributes.priority = osPriorityRealtime;
+    osThreadNew( ethernetif_input, netif, &attributes );
+}
+
+static err_t low_level_output( struct netif *netif, struct pbuf *p )
+{
+    uint8_t frame[TAP_MAX_FRAME_SIZE];
+
+    if( ( heth.tapFd < 0 ) || ( p->tot_len > sizeof( frame ) ) )
+    {
+        return ERR_IF;
+    }
+
+    pbuf_copy_partial( p, frame, p->tot_len, 0 );
+
+    if( !tapif_write( heth.tapFd, frame, p->tot_len ) )
+    {
+        return ERR_IF;
+    }
+
+    return ERR_OK;
+}
+
+static struct pbuf *low_level_input( struct netif *netif )
+{
+    uint8_t frame[TAP_MAX_FRAME_SIZE];
+    struct pbuf *p = NULL;
+
+    if( heth.tapFd >= 0 )
+    {
+        size_t len = tapif_read( heth.tapFd, frame, sizeof( frame ) );
+
+        if( len > 0 )
+        {
+            p = pbuf_alloc( PBUF_RAW, len, PBUF_POOL );
+            if( NULL != p )
+            {
+                pbuf_take( p, frame, len );
+            }
+        }
+    }
+
+    return p;
+}
@@ -0,0 +1,6 @@
+#include "gpio.h"
+
+/* The GPIO ports are plain variables on the host, there is nothing to configure */
+void MX_GPIO_Init( void )
+{
+}
@@ -0,0 +1,64 @@
+#include "stm32f7xx_hal.h"
+
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/************************************************************************************
+ * PUBLIC VARIABLES DECLERATION
+ ***********************************************************************************/
+GPIO_TypeDef host_gpioA, host_gpioB, host_gpioC, host_gpioD, host_gpioF, host_gpioG;
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static struct timespec m_hal_startTime;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+HAL_StatusTypeDef HAL_Init( void )
+{
+    clock_gettime( CLOCK_MONOTONIC, &m_hal_startTime );
+    return HAL_OK;
+}
+
+uint32_t HAL_GetTick( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint32_t)( ( now.tv_sec - m_hal_startTime.tv_sec ) * 1000 + ( now.tv_nsec - m_hal_startTime.tv_nsec ) / 1000000 );
+}
+
+void HAL_Delay( uint32_t Delay )
+{
+    vTaskDelay( pdMS_TO_TICKS( Delay ) );
+}
+
+void HAL_GPIO_Init( GPIO_TypeDef *GPIOx, GPIO_InitTypeDef *GPIO_Init )
+{
+}
+
+GPIO_PinState HAL_GPIO_ReadPin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin )
+{
+    return ( GPIOx->IDR & GPIO_Pin ) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+void HAL_GPIO_WritePin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState )
+{
+    if( GPIO_PIN_SET == PinState )
+    {
+        GPIOx->ODR |= GPIO_Pin;
+    }
+    else
+    {
+        GPIOx->ODR &= ~GPIO_Pin;
+    }
+}
+
+void HAL_GPIO_TogglePin( GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin )
+{
+    GPIOx->ODR ^= GPIO_Pin;
+}
@@ -0,0 +1,205 @@
+#include "i2c.h"
+
+#include <string.h>
+
+/*
+ * I2C1 stand-in with a simulated Sensirion SEN55 on address 0x69. Transfers complete
+ * synchronously: the completion callback runs before HAL_I2C_Master_*_IT/_DMA returns.
+ */
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+#define SEN55_SIM_I2C_ADDRESS ( 0x69 << 1 )
+
+#define SEN55_SIM_READ_DATA_READY_FLAG ( 0x0202 )
+#define SEN55_SIM_READ_MEASURED_VALUES ( 0x03C4 )
+#define SEN55_SIM_READ_PRODUCT_NAME    ( 0xD014 )
+#define SEN55_SIM_READ_DEVICE_STATUS   ( 0xD206 )
+
+#define SEN55_SIM_MAX_WORDS ( 16u )
+
+#define SEN55_SIM_MEASUREMENT_INTERVAL_MS ( 1000u )
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static size_t buildResponse( uint16_t command, uint16_t *words );
+static void encodeWords( const uint16_t *words, size_t wordCount, uint8_t *buffer, size_t length );
+static uint8_t calcCrc( const uint8_t *data, uint8_t length );
+
+/************************************************************************************
+ * PUBLIC VARIABLES DECLERATION
+ ***********************************************************************************/
+I2C_HandleTypeDef hi2c1;
+
+/************************************************************************************
+ * PRIVATE VARIABLES DECLERATION
+ ***********************************************************************************/
+static uint16_t m_i2c_lastCommand;
+static uint32_t m_i2c_sampleCounter;
+static uint32_t m_i2c_lastSampleTick;
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+void I2C1_Init( void )
+{
+    memset( &hi2c1, 0, sizeof( hi2c1 ) );
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size )
+{
+    hi2c->devAddress = DevAddress;
+
+    if( SEN55_SIM_I2C_ADDRESS != DevAddress )
+    {
+        HAL_I2C_ErrorCallback( hi2c );
+        return HAL_OK;
+    }
+
+    if( Size >= 2 )
+    {
+        m_i2c_lastCommand = ( pData[0] << 8 ) | pData[1];
+    }
+
+    HAL_I2C_MasterTxCpltCallback( hi2c );
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size )
+{
+    uint16_t words[SEN55_SIM_MAX_WORDS] = { 0 };
+
+    hi2c->devAddress = DevAddress;
+
+    if( SEN55_SIM_I2C_ADDRESS != DevAddress )
+    {
+        HAL_I2C_ErrorCallback( hi2c );
+        return HAL_OK;
+    }
+
+    size_t wordCount = buildResponse( m_i2c_lastCommand, words );
+    encodeWords( words, wordCount, pData, Size );
+
+    HAL_I2C_MasterRxCpltCallback( hi2c );
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Transmit_DMA( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size )
+{
+    return HAL_I2C_Master_Transmit_IT( hi2c, DevAddress, pData, Size );
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Receive_DMA( I2C_HandleTypeDef *hi2c, uint16_t DevAddress, uint8_t *pData, uint16_t Size )
+{
+    return HAL_I2C_Master_Receive_IT( hi2c, DevAddress, pData, Size );
+}
+
+HAL_StatusTypeDef HAL_I2C_Master_Abort_IT( I2C_HandleTypeDef *hi2c, uint16_t DevAddress )
+{
+    // Nothing is ever in flight, transfers complete inside the start call
+    return HAL_ERROR;
+}
+
+__weak void HAL_I2C_MasterTxCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+}
+
+__weak void HAL_I2C_MasterRxCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+}
+
+__weak void HAL_I2C_ErrorCallback( I2C_HandleTypeDef *hi2c )
+{
+}
+
+__weak void HAL_I2C_AbortCpltCallback( I2C_HandleTypeDef *hi2c )
+{
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static size_t buildResponse( uint16_t command, uint16_t *words )
+{
+    size_t wordCount = SEN55_SIM_MAX_WORDS;
+
+    switch( command )
+    {
+        case SEN55_SIM_READ_PRODUCT_NAME:
+        {
+            words[0] = ( 'S' << 8 ) | 'E';
+            words[1] = ( 'N' << 8 ) | '5';
+            words[2] = ( '5' << 8 );
+            wordCount = 3;
+        }
+        break;
+        case SEN55_SIM_READ_DEVICE_STATUS:
+        {
+            wordCount = 2;
+        }
+        break;
+        case SEN55_SIM_READ_DATA_READY_FLAG:
+        {
+            // A new sample is produced once per second, the flag clears when it is read
+            words[0] = ( ( HAL_GetTick() - m_i2c_lastSampleTick ) >= SEN55_SIM_MEASUREMENT_INTERVAL_MS ) ? 0x0001 : 0x0000;
+            wordCount = 1;
+        }
+        break;
+        case SEN55_SIM_READ_MEASURED_VALUES:
+        {
+            // Slowly changing synthetic sample in the raw sensor scaling
+            uint32_t phase = m_i2c_sampleCounter++ % 60u;
+            m_i2c_lastSampleTick = HAL_GetTick();
+            words[0] = 50 + phase;          // PM1.0 * 10
+            words[1] = 80 + phase;          // PM2.5 * 10
+            words[2] = 95 + phase;          // PM4.0 * 10
+            words[3] = 110 + phase;         // PM10 * 10
+            words[4] = 4500 + phase * 10;   // Humidity * 100
+            words[5] = 4400 + phase * 5;    // Temperature * 200
+            words[6] = 1000 + phase;        // VOC index * 10
+            words[7] = 10;                  // NOx index * 10
+            wordCount = 8;
+        }
+        break;
+        default:
+            break;
+    }
+
+    return wordCount;
+}
+
+static void encodeWords( const uint16_t *words, size_t wordCount, uint8_t *buffer, size_t length )
+{
+    memset( buffer, 0, length );
+
+    for( size_t i = 0; ( i + 3 ) <= length; i += 3 )
+    {
+        uint16_t word = ( ( i / 3 ) < wordCount ) ? words[i / 3] : 0;
+        buffer[i] = word >> 8;
+        buffer[i + 1] = word & 0xFF;
+        buffer[i + 2] = calcCrc( &buffer[i], 2 );
+    }
+}
+
+static uint8_t calcCrc( const uint8_t *data, uint8_t length )
+{
+    uint8_t crc = 0xFF;
+    for( uint8_t i = 0; i < length; i++ )
+    {
+        crc ^= data[i];
+        for( uint8_t bit = 0; bit < 8; bit++ )
+        {
+            if( crc & 0x80 )
+            {
+                crc = ( crc << 1 ) ^ 0x31;
+            }
+            else
+            {
+                crc = ( crc << 1 );
+            }
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,85 @@
+#include "rtc.h"
+
+#include <time.h>
+
+RTC_HandleTypeDef hrtc;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static void getCalendar( const RTC_HandleTypeDef *handle, struct tm *calendar );
+static void setCalendar( RTC_HandleTypeDef *handle, struct tm *calendar );
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+/* The RTC runs on the host wall clock, setting it only stores an offset */
+void RTC_Init( void )
+{
+    hrtc.offsetSeconds = 0;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetTime( RTC_HandleTypeDef *handle, RTC_TimeTypeDef *sTime, uint32_t Format )
+{
+    struct tm calendar;
+    getCalendar( handle, &calendar );
+
+    calendar.tm_hour = sTime->Hours;
+    calendar.tm_min = sTime->Minutes;
+    calendar.tm_sec = sTime->Seconds;
+
+    setCalendar( handle, &calendar );
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetTime( RTC_HandleTypeDef *handle, RTC_TimeTypeDef *sTime, uint32_t Format )
+{
+    struct tm calendar;
+    getCalendar( handle, &calendar );
+
+    sTime->Hours = calendar.tm_hour;
+    sTime->Minutes = calendar.tm_min;
+    sTime->Seconds = calendar.tm_sec;
+    sTime->TimeFormat = RTC_HOURFORMAT12_AM;
+    sTime->SubSeconds = 0;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_SetDate( RTC_HandleTypeDef *handle, RTC_DateTypeDef *sDate, uint32_t Format )
+{
+    struct tm calendar;
+    getCalendar( handle, &calendar );
+
+    calendar.tm_year = sDate->Year + 100;
+    calendar.tm_mon = sDate->Month - 1;
+    calendar.tm_mday = sDate->Date;
+
+    setCalendar( handle, &calendar );
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_RTC_GetDate( RTC_HandleTypeDef *handle, RTC_DateTypeDef *sDate, uint32_t Format )
+{
+    struct tm calendar;
+    getCalendar( handle, &calendar );
+
+    sDate->Year = calendar.tm_year - 100;
+    sDate->Month = calendar.tm_mon + 1;
+    sDate->Date = calendar.tm_mday;
+    sDate->WeekDay = ( calendar.tm_wday == 0 ) ? 7 : calendar.tm_wday;
+    return HAL_OK;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+static void getCalendar( const RTC_HandleTypeDef *handle, struct tm *calendar )
+{
+    time_t now = time( NULL ) + handle->offsetSeconds;
+    gmtime_r( &now, calendar );
+}
+
+static void setCalendar( RTC_HandleTypeDef *handle, struct tm *calendar )
+{
+    handle->offsetSeconds = (int64_t)timegm( calendar ) - (int64_t)time( NULL );
+}
@@ -0,0 +1,43 @@
+#include "tapif.h"
+
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+int tapif_open( const char *interfaceName )
+{
+    struct ifreq ifr = { 0 };
+    int tapFd = open( "/dev/net/tun", O_RDWR | O_NONBLOCK );
+
+    if( tapFd >= 0 )
+    {
+        ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+        strncpy( ifr.ifr_name, interfaceName, IFNAMSIZ - 1 );
+
+        if( ioctl( tapFd, TUNSETIFF, (void *)&ifr ) < 0 )
+        {
+            close( tapFd );
+            tapFd = -1;
+        }
+    }
+
+    return tapFd;
+}
+
+size_t tapif_read( int tapFd, void *frame, size_t size )
+{
+    ssize_t len = read( tapFd, frame, size );
+
+    return ( len > 0 ) ? (size_t)len : 0;
+}
+
+bool tapif_write( int tapFd, const void *frame, size_t length )
+{
+    return write( tapFd, frame, length ) == (ssize_t)length;
+}
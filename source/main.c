@@ -15,6 +15,9 @@
 #include "usart.h"
 #include "sen55.h"
 #include "i2c.h"
+#include "i2cBus.h"
+
+#define LOG_MODULE LOG_MODULE_SYSTEM
 
 static void StartDefaultTask( void* argument );
 static void userMqttDisconnectCallback( void );
@@ -36,6 +39,8 @@ int main( void )
 
     osKernelInitialize();
 
+    i2cBus_init();
+
     logger_init( &huart3 );
 
     LOG_INFO( "Initialization completed!" );
@@ -0,0 +1,126 @@
+#!/usr/bin/env python3
+"""Rebuilds text logs from the binary records sent by the firmware built with CFG_LOG_BINARY.
+
+Record layout (little endian):
+    0xA5 | payload size (1) | site ID (4) | timestamp ms (4) | payload
+
+The payload holds the arguments of the format in order: 64-bit integers (ll, j) take
+8 bytes, other integers and pointers 4 bytes, floating point values a 4-byte float and
+strings a length byte followed by the characters.
+
+Reads a capture file, a serial device configured beforehand (e.g. `stty -F /dev/ttyACM0
+115200 raw`) or stdin when no input is given.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+FRAME_MAGIC = 0xA5
+HEADER_SIZE = 10
+
+CONVERSION = re.compile(r"%([-+ #0]*)((?:\*|\d+)?(?:\.(?:\*|\d+))?)(hh|h|ll|l|L|j|z|t)?([diouxXcfFeEgGaAspn%])")
+
+
+class Payload:
+    def __init__(self, data):
+        self.data = data
+        self.offset = 0
+
+    def take(self, size):
+        if self.offset + size > len(self.data):
+            raise ValueError("truncated")
+        chunk = self.data[self.offset:self.offset + size]
+        self.offset += size
+        return chunk
+
+    def word(self, size, signed):
+        return int.from_bytes(self.take(size), "little", signed=signed)
+
+
+def formatMessage(fmt, payload):
+    def convert(match):
+        flags, width, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+
+        # '*' width and precision are sent as separate int arguments
+        while "*" in width:
+            width = width.replace("*", str(payload.word(4, True)), 1)
+
+        spec = "%" + flags + width
+        if conversion in "di":
+            return (spec + "d") % payload.word(8 if length in ("ll", "j") else 4, True)
+        if conversion in "ouxX":
+            return (spec + conversion) % payload.word(8 if length in ("ll", "j") else 4, False)
+        if conversion == "c":
+            return (spec + "c") % payload.word(4, False)
+        if conversion in "fFeEgGaA":
+            value = struct.unpack("<f", payload.take(4))[0]
+            return (spec + ("g" if conversion in "aA" else conversion)) % value
+        if conversion == "s":
+            size = payload.word(1, False)
+            return (spec + "s") % payload.take(size).decode("utf-8", errors="replace")
+        if conversion == "p":
+            return "0x%08x" % payload.word(4, False)
+        return ""
+
+    try:
+        return CONVERSION.sub(convert, fmt)
+    except ValueError:
+        return fmt + " <truncated arguments>"
+
+
+def decode(stream, sites, output):
+    buffer = b""
+
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            break
+        buffer += chunk
+
+        while len(buffer) >= HEADER_SIZE:
+            if buffer[0] != FRAME_MAGIC:
+                buffer = buffer[1:]
+                continue
+
+            payloadSize = buffer[1]
+            siteId, timestamp = struct.unpack_from("<II", buffer, 2)
+            site = sites.get(str(siteId))
+            if site is None:
+                # Not a record start, resynchronise on the next magic byte
+                buffer = buffer[1:]
+                continue
+
+            if len(buffer) < HEADER_SIZE + payloadSize:
+                break
+
+            payload = Payload(buffer[HEADER_SIZE:HEADER_SIZE + payloadSize])
+            buffer = buffer[HEADER_SIZE + payloadSize:]
+
+            message = formatMessage(site["format"], payload)
+            output.write("%10u [%s:%d] [%s] %s\n" % (timestamp, site["file"], site["line"], site["level"], message.rstrip("\n")))
+            output.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dictionary", help="JSON dictionary generated next to the ELF (<elf name>.logdict.json)")
+    parser.add_argument("input", nargs="?", help="capture file or serial device, stdin by default")
+    args = parser.parse_args()
+
+    with open(args.dictionary) as f:
+        sites = json.load(f)
+
+    if args.input:
+        with open(args.input, "rb", buffering=0) as stream:
+            decode(stream, sites, sys.stdout)
+    else:
+        decode(sys.stdin.buffer, sites, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""Builds the tokenized log dictionary from the log_strings section of the firmware.
+
+The section is dumped with `objcopy -O binary --only-section=log_strings`. Every log site
+is a NUL terminated "<level>\\x1f<file>\\x1f<line>\\x1f<format>" string and its offset inside
+the section is the site ID sent by the target.
+"""
+
+import argparse
+import json
+import os
+
+SITE_SEPARATOR = "\x1f"
+
+
+def parseSites(blob):
+    sites = {}
+    offset = 0
+
+    while offset < len(blob):
+        # The linker may pad between sites from different objects
+        if blob[offset] == 0:
+            offset += 1
+            continue
+
+        end = blob.index(b"\0", offset)
+        fields = blob[offset:end].decode("utf-8", errors="replace").split(SITE_SEPARATOR, 3)
+        if len(fields) == 4:
+            level, file, line, fmt = fields
+            sites[str(offset)] = {
+                "level": level.replace("LOG_LEVEL_", ""),
+                "file": os.path.basename(file),
+                "line": int(line),
+                "format": fmt,
+            }
+        offset = end + 1
+
+    return sites
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("section", help="raw log_strings section dumped from the ELF")
+    parser.add_argument("dictionary", help="output JSON dictionary")
+    args = parser.parse_args()
+
+    with open(args.section, "rb") as f:
+        sites = parseSites(f.read())
+
+    with open(args.dictionary, "w") as f:
+        json.dump(sites, f, indent=2, sort_keys=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,218 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetryCodec.h"
+
+/************************************************************************************
+ * PRIVATE MACROS
+ ***********************************************************************************/
+/* MQTT_CLIENT_MESSAGE_PAYLOAD_SIZE of the firmware, one batch is one message */
+#define TELEMETRY_DECODER_PAYLOAD_SIZE ( 200u )
+
+/* Samples a batch has to hold, TELEMETRY_BATCH_SIZE of the firmware */
+#define TELEMETRY_DECODER_BATCH_SIZE ( 10u )
+
+#define TELEMETRY_DECODER_INPUT_SIZE ( 64u * 1024u )
+
+#define TELEMETRY_DECODER_START_TICK ( 0xFFFFF000u )  // The offsets wrap the tick counter
+#define TELEMETRY_DECODER_PERIOD_MS  ( 1000u )
+
+/************************************************************************************
+ * PRIVATE TYPES DECLARATION
+ ***********************************************************************************/
+typedef struct
+{
+    const tSen55_data *expected;
+    tTelemetryCodec_schema schema;
+    uint32_t count;
+    bool matches;
+} tTelemetryDecoder_check;
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DECLERATION
+ ***********************************************************************************/
+static int decodeFile( FILE *file );
+static int roundTrip( void );
+static bool roundTripSchema( tTelemetryCodec_schema schema, const tSen55_data *samples, uint32_t count, bool mustFit );
+static bool printSample( uint32_t timestamp, const tSen55_data *data, void *context );
+static bool checkSample( uint32_t timestamp, const tSen55_data *data, void *context );
+static void makeSample( uint32_t index, tSen55_data *data );
+
+/************************************************************************************
+ * PUBLIC FUNTCTION DEFINTIONS
+ ***********************************************************************************/
+int main( int argc, char **argv )
+{
+    int result;
+
+    if( ( 2 == argc ) && ( 0 == strcmp( argv[1], "--round-trip" ) ) )
+    {
+        result = roundTrip();
+    }
+    else if( ( 2 == argc ) && ( 0 != strcmp( argv[1], "-" ) ) )
+    {
+        FILE *file = fopen( argv[1], "rb" );
+
+        if( NULL == file )
+        {
+            perror( argv[1] );
+            return 1;
+        }
+
+        result = decodeFile( file );
+        fclose( file );
+    }
+    else if( argc <= 2 )
+    {
+        result = decodeFile( stdin );
+    }
+    else
+    {
+        fprintf( stderr, "usage: %s [payload file | - | --round-trip]\n", argv[0] );
+        result = 1;
+    }
+
+    return result;
+}
+
+/************************************************************************************
+ * PRIVATE FUNTCTION DEFINITIONS
+ ***********************************************************************************/
+/* One raw payload as received from the telemetry topic */
+static int decodeFile( FILE *file )
+{
+    static uint8_t payload[TELEMETRY_DECODER_INPUT_SIZE];
+    size_t length = fread( payload, 1, sizeof( payload ), file );
+
+    printf( "timestamp,pm1_0,pm2_5,pm4_0,pm10,humidity,temperature,vocIndex,noxIndex\n" );
+
+    if( !telemetryCodec_decode( payload, length, printSample, NULL ) )
+    {
+        fprintf( stderr, "Malformed payload (%u bytes)\n", (unsigned int)length );
+        return 1;
+    }
+
+    return 0;
+}
+
+static int roundTrip( void )
+{
+    static const tSen55_data limits[] = {
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -10.0f, 1.0f, 1.0f },
+        { 1000.0f, 1000.0f, 1000.0f, 1000.0f, 100.0f, 60.0f, 500.0f, 500.0f },
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, -10.0f, 1.0f, 1.0f },
+    };
+    tSen55_data samples[TELEMETRY_DECODER_BATCH_SIZE];
+    tSen55_data warmUp[TELEMETRY_DECODER_BATCH_SIZE];
+    bool result = true;
+
+    for( uint32_t i = 0; i < TELEMETRY_DECODER_BATCH_SIZE; i++ )
+    {
+        makeSample( i, &samples[i] );
+
+        // The indices are unknown for the first samples after start, one temperature goes missing later
+        warmUp[i] = samples[i];
+        warmUp[i].vocIndex = ( i < 4u ) ? NAN : warmUp[i].vocIndex;
+        warmUp[i].noxIndex = ( i < 6u ) ? NAN : warmUp[i].noxIndex;
+        warmUp[i].temperature = ( 7u == i ) ? NAN : warmUp[i].temperature;
+    }
+
+    // A full batch of ordinary samples has to fit one message in the default schema
+    result &= roundTripSchema( TELEMETRY_CODEC_SCHEMA_SCALED_DELTA, samples, TELEMETRY_DECODER_BATCH_SIZE, true );
+    result &= roundTripSchema( TELEMETRY_CODEC_SCHEMA_SCALED, samples, TELEMETRY_DECODER_BATCH_SIZE, false );
+    result &= roundTripSchema( TELEMETRY_CODEC_SCHEMA_HALF, samples, TELEMETRY_DECODER_BATCH_SIZE, false );
+
+    // Jumps across the whole range are the largest deltas
+    result &= roundTripSchema( TELEMETRY_CODEC_SCHEMA_SCALED_DELTA, limits, sizeof( limits ) / sizeof( limits[0] ), true );
+
+    // Unknown values are sent as null and must not disturb the deltas of the values around them
+    result &= roundTripSchema( TELEMETRY_CODEC_SCHEMA_SCALED_DELTA, warmUp, TELEMETRY_DECODER_BATCH_SIZE, true );
+    result &= roundTripSchema( TELEMETRY_CODEC_SCHEMA_HALF, warmUp, TELEMETRY_DECODER_BATCH_SIZE, false );
+
+    printf( "%s\n", result ? "Round trip OK" : "Round trip FAILED" );
+
+    return result ? 0 : 1;
+}
+
+/* Encodes the samples into one message, as many as fit, and compares what decodes back */
+static bool roundTripSchema( tTelemetryCodec_schema schema, const tSen55_data *samples, uint32_t count, bool mustFit )
+{
+    uint8_t payload[TELEMETRY_DECODER_PAYLOAD_SIZE];
+    tTelemetryCodec_encoder encoder;
+    tTelemetryDecoder_check check = {
+        .expected = samples,
+        .schema = schema,
+        .count = 0,
+        .matches = true,
+    };
+    size_t length;
+    bool result;
+
+    telemetryCodec_begin( &encoder, payload, sizeof( payload ), schema, TELEMETRY_DECODER_START_TICK );
+
+    while( ( encoder.count < count ) &&
+           telemetryCodec_addSample( &encoder, &samples[encoder.count], TELEMETRY_DECODER_START_TICK + encoder.count * TELEMETRY_DECODER_PERIOD_MS ) )
+    {
+    }
+
+    length = telemetryCodec_end( &encoder );
+    result = ( length > 0 ) && telemetryCodec_decode( payload, length, checkSample, &check ) && check.matches &&
+             ( check.count == encoder.count ) && ( !mustFit || ( encoder.count == count ) );
+
+    printf( "Schema %d: %u of %u samples in %u bytes%s\n", (int)schema, (unsigned int)encoder.count, (unsigned int)count,
+            (unsigned int)length, result ? "" : " - FAILED" );
+
+    return result;
+}
+
+static bool printSample( uint32_t timestamp, const tSen55_data *data, void *context )
+{
+    printf( "%lu,%.1f,%.1f,%.1f,%.1f,%.2f,%.3f,%.1f,%.1f\n", (unsigned long)timestamp, data->pm1_0, data->pm2_5, data->pm4_0,
+            data->pm10, data->humidity, data->temperature, data->vocIndex, data->noxIndex );
+
+    return true;
+}
+
+static bool checkSample( uint32_t timestamp, const tSen55_data *data, void *context )
+{
+    tTelemetryDecoder_check *check = context;
+    const float *expected = (const float *)&check->expected[check->count];
+    const float *decoded = (const float *)data;
+
+    check->matches &= ( TELEMETRY_DECODER_START_TICK + check->count * TELEMETRY_DECODER_PERIOD_MS ) == timestamp;
+
+    for( uint8_t i = 0; i < SEN55_VALUE_COUNT; i++ )
+    {
+        // Half of the scaled resolution, or 11 bits of mantissa for the halves
+        float tolerance = ( TELEMETRY_CODEC_SCHEMA_HALF == check->schema ) ? ( fabsf( expected[i] ) / 1024.0f ) : 0.0026f;
+
+        if( isnan( expected[i] ) )
+        {
+            check->matches &= isnan( decoded[i] );
+        }
+        else
+        {
+            check->matches &= ( fabsf( decoded[i] - expected[i] ) <= tolerance );
+        }
+    }
+
+    check->count++;
+
+    return true;
+}
+
+/* Slow drift with some noise, the way the sensor moves from one second to the next */
+static void makeSample( uint32_t index, tSen55_data *data )
+{
+    float noise = (float)( ( index * 7u ) % 5u ) / 10.0f;
+
+    data->pm1_0 = 8.2f + noise;
+    data->pm2_5 = 12.4f + noise;
+    data->pm4_0 = 14.9f + noise;
+    data->pm10 = 16.1f + noise;
+    data->humidity = 45.67f - (float)index * 0.03f;
+    data->temperature = 22.5f + (float)index * 0.005f;
+    data->vocIndex = 100.0f + (float)( index % 3u );
+    data->noxIndex = 1.0f;
+}